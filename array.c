@@ -3,6 +3,28 @@
 #include "array.h"
 #include "utils.h"
 
+/* Resize the room of a growing up array, in its region if any */
+static char *Array_Realloc(Array *a, int OldCount, int NewCount)
+{
+    if( a->Owner != NULL )
+    {
+        return Region_Realloc(a->Owner,
+                              a->Data,
+                              OldCount * a->DataLength,
+                              NewCount * a->DataLength
+                              );
+    } else {
+        void *Data = a->Data;
+
+        if( SafeRealloc(&Data, NewCount * a->DataLength) != 0 )
+        {
+            return NULL;
+        }
+
+        return Data;
+    }
+}
+
 /* if it grows down, the InitialCount will be ignored. Otherwise, TheFirstAddress will be ignored. */
 int Array_Init(__in Array *a, __in int DataLength, __in int InitialCount, __in BOOL GrowsDown, __in void *TheFirstAddress /* The first means the biggest address*/)
 {
@@ -11,12 +33,16 @@ int Array_Init(__in Array *a, __in int DataLength, __in int InitialCount, __in B
 
     a->DataLength = DataLength;
     a->Used = 0;
+    a->Owner = NULL;
 
     if( GrowsDown == FALSE )
     {
+        a->Owner = Region_Current();
+        a->Data = NULL;
+
         if( InitialCount > 0 )
         {
-            a->Data = SafeMalloc(DataLength * InitialCount);
+            a->Data = Array_Realloc(a, 0, InitialCount);
             if( a->Data == NULL )
                 return 2;
 
@@ -93,12 +119,14 @@ int Array_PushBack(__in Array *a, __in_opt const void *Data, __in_opt void *Boun
         if( a->Used == a->Allocated )
         {
             int NewCount = (a->Allocated) < 2 ? 2 : (a->Allocated) + (a->Allocated) / 2;
+            char *NewData = Array_Realloc(a, a->Allocated, NewCount);
 
-            if( SafeRealloc((void **)&(a->Data), NewCount * (a->DataLength)) != 0 )
+            if( NewData == NULL )
             {
                 return -1;
             }
 
+            a->Data = NewData;
             a->Allocated = NewCount;
         }
 
@@ -127,9 +155,12 @@ void *Array_SetToSubscript(Array *a, int Subscript, const void *Data)
     {
         if( Subscript >= a->Allocated )
         {
-            if( SafeRealloc((void **)&(a->Data), (Subscript + 1) * (a->DataLength)) != 0 )
+            char *NewData = Array_Realloc(a, a->Allocated, Subscript + 1);
+
+            if( NewData == NULL )
                 return NULL;
 
+            a->Data = NewData;
             a->Allocated = Subscript + 1;
         }
 
@@ -172,7 +203,7 @@ void Array_Fill(Array *a, int Num, const void *DataSample)
 
 void Array_Free(Array *a)
 {
-    if( a->Allocated > 0 )
+    if( a->Allocated > 0 && a->Owner == NULL )
     {
         SafeFree(a->Data);
     }
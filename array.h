@@ -2,6 +2,7 @@
 #define ARRAY_H_INCLUDED
 
 #include "common.h"
+#include "region.h"
 
 typedef struct _Array{
 
@@ -28,6 +29,9 @@ typedef struct _Array{
      * there is enough space to hold all elements.
      */
     int32_t Allocated;
+
+    /* Where `Data' is allocated, NULL for the heap. See `region.h'. */
+    Region  *Owner;
 }Array;
 
 int Array_Init( __in Array *a,
@@ -51,7 +55,7 @@ int Array_Init( __in Array *a,
  *  0 on success, a non-zero value otherwise.
  */
 
-#define Array_Init_Static(DataLengrh)   {NULL, (DataLengrh), 0, 0}
+#define Array_Init_Static(DataLengrh)   {NULL, (DataLengrh), 0, 0, NULL}
 
 #define Array_IsEmpty(a_ptr)    (((a_ptr)->Used) == 0)
 /* Description:
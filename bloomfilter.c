@@ -0,0 +1,143 @@
+#include <string.h>
+#include "bloomfilter.h"
+#include "utils.h"
+
+#define BLOOM_FILTER_BLOCK_BITS     512
+#define BLOOM_FILTER_BLOCK_WORDS    (BLOOM_FILTER_BLOCK_BITS / 64)
+
+#define BLOOM_FILTER_MAX_PROBES     16
+
+/* A probe takes the top 9 bits of the hash times its own odd salt. Probes
+ * stepping by a fixed delta instead overlap with those of other keys of the
+ * block too often, and the rate got several times worse than configured.
+ */
+static const uint32_t Salts[BLOOM_FILTER_MAX_PROBES] = {
+    0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+    0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31,
+    0x9e3779b9, 0x7f4a7c15, 0xf39cc061, 0x5ced1e91,
+    0x3c6ef373, 0xdaa66d2b, 0x78dde6e5, 0x1715609d
+};
+
+/* `HASH' values are poorly distributed in their low bits, so they are mixed
+ * before use (the finalizer of MurmurHash3).
+ */
+static uint32_t BloomFilter_Mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+int BloomFilter_Init(BloomFilter *b, int Count, int OneIn)
+{
+    int Log2 = 0;
+    int PerKey;
+    int64_t Bits;
+
+    b->Blocks = NULL;
+    b->BlockCount = 0;
+    b->Probes = 0;
+
+    if( OneIn <= 1 )
+    {
+        return 0;
+    }
+
+    while( (1 << Log2) < OneIn && Log2 < 30 )
+    {
+        ++Log2;
+    }
+
+    /* An ideal filter takes 1.44 * Log2 bits a key. Keys are not spread
+     * evenly over blocks, so the fuller blocks decide the rate, and more bits
+     * are needed the lower the rate is. Measured with 1M keys, this gives
+     * 1 / 243, 1 / 1723, 1 / 23392 and 1 / 133333 for 2^7, 2^10, 2^14 and
+     * 2^17.
+     */
+    PerKey = Log2 * (Log2 + 96) / 64 + 1;
+    Bits = (int64_t)(Count > 0 ? Count : 1) * PerKey;
+
+    b->BlockCount = (Bits + BLOOM_FILTER_BLOCK_BITS - 1) / BLOOM_FILTER_BLOCK_BITS;
+    b->Probes = PerKey * 3 / 5 < BLOOM_FILTER_MAX_PROBES ? PerKey * 3 / 5 : BLOOM_FILTER_MAX_PROBES;
+
+    b->Blocks = SafeMalloc((size_t)b->BlockCount * BLOOM_FILTER_BLOCK_WORDS * sizeof(uint64_t));
+    if( b->Blocks == NULL )
+    {
+        b->BlockCount = 0;
+        return -1;
+    }
+
+    memset(b->Blocks, 0, (size_t)b->BlockCount * BLOOM_FILTER_BLOCK_WORDS * sizeof(uint64_t));
+
+    return 0;
+}
+
+/* The block of `Hash', and what its bits in the block are taken from */
+#define BLOOM_FILTER_LOCATE(b, Hash, Block, Inner) \
+    do { \
+        uint32_t h1 = BloomFilter_Mix(Hash); \
+        (Inner) = BloomFilter_Mix(h1 ^ 0x9e3779b9); \
+        (Block) = (b)->Blocks + \
+                  (((uint64_t)h1 * (b)->BlockCount) >> 32) * BLOOM_FILTER_BLOCK_WORDS; \
+    } while( 0 )
+
+/* 9 bits, for 512 bits a block */
+#define BLOOM_FILTER_BIT(Inner, Probe)  (((Inner) * Salts[(Probe)]) >> 23)
+
+void BloomFilter_Add(BloomFilter *b, uint32_t Hash)
+{
+    uint64_t *Block;
+    uint32_t Inner;
+    int loop;
+
+    if( !BloomFilter_IsBuilt(b) )
+    {
+        return;
+    }
+
+    BLOOM_FILTER_LOCATE(b, Hash, Block, Inner);
+
+    for( loop = 0; loop != b->Probes; ++loop )
+    {
+        uint32_t Bit = BLOOM_FILTER_BIT(Inner, loop);
+
+        Block[Bit / 64] |= (uint64_t)1 << (Bit % 64);
+    }
+}
+
+BOOL BloomFilter_MayContain(const BloomFilter *b, uint32_t Hash)
+{
+    const uint64_t *Block;
+    uint32_t Inner;
+    int loop;
+
+    if( !BloomFilter_IsBuilt(b) )
+    {
+        return TRUE;
+    }
+
+    BLOOM_FILTER_LOCATE(b, Hash, Block, Inner);
+
+    for( loop = 0; loop != b->Probes; ++loop )
+    {
+        uint32_t Bit = BLOOM_FILTER_BIT(Inner, loop);
+
+        if( (Block[Bit / 64] & ((uint64_t)1 << (Bit % 64))) == 0 )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void BloomFilter_Free(BloomFilter *b)
+{
+    SafeFree(b->Blocks);
+    b->BlockCount = 0;
+    b->Probes = 0;
+}
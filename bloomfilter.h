@@ -0,0 +1,37 @@
+#ifndef BLOOMFILTER_H_INCLUDED
+#define BLOOMFILTER_H_INCLUDED
+
+#include "common.h"
+
+/* A blocked Bloom filter over 32-bit hashes (`HASH' values).
+ *
+ * All bits of a key are set within one 64-byte block, so a test reads one
+ * cache line. It answers "definitely not added" or "maybe added", the latter
+ * being wrong for about one in `OneIn' keys never added. Keys having the same
+ * hash as an added one always pass, so the rate never gets below
+ * Count / 2^32.
+ */
+
+typedef struct _BloomFilter{
+    uint64_t    *Blocks; /* 8 words a block */
+    uint32_t    BlockCount;
+    int         Probes;
+} BloomFilter;
+
+#define BloomFilter_IsBuilt(b_ptr)  ((b_ptr)->Blocks != NULL)
+
+/* In bytes */
+#define BloomFilter_GetSize(b_ptr)  ((size_t)(b_ptr)->BlockCount * 64)
+
+/* Size it for `Count' keys and a false positive rate of 1 / `OneIn'.
+ * Nothing is allocated if `OneIn' <= 1.
+ */
+int BloomFilter_Init(BloomFilter *b, int Count, int OneIn);
+
+void BloomFilter_Add(BloomFilter *b, uint32_t Hash);
+
+BOOL BloomFilter_MayContain(const BloomFilter *b, uint32_t Hash);
+
+void BloomFilter_Free(BloomFilter *b);
+
+#endif /* BLOOMFILTER_H_INCLUDED */
@@ -4,6 +4,9 @@
 #include "utils.h"
 #include "logs.h"
 
+#define BST_RED     0
+#define BST_BLACK   1
+
 PRIFUNC Bst_NodeHead *GetUnusedNode(Bst *t)
 {
     if( t->FreeList == NULL )
@@ -56,6 +59,7 @@ PRIFUNC const void *InsertNode(Bst          *t,
     NewNode->Parent = ParentNode;
     NewNode->Left = NULL;
     NewNode->Right = NULL;
+    NewNode->Color = BST_RED;
 
     /* Copy the data */
     memcpy(NewNode + 1, Data, t->ElementLength);
@@ -302,6 +306,337 @@ PUBFUNC void Bst_Delete(Bst *t, const void *Node)
     return;
 }
 
+/* Red-black tree, the balanced variant */
+
+#define BST_IS_BLACK(n) ((n) == NULL || (n)->Color == BST_BLACK)
+
+PRIFUNC void ReplaceChild(Bst *t,
+                          Bst_NodeHead *Parent,
+                          Bst_NodeHead *Old,
+                          Bst_NodeHead *New
+                          )
+{
+    if( Parent == NULL )
+    {
+        t->Root = New;
+    } else if( Parent->Left == Old ) {
+        Parent->Left = New;
+    } else {
+        Parent->Right = New;
+    }
+}
+
+PRIFUNC void RotateLeft(Bst *t, Bst_NodeHead *n)
+{
+    Bst_NodeHead *r = n->Right;
+
+    n->Right = r->Left;
+    if( r->Left != NULL )
+    {
+        r->Left->Parent = n;
+    }
+
+    r->Parent = n->Parent;
+    ReplaceChild(t, n->Parent, n, r);
+
+    r->Left = n;
+    n->Parent = r;
+}
+
+PRIFUNC void RotateRight(Bst *t, Bst_NodeHead *n)
+{
+    Bst_NodeHead *l = n->Left;
+
+    n->Left = l->Right;
+    if( l->Right != NULL )
+    {
+        l->Right->Parent = n;
+    }
+
+    l->Parent = n->Parent;
+    ReplaceChild(t, n->Parent, n, l);
+
+    l->Right = n;
+    n->Parent = l;
+}
+
+PUBFUNC const void *Bst_Add_Balanced(Bst *t, const void *Data)
+{
+    const void *Added = Bst_Add(t, Data);
+    Bst_NodeHead *n;
+
+    if( Added == NULL )
+    {
+        return NULL;
+    }
+
+    n = ((Bst_NodeHead *)Added) - 1;
+
+    while( n->Parent != NULL && n->Parent->Color == BST_RED )
+    {
+        /* A red parent is never the root, so there is a grandparent */
+        Bst_NodeHead *Parent = n->Parent;
+        Bst_NodeHead *Grandparent = Parent->Parent;
+
+        if( Parent == Grandparent->Left )
+        {
+            Bst_NodeHead *Uncle = Grandparent->Right;
+
+            if( !BST_IS_BLACK(Uncle) )
+            {
+                Parent->Color = BST_BLACK;
+                Uncle->Color = BST_BLACK;
+                Grandparent->Color = BST_RED;
+                n = Grandparent;
+            } else {
+                if( n == Parent->Right )
+                {
+                    n = Parent;
+                    RotateLeft(t, n);
+                    Parent = n->Parent;
+                }
+
+                Parent->Color = BST_BLACK;
+                Grandparent->Color = BST_RED;
+                RotateRight(t, Grandparent);
+            }
+        } else {
+            Bst_NodeHead *Uncle = Grandparent->Left;
+
+            if( !BST_IS_BLACK(Uncle) )
+            {
+                Parent->Color = BST_BLACK;
+                Uncle->Color = BST_BLACK;
+                Grandparent->Color = BST_RED;
+                n = Grandparent;
+            } else {
+                if( n == Parent->Left )
+                {
+                    n = Parent;
+                    RotateRight(t, n);
+                    Parent = n->Parent;
+                }
+
+                Parent->Color = BST_BLACK;
+                Grandparent->Color = BST_RED;
+                RotateLeft(t, Grandparent);
+            }
+        }
+    }
+
+    t->Root->Color = BST_BLACK;
+
+    return Added;
+}
+
+/* Rotations keep the in-order sequence, where equal elements lie together,
+ * the last added first. So the last one in the sequence is found first, and
+ * then their predecessors.
+ */
+PUBFUNC const void *Bst_Search_Balanced(Bst *t, const void *Key, const void *Last)
+{
+    if( Last == NULL )
+    {
+        Bst_NodeHead *Current = t->Root;
+        Bst_NodeHead *Found = NULL;
+
+        while( Current != NULL )
+        {
+            int CompareResult = (t->Compare)(Key, (const void *)(Current + 1));
+
+            if( CompareResult < 0 )
+            {
+                Current = Current->Left;
+            } else {
+                if( CompareResult == 0 )
+                {
+                    Found = Current;
+                }
+
+                Current = Current->Right;
+            }
+        }
+
+        return Found == NULL ? NULL : (const void *)(Found + 1);
+    } else {
+        /* The predecessor */
+        Bst_NodeHead *Current = ((Bst_NodeHead *)Last) - 1;
+
+        if( Current->Left != NULL )
+        {
+            Current = Current->Left;
+            while( Current->Right != NULL )
+            {
+                Current = Current->Right;
+            }
+        } else {
+            Bst_NodeHead *Parent = Current->Parent;
+
+            while( Parent != NULL && Parent->Right != Current )
+            {
+                Current = Parent;
+                Parent = Parent->Parent;
+            }
+
+            Current = Parent;
+        }
+
+        if( Current == NULL ||
+            (t->Compare)(Key, (const void *)(Current + 1)) != 0
+            )
+        {
+            return NULL;
+        }
+
+        return (const void *)(Current + 1);
+    }
+}
+
+PRIFUNC void DeleteFixup(Bst *t, Bst_NodeHead *n, Bst_NodeHead *Parent)
+{
+    /* `n' may be NULL, so its parent is passed */
+    while( n != t->Root && BST_IS_BLACK(n) )
+    {
+        if( n == Parent->Left )
+        {
+            Bst_NodeHead *Sibling = Parent->Right;
+
+            if( Sibling->Color == BST_RED )
+            {
+                Sibling->Color = BST_BLACK;
+                Parent->Color = BST_RED;
+                RotateLeft(t, Parent);
+                Sibling = Parent->Right;
+            }
+
+            if( BST_IS_BLACK(Sibling->Left) && BST_IS_BLACK(Sibling->Right) )
+            {
+                Sibling->Color = BST_RED;
+                n = Parent;
+                Parent = n->Parent;
+            } else {
+                if( BST_IS_BLACK(Sibling->Right) )
+                {
+                    Sibling->Left->Color = BST_BLACK;
+                    Sibling->Color = BST_RED;
+                    RotateRight(t, Sibling);
+                    Sibling = Parent->Right;
+                }
+
+                Sibling->Color = Parent->Color;
+                Parent->Color = BST_BLACK;
+                Sibling->Right->Color = BST_BLACK;
+                RotateLeft(t, Parent);
+                n = t->Root;
+            }
+        } else {
+            Bst_NodeHead *Sibling = Parent->Left;
+
+            if( Sibling->Color == BST_RED )
+            {
+                Sibling->Color = BST_BLACK;
+                Parent->Color = BST_RED;
+                RotateRight(t, Parent);
+                Sibling = Parent->Left;
+            }
+
+            if( BST_IS_BLACK(Sibling->Left) && BST_IS_BLACK(Sibling->Right) )
+            {
+                Sibling->Color = BST_RED;
+                n = Parent;
+                Parent = n->Parent;
+            } else {
+                if( BST_IS_BLACK(Sibling->Left) )
+                {
+                    Sibling->Right->Color = BST_BLACK;
+                    Sibling->Color = BST_RED;
+                    RotateLeft(t, Sibling);
+                    Sibling = Parent->Left;
+                }
+
+                Sibling->Color = Parent->Color;
+                Parent->Color = BST_BLACK;
+                Sibling->Left->Color = BST_BLACK;
+                RotateRight(t, Parent);
+                n = t->Root;
+            }
+        }
+    }
+
+    if( n != NULL )
+    {
+        n->Color = BST_BLACK;
+    }
+}
+
+PUBFUNC void Bst_Delete_Balanced(Bst *t, const void *Node)
+{
+    Bst_NodeHead *Current = ((Bst_NodeHead *)Node) - 1;
+    Bst_NodeHead *ActuallyRemoved, *Child, *ChildParent;
+    int RemovedColor;
+
+    /* As the unbalanced one, nodes are relinked rather than copied, since
+     * elements are referenced by their addresses.
+     */
+    if( Current->Left == NULL || Current->Right == NULL )
+    {
+        ActuallyRemoved = Current;
+    } else {
+        ActuallyRemoved = Current->Right;
+        while( ActuallyRemoved->Left != NULL )
+        {
+            ActuallyRemoved = ActuallyRemoved->Left;
+        }
+    }
+
+    Child = ActuallyRemoved->Left != NULL ?
+            ActuallyRemoved->Left :
+            ActuallyRemoved->Right;
+    ChildParent = ActuallyRemoved->Parent;
+    RemovedColor = ActuallyRemoved->Color;
+
+    if( Child != NULL )
+    {
+        Child->Parent = ChildParent;
+    }
+
+    ReplaceChild(t, ChildParent, ActuallyRemoved, Child);
+
+    if( ActuallyRemoved != Current )
+    {
+        /* ActuallyRemoved takes the place and the color of Current */
+        if( ChildParent == Current )
+        {
+            ChildParent = ActuallyRemoved;
+        }
+
+        ActuallyRemoved->Parent = Current->Parent;
+        ActuallyRemoved->Left = Current->Left;
+        ActuallyRemoved->Right = Current->Right;
+        ActuallyRemoved->Color = Current->Color;
+
+        ReplaceChild(t, Current->Parent, Current, ActuallyRemoved);
+
+        if( ActuallyRemoved->Left != NULL )
+        {
+            ActuallyRemoved->Left->Parent = ActuallyRemoved;
+        }
+
+        if( ActuallyRemoved->Right != NULL )
+        {
+            ActuallyRemoved->Right->Parent = ActuallyRemoved;
+        }
+    }
+
+    if( RemovedColor == BST_BLACK )
+    {
+        DeleteFixup(t, Child, ChildParent);
+    }
+
+    Current->Right = t->FreeList;
+    t->FreeList = Current;
+}
+
 PUBFUNC void Bst_Reset(Bst *t)
 {
     t->Nodes.Clear(&(t->Nodes));
@@ -337,3 +672,19 @@ int Bst_Init(Bst *t, int ElementLength, CompareFunc Compare)
 
     return 0;
 }
+
+int Bst_InitBalanced(Bst *t, int ElementLength, CompareFunc Compare)
+{
+    int ret = Bst_Init(t, ElementLength, Compare);
+
+    if( ret != 0 )
+    {
+        return ret;
+    }
+
+    t->Add = Bst_Add_Balanced;
+    t->Delete = Bst_Delete_Balanced;
+    t->Search = Bst_Search_Balanced;
+
+    return 0;
+}
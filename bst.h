@@ -11,6 +11,7 @@ struct _Bst_NodeHead{
     Bst_NodeHead    *Parent;
     Bst_NodeHead    *Left;
     Bst_NodeHead    *Right;
+    int             Color; /* Only used by balanced trees */
 };
 
 typedef struct _Bst Bst;
@@ -37,4 +38,10 @@ struct _Bst {
 
 int Bst_Init(Bst *t, int ElementLength, CompareFunc Compare);
 
+/* A red-black tree behind the same interface, for keys that may come in
+ * order. Elements never move, equal ones are searched in the same order as
+ * in an unbalanced tree (the first added first).
+ */
+int Bst_InitBalanced(Bst *t, int ElementLength, CompareFunc Compare);
+
 #endif /* BST_H_INCLUDED */
@@ -35,6 +35,7 @@ int CacheHT_Init(CacheHT *h, char *BaseAddr, int CacheSize)
     h->Slots.DataLength = sizeof(Cht_Slot);
     h->Slots.Data = BaseAddr + CacheSize - (h->Slots.DataLength) * (h->Slots.Used);
     h->Slots.Allocated = h->Slots.Used;
+    h->Slots.Owner = NULL;
 
     for(loop = 0; loop != h->Slots.Allocated; ++loop)
     {
@@ -45,6 +46,7 @@ int CacheHT_Init(CacheHT *h, char *BaseAddr, int CacheSize)
     h->NodeChunk.Data = h->Slots.Data - h->NodeChunk.DataLength;
     h->NodeChunk.Used = 0;
     h->NodeChunk.Allocated = -1;
+    h->NodeChunk.Owner = NULL;
 
     h->Free2DList = -1;
 
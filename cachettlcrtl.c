@@ -99,10 +99,13 @@ int CacheTtlCrtl_Add_From_StringList(CacheTtlCtrl *c, StringList *sl)
     return 0;
 }
 
-const CtrlContent *CacheTtlCrtl_Get(CacheTtlCtrl *c, const char *Domain)
+const CtrlContent *CacheTtlCrtl_Get(CacheTtlCtrl *c,
+                                    const char *Domain,
+                                    const DomainHash *Hashes /* Could be NULL */
+                                    )
 {
     CtrlContent *ret = NULL;
-    if( StringChunk_Domain_Match((StringChunk *)c, Domain, NULL, (void **)&(ret), NULL, NULL) == TRUE )
+    if( StringChunk_Domain_Match((StringChunk *)c, Domain, Hashes, (void **)&(ret), NULL, NULL) == TRUE )
     {
         return ret;
     } else {
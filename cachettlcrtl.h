@@ -32,6 +32,9 @@ int CacheTtlCrtl_Add_From_String(CacheTtlCtrl *c, const char *Rule);
 
 int CacheTtlCrtl_Add_From_StringList(CacheTtlCtrl *c, StringList *sl);
 
-const CtrlContent *CacheTtlCrtl_Get(CacheTtlCtrl *c, const char *Domain);
+const CtrlContent *CacheTtlCrtl_Get(CacheTtlCtrl *c,
+                                    const char *Domain,
+                                    const DomainHash *Hashes /* Could be NULL */
+                                    );
 
 #endif /* CACHETTLCRTL_H_INCLUDED */
@@ -10,8 +10,11 @@
 #include "logs.h"
 #include "timedtask.h"
 #include "domainstatistic.h"
+#include "latency.h"
+#include "metrics.h"
+#include "probes.h"
 
-#define CACHE_VERSION   23
+#define CACHE_VERSION   24
 
 #define CACHE_END   '\x0A'
 #define CACHE_START '\xFF'
@@ -85,6 +88,7 @@ static void DNSCacheTTLCountdown_Task(void *Unused, void *Unused2)
                 CacheHT_RemoveFromSlot(CacheInfo, loop, Node);
 
                 --(*CacheCount);
+                Metrics_Increase(METRICS_CACHE_EVICTIONS);
 
             }
         }
@@ -263,6 +267,8 @@ int DNSCache_Init(ConfigFileInfo *ConfigInfo)
         }
     }
 
+    StringChunk_Compile(TtlCtrl);
+
     CacheSize = CACHE_ROUND_UP(_CacheSize);
 
     if( CacheSize < 102400 )
@@ -346,7 +352,8 @@ int DNSCache_Init(ConfigFileInfo *ConfigInfo)
 
     if( !IgnoreTTL )
     {
-        TimedTask_Add(TRUE,
+        TimedTask_Add("cache TTL countdown",
+                      TRUE,
                       FALSE,
                       59000,
                       (TaskFunc)DNSCacheTTLCountdown_Task,
@@ -364,6 +371,21 @@ BOOL Cache_IsInited(void)
     return Inited;
 }
 
+/* Read without the lock, each figure could be a moment old */
+int DNSCache_GetUsage(int32_t *Count, int32_t *Used, int32_t *Size)
+{
+    if( Inited != TRUE )
+    {
+        return -1;
+    }
+
+    *Count = *(volatile int32_t *)CacheCount;
+    *Used = *CacheEnd;
+    *Size = CacheSize;
+
+    return 0;
+}
+
 static BOOL IsValidCachedType(DNSRecordType Type)
 {
     return  /* raw */
@@ -551,7 +573,7 @@ static int DNSCache_AddAItemToCache(DnsSimpleParserIterator *i,
                     break;
 
                 case TTL_CTRL_INFECTION_PASSIVLY:
-                    TtlContent = CacheTtlCrtl_Get(TtlCtrl, Item);
+                    TtlContent = CacheTtlCrtl_Get(TtlCtrl, Item, NULL);
                     if( TtlContent == NULL )
                     {
                         TtlContent = InfectedTtlContent;
@@ -559,11 +581,11 @@ static int DNSCache_AddAItemToCache(DnsSimpleParserIterator *i,
                     break;
 
                 case TTL_CTRL_INFECTION_NONE:
-                    TtlContent = CacheTtlCrtl_Get(TtlCtrl, Item);
+                    TtlContent = CacheTtlCrtl_Get(TtlCtrl, Item, NULL);
                     break;
             }
         } else {
-            TtlContent = CacheTtlCrtl_Get(TtlCtrl, Item);
+            TtlContent = CacheTtlCrtl_Get(TtlCtrl, Item, NULL);
         }
 
         if( TtlContent != NULL )
@@ -623,6 +645,7 @@ static int DNSCache_AddAItemToCache(DnsSimpleParserIterator *i,
                   );
         } else {
             WARNING("No available cache: %s\n", Item);
+            Metrics_Increase(METRICS_CACHE_FULL);
             return -1;
         }
     }
@@ -652,7 +675,7 @@ int DNSCache_AddItemsToCache(MsgContext *MsgCtx, BOOL IsFirst)
         return -2;
     }
 
-    TtlContent =  CacheTtlCrtl_Get(TtlCtrl, Header->Domain);
+    TtlContent =  CacheTtlCrtl_Get(TtlCtrl, Header->Domain, &(Header->SuffixHashes));
     RWLock_WrLock(CacheLock);
 
     while( i.Next(&i) != NULL )
@@ -918,9 +941,15 @@ int DNSCache_FetchFromCache(MsgContext *MsgCtx, int BufferLength)
 
     if( DNSCache_GetByQuestion(&g, &p, time(NULL)) != 0 )
     {
+        STAMP(h, STAMP_CACHE);
+        PROBE_QUERY0(cache_miss, h);
+        Metrics_Increase(METRICS_CACHE_MISSES);
         return -3;
     }
 
+    STAMP(h, STAMP_CACHE);
+    PROBE_QUERY0(cache_hit, h);
+
     g.Header->Flags.Direction = 1;
     g.Header->Flags.AuthoritativeAnswer = 0;
     g.Header->Flags.RecursionAvailable = 1;
@@ -957,7 +986,9 @@ int DNSCache_FetchFromCache(MsgContext *MsgCtx, int BufferLength)
     }
 
     ShowNormalMessage(h, 'C');
+    Metrics_Increase(METRICS_CACHE_HITS);
     DomainStatistic_Add(h, STATISTIC_TYPE_CACHE);
+    Latency_Record(LATENCY_TYPE_CACHE, h->ReceivedTime);
 
     return 0;
 }
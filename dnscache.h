@@ -9,6 +9,9 @@ int DNSCache_Init(ConfigFileInfo *ConfigInfo);
 
 BOOL Cache_IsInited(void);
 
+/* Records cached, bytes used and bytes in all */
+int DNSCache_GetUsage(int32_t *Count, int32_t *Used, int32_t *Size);
+
 int DNSCache_AddItemsToCache(MsgContext *MsgCtx, BOOL IsFirst);
 
 int DNSCache_FetchFromCache(MsgContext *MsgCtx, int BufferLength);
@@ -0,0 +1,318 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+#include "domainhash.h"
+#include "dnsparser.h"
+#include "utils.h"
+
+/* Must be the same as the one used by `BKDRHash' */
+#define DOMAIN_HASH_SEED    131
+
+/* Compression pointers followed at most, to break pointer loops */
+#define DOMAIN_HASH_MAX_JUMPS   64
+
+#define DOMAIN_HASH_STEP(hash, ch)  ((hash) * DOMAIN_HASH_SEED + (ch))
+
+/* DOMAIN_HASH_SEED ^ Exponent */
+static uint32_t DomainHash_Power(int Exponent)
+{
+    uint32_t Result = 1;
+    uint32_t Base = DOMAIN_HASH_SEED;
+
+    while( Exponent > 0 )
+    {
+        if( Exponent & 1 )
+        {
+            Result *= Base;
+        }
+
+        Base *= Base;
+        Exponent >>= 1;
+    }
+
+    return Result;
+}
+
+/* With Full = HASH(Domain) and Prefix = HASH(Domain[0, Offset)),
+ * HASH(Domain + Offset) = Full - Prefix * SEED ^ (Length - Offset),
+ * all in modulo 2^32.
+ */
+static void DomainHash_Finish(DomainHash *Hashes,
+                              const uint32_t *Prefix,
+                              uint32_t Full,
+                              int Length
+                              )
+{
+    int loop;
+
+    for( loop = 0; loop != Hashes->Count; ++loop )
+    {
+        Hashes->Suffix[loop] = Full -
+                               Prefix[loop] *
+                               DomainHash_Power(Length - Hashes->Offset[loop]);
+    }
+}
+
+static void DomainHash_Record(DomainHash *Hashes,
+                              uint32_t *Prefix,
+                              int Offset,
+                              uint32_t Hash
+                              )
+{
+    if( Hashes != NULL &&
+        Hashes->Count < DOMAIN_HASH_MAX_SUFFIXES &&
+        Offset <= UINT8_MAX
+        )
+    {
+        Hashes->Offset[Hashes->Count] = Offset;
+        Prefix[Hashes->Count] = Hash;
+        ++(Hashes->Count);
+    }
+}
+
+/* Copy and lowercase a label, updating `*Hash'.
+ * Return FALSE if the label contains a '\0'.
+ */
+static BOOL DomainHash_Label(char *Dest,
+                             const char *DestEnd,
+                             const char *Src,
+                             const char *SrcEnd,
+                             int Length,
+                             uint32_t *Hash
+                             )
+{
+    uint32_t h = *Hash;
+    BOOL NoZero = TRUE;
+
+#ifdef __SSE2__
+    const __m128i Before = _mm_set1_epi8('A' - 1);
+    const __m128i After = _mm_set1_epi8('Z' + 1);
+    const __m128i Bit = _mm_set1_epi8('a' - 'A');
+    const __m128i Zero = _mm_setzero_si128();
+
+    /* 16 bytes a time, as long as the whole block is readable and writable */
+    while( Length > 0 && Src + 16 <= SrcEnd && Dest + 16 <= DestEnd )
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)Src);
+        __m128i Upper = _mm_and_si128(_mm_cmpgt_epi8(v, Before),
+                                      _mm_cmplt_epi8(v, After)
+                                      );
+        int Step = Length < 16 ? Length : 16;
+        int ZeroMask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, Zero)) &
+                       ((1 << Step) - 1);
+        int loop;
+
+        v = _mm_or_si128(v, _mm_and_si128(Upper, Bit));
+        _mm_storeu_si128((__m128i *)Dest, v);
+
+        if( ZeroMask != 0 )
+        {
+            NoZero = FALSE;
+        }
+
+        for( loop = 0; loop != Step; ++loop )
+        {
+            h = DOMAIN_HASH_STEP(h, Dest[loop]);
+        }
+
+        Src += Step;
+        Dest += Step;
+        Length -= Step;
+    }
+#endif /* __SSE2__ */
+
+    while( Length > 0 )
+    {
+        char c = *Src;
+
+        if( c >= 'A' && c <= 'Z' )
+        {
+            c += 'a' - 'A';
+        } else if( c == '\0' )
+        {
+            NoZero = FALSE;
+        }
+
+        *Dest = c;
+        h = DOMAIN_HASH_STEP(h, c);
+
+        ++Src;
+        ++Dest;
+        --Length;
+    }
+
+    *Hash = h;
+
+    return NoZero;
+}
+
+int DomainHash_Unpack(const char    *DNSBody,
+                      int           DNSBodyLength,
+                      const char    *NameStart,
+                      char          *Buffer,
+                      int           BufferLength,
+                      DomainHash    *Hashes /* Could be NULL */
+                      )
+{
+    const char *NameItr = NameStart;
+    const char *BodyEnd = DNSBody + DNSBodyLength;
+    char *BufferItr = Buffer;
+    const char *BufferEnd = Buffer + BufferLength;
+
+    uint32_t Hash = 0;
+    uint32_t Prefix[DOMAIN_HASH_MAX_SUFFIXES];
+    BOOL NoZero = TRUE;
+    int Jumps = 0;
+
+    if( Hashes != NULL )
+    {
+        Hashes->Count = 0;
+    }
+
+    if( BufferLength <= 0 )
+    {
+        return -1;
+    }
+
+    while( TRUE )
+    {
+        int LabelCount;
+
+        if( NameItr < DNSBody || NameItr >= BodyEnd )
+        {
+            *Buffer = '\0';
+            return -1;
+        }
+
+        LabelCount = GET_8_BIT_U_INT(NameItr);
+        if( LabelCount == 0 )
+        {
+            break;
+        }
+
+        if( DNSIsLabelPointerStart(LabelCount) )
+        {
+            int LabelPointer;
+
+            if( NameItr + 1 >= BodyEnd || ++Jumps > DOMAIN_HASH_MAX_JUMPS )
+            {
+                *Buffer = '\0';
+                return -1;
+            }
+
+            LabelPointer = DNSLabelGetPointer(NameItr);
+            if( LabelPointer >= DNSBodyLength )
+            {
+                *Buffer = '\0';
+                return -1;
+            }
+
+            NameItr = DNSBody + LabelPointer;
+            continue;
+        }
+
+        /* The label, a leading dot and the terminating zero */
+        if( NameItr + 1 + LabelCount > BodyEnd ||
+            BufferItr + (BufferItr != Buffer) + LabelCount + 1 > BufferEnd
+            )
+        {
+            *Buffer = '\0';
+            return -1;
+        }
+
+        if( BufferItr != Buffer )
+        {
+            *BufferItr = '.';
+            Hash = DOMAIN_HASH_STEP(Hash, '.');
+            ++BufferItr;
+        }
+
+        DomainHash_Record(Hashes, Prefix, BufferItr - Buffer, Hash);
+
+        if( !DomainHash_Label(BufferItr,
+                              BufferEnd,
+                              NameItr + 1,
+                              BodyEnd,
+                              LabelCount,
+                              &Hash
+                              )
+            )
+        {
+            NoZero = FALSE;
+        }
+
+        BufferItr += LabelCount;
+        NameItr += 1 + LabelCount;
+    }
+
+    *BufferItr = '\0';
+
+    if( Hashes != NULL )
+    {
+        if( NoZero )
+        {
+            DomainHash_Finish(Hashes, Prefix, Hash, BufferItr - Buffer);
+        } else {
+            /* Keep consistent with hashing the truncated string */
+            DomainHash_FromString(Hashes, Buffer);
+        }
+    }
+
+    return BufferItr - Buffer;
+}
+
+void DomainHash_FromString(DomainHash *Hashes, const char *Domain)
+{
+    const char *Itr = Domain;
+    uint32_t Hash = 0;
+    uint32_t Prefix[DOMAIN_HASH_MAX_SUFFIXES];
+
+    Hashes->Count = 0;
+
+    if( *Itr == '\0' )
+    {
+        return;
+    }
+
+    DomainHash_Record(Hashes, Prefix, 0, 0);
+
+    while( *Itr != '\0' )
+    {
+        Hash = DOMAIN_HASH_STEP(Hash, *Itr);
+
+        if( *Itr == '.' )
+        {
+            DomainHash_Record(Hashes, Prefix, Itr + 1 - Domain, Hash);
+        }
+
+        ++Itr;
+    }
+
+    DomainHash_Finish(Hashes, Prefix, Hash, Itr - Domain);
+}
+
+const uint32_t *DomainHash_Get(const DomainHash *Hashes, int Offset)
+{
+    int loop;
+
+    if( Hashes == NULL )
+    {
+        return NULL;
+    }
+
+    for( loop = 0; loop != Hashes->Count; ++loop )
+    {
+        if( Hashes->Offset[loop] == Offset )
+        {
+            return &(Hashes->Suffix[loop]);
+        }
+
+        if( Hashes->Offset[loop] > Offset )
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef DOMAINHASH_H_INCLUDED
+#define DOMAINHASH_H_INCLUDED
+
+#include "common.h"
+
+/* Suffixes deeper than this are not recorded, lookups on them fall back to
+ * hashing on the fly.
+ */
+#define DOMAIN_HASH_MAX_SUFFIXES    32
+
+/* `HASH' values of a domain and of every label suffix of it.
+ *
+ * For "www.example.com", Offset[] is {0, 4, 12} and Suffix[] holds the
+ * hashes of "www.example.com", "example.com" and "com". Suffix[0] is the
+ * hash of the full name whenever Count > 0.
+ */
+typedef struct _DomainHash{
+    int         Count;
+    uint8_t     Offset[DOMAIN_HASH_MAX_SUFFIXES];
+    uint32_t    Suffix[DOMAIN_HASH_MAX_SUFFIXES];
+} DomainHash;
+
+/* Unpack the labeled name at `NameStart' into `Buffer' as a dotted and
+ * lowercased string, computing `HASH' of the full name and of every label
+ * suffix in the same pass.
+ * Return the length of the string in `Buffer', negative on error.
+ */
+int DomainHash_Unpack(const char    *DNSBody,
+                      int           DNSBodyLength,
+                      const char    *NameStart,
+                      char          *Buffer,
+                      int           BufferLength,
+                      DomainHash    *Hashes /* Could be NULL */
+                      );
+
+/* Fill `Hashes' from an already dotted and lowercased domain. */
+void DomainHash_FromString(DomainHash *Hashes, const char *Domain);
+
+/* Return the recorded hash of the suffix starting at `Offset', or NULL. */
+const uint32_t *DomainHash_Get(const DomainHash *Hashes, int Offset);
+
+#endif /* DOMAINHASH_H_INCLUDED */
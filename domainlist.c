@@ -0,0 +1,584 @@
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif /* _WIN32 */
+#include "domainlist.h"
+#include "stringlist.h"
+#include "readline.h"
+#include "array.h"
+#include "utils.h"
+
+#define DOMAIN_LIST_BYTE_ORDER  0x01020304
+
+/* About one hash a slot of the index */
+#define DOMAIN_LIST_MAX_INDEX_BITS  24
+
+#define DOMAIN_LIST_BUCKET(Hash, Bits)  ((Bits) == 0 ? 0 : (Hash) >> (32 - (Bits)))
+
+typedef struct _DomainList_Item{
+    uint32_t    Hash;
+    const char  *Str;
+} DomainList_Item;
+
+static int DomainList_ItemCompare(const DomainList_Item *One,
+                                  const DomainList_Item *Two
+                                  )
+{
+    if( One->Hash != Two->Hash )
+    {
+        return One->Hash < Two->Hash ? -1 : 1;
+    }
+
+    return strcmp(One->Str, Two->Str);
+}
+
+static int DomainList_Write(FILE *fp, const Array *Items, const Array *WildCards)
+{
+    DomainList_Header Header;
+    uint32_t Offset = 0;
+    uint32_t Bucket;
+    int loop;
+
+    memset(&Header, 0, sizeof(Header));
+    strcpy(Header.Magic, DOMAIN_LIST_MAGIC);
+    Header.ByteOrder = DOMAIN_LIST_BYTE_ORDER;
+    Header.Version = DOMAIN_LIST_VERSION;
+    Header.Count = Array_GetUsed(Items);
+    Header.WildCardCount = Array_GetUsed(WildCards);
+
+    while( Header.IndexBits < DOMAIN_LIST_MAX_INDEX_BITS &&
+           (1u << Header.IndexBits) < Header.Count
+           )
+    {
+        ++(Header.IndexBits);
+    }
+
+    for( loop = 0; loop != Array_GetUsed(Items); ++loop )
+    {
+        const DomainList_Item *i = Array_GetBySubscript(Items, loop);
+
+        Header.StringsLength += strlen(i->Str) + 1;
+    }
+
+    for( loop = 0; loop != Array_GetUsed(WildCards); ++loop )
+    {
+        const char **w = Array_GetBySubscript(WildCards, loop);
+
+        Header.StringsLength += strlen(*w) + 1;
+    }
+
+    if( fwrite(&Header, sizeof(Header), 1, fp) != 1 )
+    {
+        return -1;
+    }
+
+    for( loop = 0; loop != Array_GetUsed(Items); ++loop )
+    {
+        const DomainList_Item *i = Array_GetBySubscript(Items, loop);
+
+        if( fwrite(&(i->Hash), sizeof(uint32_t), 1, fp) != 1 )
+        {
+            return -2;
+        }
+    }
+
+    /* Strings are written in the same order as their offsets */
+    for( loop = 0; loop != Array_GetUsed(Items); ++loop )
+    {
+        const DomainList_Item *i = Array_GetBySubscript(Items, loop);
+
+        if( fwrite(&Offset, sizeof(uint32_t), 1, fp) != 1 )
+        {
+            return -3;
+        }
+
+        Offset += strlen(i->Str) + 1;
+    }
+
+    /* Items are sorted by their hashes, and so by the top bits of them */
+    for( Bucket = 0, loop = 0; Bucket <= (1u << Header.IndexBits); ++Bucket )
+    {
+        uint32_t First;
+
+        for( ; loop != Array_GetUsed(Items); ++loop )
+        {
+            const DomainList_Item *i = Array_GetBySubscript(Items, loop);
+
+            if( DOMAIN_LIST_BUCKET(i->Hash, Header.IndexBits) >= Bucket )
+            {
+                break;
+            }
+        }
+
+        First = loop;
+        if( fwrite(&First, sizeof(uint32_t), 1, fp) != 1 )
+        {
+            return -7;
+        }
+    }
+
+    for( loop = 0; loop != Array_GetUsed(WildCards); ++loop )
+    {
+        const char **w = Array_GetBySubscript(WildCards, loop);
+
+        if( fwrite(&Offset, sizeof(uint32_t), 1, fp) != 1 )
+        {
+            return -4;
+        }
+
+        Offset += strlen(*w) + 1;
+    }
+
+    for( loop = 0; loop != Array_GetUsed(Items); ++loop )
+    {
+        const DomainList_Item *i = Array_GetBySubscript(Items, loop);
+
+        if( fwrite(i->Str, strlen(i->Str) + 1, 1, fp) != 1 )
+        {
+            return -5;
+        }
+    }
+
+    for( loop = 0; loop != Array_GetUsed(WildCards); ++loop )
+    {
+        const char **w = Array_GetBySubscript(WildCards, loop);
+
+        if( fwrite(*w, strlen(*w) + 1, 1, fp) != 1 )
+        {
+            return -6;
+        }
+    }
+
+    return 0;
+}
+
+int DomainList_Compile(const char *Input, const char *Output)
+{
+    FILE *fp;
+    char Domain[512];
+
+    StringList  Strings;
+    Array       Items;
+    Array       WildCards;
+
+    DomainList_Item *ItemArray;
+    char *Temp;
+    int Count = 0;
+    int loop;
+    int ret;
+
+    fp = fopen(Input, "r");
+    if( fp == NULL )
+    {
+        return -1;
+    }
+
+    if( StringList_Init(&Strings, NULL, NULL) != 0 )
+    {
+        ret = -2;
+        goto EXIT_1;
+    }
+
+    if( Array_Init(&Items, sizeof(DomainList_Item), 0, FALSE, NULL) != 0 )
+    {
+        ret = -3;
+        goto EXIT_2;
+    }
+
+    if( Array_Init(&WildCards, sizeof(const char *), 0, FALSE, NULL) != 0 )
+    {
+        ret = -4;
+        goto EXIT_3;
+    }
+
+    /* The same as `LoadDomainsFromFile' and `StringChunk_Add_Domain' do */
+    while( TRUE )
+    {
+        ReadLineStatus  Status;
+        const char *Str;
+
+        Status = ReadLine(fp, Domain, sizeof(Domain));
+        if( Status == READ_FAILED_OR_END )
+        {
+            break;
+        }
+
+        if( Status != READ_DONE )
+        {
+            ReadLine_GoToNextLine(fp);
+            continue;
+        }
+
+        Str = Strings.Add(&Strings,
+                          Domain[0] == '.' ? Domain + 1 : Domain,
+                          NULL
+                          );
+        if( Str == NULL )
+        {
+            ret = -5;
+            goto EXIT_4;
+        }
+
+        if( HAS_WILDCARD(Str) )
+        {
+            ret = Array_PushBack(&WildCards, &Str, NULL);
+        } else {
+            DomainList_Item i;
+
+            i.Hash = HASH(Str, 0);
+            i.Str = Str;
+
+            ret = Array_PushBack(&Items, &i, NULL);
+        }
+
+        if( ret < 0 )
+        {
+            ret = -6;
+            goto EXIT_4;
+        }
+    }
+
+    fclose(fp);
+    fp = NULL;
+
+    Array_Sort(&Items, (CompareFunc)DomainList_ItemCompare);
+
+    /* Dropping duplicates, they are adjacent now */
+    ItemArray = (DomainList_Item *)Array_GetRawArray(&Items);
+    for( loop = 0; loop < Array_GetUsed(&Items); ++loop )
+    {
+        if( Count == 0 ||
+            DomainList_ItemCompare(ItemArray + Count - 1, ItemArray + loop) != 0
+            )
+        {
+            ItemArray[Count] = ItemArray[loop];
+            ++Count;
+        }
+    }
+    Items.Used = Count;
+
+    /* `Output' may be mapped by a running instance, truncating it would pull
+     * the pages from under that one.
+     */
+    Temp = SafeMalloc(strlen(Output) + sizeof(".tmp"));
+    if( Temp == NULL )
+    {
+        ret = -7;
+        goto EXIT_4;
+    }
+
+    sprintf(Temp, "%s.tmp", Output);
+
+    fp = fopen(Temp, "wb");
+    if( fp == NULL )
+    {
+        ret = -7;
+        goto EXIT_5;
+    }
+
+    if( DomainList_Write(fp, &Items, &WildCards) != 0 )
+    {
+        ret = -8;
+        goto EXIT_6;
+    }
+
+    ret = fclose(fp);
+    fp = NULL;
+    if( ret != 0 )
+    {
+        ret = -9;
+        goto EXIT_6;
+    }
+
+#ifdef _WIN32
+    if( !MoveFileEx(Temp, Output, MOVEFILE_REPLACE_EXISTING) )
+#else /* _WIN32 */
+    if( rename(Temp, Output) != 0 )
+#endif /* _WIN32 */
+    {
+        ret = -10;
+        goto EXIT_6;
+    }
+
+    ret = Count + Array_GetUsed(&WildCards);
+
+EXIT_6:
+    if( fp != NULL )
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+
+    if( ret < 0 )
+    {
+        remove(Temp);
+    }
+EXIT_5:
+    SafeFree(Temp);
+EXIT_4:
+    Array_Free(&WildCards);
+EXIT_3:
+    Array_Free(&Items);
+EXIT_2:
+    Strings.Free(&Strings);
+EXIT_1:
+    if( fp != NULL )
+    {
+        fclose(fp);
+    }
+    return ret;
+}
+
+/* Check the mapped content once, so that lookups can trust every offset and
+ * index in it.
+ */
+static int DomainList_Verify(DomainList *l)
+{
+    const DomainList_Header *h = (const DomainList_Header *)(l->Base);
+    int64_t Expected;
+    uint32_t loop;
+
+    if( l->Length < (int64_t)sizeof(DomainList_Header) ||
+        memcmp(h->Magic, DOMAIN_LIST_MAGIC, sizeof(DOMAIN_LIST_MAGIC)) != 0
+        )
+    {
+        return -2;
+    }
+
+    if( h->ByteOrder != DOMAIN_LIST_BYTE_ORDER ||
+        h->Version != DOMAIN_LIST_VERSION
+        )
+    {
+        return -3;
+    }
+
+    if( h->IndexBits > DOMAIN_LIST_MAX_INDEX_BITS )
+    {
+        return -4;
+    }
+
+    Expected = (int64_t)sizeof(DomainList_Header) +
+               ((int64_t)h->Count * 2 +
+                (1 << h->IndexBits) + 1 +
+                h->WildCardCount
+                ) * sizeof(uint32_t) +
+               h->StringsLength;
+
+    if( Expected != l->Length )
+    {
+        return -4;
+    }
+
+    l->Header = h;
+    l->Hashes = (const uint32_t *)(h + 1);
+    l->Offsets = l->Hashes + h->Count;
+    l->Index = l->Offsets + h->Count;
+    l->WildCards = l->Index + (1 << h->IndexBits) + 1;
+    l->Strings = (const char *)(l->WildCards + h->WildCardCount);
+
+    /* So that no string could run out of the mapping */
+    if( h->StringsLength > 0 && l->Strings[h->StringsLength - 1] != '\0' )
+    {
+        return -5;
+    }
+
+    for( loop = 0; loop != h->Count; ++loop )
+    {
+        if( l->Offsets[loop] >= h->StringsLength )
+        {
+            return -5;
+        }
+    }
+
+    for( loop = 0; loop != h->WildCardCount; ++loop )
+    {
+        if( l->WildCards[loop] >= h->StringsLength )
+        {
+            return -5;
+        }
+    }
+
+    /* Ranges of the index must be in order and within `Hashes' */
+    for( loop = 0; loop != (1u << h->IndexBits); ++loop )
+    {
+        if( l->Index[loop] > l->Index[loop + 1] )
+        {
+            return -5;
+        }
+    }
+
+    if( l->Index[loop] != h->Count )
+    {
+        return -5;
+    }
+
+    return 0;
+}
+
+int DomainList_Map(DomainList *l, const char *File)
+{
+    int ret;
+
+    memset(l, 0, sizeof(DomainList));
+
+#ifdef _WIN32
+    {
+        HANDLE f;
+        LARGE_INTEGER Size;
+
+        f = CreateFile(File,
+                       GENERIC_READ,
+                       FILE_SHARE_READ,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL,
+                       NULL
+                       );
+        if( f == INVALID_HANDLE_VALUE )
+        {
+            return -1;
+        }
+
+        if( !GetFileSizeEx(f, &Size) || Size.QuadPart == 0 )
+        {
+            CloseHandle(f);
+            return -2;
+        }
+
+        l->Length = Size.QuadPart;
+
+        l->Mapping = CreateFileMapping(f, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(f);
+        if( l->Mapping == NULL )
+        {
+            return -6;
+        }
+
+        l->Base = MapViewOfFile(l->Mapping, FILE_MAP_READ, 0, 0, 0);
+        if( l->Base == NULL )
+        {
+            CloseHandle(l->Mapping);
+            l->Mapping = NULL;
+            return -6;
+        }
+    }
+#else /* _WIN32 */
+    {
+        int fd;
+        struct stat st;
+
+        fd = open(File, O_RDONLY);
+        if( fd < 0 )
+        {
+            return -1;
+        }
+
+        if( fstat(fd, &st) != 0 || st.st_size == 0 )
+        {
+            close(fd);
+            return -2;
+        }
+
+        l->Length = st.st_size;
+
+        l->Base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if( l->Base == MAP_FAILED )
+        {
+            l->Base = NULL;
+            return -6;
+        }
+    }
+#endif /* _WIN32 */
+
+    ret = DomainList_Verify(l);
+    if( ret != 0 )
+    {
+        DomainList_Unmap(l);
+        return ret;
+    }
+
+    return 0;
+}
+
+static BOOL DomainList_Find(const DomainList *l, const char *Str, uint32_t Hash)
+{
+    const uint32_t *Range =
+                l->Index + DOMAIN_LIST_BUCKET(Hash, l->Header->IndexBits);
+    uint32_t Lo = Range[0];
+    uint32_t Hi = Range[1];
+
+    /* The first one not less than `Hash' */
+    while( Lo < Hi )
+    {
+        uint32_t Mid = Lo + (Hi - Lo) / 2;
+
+        if( l->Hashes[Mid] < Hash )
+        {
+            Lo = Mid + 1;
+        } else {
+            Hi = Mid;
+        }
+    }
+
+    for( ; Lo < Range[1] && l->Hashes[Lo] == Hash; ++Lo )
+    {
+        if( strcmp(l->Strings + l->Offsets[Lo], Str) == 0 )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+BOOL DomainList_Match(const DomainList  *l,
+                      const char        *Domain,
+                      const DomainHash  *Hashes /* Could be NULL */
+                      )
+{
+    const char *Itr = Domain;
+
+    if( l == NULL || l->Header == NULL || l->Header->Count == 0 )
+    {
+        return FALSE;
+    }
+
+    while( Itr != NULL )
+    {
+        const uint32_t *Hash = DomainHash_Get(Hashes, Itr - Domain);
+
+        if( DomainList_Find(l, Itr, Hash == NULL ? HASH(Itr, 0) : *Hash) )
+        {
+            return TRUE;
+        }
+
+        Itr = strchr(Itr + (Itr == Domain), '.');
+        if( Itr != NULL )
+        {
+            ++Itr;
+        }
+    }
+
+    return FALSE;
+}
+
+void DomainList_Unmap(DomainList *l)
+{
+    if( l->Base != NULL )
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(l->Base);
+        CloseHandle(l->Mapping);
+        l->Mapping = NULL;
+#else /* _WIN32 */
+        munmap(l->Base, l->Length);
+#endif /* _WIN32 */
+    }
+
+    l->Base = NULL;
+    l->Header = NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef DOMAINLIST_H_INCLUDED
+#define DOMAINLIST_H_INCLUDED
+
+#include "common.h"
+#include "domainhash.h"
+
+/* A precompiled domain list, mapped read-only into memory.
+ *
+ * `DomainList_Compile' turns a text list (one domain per line, like the ones
+ * `DisabledList' takes) into a binary file. Plain domains are stored as two
+ * parallel arrays, their `HASH' values in ascending order and offsets of the
+ * strings, followed by all strings. Mapping the file parses nothing, and the
+ * pages are shared by every process mapping the same file. Wildcard patterns are kept as strings only, and are left to
+ * the user to load.
+ *
+ * Hashes are also indexed by their top `IndexBits' bits, so a lookup reads
+ * about one of them instead of binary searching all of them.
+ *
+ * Integers are in host byte order, a file compiled on a machine with another
+ * byte order is refused. Every offset is checked when the file is mapped, so
+ * a corrupt file can't make lookups read past the mapping.
+ */
+
+#define DOMAIN_LIST_MAGIC   "DNSFWDL"
+#define DOMAIN_LIST_VERSION 2
+
+typedef struct _DomainList_Header{
+    char        Magic[8];
+    uint32_t    ByteOrder; /* 0x01020304 */
+    uint32_t    Version;
+
+    uint32_t    Count;
+    uint32_t    WildCardCount;
+    uint32_t    StringsLength;
+    uint32_t    IndexBits;
+
+    /* Followed by
+     *  uint32_t    Hashes[Count];
+     *  uint32_t    Offsets[Count];
+     *  uint32_t    Index[(1 << IndexBits) + 1];
+     *  uint32_t    WildCards[WildCardCount];
+     *  char        Strings[StringsLength];
+     * Offsets are into `Strings', every string is terminated by a '\0'.
+     * `Index[i]' is the first of `Hashes' whose top bits are not less than i.
+     */
+} DomainList_Header;
+
+typedef struct _DomainList{
+    const DomainList_Header *Header;
+    const uint32_t  *Hashes;
+    const uint32_t  *Offsets;
+    const uint32_t  *Index;
+    const uint32_t  *WildCards;
+    const char      *Strings;
+
+    /* Mapping */
+    void        *Base;
+    int64_t     Length;
+#ifdef _WIN32
+    HANDLE      Mapping;
+#endif /* _WIN32 */
+} DomainList;
+
+/* Compile the text list `Input' into `Output'. It is written aside and then
+ * renamed over `Output', so a list mapped by a running instance is left as it
+ * was.
+ * Return the number of entries written, negative on error.
+ */
+int DomainList_Compile(const char *Input, const char *Output);
+
+/* Return 0 on success, -2 if `File' is not a compiled list (so it could be
+ * read as text), other negative values on errors.
+ */
+int DomainList_Map(DomainList *l, const char *File);
+
+/* Whether `Domain' or a suffix of it is in the list, in the same way as
+ * `StringChunk_Domain_Match_NoWildCard' does.
+ */
+BOOL DomainList_Match(const DomainList  *l,
+                      const char        *Domain,
+                      const DomainHash  *Hashes /* Could be NULL */
+                      );
+
+#define DomainList_GetCount(l_ptr)  ((l_ptr)->Header->Count)
+
+#define DomainList_GetWildCardCount(l_ptr)  ((l_ptr)->Header->WildCardCount)
+
+#define DomainList_GetWildCard(l_ptr, Index) \
+    ((l_ptr)->Strings + (l_ptr)->WildCards[(Index)])
+
+void DomainList_Unmap(DomainList *l);
+
+#endif /* DOMAINLIST_H_INCLUDED */
@@ -2,11 +2,22 @@
 #include <time.h>
 #include "common.h"
 #include "stringchunk.h"
+#include "topk.h"
 #include "domainstatistic.h"
 #include "utils.h"
 #include "timedtask.h"
+#include "epoch.h"
+#include "latency.h"
+#include "metrics.h"
+#include "querylog.h"
 #include "logs.h"
 
+#ifdef _MSC_VER
+    #define STATISTIC_THREAD_LOCAL  __declspec(thread)
+#else
+    #define STATISTIC_THREAD_LOCAL  __thread
+#endif /* _MSC_VER */
+
 typedef struct _DomainInfo{
     int     Count;
     int     Refused;
@@ -22,9 +33,52 @@ typedef struct _RankList{
     DomainInfo  *Info;
 } RankList;
 
+/* Lengths of keys of `TopK' tables */
+#define STATISTIC_DOMAIN_LENGTH sizeof(((IHeader *)NULL)->Domain)
+#define STATISTIC_CLIENT_LENGTH sizeof(((IHeader *)NULL)->Agent)
+
+/* What is counted. Every domain in `Domains' if `MaxEntries' is 0, otherwise
+ * the most queried domains and clients in fixed memory. `Sum' is exact either
+ * way.
+ */
+typedef struct _StatisticTable{
+    DomainInfo  Sum;
+    StringChunk Domains;
+    TopK        TopDomains;
+    TopK        TopClients;
+} StatisticTable;
+
+/* Counts of a thread, taken without locks.
+ *
+ * The thread counts into `Current' in an epoch section. `DomainStatistic_Works'
+ * points `Current' to the other table, waits out the sections, then adds up
+ * the table left and empties it, so nothing is lost while it is written out.
+ *
+ * A thread exiting marks its shard `Retired'. The shard is freed by the first
+ * merge that found it marked, after its last counts are added up.
+ */
+typedef struct _StatisticShard StatisticShard;
+
+struct _StatisticShard{
+    StatisticShard  *Next;
+    StatisticTable  *Current;
+    StatisticTable  Tables[2];
+    BOOL            Retired;
+    BOOL            Dropping; /* Only used by `DomainStatistic_Merge' */
+};
+
+/* Guards `Shards' and `Retired' */
 static EFFECTIVE_LOCK   StatisticLock;
 
-static StringChunk      MainChunk;
+static StatisticShard   *Shards = NULL;
+
+static STATISTIC_THREAD_LOCAL StatisticShard *ThreadShard = NULL;
+
+/* Entries of each of `TopDomains' and `TopClients', 0 for no bound */
+static int              MaxEntries = 0;
+
+/* Only used by `DomainStatistic_Works' */
+static StatisticTable   MainTable;
 
 static FILE             *MainFile = NULL;
 
@@ -33,8 +87,6 @@ static unsigned long int    InitTime_Num;
 static char *PreOutput = NULL;
 static char *PostOutput = NULL;
 
-volatile static BOOL    SkipStatistic = FALSE;
-
 static int GetPreAndPost(ConfigFileInfo *ConfigInfo)
 {
     const char  *TemplateFile = ConfigGetRawString(ConfigInfo, "DomainStatisticTempletFile");
@@ -84,13 +136,270 @@ EXIT:
     return -1;
 }
 
+static void DomainStatistic_AddInfo(DomainInfo *To, const DomainInfo *Delta)
+{
+    To->Count += Delta->Count;
+    To->Refused += Delta->Refused;
+    To->Hosts += Delta->Hosts;
+    To->Cache += Delta->Cache;
+    To->Udp += Delta->Udp;
+    To->Tcp += Delta->Tcp;
+    To->BlockedMsg += Delta->BlockedMsg;
+}
+
+static int DomainStatistic_InitTable(StatisticTable *t)
+{
+    memset(&(t->Sum), 0, sizeof(DomainInfo));
+
+    if( MaxEntries == 0 )
+    {
+        return StringChunk_Init(&(t->Domains), NULL);
+    }
+
+    if( TopK_Init(&(t->TopDomains), MaxEntries, STATISTIC_DOMAIN_LENGTH, sizeof(DomainInfo)) != 0 )
+    {
+        return -1;
+    }
+
+    if( TopK_Init(&(t->TopClients), MaxEntries, STATISTIC_CLIENT_LENGTH, 0) != 0 )
+    {
+        TopK_Free(&(t->TopDomains));
+        return -2;
+    }
+
+    return 0;
+}
+
+static void DomainStatistic_FreeTable(StatisticTable *t)
+{
+    if( MaxEntries == 0 )
+    {
+        StringChunk_Free(&(t->Domains), TRUE);
+    } else {
+        TopK_Free(&(t->TopDomains));
+        TopK_Free(&(t->TopClients));
+    }
+}
+
+static void DomainStatistic_Sum(StatisticTable *t,
+                                const char *Domain,
+                                const uint32_t *HashValue,
+                                const DomainInfo *Delta
+                                )
+{
+    DomainInfo *ExistInfo;
+
+    if( MaxEntries != 0 )
+    {
+        /* Ranked by queries, blocked messages only count for domains held */
+        ExistInfo = TopK_Add(&(t->TopDomains),
+                             Domain,
+                             HashValue == NULL ? HASH(Domain, 0) : *HashValue,
+                             Delta->Count,
+                             0
+                             );
+        if( ExistInfo != NULL )
+        {
+            DomainStatistic_AddInfo(ExistInfo, Delta);
+        }
+    } else if( StringChunk_Match(&(t->Domains),
+                                 Domain,
+                                 HashValue,
+                                 (void **)&ExistInfo,
+                                 NULL,
+                                 NULL
+                                 )
+               == FALSE )
+    {
+        StringChunk_Add(&(t->Domains), Domain, (const char *)Delta, sizeof(DomainInfo));
+    } else {
+        if( ExistInfo != NULL )
+        {
+            DomainStatistic_AddInfo(ExistInfo, Delta);
+        }
+    }
+}
+
+/* Add up the summaries of `From' into `To', then empty them */
+static void DomainStatistic_MergeTop(TopK *To, TopK *From)
+{
+    const char *Str;
+    int Enum_Start = 0;
+    uint32_t Hash, Count, Error;
+    char *Data;
+
+    Str = TopK_Enum(From, &Enum_Start, &Hash, &Count, &Error, (void **)&Data);
+    while( Str != NULL )
+    {
+        char *ToData = TopK_Add(To, Str, Hash, Count, Error);
+
+        if( ToData != NULL && To == &(MainTable.TopDomains) )
+        {
+            DomainStatistic_AddInfo((DomainInfo *)ToData, (DomainInfo *)Data);
+        }
+
+        Str = TopK_Enum(From, &Enum_Start, &Hash, &Count, &Error, (void **)&Data);
+    }
+
+    TopK_Clear(From);
+}
+
+/* Add up the counts of all threads into `MainTable' */
+static void DomainStatistic_Merge(void)
+{
+    StatisticShard *First, *s, **Link;
+
+    /* Shards retired from now on are still counted into, they are dropped by
+     * the next merge.
+     */
+    EFFECTIVE_LOCK_GET(StatisticLock);
+    First = Shards;
+    for( s = First; s != NULL; s = s->Next )
+    {
+        s->Dropping = s->Retired;
+    }
+    EFFECTIVE_LOCK_RELEASE(StatisticLock);
+
+    for( s = First; s != NULL; s = s->Next )
+    {
+        StatisticTable *Current = s->Current;
+
+        (void)EPOCH_EXCHANGE(s->Current,
+                             Current == s->Tables ? s->Tables + 1 : s->Tables
+                             );
+    }
+
+    Epoch_Synchronize();
+
+    for( s = First; s != NULL; s = s->Next )
+    {
+        StatisticTable *Old = s->Current == s->Tables ? s->Tables + 1 : s->Tables;
+        const char *Str;
+        int32_t Enum_Start = 0;
+        DomainInfo *Info;
+        StringChunk Empty;
+
+        DomainStatistic_AddInfo(&(MainTable.Sum), &(Old->Sum));
+        memset(&(Old->Sum), 0, sizeof(DomainInfo));
+
+        if( MaxEntries != 0 )
+        {
+            DomainStatistic_MergeTop(&(MainTable.TopDomains), &(Old->TopDomains));
+            DomainStatistic_MergeTop(&(MainTable.TopClients), &(Old->TopClients));
+            continue;
+        }
+
+        Str = StringChunk_Enum_NoWildCard(&(Old->Domains), &Enum_Start, (void **)&Info);
+        while( Str != NULL )
+        {
+            if( Info != NULL && (Info->Count != 0 || Info->BlockedMsg != 0) )
+            {
+                DomainStatistic_Sum(&MainTable, Str, NULL, Info);
+                memset(Info, 0, sizeof(DomainInfo));
+            }
+
+            Str = StringChunk_Enum_NoWildCard(&(Old->Domains), &Enum_Start, (void **)&Info);
+        }
+
+        /* A thread only holds the domains queried since the last merge, the
+         * others are in `MainTable' already. If no empty table can be had,
+         * the zeroed one is kept.
+         */
+        if( StringChunk_Init(&Empty, NULL) == 0 )
+        {
+            StringChunk_Free(&(Old->Domains), TRUE);
+            Old->Domains = Empty;
+        }
+    }
+
+    /* Shards added since are before `First', and not dropped */
+    EFFECTIVE_LOCK_GET(StatisticLock);
+    Link = &Shards;
+    while( *Link != NULL )
+    {
+        s = *Link;
+
+        if( s->Dropping )
+        {
+            *Link = s->Next;
+            DomainStatistic_FreeTable(s->Tables);
+            DomainStatistic_FreeTable(s->Tables + 1);
+            SafeFree(s);
+        } else {
+            Link = &(s->Next);
+        }
+    }
+    EFFECTIVE_LOCK_RELEASE(StatisticLock);
+}
+
+static void DomainStatistic_PrintInfo(const char *Domain,
+                                      int Total,
+                                      const DomainInfo *Info,
+                                      const char *Error
+                                      )
+{
+    fprintf(MainFile,
+            "{"
+                "Domain:\"%s\","
+                "Total:%d,"
+                "RaF:%d,"
+                "Hosts:%d,"
+                "Cache:%d,"
+                "UDP:%d,"
+                "TCP:%d,"
+                "BlockedMsg:%d"
+                "%s"
+            "},",
+            Domain,
+            Total,
+            Info->Refused,
+            Info->Hosts,
+            Info->Cache,
+            Info->Udp,
+            Info->Tcp,
+            Info->BlockedMsg,
+            Error
+             );
+}
+
+static void DomainStatistic_PrintLatency(const char *Name,
+                                         const char *Upstream,
+                                         uint64_t Count,
+                                         uint64_t Sum,
+                                         const uint32_t *Percentiles,
+                                         uint32_t Max,
+                                         void *Unused
+                                         )
+{
+    fprintf(MainFile,
+            "{"
+                "Name:\"%s%s%s\","
+                "Count:%lu,"
+                "P50:%u,"
+                "P90:%u,"
+                "P99:%u,"
+                "P999:%u,"
+                "Max:%u"
+            "},",
+            Name,
+            Upstream == NULL ? "" : " ",
+            Upstream == NULL ? "" : Upstream,
+            (unsigned long)Count,
+            Percentiles[0],
+            Percentiles[1],
+            Percentiles[2],
+            Percentiles[3],
+            Max
+            );
+}
+
 static int DomainStatistic_Works(void *Unused, void *Unused2)
 {
     const char *Str;
     int32_t Enum_Start;
 
     DomainInfo *Info;
-    DomainInfo Sum;
+    DomainInfo *Sum = &(MainTable.Sum);
 
     unsigned long int GenerateTime_Num;
 
@@ -101,8 +410,6 @@ static int DomainStatistic_Works(void *Unused, void *Unused2)
 
     rewind(MainFile);
 
-    memset(&Sum, 0, sizeof(DomainInfo));
-
     GenerateTime_Num = time(NULL);
 
     fprintf(MainFile, "%s", PreOutput);
@@ -117,51 +424,55 @@ static int DomainStatistic_Works(void *Unused, void *Unused2)
 
     Enum_Start = 0;
 
-    EFFECTIVE_LOCK_GET(StatisticLock);
-    SkipStatistic = TRUE;
-    EFFECTIVE_LOCK_RELEASE(StatisticLock);
+    DomainStatistic_Merge();
 
-    Str = StringChunk_Enum_NoWildCard(&MainChunk, &Enum_Start, (void **)&Info);
-    while( Str != NULL )
+    if( MaxEntries != 0 )
     {
-        if( Info != NULL )
+        uint32_t Count, Error;
+        char ErrorStr[32];
+
+        Str = TopK_Enum(&(MainTable.TopDomains), &Enum_Start, NULL, &Count, &Error, (void **)&Info);
+        while( Str != NULL )
         {
-            Sum.Count += Info->Count;
-            Sum.Refused += Info->Refused;
-            Sum.Hosts += Info->Hosts;
-            Sum.Cache += Info->Cache;
-            Sum.Udp += Info->Udp;
-            Sum.Tcp += Info->Tcp;
-            Sum.BlockedMsg += Info->BlockedMsg;
+            sprintf(ErrorStr, ",Error:%u", Error);
+            DomainStatistic_PrintInfo(Str, Count, Info, ErrorStr);
+
+            Str = TopK_Enum(&(MainTable.TopDomains), &Enum_Start, NULL, &Count, &Error, (void **)&Info);
+        }
+
+        fprintf(MainFile, "];var ClientArray = [");
 
+        Enum_Start = 0;
+        Str = TopK_Enum(&(MainTable.TopClients), &Enum_Start, NULL, &Count, &Error, NULL);
+        while( Str != NULL )
+        {
             fprintf(MainFile,
-                    "{"
-                        "Domain:\"%s\","
-                        "Total:%d,"
-                        "RaF:%d,"
-                        "Hosts:%d,"
-                        "Cache:%d,"
-                        "UDP:%d,"
-                        "TCP:%d,"
-                        "BlockedMsg:%d"
-                    "},",
+                    "{Client:\"%s\",Total:%u,Error:%u},",
                     Str,
-                    Info->Count,
-                    Info->Refused,
-                    Info->Hosts,
-                    Info->Cache,
-                    Info->Udp,
-                    Info->Tcp,
-                    Info->BlockedMsg
-                     );
+                    Count,
+                    Error
+                    );
+
+            Str = TopK_Enum(&(MainTable.TopClients), &Enum_Start, NULL, &Count, &Error, NULL);
         }
+    } else {
+        Str = StringChunk_Enum_NoWildCard(&(MainTable.Domains), &Enum_Start, (void **)&Info);
+        while( Str != NULL )
+        {
+            if( Info != NULL )
+            {
+                DomainStatistic_PrintInfo(Str, Info->Count, Info, "");
+            }
 
-        Str = StringChunk_Enum_NoWildCard(&MainChunk, &Enum_Start, (void **)&Info);
+            Str = StringChunk_Enum_NoWildCard(&(MainTable.Domains), &Enum_Start, (void **)&Info);
+        }
+
+        fprintf(MainFile, "];var ClientArray = [");
     }
 
-    EFFECTIVE_LOCK_GET(StatisticLock);
-    SkipStatistic = FALSE;
-    EFFECTIVE_LOCK_RELEASE(StatisticLock);
+    /* Microseconds */
+    fprintf(MainFile, "];var LatencyArray = [");
+    Latency_Enum(DomainStatistic_PrintLatency, NULL);
 
     fprintf(MainFile, "];");
 
@@ -172,16 +483,18 @@ static int DomainStatistic_Works(void *Unused, void *Unused2)
                         "Cache      :   %d,"
                         "UDP        :   %d,"
                         "TCP        :   %d,"
-                        "BlockedMsg :   %d"
+                        "BlockedMsg :   %d,"
+                        "MaxEntries :   %d"
                         "};"
             "</script>",
-            Sum.Count,
-            Sum.Refused,
-            Sum.Hosts,
-            Sum.Cache,
-            Sum.Udp,
-            Sum.Tcp,
-            Sum.BlockedMsg
+            Sum->Count,
+            Sum->Refused,
+            Sum->Hosts,
+            Sum->Cache,
+            Sum->Udp,
+            Sum->Tcp,
+            Sum->BlockedMsg,
+            MaxEntries
             );
 
     fprintf(MainFile, "%s", PostOutput);
@@ -223,6 +536,14 @@ int DomainStatistic_Init(ConfigFileInfo *ConfigInfo)
         return 1;
     }
 
+    MaxEntries = ConfigGetInt32(ConfigInfo, "StatisticMaxEntries");
+
+    if( MaxEntries < 0 )
+    {
+        ERRORMSG("`StatisticMaxEntries' should not be negative.\n");
+        return 1;
+    }
+
     if( GetPreAndPost(ConfigInfo) != 0 )
     {
         WARNING("Domain statistic init failed, it may due to lack of memory or templet file.\n");
@@ -244,12 +565,19 @@ int DomainStatistic_Init(ConfigFileInfo *ConfigInfo)
     }
 
     EFFECTIVE_LOCK_INIT(StatisticLock);
-    StringChunk_Init(&MainChunk, NULL);
+
+    if( DomainStatistic_InitTable(&MainTable) != 0 )
+    {
+        fclose(MainFile);
+        MainFile = NULL;
+        ERRORMSG("Domain statistic init failed.\n");
+        return 4;
+    }
 
     InitTime_Num = time(NULL);
-    SkipStatistic = FALSE;
 
-    TimedTask_Add(TRUE,
+    TimedTask_Add("domain statistic",
+                  TRUE,
                   FALSE,
                   OutputInterval * 1000,
                   DomainStatistic_Works,
@@ -261,108 +589,134 @@ int DomainStatistic_Init(ConfigFileInfo *ConfigInfo)
     return 0;
 }
 
+static StatisticShard *DomainStatistic_NewShard(void)
+{
+    StatisticShard *s = SafeMalloc(sizeof(StatisticShard));
+
+    if( s == NULL )
+    {
+        return NULL;
+    }
+
+    if( DomainStatistic_InitTable(s->Tables) != 0 )
+    {
+        SafeFree(s);
+        return NULL;
+    }
+
+    if( DomainStatistic_InitTable(s->Tables + 1) != 0 )
+    {
+        DomainStatistic_FreeTable(s->Tables);
+        SafeFree(s);
+        return NULL;
+    }
+
+    s->Current = s->Tables;
+    s->Retired = FALSE;
+    s->Dropping = FALSE;
+
+    EFFECTIVE_LOCK_GET(StatisticLock);
+    s->Next = Shards;
+    Shards = s;
+    EFFECTIVE_LOCK_RELEASE(StatisticLock);
+
+    return s;
+}
+
 int DomainStatistic_Add(IHeader *h, StatisticType Type)
 {
-    DomainInfo *ExistInfo;
+    StatisticShard *s;
+    StatisticTable *t;
+    DomainInfo Delta;
 
-    if( MainFile == NULL || h == NULL )
+    if( h == NULL )
     {
         return 0;
     }
 
-    EFFECTIVE_LOCK_GET(StatisticLock);
+    Metrics_CountQuery(Type, h->Type);
+    QueryLog_Add(h, Type);
 
-    if( SkipStatistic == FALSE )
+    if( MainFile == NULL )
     {
+        return 0;
+    }
 
-        if( StringChunk_Match(&MainChunk,
-                              h->Domain,
-                              &(h->HashValue),
-                              (void **)&ExistInfo,
-                              NULL,
-                              NULL
-                              )
-            == FALSE )
+    s = ThreadShard;
+    if( s == NULL )
+    {
+        s = DomainStatistic_NewShard();
+        if( s == NULL )
         {
-            DomainInfo NewInfo;
+            return -1;
+        }
 
-            memset(&NewInfo, 0, sizeof(DomainInfo));
+        ThreadShard = s;
+    }
 
-            switch( Type )
-            {
-                case STATISTIC_TYPE_REFUSED:
-                    NewInfo.Count = 1;
-                    NewInfo.Refused = 1;
-                    break;
-
-                case STATISTIC_TYPE_HOSTS:
-                    NewInfo.Count = 1;
-                    NewInfo.Hosts = 1;
-                    break;
-
-                case STATISTIC_TYPE_CACHE:
-                    NewInfo.Count = 1;
-                    NewInfo.Cache = 1;
-                    break;
-
-                case STATISTIC_TYPE_UDP:
-                    NewInfo.Count = 1;
-                    NewInfo.Udp = 1;
-                    break;
-
-                case STATISTIC_TYPE_TCP:
-                    NewInfo.Count = 1;
-                    NewInfo.Tcp = 1;
-                    break;
-
-                case STATISTIC_TYPE_BLOCKEDMSG:
-                    NewInfo.Count = 0;
-                    NewInfo.BlockedMsg = 1;
-                    break;
+    memset(&Delta, 0, sizeof(DomainInfo));
 
-            }
+    switch( Type )
+    {
+        case STATISTIC_TYPE_REFUSED:
+            Delta.Count = 1;
+            Delta.Refused = 1;
+            break;
+
+        case STATISTIC_TYPE_HOSTS:
+            Delta.Count = 1;
+            Delta.Hosts = 1;
+            break;
+
+        case STATISTIC_TYPE_CACHE:
+            Delta.Count = 1;
+            Delta.Cache = 1;
+            break;
+
+        case STATISTIC_TYPE_UDP:
+            Delta.Count = 1;
+            Delta.Udp = 1;
+            break;
+
+        case STATISTIC_TYPE_TCP:
+            Delta.Count = 1;
+            Delta.Tcp = 1;
+            break;
+
+        case STATISTIC_TYPE_BLOCKEDMSG:
+            Delta.BlockedMsg = 1;
+            break;
+    }
 
-            StringChunk_Add(&MainChunk, h->Domain, (const char *)&NewInfo, sizeof(DomainInfo));
-        } else {
-            if( ExistInfo != NULL )
-            {
-                switch( Type )
-                {
-                    case STATISTIC_TYPE_REFUSED:
-                        ++(ExistInfo->Count);
-                        ++(ExistInfo->Refused);
-                        break;
-
-                    case STATISTIC_TYPE_HOSTS:
-                        ++(ExistInfo->Count);
-                        ++(ExistInfo->Hosts);
-                        break;
-
-                    case STATISTIC_TYPE_CACHE:
-                        ++(ExistInfo->Count);
-                        ++(ExistInfo->Cache);
-                        break;
-
-                    case STATISTIC_TYPE_UDP:
-                        ++(ExistInfo->Count);
-                        ++(ExistInfo->Udp);
-                        break;
-
-                    case STATISTIC_TYPE_TCP:
-                        ++(ExistInfo->Count);
-                        ++(ExistInfo->Tcp);
-                        break;
-
-                    case STATISTIC_TYPE_BLOCKEDMSG:
-                        ++(ExistInfo->BlockedMsg);
-                        break;
-                }
-            }
-        }
+    Epoch_Enter();
+
+    t = EPOCH_LOAD(s->Current);
+
+    DomainStatistic_AddInfo(&(t->Sum), &Delta);
+    DomainStatistic_Sum(t, h->Domain, &(h->HashValue), &Delta);
 
+    if( MaxEntries != 0 && *IHeader_GetAgent(h) != '\0' )
+    {
+        TopK_Add(&(t->TopClients), h->Agent, HASH(h->Agent, 0), Delta.Count, 0);
     }
 
-    EFFECTIVE_LOCK_RELEASE(StatisticLock);
+    Epoch_Leave();
 
     return 0;
 }
+
+void DomainStatistic_Retire(void)
+{
+    StatisticShard *s = ThreadShard;
+
+    if( s == NULL )
+    {
+        return;
+    }
+
+    ThreadShard = NULL;
+
+    EFFECTIVE_LOCK_GET(StatisticLock);
+    s->Retired = TRUE;
+    EFFECTIVE_LOCK_RELEASE(StatisticLock);
+}
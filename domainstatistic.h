@@ -18,4 +18,9 @@ int DomainStatistic_Init(ConfigFileInfo *ConfigInfo);
 
 int DomainStatistic_Add(IHeader *h, StatisticType Type);
 
+/* Called by a thread which has added and is exiting, its counts are freed
+ * once they are written out.
+ */
+void DomainStatistic_Retire(void);
+
 #endif /* DOMAINSTATISTIC_H_INCLUDED */
@@ -10,6 +10,7 @@
 
 #ifndef NODOWNLOAD
 #ifdef _WIN32
+#include <io.h>
 #else
 #include <limits.h>
 #ifdef DOWNLOAD_LIBCURL
@@ -20,14 +21,155 @@
 #include <sys/wait.h>
 #endif /* DOWNLOAD_WGET */
 #endif
-#include "common.h"
-#include "utils.h"
+#include <ctype.h>
 #endif /* NODOWNLOAD */
 
+#include <stdio.h>
 #include <string.h>
+#include "common.h"
+#include "utils.h"
 #include "downloader.h"
 #include "logs.h"
 
+/* Validators are kept a line per URL, "URL\tETag\tLast-Modified" */
+static char *Validators_File(const char *File)
+{
+    char *Path = SafeMalloc(strlen(File) + sizeof(".validators"));
+
+    if( Path != NULL )
+    {
+        strcpy(Path, File);
+        strcat(Path, ".validators");
+    }
+
+    return Path;
+}
+
+/* Return the number of URLs which have got validators */
+static int Validators_Load(const char **URLs,
+                           const char *File,
+                           DownloadValidators *Validators
+                           )
+{
+    char *Path = Validators_File(File);
+    FILE *fp;
+    char Line[1024];
+    int Count = 0;
+
+    if( Path == NULL )
+    {
+        return 0;
+    }
+
+    fp = fopen(Path, "r");
+    SafeFree(Path);
+    if( fp == NULL )
+    {
+        return 0;
+    }
+
+    while( fgets(Line, sizeof(Line), fp) != NULL )
+    {
+        char *ETag, *LastModified;
+        int loop;
+
+        ETag = strchr(Line, '\t');
+        if( ETag == NULL )
+        {
+            continue;
+        }
+        *ETag++ = '\0';
+
+        LastModified = strchr(ETag, '\t');
+        if( LastModified == NULL )
+        {
+            continue;
+        }
+        *LastModified++ = '\0';
+        LastModified[strcspn(LastModified, "\r\n")] = '\0';
+
+        if( strlen(ETag) >= sizeof(Validators->ETag) ||
+            strlen(LastModified) >= sizeof(Validators->LastModified)
+            )
+        {
+            continue;
+        }
+
+        for( loop = 0; URLs[loop] != NULL; ++loop )
+        {
+            DownloadValidators *v = Validators + loop;
+
+            if( strcmp(URLs[loop], Line) == 0 &&
+                *(v->ETag) == '\0' && *(v->LastModified) == '\0'
+                )
+            {
+                strcpy(v->ETag, ETag);
+                strcpy(v->LastModified, LastModified);
+                if( *ETag != '\0' || *LastModified != '\0' )
+                {
+                    ++Count;
+                }
+                break;
+            }
+        }
+    }
+
+    fclose(fp);
+
+    return Count;
+}
+
+static void Validators_Save(const char **URLs,
+                            const char *File,
+                            const DownloadValidators *Validators
+                            )
+{
+    char *Path = Validators_File(File);
+    FILE *fp;
+    int loop;
+
+    if( Path == NULL )
+    {
+        return;
+    }
+
+    fp = fopen(Path, "w");
+    if( fp == NULL )
+    {
+        ERRORMSG("Cannot save %s\n", Path);
+        SafeFree(Path);
+        return;
+    }
+
+    for( loop = 0; URLs[loop] != NULL; ++loop )
+    {
+        const DownloadValidators *v = Validators + loop;
+
+        if( *(v->ETag) != '\0' || *(v->LastModified) != '\0' )
+        {
+            fprintf(fp, "%s\t%s\t%s\n", URLs[loop], v->ETag, v->LastModified);
+        }
+    }
+
+    fclose(fp);
+    SafeFree(Path);
+}
+
+static int AppendNewLine(const char *File)
+{
+    FILE *fp = fopen(File, "a+");
+
+    if( fp == NULL )
+    {
+        return -1;
+    }
+
+    fputc('\n', fp);
+    fclose(fp);
+
+    return 0;
+}
+
 int GetFromInternet_MultiFiles(const char   **URLs,
                                const char   *File,
                                int          RetryInterval,
@@ -38,7 +180,14 @@ int GetFromInternet_MultiFiles(const char   **URLs,
 {
     int State = FALSE;
     FILE *fp;
-    char *TempFile;
+    char *TempFile, *PartFile;
+    DownloadValidators *Validators;
+    int Count, loop;
+
+    /* Until a URL has changed, nothing is written */
+    BOOL Checking;
+
+    for( Count = 0; URLs[Count] != NULL; ++Count );
 
     TempFile = SafeMalloc(strlen(File) + sizeof(".tmp") + 1);
     if( TempFile == NULL )
@@ -50,6 +199,25 @@ int GetFromInternet_MultiFiles(const char   **URLs,
     strcpy(TempFile, File);
     strcat(TempFile, ".tmp");
 
+    PartFile = SafeMalloc(strlen(File) + sizeof(".part") + 1);
+    Validators = SafeMalloc(sizeof(DownloadValidators) * (Count + 1));
+    if( PartFile == NULL || Validators == NULL )
+    {
+        SafeFree(TempFile);
+        SafeFree(PartFile);
+        SafeFree(Validators);
+        return -1;
+    }
+
+    strcpy(PartFile, File);
+    strcat(PartFile, ".part");
+
+    memset(Validators, 0, sizeof(DownloadValidators) * (Count + 1));
+
+    Checking = Count > 0 &&
+               FileIsReadable(File) &&
+               Validators_Load(URLs, File, Validators) == Count;
+
     fp = fopen(TempFile, "w");
     if( fp != NULL )
     {
@@ -57,42 +225,154 @@ int GetFromInternet_MultiFiles(const char   **URLs,
     } else {
         ERRORMSG("Cannot create temp file %s\n", TempFile);
         SafeFree(TempFile);
+        SafeFree(PartFile);
+        SafeFree(Validators);
         return -2;
     }
 
-    while( *URLs != NULL )
+    for( loop = 0; loop != Count; ++loop )
     {
-        State |= !GetFromInternet_SingleFile(*URLs, TempFile, TRUE, RetryInterval, RetryTimes, ErrorCallBack, SuccessCallBack);
+        int Ret;
 
-        fp = fopen(TempFile, "a+");
-        if( fp != NULL )
+        /* Needed in full once one has changed */
+        if( !Checking )
+        {
+            memset(Validators + loop, 0, sizeof(DownloadValidators));
+        }
+
+        Ret = GetFromInternet_SingleFile(URLs[loop], TempFile, TRUE, Validators + loop, RetryInterval, RetryTimes, ErrorCallBack, SuccessCallBack);
+
+        if( Checking )
+        {
+            int Previous;
+
+            if( Ret == GET_FROM_INTERNET_NOT_MODIFIED )
+            {
+                continue;
+            }
+
+            Checking = FALSE;
+
+            /* The ones not modified before this one are not in `TempFile' */
+            if( loop > 0 )
+            {
+                remove(PartFile);
+                if( rename(TempFile, PartFile) != 0 )
+                {
+                    break;
+                }
+
+                fp = fopen(TempFile, "w");
+                if( fp == NULL )
+                {
+                    break;
+                }
+                fclose(fp);
+
+                for( Previous = 0; Previous != loop; ++Previous )
+                {
+                    memset(Validators + Previous, 0, sizeof(DownloadValidators));
+
+                    State |= !GetFromInternet_SingleFile(URLs[Previous], TempFile, TRUE, Validators + Previous, RetryInterval, RetryTimes, ErrorCallBack, SuccessCallBack);
+
+                    if( AppendNewLine(TempFile) != 0 )
+                    {
+                        break;
+                    }
+                }
+
+                if( CopyAFile(PartFile, TempFile, TRUE) != 0 )
+                {
+                    break;
+                }
+
+                remove(PartFile);
+            }
+        }
+
+        if( Ret != 0 )
+        {
+            /* Asked for again in full next time */
+            memset(Validators + loop, 0, sizeof(DownloadValidators));
+        }
+
+        State |= (Ret == 0);
+
+        if( AppendNewLine(TempFile) != 0 )
         {
-            fputc('\n', fp);
-            fclose(fp);
-        } else {
             break;
         }
+    }
 
-        ++URLs;
+    if( Checking )
+    {
+        remove(TempFile);
+        SafeFree(TempFile);
+        SafeFree(PartFile);
+        SafeFree(Validators);
+        return GET_FROM_INTERNET_NOT_MODIFIED;
     }
 
     if( State && TRUE )
     {
         remove(File);
         rename(TempFile, File);
+        Validators_Save(URLs, File, Validators);
     }
 
+    remove(PartFile);
     SafeFree(TempFile);
+    SafeFree(PartFile);
+    SafeFree(Validators);
     return !State;
 }
 
-int GetFromInternet_SingleFile(const char   *URL,
-                               const char   *File,
-                               BOOL         Append,
-                               int          RetryInterval,
-                               int          RetryTimes,
-                               void         (*ErrorCallBack)(int ErrorCode, const char *URL, const char *File),
-                               void         (*SuccessCallBack)(const char *URL, const char *File)
+static long FileLength(const char *File)
+{
+    FILE *fp = fopen(File, "ab");
+    long Length;
+
+    if( fp == NULL )
+    {
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    Length = ftell(fp);
+    fclose(fp);
+
+    return Length;
+}
+
+/* Cut what a failed download has left at the end of `File' */
+static int TruncateFile(const char *File, long Length)
+{
+#ifdef _WIN32
+    FILE *fp = fopen(File, "r+b");
+    int ret;
+
+    if( fp == NULL )
+    {
+        return -1;
+    }
+
+    ret = _chsize(_fileno(fp), Length);
+    fclose(fp);
+
+    return ret;
+#else /* _WIN32 */
+    return truncate(File, Length);
+#endif /* _WIN32 */
+}
+
+int GetFromInternet_SingleFile(const char           *URL,
+                               const char           *File,
+                               BOOL                 Append,
+                               DownloadValidators   *Validators,
+                               int                  RetryInterval,
+                               int                  RetryTimes,
+                               void                 (*ErrorCallBack)(int ErrorCode, const char *URL, const char *File),
+                               void                 (*SuccessCallBack)(const char *URL, const char *File)
                                )
 {
     if( strncmp(URL, "file", 4) == 0 )
@@ -127,20 +407,31 @@ int GetFromInternet_SingleFile(const char   *URL,
         return 0;
     } else {
         int Ret = -1;
-        char *TempFile;
-        TempFile = SafeMalloc(strlen(File) + sizeof(".tmp") + 1);
-        if( TempFile == NULL )
+        long Length;
+
+        if( !Append )
+        {
+            FILE *fp = fopen(File, "wb");
+
+            if( fp == NULL )
+            {
+                return -1;
+            }
+
+            fclose(fp);
+        }
+
+        Length = FileLength(File);
+        if( Length < 0 )
         {
             return -1;
         }
-        strcpy(TempFile, File);
-        strcat(TempFile, ".tmp");
 
         while( RetryTimes != 0 )
         {
             int DownloadState = 0;
 
-            DownloadState = GetFromInternet_Base(URL, TempFile);
+            DownloadState = GetFromInternet_Base(URL, File, Validators);
             if( DownloadState == 0 )
             {
                 if( SuccessCallBack != NULL )
@@ -148,7 +439,14 @@ int GetFromInternet_SingleFile(const char   *URL,
                     SuccessCallBack(URL, File);
                 }
 
-                if( CopyAFile(TempFile, File, Append) != 0 )
+                Ret = 0;
+                break;
+            } else if( DownloadState == GET_FROM_INTERNET_NOT_MODIFIED )
+            {
+                Ret = GET_FROM_INTERNET_NOT_MODIFIED;
+                break;
+            } else {
+                if( TruncateFile(File, Length) != 0 )
                 {
                     if( ErrorCallBack != NULL )
                     {
@@ -157,11 +455,8 @@ int GetFromInternet_SingleFile(const char   *URL,
 
                     Ret = -1;
                     break;
-                } else {
-                    Ret = 0;
-                    break;
                 }
-            } else {
+
                 if( RetryTimes > 0 )
                 {
                     --RetryTimes;
@@ -176,12 +471,98 @@ int GetFromInternet_SingleFile(const char   *URL,
             }
         }
 
-        remove(TempFile);
-        SafeFree(TempFile);
         return Ret;
     }
 }
 
+#ifndef NODOWNLOAD
+/* Copy the value of a header, dropping ones that could not be sent back
+ * as they are
+ */
+static void Validators_Copy(char *To, int Size, const char *Value)
+{
+    int n = 0;
+
+    for( ; *Value == ' ' || *Value == '\t'; ++Value );
+
+    for( ; *Value != '\0' && *Value != '\r' && *Value != '\n'; ++Value )
+    {
+        if( n == Size - 1 || *Value == '\t' || *Value == '\'' )
+        {
+            n = 0;
+            break;
+        }
+
+        To[n++] = *Value;
+    }
+
+    for( ; n > 0 && isspace(To[n - 1]); --n );
+
+    To[n] = '\0';
+}
+
+static BOOL Validators_HeaderIs(const char *Line, const char *Name)
+{
+    for( ; *Name != '\0'; ++Line, ++Name )
+    {
+        if( tolower(*Line) != tolower(*Name) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Take `ETag' or `Last-Modified' of a response header line */
+static void Validators_Take(DownloadValidators *Validators, const char *Line)
+{
+    for( ; *Line == ' ' || *Line == '\t'; ++Line );
+
+    if( Validators_HeaderIs(Line, "ETag:") )
+    {
+        Validators_Copy(Validators->ETag,
+                        sizeof(Validators->ETag),
+                        Line + sizeof("ETag:") - 1
+                        );
+    } else if( Validators_HeaderIs(Line, "Last-Modified:") )
+    {
+        Validators_Copy(Validators->LastModified,
+                        sizeof(Validators->LastModified),
+                        Line + sizeof("Last-Modified:") - 1
+                        );
+    }
+}
+
+/* Request headers asking for a download only if it changed, "" for none */
+static void Validators_Headers(const DownloadValidators *Validators,
+                               char *Buffer, /* 256 bytes at least */
+                               const char *Format /* "%s: %s" and a separator */
+                               )
+{
+    *Buffer = '\0';
+
+    if( Validators == NULL )
+    {
+        return;
+    }
+
+    if( *(Validators->ETag) != '\0' )
+    {
+        sprintf(Buffer, Format, "If-None-Match", Validators->ETag);
+    }
+
+    if( *(Validators->LastModified) != '\0' )
+    {
+        sprintf(Buffer + strlen(Buffer),
+                Format,
+                "If-Modified-Since",
+                Validators->LastModified
+                );
+    }
+}
+#endif /* NODOWNLOAD */
+
 #ifdef DOWNLOAD_LIBCURL
 static size_t WriteFileCallback(void *Contents,
                                 size_t Size,
@@ -193,9 +574,38 @@ static size_t WriteFileCallback(void *Contents,
     fwrite(Contents, Size, nmemb, fp);
     return Size * nmemb;
 }
+
+static size_t HeaderCallback(char *Contents,
+                             size_t Size,
+                             size_t nmemb,
+                             void *Validators
+                             )
+{
+    char Line[256];
+    size_t Length = Size * nmemb;
+
+    if( Length < sizeof(Line) )
+    {
+        memcpy(Line, Contents, Length);
+        Line[Length] = '\0';
+
+        /* A new response, after a redirection */
+        if( strncmp(Line, "HTTP/", 5) == 0 )
+        {
+            memset(Validators, 0, sizeof(DownloadValidators));
+        }
+
+        Validators_Take(Validators, Line);
+    }
+
+    return Length;
+}
 #endif /* DOWNLOAD_LIBCURL */
 
-int GetFromInternet_Base(const char *URL, const char *File)
+int GetFromInternet_Base(const char *URL,
+                         const char *File,
+                         DownloadValidators *Validators
+                         )
 {
 #ifndef NODOWNLOAD
 #   ifdef _WIN32
@@ -206,6 +616,7 @@ int GetFromInternet_Base(const char *URL, const char *File)
     char        Buffer[4096];
     int         ret = 0;
     int         TimeOut = 30000;
+    DWORD       StatusCode = 0, Length;
 
     webopen = InternetOpen("dnsforwarder", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
     if( webopen == NULL ){
@@ -213,7 +624,9 @@ int GetFromInternet_Base(const char *URL, const char *File)
         goto Exit_1;
     }
 
-    webopenurl = InternetOpenUrl(webopen, URL, NULL, 0, INTERNET_FLAG_RELOAD, 0);
+    Validators_Headers(Validators, Buffer, "%s: %s\r\n");
+
+    webopenurl = InternetOpenUrl(webopen, URL, *Buffer == '\0' ? NULL : Buffer, (DWORD)-1, INTERNET_FLAG_RELOAD, 0);
     if( webopenurl == NULL ){
         ret = -1 * (int)GetLastError();
         goto Exit_2;
@@ -221,7 +634,35 @@ int GetFromInternet_Base(const char *URL, const char *File)
 
     InternetSetOption(webopenurl, INTERNET_OPTION_CONNECT_TIMEOUT, &TimeOut, sizeof(TimeOut));
 
-    fp = fopen(File, "wb" );
+    /* Fails with URLs other than HTTP ones */
+    Length = sizeof(StatusCode);
+    HttpQueryInfo(webopenurl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &StatusCode, &Length, NULL);
+    if( StatusCode == 304 )
+    {
+        ret = GET_FROM_INTERNET_NOT_MODIFIED;
+        goto Exit_2;
+    }
+
+    if( Validators != NULL )
+    {
+        memset(Validators, 0, sizeof(DownloadValidators));
+
+        Length = sizeof(Buffer) - 1;
+        if( HttpQueryInfo(webopenurl, HTTP_QUERY_ETAG, Buffer, &Length, NULL) )
+        {
+            Buffer[Length] = '\0';
+            Validators_Copy(Validators->ETag, sizeof(Validators->ETag), Buffer);
+        }
+
+        Length = sizeof(Buffer) - 1;
+        if( HttpQueryInfo(webopenurl, HTTP_QUERY_LAST_MODIFIED, Buffer, &Length, NULL) )
+        {
+            Buffer[Length] = '\0';
+            Validators_Copy(Validators->LastModified, sizeof(Validators->LastModified), Buffer);
+        }
+    }
+
+    fp = fopen(File, "ab" );
     if( fp == NULL )
     {
         ret = -1 * (int)GetLastError();
@@ -259,10 +700,13 @@ Exit_1:
 #       ifdef DOWNLOAD_LIBCURL
     CURL *curl;
     CURLcode res;
+    struct curl_slist *Headers = NULL;
+    char Buffer[320];
+    long StatusCode = 0;
 
     FILE *fp;
 
-    fp = fopen(File, "w");
+    fp = fopen(File, "ab");
     if( fp == NULL )
     {
         return -1;
@@ -275,32 +719,114 @@ Exit_1:
         return -2;
     }
 
+    Validators_Headers(Validators, Buffer, "%s: %s\n");
+    if( *Buffer != '\0' )
+    {
+        char *Line;
+
+        for( Line = strtok(Buffer, "\n"); Line != NULL; Line = strtok(NULL, "\n") )
+        {
+            Headers = curl_slist_append(Headers, Line);
+        }
+
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, Headers);
+    }
+
     curl_easy_setopt(curl, CURLOPT_URL, URL);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1l);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteFileCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
 
+    if( Validators != NULL )
+    {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, Validators);
+    }
+
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
 
     res = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &StatusCode);
+
+    curl_easy_cleanup(curl);
+    curl_slist_free_all(Headers);
+    fclose(fp);
+
     if( res != CURLE_OK )
     {
-        curl_easy_cleanup(curl);
-        fclose(fp);
         return -3;
+    } else if( StatusCode == 304 )
+    {
+        return GET_FROM_INTERNET_NOT_MODIFIED;
     } else {
-        curl_easy_cleanup(curl);
-        fclose(fp);
         return 0;
     }
 #       endif /* DOWNLOAD_LIBCURL */
 #       ifdef DOWNLOAD_WGET
     char Cmd[2048];
+    char Headers[320];
+    char *LogFile;
+    FILE *fp;
+    int ret;
+    int StatusCode = 0;
+
+    LogFile = SafeMalloc(strlen(File) + sizeof(".log"));
+    if( LogFile == NULL )
+    {
+        return -1;
+    }
+
+    strcpy(LogFile, File);
+    strcat(LogFile, ".log");
+
+    /* Values with a `'' have been dropped */
+    Validators_Headers(Validators, Headers, "--header='%s: %s' ");
+
+    /* The body goes to the end of `File', server responses to `LogFile' */
+    sprintf(Cmd, "wget -t 2 -T 60 -S -o %s --no-check-certificate %s%s -O - >> %s ", LogFile, Headers, URL, File);
+
+    ret = Execute(Cmd);
+
+    fp = fopen(LogFile, "r");
+    if( fp != NULL )
+    {
+        char Line[320];
+
+        while( fgets(Line, sizeof(Line), fp) != NULL )
+        {
+            /* A new response, after a redirection */
+            if( strncmp(Line, "  HTTP/", 7) == 0 )
+            {
+                const char *Code = strchr(Line + 7, ' ');
+
+                StatusCode = Code == NULL ? 0 : atoi(Code);
+
+                if( Validators != NULL && StatusCode != 304 )
+                {
+                    memset(Validators, 0, sizeof(DownloadValidators));
+                }
+            } else if( Validators != NULL &&
+                       StatusCode != 304 &&
+                       strncmp(Line, "  ", 2) == 0
+                       )
+            {
+                Validators_Take(Validators, Line);
+            }
+        }
+
+        fclose(fp);
+    }
 
-    sprintf(Cmd, "wget -t 2 -T 60 -q --no-check-certificate %s -O %s ", URL, File);
+    remove(LogFile);
+    SafeFree(LogFile);
 
-    return Execute(Cmd);
+    if( StatusCode == 304 )
+    {
+        return GET_FROM_INTERNET_NOT_MODIFIED;
+    }
+
+    return ret;
 #       endif /* DOWNLOAD_WGET */
 #   endif /* _WIN32 */
 #else /* NODOWNLOAD */
@@ -3,6 +3,23 @@
 
 #include "common.h"
 
+/* What a server told of a download, sent back to get it only if it changed
+ * since. Both empty for none.
+ */
+typedef struct _DownloadValidators{
+    char    ETag[128];
+    char    LastModified[64];
+} DownloadValidators;
+
+/* Returned instead of 0 if the server says nothing changed (HTTP 304) */
+#define GET_FROM_INTERNET_NOT_MODIFIED  304
+
+/* Download `URLs' one after another into `File'.
+ *
+ * The validators of each URL are kept in `File'.validators, and once `File'
+ * is complete, the URLs are asked for only if they changed. If none did,
+ * `File' is left alone and `GET_FROM_INTERNET_NOT_MODIFIED' is returned.
+ */
 int GetFromInternet_MultiFiles(const char   **URLs,
                                const char   *File,
                                int          RetryInterval,
@@ -11,16 +28,23 @@ int GetFromInternet_MultiFiles(const char   **URLs,
                                void         (*SuccessCallBack)(const char *URL, const char *File)
                                );
 
-int GetFromInternet_SingleFile(const char   *URL,
-                               const char   *File,
-                               BOOL         Append,
-                               int          RetryInterval,
-                               int          RetryTimes,
-                               void         (*ErrorCallBack)(int ErrorCode, const char *URL, const char *File),
-                               void         (*SuccessCallBack)(const char *URL, const char *File)
+/* `Validators' could be NULL. If not, the download is conditional as far as
+ * they are known, and they get the new ones when it is done.
+ */
+int GetFromInternet_SingleFile(const char           *URL,
+                               const char           *File,
+                               BOOL                 Append,
+                               DownloadValidators   *Validators,
+                               int                  RetryInterval,
+                               int                  RetryTimes,
+                               void                 (*ErrorCallBack)(int ErrorCode, const char *URL, const char *File),
+                               void                 (*SuccessCallBack)(const char *URL, const char *File)
                                );
 
-int GetFromInternet_Base(const char *URL, const char *File);
+/* Write what is downloaded to the end of `File', without a copy in between */
+int GetFromInternet_Base(const char *URL,
+                         const char *File,
+                         DownloadValidators *Validators
+                         );
 
 #endif /* DOWNLOADER_H_INCLUDED */
-
@@ -2,104 +2,244 @@
 #include "dynamichosts.h"
 #include "common.h"
 #include "downloader.h"
-#include "readline.h"
+#include "hostsloader.h"
 #include "goodiplist.h"
 #include "timedtask.h"
-#include "rwlock.h"
 #include "logs.h"
 #include "filter.h"
 #include "ipmisc.h"
 #include "mmgr.h"
+#include "region.h"
+#include "epoch.h"
+#include "filestamp.h"
+#include "ptimer.h"
+#include "metrics.h"
 
 #define SIZE_OF_PATH_BUFFER 384
 
+/* Changes to more than one record in this many are loaded in full */
+#define DYNAMIC_HOSTS_PATCH_RATIO   16
+
 static const char   *File = NULL;
-static RWLock       HostsLock = NULL_RWLOCK;
-static volatile HostsContainer  *MainDynamicContainer = NULL;
+
+/* Hosts loaded in full, which later changes are made over */
+typedef struct _DynamicHostsBase{
+    HostsContainer  Container;
+    Array           Keys;   /* Of its records, see `HostsLoader_Patch' */
+    Region          Memory; /* Where all of it is built */
+} DynamicHostsBase;
+
+/* A generation of hosts, replaced as a whole */
+typedef struct _DynamicHostsSet{
+    HostsContainer  *Hosts; /* `&(Base->Container)' or `&Patch' */
+
+    DynamicHostsBase    *Base;
+
+    HostsContainer  Patch;  /* Changes over `Base', if patched */
+    Region          Memory; /* Where `Patch' is built */
+} DynamicHostsSet;
+
+static DynamicHostsSet  *MainDynamicHosts = NULL;
+
+/* Both only touched by the loading thread */
+static DynamicHostsBase *CurrentBase = NULL;
+static FileStamp        Stamp;
 
 /* Arguments for updating  */
 static int          HostsRetryInterval;
 static char         Script[SIZE_OF_PATH_BUFFER] = "";
 static const char   **HostsURLs = NULL; /* malloced */
 
-static void DynamicHosts_ContainerCleanup(HostsContainer *DynamicContainer)
+static void DynamicHosts_BaseCleanup(DynamicHostsBase *Base)
+{
+    if( Base != NULL )
+    {
+        Base->Container.Free(&(Base->Container));
+        Region_Free(&(Base->Memory));
+        SafeFree(Base);
+    }
+}
+
+/* The base is not freed, it may still be used by the next generation */
+static void DynamicHosts_ContainerCleanup(DynamicHostsSet *Set)
 {
-    if( DynamicContainer != NULL )
+    if( Set != NULL )
     {
-        DynamicContainer->Free(DynamicContainer);
-        SafeFree(DynamicContainer);
+        if( Set->Hosts == &(Set->Patch) )
+        {
+            Set->Patch.Free(&(Set->Patch));
+        }
+
+        Region_Free(&(Set->Memory));
+        SafeFree(Set);
     }
 }
 
 static void DynamicHosts_Cleanup(void)
 {
-    DynamicHosts_ContainerCleanup((HostsContainer *)MainDynamicContainer);
+    DynamicHosts_ContainerCleanup(EPOCH_EXCHANGE(MainDynamicHosts, NULL));
+    DynamicHosts_BaseCleanup(CurrentBase);
+    CurrentBase = NULL;
     FreeCharPtrArray((char **)HostsURLs);
-    RWLock_Destroy(HostsLock);
 }
 
-static int DynamicHosts_Load(void)
+static DynamicHostsBase *DynamicHosts_LoadBase(void)
 {
-    FILE            *fp;
-    char            Buffer[320];
-    ReadLineStatus  Status;
+    DynamicHostsBase *Base;
+    Region *PreviousRegion;
 
-    HostsContainer *TempContainer;
+    Base = (DynamicHostsBase *)SafeMalloc(sizeof(DynamicHostsBase));
+    if( Base == NULL )
+    {
+        return NULL;
+    }
 
-    fp = fopen(File, "r");
-    if( fp == NULL )
+    /* All of it is built in one region, freed at once */
+    Region_Init(&(Base->Memory), 0);
+    PreviousRegion = Region_Enter(&(Base->Memory));
+
+    if( HostsContainer_Init(&(Base->Container)) != 0 )
     {
         goto EXIT_1;
     }
 
-    TempContainer = (HostsContainer *)SafeMalloc(sizeof(HostsContainer));
-    if( TempContainer == NULL )
+    if( Array_Init(&(Base->Keys), sizeof(uint64_t), 0, FALSE, NULL) != 0 )
     {
         goto EXIT_2;
     }
 
-    if( HostsContainer_Init(TempContainer) != 0 )
+    if( HostsLoader_LoadKeyed(&(Base->Container), File, 0, &(Base->Keys), NULL)
+        != 0 )
     {
-        SafeFree(TempContainer);
         goto EXIT_2;
     }
 
-    while( TRUE )
+    Base->Container.Compile(&(Base->Container));
+
+    Region_Leave(PreviousRegion);
+
+    return Base;
+
+EXIT_2:
+    Base->Container.Free(&(Base->Container));
+EXIT_1:
+    Region_Leave(PreviousRegion);
+    Region_Free(&(Base->Memory));
+    SafeFree(Base);
+    return NULL;
+}
+
+/* Make the changes of the file over the current base, 0 if done */
+static int DynamicHosts_Patch(DynamicHostsSet *Set)
+{
+    Region *PreviousRegion;
+    int ret;
+
+    PreviousRegion = Region_Enter(&(Set->Memory));
+
+    if( HostsContainer_InitDerived(&(Set->Patch), &(CurrentBase->Container))
+        != 0 )
     {
-        Status = ReadLine(fp, Buffer, sizeof(Buffer));
-        if( Status == READ_FAILED_OR_END )
-        {
-            break;
-        }
+        Region_Leave(PreviousRegion);
+        return -1;
+    }
 
-        if( Status == READ_TRUNCATED )
+    ret = HostsLoader_Patch(&(Set->Patch),
+                            File,
+                            &(CurrentBase->Keys),
+                            Array_GetUsed(&(CurrentBase->Keys)) /
+                                DYNAMIC_HOSTS_PATCH_RATIO,
+                            NULL
+                            );
+    if( ret != 0 )
+    {
+        Set->Patch.Free(&(Set->Patch));
+        Region_Leave(PreviousRegion);
+
+        if( ret == 1 )
+        {
+            INFO("Too many hosts changed, loading them in full.\n");
+        } else if( ret > 0 )
         {
-            ERRORMSG("Hosts is too long : %s\n", Buffer);
-            ReadLine_GoToNextLine(fp);
-            continue;
+            INFO("Hosts changes can't be patched, loading them in full.\n");
         }
 
-        TempContainer->Load(TempContainer, Buffer);
+        return ret;
+    }
+
+    Set->Patch.Compile(&(Set->Patch));
+
+    Region_Leave(PreviousRegion);
+
+    Set->Hosts = &(Set->Patch);
+    Set->Base = CurrentBase;
+
+    return 0;
+}
+
+/* TRUE if a new generation has been put in place */
+static BOOL DynamicHosts_Load(void)
+{
+    DynamicHostsSet *TempSet;
+    DynamicHostsBase *OldBase = NULL;
+
+    if( !FileStamp_Changed(&Stamp, File) )
+    {
+        INFO("Hosts file unchanged, not reloaded.\n");
+        return FALSE;
     }
 
-    fclose(fp);
+    TempSet = (DynamicHostsSet *)SafeMalloc(sizeof(DynamicHostsSet));
+    if( TempSet == NULL )
+    {
+        goto EXIT_1;
+    }
+
+    Region_Init(&(TempSet->Memory), 0);
+    TempSet->Hosts = NULL;
+
+    /* Small changes are made over the current base, leaving it untouched */
+    if( CurrentBase == NULL || DynamicHosts_Patch(TempSet) != 0 )
+    {
+        DynamicHostsBase *NewBase;
+
+        /* What a failed patch parsed would live as long as the new base.
+         * The region is left empty, ready to be used again.
+         */
+        Region_Free(&(TempSet->Memory));
 
-    RWLock_WrLock(HostsLock);
+        NewBase = DynamicHosts_LoadBase();
 
-    DynamicHosts_ContainerCleanup((HostsContainer *)MainDynamicContainer);
-    MainDynamicContainer = TempContainer;
+        if( NewBase == NULL )
+        {
+            goto EXIT_2;
+        }
+
+        OldBase = CurrentBase;
+        CurrentBase = NewBase;
 
-    RWLock_UnWLock(HostsLock);
+        TempSet->Hosts = &(NewBase->Container);
+        TempSet->Base = NewBase;
+    }
+
+    /* Queries go on with the old generation until they see the new one */
+    TempSet = EPOCH_EXCHANGE(MainDynamicHosts, TempSet);
+    Epoch_Synchronize();
+    DynamicHosts_ContainerCleanup(TempSet);
+    DynamicHosts_BaseCleanup(OldBase);
 
     INFO("Loading hosts completed.\n");
 
-    return 0;
+    return TRUE;
 
 EXIT_2:
-    fclose(fp);
+    Region_Free(&(TempSet->Memory));
+    SafeFree(TempSet);
 EXIT_1:
+    /* Tried again next time */
+    FileStamp_Init(&Stamp);
     INFO("Loading hosts failed.\n");
-    return -1;
+    return FALSE;
 }
 
 static void GetHostsFromInternet_Failed(int ErrorCode, const char *URL, const char *File1)
@@ -115,8 +255,34 @@ static void GetHostsFromInternet_Succeed(const char *URL, const char *File1)
     INFO("Hosts %s saved.\n", URL);
 }
 
+/* Those following the hosts, each timed */
+/* Only reloads which ran are recorded, not the checks finding nothing new */
+static void DynamicHosts_UpdateOthers(void)
+{
+    uint64_t Since;
+
+    Since = PTimer_MonotonicMicro();
+    if( Filter_Update() )
+    {
+        Metrics_RecordReload(METRICS_RELOAD_FILTER, Since);
+    }
+
+    Since = PTimer_MonotonicMicro();
+    if( IpMiscMapping_Update() )
+    {
+        Metrics_RecordReload(METRICS_RELOAD_IP_MISC, Since);
+    }
+
+    Since = PTimer_MonotonicMicro();
+    if( Modules_Update() )
+    {
+        Metrics_RecordReload(METRICS_RELOAD_GROUPS, Since);
+    }
+}
+
 static void GetHostsFromInternet_Thread(void *Unused1, void *Unused2)
 {
+    uint64_t    Since;
 #if !defined(TEST_RELOADING)
     int         DownloadState;
 
@@ -150,13 +316,22 @@ static void GetHostsFromInternet_Thread(void *Unused1, void *Unused2)
         }
 #endif
 
-        DynamicHosts_Load();
-        Filter_Update();
-        IpMiscMapping_Update();
-        Modules_Update();
+        Since = PTimer_MonotonicMicro();
+        if( DynamicHosts_Load() )
+        {
+            Metrics_RecordReload(METRICS_RELOAD_HOSTS, Since);
+        }
+
+        DynamicHosts_UpdateOthers();
 
         INFO("Reloading Modules completed.\n");
 #if !defined(TEST_RELOADING)
+    } else if( DownloadState == GET_FROM_INTERNET_NOT_MODIFIED )
+    {
+        /* Nothing downloaded, the hosts are kept as they are */
+        INFO("Hosts not modified since last time.\n");
+
+        DynamicHosts_UpdateOthers();
     } else {
         ERRORMSG("Getting hosts file(s) failed.\n");
     }
@@ -181,6 +356,8 @@ int DynamicHosts_Init(ConfigFileInfo *ConfigInfo)
     UpdateInterval = ConfigGetInt32(ConfigInfo, "ModulesUpdateInterval");
     HostsRetryInterval = ConfigGetInt32(ConfigInfo, "HostsRetryInterval");
 
+    FileStamp_Init(&Stamp);
+
     atexit(DynamicHosts_Cleanup);
 
     RawScript = ConfigGetRawString(ConfigInfo, "HostsScript");
@@ -195,7 +372,6 @@ int DynamicHosts_Init(ConfigFileInfo *ConfigInfo)
         *Script = 0;
     }
 
-    RWLock_Init(HostsLock);
 
     File = ConfigGetRawString(ConfigInfo, "HostsDownloadPath");
 
@@ -218,7 +394,8 @@ int DynamicHosts_Init(ConfigFileInfo *ConfigInfo)
 
     if( UpdateInterval <= 0 )
     {
-        TimedTask_Add(FALSE,
+        TimedTask_Add("hosts update",
+                      FALSE,
                       TRUE,
                       0,
                       (TaskFunc)GetHostsFromInternet_Thread,
@@ -226,7 +403,8 @@ int DynamicHosts_Init(ConfigFileInfo *ConfigInfo)
                       NULL,
                       TRUE);
     } else {
-        TimedTask_Add(TRUE,
+        TimedTask_Add("hosts update",
+                      TRUE,
                       TRUE,
                       UpdateInterval * 1000,
                       (TaskFunc)GetHostsFromInternet_Thread,
@@ -241,20 +419,23 @@ int DynamicHosts_Init(ConfigFileInfo *ConfigInfo)
 int DynamicHosts_GetCName(const char *Domain, char *Buffer)
 {
     int ret;
+    DynamicHostsSet *Set;
+
+    Epoch_Enter();
 
-    if( MainDynamicContainer == NULL )
+    Set = EPOCH_LOAD(MainDynamicHosts);
+    if( Set == NULL )
     {
+        Epoch_Leave();
         return -198;
     }
 
-    RWLock_RdLock(HostsLock);
-
     ret = HostsUtils_GetCName(Domain,
                               Buffer,
-                              (HostsContainer *)MainDynamicContainer
+                              Set->Hosts
                               );
 
-    RWLock_UnRLock(HostsLock);
+    Epoch_Leave();
 
     return ret;
 }
@@ -262,20 +443,23 @@ int DynamicHosts_GetCName(const char *Domain, char *Buffer)
 BOOL DynamicHosts_TypeExisting(const char *Domain, HostsRecordType Type)
 {
     BOOL ret;
+    DynamicHostsSet *Set;
+
+    Epoch_Enter();
 
-    if( MainDynamicContainer == NULL )
+    Set = EPOCH_LOAD(MainDynamicHosts);
+    if( Set == NULL )
     {
+        Epoch_Leave();
         return FALSE;
     }
 
-    RWLock_RdLock(HostsLock);
-
-    ret = HostsUtils_TypeExisting((HostsContainer *)MainDynamicContainer,
+    ret = HostsUtils_TypeExisting(Set->Hosts,
                                   Domain,
                                   Type
                                   );
 
-    RWLock_UnRLock(HostsLock);
+    Epoch_Leave();
 
     return ret;
 }
@@ -283,20 +467,23 @@ BOOL DynamicHosts_TypeExisting(const char *Domain, HostsRecordType Type)
 HostsUtilsTryResult DynamicHosts_Try(MsgContext *MsgCtx, int BufferLength)
 {
     HostsUtilsTryResult ret;
+    DynamicHostsSet *Set;
 
-    if( MainDynamicContainer == NULL )
+    Epoch_Enter();
+
+    Set = EPOCH_LOAD(MainDynamicHosts);
+    if( Set == NULL )
     {
+        Epoch_Leave();
         return HOSTSUTILS_TRY_NONE;
     }
 
-    RWLock_RdLock(HostsLock);
-
     ret = HostsUtils_Try(MsgCtx,
                          BufferLength,
-                         (HostsContainer *)MainDynamicContainer
+                         Set->Hosts
                          );
 
-    RWLock_UnRLock(HostsLock);
+    Epoch_Leave();
 
     return ret;
 }
@@ -0,0 +1,140 @@
+#include "epoch.h"
+
+#ifndef _WIN32
+    #include <sched.h>
+#endif /* _WIN32 */
+
+/* Threads in a section at the same time, see epoch.h for more of them */
+#define EPOCH_SLOTS         64
+
+#define EPOCH_CACHE_LINE    64
+
+#ifdef __GNUC__
+    #define EPOCH_GET(v)        __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+    #define EPOCH_CLEAR(v)      __atomic_store_n(&(v), 0, __ATOMIC_RELEASE)
+    #define EPOCH_ADD(v, n)     __atomic_add_fetch(&(v), (n), __ATOMIC_SEQ_CST)
+    #define EPOCH_FENCE()       __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else /* __GNUC__ */
+    #define EPOCH_GET(v)        (_ReadWriteBarrier(), (v))
+    #define EPOCH_CLEAR(v)      do { _ReadWriteBarrier(); (v) = 0; } while( 0 )
+    #define EPOCH_ADD(v, n)     ((uint32_t)InterlockedExchangeAdd((LONG volatile *)&(v), (n)) + (n))
+    #define EPOCH_FENCE()       MemoryBarrier()
+#endif /* __GNUC__ */
+
+#ifdef _WIN32
+    #define EPOCH_YIELD()   SwitchToThread()
+#else /* _WIN32 */
+    #define EPOCH_YIELD()   sched_yield()
+#endif /* _WIN32 */
+
+#ifdef _MSC_VER
+    #define EPOCH_THREAD_LOCAL  __declspec(thread)
+#else
+    #define EPOCH_THREAD_LOCAL  __thread
+#endif /* _MSC_VER */
+
+/* A slot holds the epoch its reader entered at, 0 if it's free. A reader
+ * takes any free slot, so threads which have exited hold none.
+ */
+typedef struct _Epoch_Slot{
+    volatile uint32_t   Epoch;
+    char                Padding[EPOCH_CACHE_LINE - sizeof(uint32_t)];
+} Epoch_Slot;
+
+static Epoch_Slot   Slots[EPOCH_SLOTS];
+
+/* Always odd, never 0 even after wrapping around */
+static volatile uint32_t    GlobalEpoch = 1;
+
+static volatile uint32_t    NextSlot = 0;
+
+static EPOCH_THREAD_LOCAL int   Depth = 0;
+static EPOCH_THREAD_LOCAL int   Slot = -1; /* Taken last time */
+
+static BOOL Epoch_Take(Epoch_Slot *s, uint32_t Epoch)
+{
+#ifdef __GNUC__
+    uint32_t Expected = 0;
+
+    return __atomic_compare_exchange_n(&(s->Epoch),
+                                       &Expected,
+                                       Epoch,
+                                       FALSE,
+                                       __ATOMIC_SEQ_CST,
+                                       __ATOMIC_RELAXED
+                                       );
+#else /* __GNUC__ */
+    return InterlockedCompareExchange((LONG volatile *)&(s->Epoch),
+                                      Epoch,
+                                      0
+                                      ) == 0;
+#endif /* __GNUC__ */
+}
+
+void Epoch_Enter(void)
+{
+    int Tried = 0;
+
+    if( Depth++ > 0 )
+    {
+        return;
+    }
+
+    if( Slot < 0 )
+    {
+        /* Spread threads over slots */
+        Slot = EPOCH_ADD(NextSlot, 1) % EPOCH_SLOTS;
+    }
+
+    while( Slots[Slot].Epoch != 0 ||
+           !Epoch_Take(Slots + Slot, EPOCH_GET(GlobalEpoch))
+           )
+    {
+        Slot = (Slot + 1) % EPOCH_SLOTS;
+
+        if( ++Tried % EPOCH_SLOTS == 0 )
+        {
+            EPOCH_YIELD();
+        }
+    }
+
+    /* The slot must be seen taken before anything of a generation is read */
+    EPOCH_FENCE();
+}
+
+void Epoch_Leave(void)
+{
+    if( --Depth > 0 )
+    {
+        return;
+    }
+
+    EPOCH_CLEAR(Slots[Slot].Epoch);
+}
+
+void Epoch_Synchronize(void)
+{
+    uint32_t Target;
+    int loop;
+
+    /* What was published must be seen before slots are checked */
+    EPOCH_FENCE();
+
+    Target = EPOCH_ADD(GlobalEpoch, 2);
+
+    for( loop = 0; loop != EPOCH_SLOTS; ++loop )
+    {
+        while( TRUE )
+        {
+            uint32_t Epoch = EPOCH_GET(Slots[loop].Epoch);
+
+            /* Free, or entered after the new generation was published */
+            if( Epoch == 0 || (int32_t)(Epoch - Target) >= 0 )
+            {
+                break;
+            }
+
+            EPOCH_YIELD();
+        }
+    }
+}
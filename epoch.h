@@ -0,0 +1,41 @@
+#ifndef EPOCH_H_INCLUDED
+#define EPOCH_H_INCLUDED
+
+#include "common.h"
+
+/* Epoch based reclamation for structures replaced as a whole, like a
+ * generation of hosts or filters.
+ *
+ * Readers take no lock. They wrap their accesses between `Epoch_Enter' and
+ * `Epoch_Leave', and get the current generation by `EPOCH_LOAD'. Sections
+ * may nest, and must not block.
+ *
+ * A writer builds a new generation aside, publishes it by `EPOCH_EXCHANGE',
+ * then calls `Epoch_Synchronize', after which no reader can still see the
+ * old one, so it can be freed. A writer must not be in a section itself.
+ *
+ * A reader holds one of 64 slots while in a section. More threads than that
+ * may use epochs, but when 64 are in sections at once, the next one to enter
+ * spins, yielding, until a slot is left. Sections never block, so that only
+ * delays it. dnsforwarder itself has the frontends, the timed task workers
+ * and up to two threads for each module (doubled during a reload) entering
+ * sections, which stays below 64 unless there are 15 or more groups.
+ */
+
+#ifdef __GNUC__
+    #define EPOCH_LOAD(p)           __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+    #define EPOCH_EXCHANGE(p, v)    __atomic_exchange_n(&(p), (v), __ATOMIC_SEQ_CST)
+#else /* __GNUC__ */
+    /* Plain loads are acquire on x86 */
+    #define EPOCH_LOAD(p)           (_ReadWriteBarrier(), (p))
+    #define EPOCH_EXCHANGE(p, v)    InterlockedExchangePointer((PVOID volatile *)&(p), (v))
+#endif /* __GNUC__ */
+
+void Epoch_Enter(void);
+
+void Epoch_Leave(void);
+
+/* Wait until every section entered before the call has been left */
+void Epoch_Synchronize(void);
+
+#endif /* EPOCH_H_INCLUDED */
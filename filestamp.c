@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include "filestamp.h"
+#include "utils.h"
+
+#define FILE_STAMP_BUFFER_SIZE  (64 * 1024)
+
+/* 64-bit FNV-1a */
+#define FILE_STAMP_HASH_INIT    0xCBF29CE484222325ULL
+#define FILE_STAMP_HASH_PRIME   0x100000001B3ULL
+
+static int FileStamp_Stat(const char *File, int64_t *Modified, int64_t *Size)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA a;
+
+    if( !GetFileAttributesEx(File, GetFileExInfoStandard, &a) )
+    {
+        return -1;
+    }
+
+    *Modified = ((int64_t)a.ftLastWriteTime.dwHighDateTime << 32) |
+                a.ftLastWriteTime.dwLowDateTime;
+    *Size = ((int64_t)a.nFileSizeHigh << 32) | a.nFileSizeLow;
+#else /* _WIN32 */
+    struct stat st;
+
+    if( stat(File, &st) != 0 )
+    {
+        return -1;
+    }
+
+    *Modified = (int64_t)st.st_mtime;
+    *Size = (int64_t)st.st_size;
+#endif /* _WIN32 */
+
+    return 0;
+}
+
+static int FileStamp_Hash(const char *File, uint64_t *Hash)
+{
+    FILE *fp = fopen(File, "rb");
+    char *Buffer;
+    size_t Read;
+    uint64_t h = FILE_STAMP_HASH_INIT;
+
+    if( fp == NULL )
+    {
+        return -1;
+    }
+
+    Buffer = SafeMalloc(FILE_STAMP_BUFFER_SIZE);
+    if( Buffer == NULL )
+    {
+        fclose(fp);
+        return -2;
+    }
+
+    while( (Read = fread(Buffer, 1, FILE_STAMP_BUFFER_SIZE, fp)) > 0 )
+    {
+        const unsigned char *Itr = (const unsigned char *)Buffer;
+        const unsigned char *End = Itr + Read;
+
+        for( ; Itr != End; ++Itr )
+        {
+            h ^= *Itr;
+            h *= FILE_STAMP_HASH_PRIME;
+        }
+    }
+
+    SafeFree(Buffer);
+    fclose(fp);
+
+    *Hash = h;
+
+    return 0;
+}
+
+void FileStamp_Init(FileStamp *s)
+{
+    s->Modified = 0;
+    s->Size = 0;
+    s->Hash = 0;
+    s->Taken = FALSE;
+}
+
+BOOL FileStamp_Changed(FileStamp *s, const char *File)
+{
+    int64_t Modified, Size;
+    uint64_t Hash;
+
+    if( FileStamp_Stat(File, &Modified, &Size) != 0 )
+    {
+        s->Taken = FALSE;
+        return TRUE;
+    }
+
+    if( s->Taken && s->Modified == Modified && s->Size == Size )
+    {
+        return FALSE;
+    }
+
+    if( FileStamp_Hash(File, &Hash) != 0 )
+    {
+        s->Taken = FALSE;
+        return TRUE;
+    }
+
+    if( s->Taken && s->Size == Size && s->Hash == Hash )
+    {
+        /* Touched or downloaded again */
+        s->Modified = Modified;
+        return FALSE;
+    }
+
+    s->Modified = Modified;
+    s->Size = Size;
+    s->Hash = Hash;
+    s->Taken = TRUE;
+
+    return TRUE;
+}
+
+BOOL FileStamp_ChangedAt(Array *Stamps, int Subscript, const char *File)
+{
+    FileStamp *s;
+
+    while( Array_GetUsed(Stamps) <= Subscript )
+    {
+        FileStamp New;
+
+        FileStamp_Init(&New);
+        if( Array_PushBack(Stamps, &New, NULL) < 0 )
+        {
+            return TRUE;
+        }
+    }
+
+    s = Array_GetBySubscript(Stamps, Subscript);
+    if( s == NULL )
+    {
+        return TRUE;
+    }
+
+    return FileStamp_Changed(s, File);
+}
+
+void FileStamp_InitAll(Array *Stamps)
+{
+    int loop;
+
+    for( loop = 0; loop != Array_GetUsed(Stamps); ++loop )
+    {
+        FileStamp_Init(Array_GetBySubscript(Stamps, loop));
+    }
+}
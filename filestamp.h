@@ -0,0 +1,39 @@
+#ifndef FILESTAMP_H_INCLUDED
+#define FILESTAMP_H_INCLUDED
+
+#include "common.h"
+#include "array.h"
+
+/* What a file looked like when it was loaded, to skip reloading it when it
+ * has not changed.
+ *
+ * The modification time and the size are compared first. Files downloaded
+ * again get a new time even if nothing in them changed, so the content is
+ * hashed then, and only a different hash counts as a change.
+ */
+
+typedef struct _FileStamp{
+    int64_t     Modified;
+    int64_t     Size;
+    uint64_t    Hash;   /* Of the content */
+    BOOL        Taken;
+} FileStamp;
+
+void FileStamp_Init(FileStamp *s);
+
+/* TRUE if `File' changed since `s' was taken, or cannot be read. `s' is
+ * taken again.
+ */
+BOOL FileStamp_Changed(FileStamp *s, const char *File);
+
+/* The same for the `Subscript'th file of a list, `Stamps' an `Array' of
+ * `FileStamp's kept between checks. New files count as changed.
+ */
+BOOL FileStamp_ChangedAt(Array *Stamps, int Subscript, const char *File);
+
+/* Forget every stamp of the list, so all the files count as changed next
+ * time. For a load that failed after the stamps were taken.
+ */
+void FileStamp_InitAll(Array *Stamps);
+
+#endif /* FILESTAMP_H_INCLUDED */
@@ -2,20 +2,33 @@
 #include <stdlib.h>
 #include "filter.h"
 #include "stringchunk.h"
+#include "domainlist.h"
 #include "bst.h"
 #include "common.h"
 #include "logs.h"
 #include "readline.h"
 #include "domainstatistic.h"
-#include "rwlock.h"
+#include "region.h"
+#include "epoch.h"
+#include "filestamp.h"
+#include "probes.h"
 
 static Bst          *DisabledTypes = NULL;
 
-static StringChunk  *DisabledDomain = NULL;
-static RWLock       DisabledDomainLock = NULL_RWLOCK;
+/* A generation of disabled domains, replaced as a whole */
+typedef struct _DisabledSet{
+    StringChunk *Domains;
+    Array       *Maps; /* `DomainList', compiled lists */
+    Region      *Memory; /* Where the two above are built */
+} DisabledSet;
+
+static DisabledSet  *CurrDisabled = NULL;
 
 static ConfigFileInfo *CurrConfigInfo = NULL;
 
+/* `FileStamp's of `DisabledList' files, in order */
+static Array    DisabledListStamps = Array_Init_Static(sizeof(FileStamp));
+
 static int TypeCompare(const int *_1, const int *_2)
 {
     return *_1 - *_2;
@@ -84,16 +97,79 @@ static int FilterDomain_Init(StringChunk **List, ConfigFileInfo *ConfigInfo)
     return 0;
 }
 
-static int LoadDomainsFromFile(StringChunk *List, const char *FilePath)
+/* Compiled lists are mapped as they are, only wildcard patterns are copied */
+static int MapDomainsFromFile(StringChunk *List,
+                              Array **Maps,
+                              const char *FilePath
+                              )
+{
+    DomainList  l;
+    int ret;
+    uint32_t loop;
+
+    ret = DomainList_Map(&l, FilePath);
+    if( ret != 0 )
+    {
+        return ret;
+    }
+
+    if( *Maps == NULL )
+    {
+        *Maps = malloc(sizeof(Array));
+        if( *Maps == NULL )
+        {
+            DomainList_Unmap(&l);
+            return -121;
+        }
+
+        if( Array_Init(*Maps, sizeof(DomainList), 0, FALSE, NULL) != 0 )
+        {
+            SafeFree(*Maps);
+            DomainList_Unmap(&l);
+            return -122;
+        }
+    }
+
+    if( Array_PushBack(*Maps, &l, NULL) < 0 )
+    {
+        DomainList_Unmap(&l);
+        return -123;
+    }
+
+    for( loop = 0; loop != DomainList_GetWildCardCount(&l); ++loop )
+    {
+        StringChunk_Add_Domain(List, DomainList_GetWildCard(&l, loop), NULL, 0);
+    }
+
+    return 0;
+}
+
+static int LoadDomainsFromFile(StringChunk *List,
+                               Array **Maps,
+                               const char *FilePath
+                               )
 {
     FILE *fp;
     char    Domain[512];
+    int     ret;
 
     if( List == NULL || FilePath == NULL )
     {
         return 0;
     }
 
+    ret = MapDomainsFromFile(List, Maps, FilePath);
+    if( ret == 0 )
+    {
+        INFO("DisabledList `%s' mapped.\n", FilePath);
+        return 0;
+    } else if( ret != -2 )
+    {
+        /* A broken compiled list, not to be read as text */
+        WARNING("Mapping DisabledList `%s' failed : %d.\n", FilePath, ret);
+        return -118;
+    }
+
     fp = fopen(FilePath, "r");
     if( fp == NULL )
     {
@@ -123,7 +199,10 @@ static int LoadDomainsFromFile(StringChunk *List, const char *FilePath)
     return 0;
 }
 
-static int FilterDomain_InitFromFile(StringChunk **List, ConfigFileInfo *ConfigInfo)
+static int FilterDomain_InitFromFile(StringChunk **List,
+                                     Array **Maps,
+                                     ConfigFileInfo *ConfigInfo
+                                     )
 {
     StringList *FilePaths = ConfigGetStringList(ConfigInfo, "DisabledList");
     const char *FilePath;
@@ -146,7 +225,7 @@ static int FilterDomain_InitFromFile(StringChunk **List, ConfigFileInfo *ConfigI
 
     while( (FilePath = sli.Next(&sli)) != NULL )
     {
-        LoadDomainsFromFile(*List, FilePath);
+        LoadDomainsFromFile(*List, Maps, FilePath);
     }
 
     return 0;
@@ -159,8 +238,6 @@ static void FilterType_Cleanup(void)
         DisabledTypes->Free(DisabledTypes);
         free(DisabledTypes);
     }
-
-    RWLock_Destroy(DisabledDomainLock);
 }
 
 static int FilterType_Init(ConfigFileInfo *ConfigInfo)
@@ -204,41 +281,143 @@ static int FilterType_Init(ConfigFileInfo *ConfigInfo)
     return 0;
 }
 
-static void DisabledDomain_Cleanup(void)
+static void DisabledMaps_Free(Array *Maps)
 {
-    if( DisabledDomain != NULL )
+    int loop;
+
+    if( Maps == NULL )
     {
-        StringChunk_Free(DisabledDomain, TRUE);
-        SafeFree(DisabledDomain);
+        return;
     }
+
+    for( loop = 0; loop != Array_GetUsed(Maps); ++loop )
+    {
+        DomainList_Unmap((DomainList *)Array_GetBySubscript(Maps, loop));
+    }
+
+    Array_Free(Maps);
+    free(Maps);
+}
+
+static void DisabledSet_Free(DisabledSet *Set)
+{
+    if( Set == NULL )
+    {
+        return;
+    }
+
+    if( Set->Domains != NULL )
+    {
+        StringChunk_Free(Set->Domains, TRUE);
+        SafeFree(Set->Domains);
+    }
+
+    DisabledMaps_Free(Set->Maps);
+
+    if( Set->Memory != NULL )
+    {
+        Region_Free(Set->Memory);
+        SafeFree(Set->Memory);
+    }
+
+    SafeFree(Set);
+}
+
+/* Stamps of all the files are taken again */
+static BOOL DisabledList_Changed(ConfigFileInfo *ConfigInfo)
+{
+    StringList *FilePaths = ConfigGetStringList(ConfigInfo, "DisabledList");
+    const char *FilePath;
+    StringListIterator sli;
+    BOOL Changed = FALSE;
+    int Subscript = 0;
+
+    if( FilePaths == NULL )
+    {
+        return FALSE;
+    }
+
+    if( StringListIterator_Init(&sli, FilePaths) != 0 )
+    {
+        return TRUE;
+    }
+
+    while( (FilePath = sli.Next(&sli)) != NULL )
+    {
+        if( FileStamp_ChangedAt(&DisabledListStamps, Subscript++, FilePath) )
+        {
+            Changed = TRUE;
+        }
+    }
+
+    return Changed;
+}
+
+static void DisabledDomain_Cleanup(void)
+{
+    DisabledSet_Free(EPOCH_EXCHANGE(CurrDisabled, NULL));
+    Array_Free(&DisabledListStamps);
 }
 
 static int DisabledDomain_Init(ConfigFileInfo *ConfigInfo)
 {
-    StringChunk    *TempDisabledDomain = NULL;
+    DisabledSet    *TempSet;
+    Region         *PreviousRegion;
 
-    if( FilterDomain_Init(&TempDisabledDomain, ConfigInfo) != 0 )
+    TempSet = SafeMalloc(sizeof(DisabledSet));
+    if( TempSet == NULL )
     {
+        return -1;
+    }
+
+    TempSet->Domains = NULL;
+    TempSet->Maps = NULL;
+
+    /* All of a generation is built in one region, freed at once */
+    TempSet->Memory = SafeMalloc(sizeof(Region));
+    if( TempSet->Memory == NULL )
+    {
+        SafeFree(TempSet);
+        return -1;
+    }
+
+    Region_Init(TempSet->Memory, 0);
+    PreviousRegion = Region_Enter(TempSet->Memory);
+
+    if( FilterDomain_Init(&(TempSet->Domains), ConfigInfo) != 0 )
+    {
+        Region_Leave(PreviousRegion);
+        DisabledSet_Free(TempSet);
         INFO("Loading DisabledDomain failed.\n");
         return -1;
     } else {
         INFO("Loading DisabledDomain completed.\n");
     }
 
-    if( FilterDomain_InitFromFile(&TempDisabledDomain, ConfigInfo) != 0 )
+    if( FilterDomain_InitFromFile(&(TempSet->Domains),
+                                  &(TempSet->Maps),
+                                  ConfigInfo
+                                  ) != 0 )
     {
-        StringChunk_Free(TempDisabledDomain, TRUE);
-        SafeFree(TempDisabledDomain);
+        Region_Leave(PreviousRegion);
+        DisabledSet_Free(TempSet);
         INFO("Loading DisabledList failed.\n");
         return -1;
     } else {
         INFO("Loading DisabledList completed.\n");
     }
 
-    RWLock_WrLock(DisabledDomainLock);
-    DisabledDomain_Cleanup();
-    DisabledDomain = TempDisabledDomain;
-    RWLock_UnWLock(DisabledDomainLock);
+    if( StringChunk_Compile(TempSet->Domains) != 0 )
+    {
+        WARNING("Compiling DisabledDomain failed, slower matching used.\n");
+    }
+
+    Region_Leave(PreviousRegion);
+
+    /* Queries go on with the old generation until they see the new one */
+    TempSet = EPOCH_EXCHANGE(CurrDisabled, TempSet);
+    Epoch_Synchronize();
+    DisabledSet_Free(TempSet);
 
     return 0;
 }
@@ -254,23 +433,37 @@ int Filter_Init(ConfigFileInfo *ConfigInfo)
         INFO("Setting DisabledType succeeded.\n");
     }
 
-    RWLock_Init(DisabledDomainLock);
-
     atexit(FilterType_Cleanup);
 
-    DisabledDomain_Init(ConfigInfo);
+    DisabledList_Changed(ConfigInfo);
+    if( DisabledDomain_Init(ConfigInfo) != 0 )
+    {
+        /* Tried again next time */
+        FileStamp_InitAll(&DisabledListStamps);
+    }
     atexit(DisabledDomain_Cleanup);
 
     return 0;
 }
 
-int Filter_Update(void)
+BOOL Filter_Update(void)
 {
     if ( ConfigGetBoolean(CurrConfigInfo, "ReloadDisabledList") )
     {
-        DisabledDomain_Init(CurrConfigInfo);
+        if( DisabledList_Changed(CurrConfigInfo) )
+        {
+            if( DisabledDomain_Init(CurrConfigInfo) != 0 )
+            {
+                /* Tried again next time */
+                FileStamp_InitAll(&DisabledListStamps);
+            }
+
+            return TRUE;
+        } else {
+            INFO("DisabledList unchanged, not reloaded.\n");
+        }
     }
-    return 0;
+    return FALSE;
 }
 
 static BOOL IsDisabledType(int Type)
@@ -284,18 +477,35 @@ static BOOL IsDisabledType(int Type)
     }
 }
 
-static BOOL IsDisabledDomain(const char *Domain, uint32_t HashValue)
+static BOOL IsDisabledDomain(const char *Domain, const DomainHash *Hashes)
 {
-    int ret;
+    BOOL ret;
+    int loop;
+    DisabledSet *Set;
 
-    if (DisabledDomain == NULL)
+    Epoch_Enter();
+
+    Set = EPOCH_LOAD(CurrDisabled);
+    if( Set == NULL )
     {
+        Epoch_Leave();
         return FALSE;
     }
 
-    RWLock_RdLock(DisabledDomainLock);
-    ret = StringChunk_Domain_Match(DisabledDomain, Domain, &HashValue, NULL, NULL, NULL);
-    RWLock_UnRLock(DisabledDomainLock);
+    ret = StringChunk_Domain_Match(Set->Domains, Domain, Hashes, NULL, NULL, NULL);
+
+    for( loop = 0;
+         !ret && Set->Maps != NULL && loop != Array_GetUsed(Set->Maps);
+         ++loop
+         )
+    {
+        ret = DomainList_Match(Array_GetBySubscript(Set->Maps, loop),
+                               Domain,
+                               Hashes
+                               );
+    }
+
+    Epoch_Leave();
 
     return ret;
 }
@@ -303,8 +513,13 @@ static BOOL IsDisabledDomain(const char *Domain, uint32_t HashValue)
 BOOL Filter_Out(MsgContext *MsgCtx)
 {
     IHeader *h = (IHeader *)MsgCtx;
+    BOOL Out = IsDisabledType(h->Type) ||
+               IsDisabledDomain(h->Domain, &(h->SuffixHashes));
+
+    STAMP(h, STAMP_FILTERED);
+    PROBE_QUERY1(filter_out, h, Out ? 1 : 0);
 
-    if(IsDisabledType(h->Type) || IsDisabledDomain(h->Domain, h->HashValue) )
+    if( Out )
     {
         MsgContext_SendBackRefusedMessage(MsgCtx);
         ShowRefusingMessage(h, "Disabled type or domain");
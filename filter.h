@@ -8,7 +8,8 @@
 
 int Filter_Init(ConfigFileInfo *ConfigInfo);
 
-int Filter_Update(void);
+/* TRUE if the disabled lists were reloaded */
+BOOL Filter_Update(void);
 
 BOOL Filter_Out(MsgContext *MsgCtx);
 
@@ -233,7 +233,8 @@ static int AddTask(void)
     {
         if( m != NULL )
         {
-            TimedTask_Add(TRUE,
+            TimedTask_Add("good IP list",
+                          TRUE,
                           FALSE,
                           m->Interval,
                           (TaskFunc)ThreadJod,
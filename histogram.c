@@ -0,0 +1,135 @@
+#include <string.h>
+#include "histogram.h"
+
+#ifdef __GNUC__
+    #define HISTOGRAM_INCREASE(v)   __atomic_fetch_add(&(v), 1, __ATOMIC_RELAXED)
+    #define HISTOGRAM_ADD64(v, n)   __atomic_fetch_add(&(v), (n), __ATOMIC_RELAXED)
+    #define HISTOGRAM_GET(v)        __atomic_load_n(&(v), __ATOMIC_RELAXED)
+    #define HISTOGRAM_CAS(v, o, n)  __atomic_compare_exchange_n(&(v), &(o), (n), FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+    #define HISTOGRAM_GET64(v)      __atomic_load_n(&(v), __ATOMIC_RELAXED)
+    #define HISTOGRAM_MSB(v)        (31 - __builtin_clz(v))
+#else /* __GNUC__ */
+    #define HISTOGRAM_INCREASE(v)   InterlockedIncrement((LONG volatile *)&(v))
+    #define HISTOGRAM_ADD64(v, n)   InterlockedExchangeAdd64((LONGLONG volatile *)&(v), (n))
+    #define HISTOGRAM_GET(v)        (*(volatile uint32_t *)&(v))
+    #define HISTOGRAM_GET64(v)      InterlockedCompareExchange64((LONGLONG volatile *)&(v), 0, 0)
+    #define HISTOGRAM_CAS(v, o, n)  ((uint32_t)InterlockedCompareExchange((LONG volatile *)&(v), (n), (o)) == (o))
+
+    static int HISTOGRAM_MSB(uint32_t v)
+    {
+        unsigned long Index;
+
+        _BitScanReverse(&Index, v);
+
+        return Index;
+    }
+#endif /* __GNUC__ */
+
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+
+static int Histogram_Index(uint32_t Value)
+{
+    int Msb;
+
+    if( Value < HISTOGRAM_SUB_COUNT )
+    {
+        return Value;
+    }
+
+    Msb = HISTOGRAM_MSB(Value);
+
+    return ((Msb - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+           ((Value >> (Msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1));
+}
+
+/* The highest value counted in bucket `Index' */
+static uint32_t Histogram_Highest(int Index)
+{
+    int Shift;
+
+    if( Index < HISTOGRAM_SUB_COUNT )
+    {
+        return Index;
+    }
+
+    Shift = (Index >> HISTOGRAM_SUB_BITS) - 1;
+
+    return (((uint32_t)(Index & (HISTOGRAM_SUB_COUNT - 1)) + HISTOGRAM_SUB_COUNT) << Shift) +
+           ((uint32_t)1 << Shift) - 1;
+}
+
+void Histogram_Init(Histogram *h)
+{
+    memset(h, 0, sizeof(Histogram));
+}
+
+void Histogram_Record(Histogram *h, uint32_t Value)
+{
+    uint32_t Max = HISTOGRAM_GET(h->Max);
+
+    HISTOGRAM_INCREASE(h->Counts[Histogram_Index(Value)]);
+    HISTOGRAM_ADD64(h->Sum, Value);
+
+    while( Value > Max )
+    {
+        if( HISTOGRAM_CAS(h->Max, Max, Value) )
+        {
+            break;
+        }
+
+        Max = HISTOGRAM_GET(h->Max);
+    }
+}
+
+uint64_t Histogram_Percentiles(const Histogram *h,
+                               const double *Percentiles,
+                               uint32_t *Values,
+                               int Number,
+                               uint32_t *Max /* Could be NULL */
+                               )
+{
+    uint32_t Counts[HISTOGRAM_BUCKETS];
+    uint32_t Highest = HISTOGRAM_GET(((Histogram *)h)->Max);
+    uint64_t Total = 0, Cumulative = 0;
+    int Index, n = 0;
+
+    for( Index = 0; Index != HISTOGRAM_BUCKETS; ++Index )
+    {
+        Counts[Index] = HISTOGRAM_GET(((Histogram *)h)->Counts[Index]);
+        Total += Counts[Index];
+    }
+
+    for( Index = 0; Index != HISTOGRAM_BUCKETS && n != Number; ++Index )
+    {
+        Cumulative += Counts[Index];
+
+        /* The value of rank ceil(Total * Percentile / 100) */
+        while( n != Number &&
+               Cumulative > 0 &&
+               Cumulative * 100.0 >= Total * Percentiles[n]
+               )
+        {
+            uint32_t v = Histogram_Highest(Index);
+
+            Values[n] = v > Highest ? Highest : v;
+            ++n;
+        }
+    }
+
+    for( ; n != Number; ++n )
+    {
+        Values[n] = 0;
+    }
+
+    if( Max != NULL )
+    {
+        *Max = Highest;
+    }
+
+    return Total;
+}
+
+uint64_t Histogram_Sum(const Histogram *h)
+{
+    return HISTOGRAM_GET64(((Histogram *)h)->Sum);
+}
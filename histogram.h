@@ -0,0 +1,40 @@
+#ifndef HISTOGRAM_H_INCLUDED
+#define HISTOGRAM_H_INCLUDED
+
+#include "common.h"
+
+/* A histogram of 32-bit values in the manner of HDR histograms, for latencies.
+ *
+ * Values below 2^HISTOGRAM_SUB_BITS are counted exactly. Each power of 2 above
+ * is cut into 2^HISTOGRAM_SUB_BITS buckets, so a percentile read back is at
+ * most about 3% over the true one. Recording is an atomic increment, from any
+ * thread, without a lock.
+ */
+
+#define HISTOGRAM_SUB_BITS  5
+#define HISTOGRAM_BUCKETS   ((32 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct _Histogram{
+    uint32_t    Counts[HISTOGRAM_BUCKETS];
+    uint32_t    Max;
+    uint64_t    Sum;
+} Histogram;
+
+void Histogram_Init(Histogram *h);
+
+void Histogram_Record(Histogram *h, uint32_t Value);
+
+/* Read `Number' percentiles, like 99.9, in ascending order into `Values', in
+ * one pass while others record. Return how many values were counted.
+ */
+uint64_t Histogram_Percentiles(const Histogram *h,
+                               const double *Percentiles,
+                               uint32_t *Values,
+                               int Number,
+                               uint32_t *Max /* Could be NULL */
+                               );
+
+/* Of all values recorded */
+uint64_t Histogram_Sum(const Histogram *h);
+
+#endif /* HISTOGRAM_H_INCLUDED */
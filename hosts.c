@@ -1,19 +1,51 @@
+#include <time.h>
 #include "hosts.h"
 #include "addresslist.h"
-#include "mcontext.h"
-#include "socketpuller.h"
+#include "bst.h"
 #include "goodiplist.h"
 #include "logs.h"
 #include "domainstatistic.h"
+#include "latency.h"
 #include "mmgr.h"
+#include "probes.h"
+#include "timedtask.h"
 
-extern BOOL Ipv6_Enabled;
+#ifdef _WIN32
+    #define HOSTS_THREAD_LOCAL  __declspec(thread)
+#else /* _WIN32 */
+    #define HOSTS_THREAD_LOCAL  __thread
+#endif /* _WIN32 */
+
+/* Seconds a parent query waits for the answer of its CNAME */
+#define HOSTS_PENDING_TIMEOUT   10
+
+/* CNAME records pointing to each other are resolved on the same stack */
+#define HOSTS_RECURSION_MAX     8
 
 static BOOL BlockIpv6WhenIpv4Exists = FALSE;
 
-static SOCKET   InnerSocket;
-static Address_Type InnerAddress;
-static SocketPuller Puller;
+/* A query answered by a CNAME record, waiting for the answer of the CNAME.
+ * Found by the identifier, hash and type of the query sent for the CNAME.
+ */
+typedef struct _HostsPending{
+    uint16_t    Identifier;
+    uint32_t    HashValue;
+    DNSRecordType   Type;
+    time_t      Since;
+
+    IHeader     Parent;
+    uint16_t    ParentIdentifier; /* Network order */
+} HostsPending;
+
+static Bst  Pending;
+static EFFECTIVE_LOCK   PendingLock;
+
+/* What `Parent' of a query sent for a CNAME points to. It only marks the
+ * query as a child, its parent is found in `Pending'.
+ */
+static IHeader  ChildMark;
+
+static HOSTS_THREAD_LOCAL int RecursionDepth = 0;
 
 BOOL Hosts_TypeExisting(const char *Domain, HostsRecordType Type)
 {
@@ -40,6 +72,203 @@ static int Hosts_GetCName(const char *Domain, char *Buffer)
            DynamicHosts_GetCName(Domain, Buffer) == 0);
 }
 
+static int HostsPending_Compare(const HostsPending *One,
+                                const HostsPending *Two
+                                )
+{
+    if( One->Identifier != Two->Identifier )
+    {
+        return One->Identifier < Two->Identifier ? -1 : 1;
+    } else if( One->HashValue != Two->HashValue ) {
+        return One->HashValue < Two->HashValue ? -1 : 1;
+    } else if( One->Type != Two->Type ) {
+        return One->Type < Two->Type ? -1 : 1;
+    } else {
+        return 0;
+    }
+}
+
+static int Hosts_Sweep_Collect(Bst *t, const HostsPending *p, Array *Expired)
+{
+    if( time(NULL) - p->Since > HOSTS_PENDING_TIMEOUT )
+    {
+        Array_PushBack(Expired, &p, NULL);
+    }
+
+    return 0;
+}
+
+/* Drop parents whose CNAME was never answered, run as a timed task */
+static int Hosts_Sweep(void *Unused, void *Unused2)
+{
+    Array Expired;
+    int i;
+
+    if( Array_Init(&Expired, sizeof(const HostsPending *), 4, FALSE, NULL)
+        != 0 )
+    {
+        return -1;
+    }
+
+    EFFECTIVE_LOCK_GET(PendingLock);
+
+    Pending.Enum(&Pending, (Bst_Enum_Callback)Hosts_Sweep_Collect, &Expired);
+
+    for( i = 0; i < Array_GetUsed(&Expired); ++i )
+    {
+        const HostsPending **p = Array_GetBySubscript(&Expired, i);
+
+        Pending.Delete(&Pending, *p);
+    }
+
+    EFFECTIVE_LOCK_RELEASE(PendingLock);
+
+    Array_Free(&Expired);
+
+    return 0;
+}
+
+/* Query the CNAME of `MsgCtx' through the modules, parking `MsgCtx' until
+ * `Hosts_Resume' gets the answer.
+ */
+static HostsUtilsTryResult Hosts_Recurse(MsgContext *MsgCtx)
+{
+    IHeader *Header = (IHeader *)MsgCtx;
+
+    char Buffer[SOCKET_CONTEXT_LENGTH];
+    IHeader *Child = (IHeader *)Buffer;
+
+    char CName[DOMAIN_NAME_LENGTH_MAX + 1];
+    Address_Type Nowhere;
+    HostsPending p;
+    const HostsPending *Stored;
+    int ret;
+
+    if( RecursionDepth >= HOSTS_RECURSION_MAX )
+    {
+        return HOSTSUTILS_TRY_NONE;
+    }
+
+    if( Hosts_GetCName(Header->Domain, CName) != 0 )
+    {
+        return HOSTSUTILS_TRY_NONE;
+    }
+
+    /* Answers never leave the process, see `Hosts_Resume' */
+    memset(&Nowhere, 0, sizeof(Nowhere));
+    Nowhere.family = AF_INET;
+
+    if( HostsUtils_GenerateQuery(Buffer,
+                                 sizeof(Buffer),
+                                 INVALID_SOCKET,
+                                 &Nowhere,
+                                 MsgContext_IsFromTCP(MsgCtx) ||
+                                    Header->RequestTcp,
+                                 rand(),
+                                 CName,
+                                 Header->Type
+                                 )
+        != 0 )
+    {
+        return HOSTSUTILS_TRY_NONE;
+    }
+
+    p.Identifier = DNSGetQueryIdentifier(IHEADER_TAIL(Child));
+    p.HashValue = Child->HashValue;
+    p.Type = Child->Type;
+    p.Since = time(NULL);
+    memcpy(&(p.Parent), Header, sizeof(IHeader));
+    DNSCopyQueryIdentifier(&(p.ParentIdentifier), IHEADER_TAIL(Header));
+
+    EFFECTIVE_LOCK_GET(PendingLock);
+    Stored = Pending.Add(&Pending, &p);
+    EFFECTIVE_LOCK_RELEASE(PendingLock);
+
+    if( Stored == NULL )
+    {
+        return HOSTSUTILS_TRY_NONE;
+    }
+
+    Child->Parent = &ChildMark;
+
+    /* The answer may come back before `MMgr_Send' returns */
+    ++RecursionDepth;
+    ret = MMgr_Send(Buffer, sizeof(Buffer));
+    --RecursionDepth;
+
+    if( ret != 0 )
+    {
+        EFFECTIVE_LOCK_GET(PendingLock);
+        Stored = Pending.Search(&Pending, &p, NULL);
+        if( Stored != NULL )
+        {
+            Pending.Delete(&Pending, Stored);
+        }
+        EFFECTIVE_LOCK_RELEASE(PendingLock);
+
+        return HOSTSUTILS_TRY_NONE;
+    }
+
+    return HOSTSUTILS_TRY_RECURSED;
+}
+
+/* Called by `MsgContext_SendBack' for the answer of a CNAME, from a module
+ * or the cache.
+ */
+static int Hosts_Resume(MsgContext *Answer)
+{
+    IHeader *h = (IHeader *)Answer;
+
+    char Buffer[SOCKET_CONTEXT_LENGTH];
+    IHeader *Parent = (IHeader *)Buffer;
+
+    HostsPending Key;
+    const HostsPending *p;
+
+    Key.Identifier = DNSGetQueryIdentifier(IHEADER_TAIL(h));
+    Key.HashValue = h->HashValue;
+    Key.Type = h->Type;
+
+    EFFECTIVE_LOCK_GET(PendingLock);
+    p = Pending.Search(&Pending, &Key, NULL);
+    if( p != NULL )
+    {
+        memcpy(Parent, &(p->Parent), sizeof(IHeader));
+        DNSCopyQueryIdentifier(IHEADER_TAIL(Parent), &(p->ParentIdentifier));
+        Pending.Delete(&Pending, p);
+    }
+    EFFECTIVE_LOCK_RELEASE(PendingLock);
+
+    if( p == NULL )
+    {
+        /* Timed out */
+        return -240;
+    }
+
+    if( HostsUtils_CombineRecursedResponse((MsgContext *)Buffer,
+                                           sizeof(Buffer),
+                                           IHEADER_TAIL(h),
+                                           h->EntityLength,
+                                           h->Domain
+                                           )
+        != 0 )
+    {
+        ERRORMSG("Fatal error 279.\n");
+        return -279;
+    }
+
+    /* A parent may be a child itself */
+    if( MsgContext_SendBack((MsgContext *)Buffer) != 0 )
+    {
+        return -285;
+    }
+
+    ShowNormalMessage(Parent, 'H');
+    Latency_Record(LATENCY_TYPE_HOSTS, Parent->ReceivedTime);
+
+    return 0;
+}
+
 HostsUtilsTryResult Hosts_Try(MsgContext *MsgCtx, int BufferLength)
 {
     HostsUtilsTryResult ret;
@@ -67,17 +296,7 @@ HostsUtilsTryResult Hosts_Try(MsgContext *MsgCtx, int BufferLength)
 
     if( ret == HOSTSUTILS_TRY_RECURSED )
     {
-        if( sendto(InnerSocket,
-                   (const char *)Header, /* Only send header and identifier */
-                   sizeof(IHeader) + sizeof(uint16_t), /* Only send header and identifier */
-                   MSG_NOSIGNAL,
-                   (const struct sockaddr *)&(InnerAddress.Addr),
-                   GetAddressLength(InnerAddress.family)
-                   )
-            < 0 )
-        {
-            return HOSTSUTILS_TRY_NONE;
-        }
+        return Hosts_Recurse(MsgCtx);
     }
 
     return ret;
@@ -86,8 +305,12 @@ HostsUtilsTryResult Hosts_Try(MsgContext *MsgCtx, int BufferLength)
 int Hosts_Get(MsgContext *MsgCtx, int BufferLength)
 {
     IHeader *Header = (IHeader *)MsgCtx;
+    HostsUtilsTryResult Result = Hosts_Try(MsgCtx, BufferLength);
 
-    switch( Hosts_Try(MsgCtx, BufferLength) )
+    STAMP(Header, STAMP_HOSTS);
+    PROBE_QUERY1(hosts_get, Header, (int)Result);
+
+    switch( Result )
     {
     case HOSTSUTILS_TRY_BLOCKED:
         MsgContext_SendBackRefusedMessage(MsgCtx);
@@ -107,6 +330,7 @@ int Hosts_Get(MsgContext *MsgCtx, int BufferLength)
     case HOSTSUTILS_TRY_OK:
         ShowNormalMessage(Header, 'H');
         DomainStatistic_Add(Header, STATISTIC_TYPE_HOSTS);
+        Latency_Record(LATENCY_TYPE_HOSTS, Header->ReceivedTime);
         return 0;
         break;
 
@@ -116,195 +340,8 @@ int Hosts_Get(MsgContext *MsgCtx, int BufferLength)
     }
 }
 
-static int
-#ifdef WIN32
-WINAPI
-#endif
-Hosts_SocketLoop(void *Unused)
-{
-    ModuleContext Context;
-
-    SOCKET   OuterSocket;
-    Address_Type OuterAddress;
-
-    const struct timeval LongTime = {3600, 0};
-    const struct timeval ShortTime = {10, 0};
-
-    struct timeval  TimeLimit = LongTime;
-
-    #define LEFT_LENGTH_SL (SOCKET_CONTEXT_LENGTH - sizeof(IHeader))
-
-    char    InnerBuffer[SOCKET_CONTEXT_LENGTH];
-    MsgContext *InnerMsgCtx = (MsgContext *)InnerBuffer;
-    IHeader *InnerHeader = (IHeader *)InnerBuffer;
-    /* char    *InnerEntity = InnerBuffer + sizeof(IHeader); */
-
-    char OuterBuffer[SOCKET_CONTEXT_LENGTH];
-    /* MsgContext *OuterMsgCtx = (MsgContext *)OuterBuffer; */
-    IHeader *OuterHeader = (IHeader *)OuterBuffer;
-    char    *OuterEntity = OuterBuffer + sizeof(IHeader);
-
-    int State;
-    int ret = 0;
-
-    OuterSocket = TryBindLocal(Ipv6_Enabled, 10300, &OuterAddress);
-
-    if( OuterSocket == INVALID_SOCKET )
-    {
-        return -416;
-    }
-
-    if( SocketPuller_Init(&Puller, 0) != 0 )
-    {
-        ret = -423;
-        goto EXIT_1;
-    }
-
-    Puller.Add(&Puller, InnerSocket, NULL, 0);
-    Puller.Add(&Puller, OuterSocket, NULL, 0);
-
-    if( ModuleContext_Init(&Context, SOCKET_CONTEXT_LENGTH) != 0 )
-    {
-        ret = -431;
-        goto EXIT_1;
-    }
-
-    srand(time(NULL));
-
-    while( TRUE )
-    {
-        SOCKET  Pulled;
-        int Err;
-
-        Pulled = Puller.Select(&Puller, &TimeLimit, NULL, TRUE, FALSE, &Err);
-        if( Pulled == INVALID_SOCKET )
-        {
-            if( Err != 0 )
-            {
-                ERRORMSG("Fatal error 70.\n");
-                break;
-            }
-            TimeLimit = LongTime;
-            Context.Sweep(&Context, NULL, NULL);
-        } else if( Pulled == InnerSocket )
-        {
-            /* Recursive query */
-            MsgContext *MsgCtxStored;
-            char RecursedDomain[DOMAIN_NAME_LENGTH_MAX + 1];
-            uint16_t NewIdentifier;
-
-            TimeLimit = ShortTime;
-
-            State = recvfrom(InnerSocket,
-                             InnerBuffer, /* Receiving a header */
-                             sizeof(InnerBuffer),
-                             0,
-                             NULL,
-                             NULL
-                             );
-
-            if( State < 1 )
-            {
-                continue;
-            }
-
-            if( Hosts_GetCName(InnerHeader->Domain, RecursedDomain) != 0 )
-            {
-                ERRORMSG("Fatal error 221.\n");
-                continue;
-            }
-
-            NewIdentifier = rand();
-
-            if( HostsUtils_GenerateQuery(OuterBuffer,
-                                         SOCKET_CONTEXT_LENGTH,
-                                         OuterSocket,
-                                         &OuterAddress,
-                                         MsgContext_IsFromTCP(InnerMsgCtx),
-                                         NewIdentifier,
-                                         RecursedDomain,
-                                         InnerHeader->Type
-                                         )
-                != 0 )
-            {
-                /** TODO: Show an error */
-                continue;
-            }
-
-            MsgCtxStored = Context.Add(&Context, InnerMsgCtx);
-            if( MsgCtxStored == NULL )
-            {
-                ERRORMSG("Fatal error 230.\n");
-                continue;
-            }
-
-            OuterHeader->Parent = (IHeader *)MsgCtxStored;
-
-            MMgr_Send(OuterBuffer, SOCKET_CONTEXT_LENGTH);
-
-        } else if( Pulled == OuterSocket )
-        {
-            MsgContext *BackTraceMsgCtx;
-            IHeader *BackTraceHeader;
-
-            TimeLimit = ShortTime;
-
-            State = recvfrom(OuterSocket,
-                             OuterBuffer, /* Receiving a header */
-                             sizeof(OuterBuffer),
-                             0,
-                             NULL,
-                             NULL
-                             );
-
-            if( State < 1 )
-            {
-                continue;
-            }
-
-            BackTraceHeader = OuterHeader->Parent;
-            BackTraceMsgCtx = (MsgContext *)BackTraceHeader;
-            DNSCopyQueryIdentifier(InnerHeader + 1, BackTraceHeader + 1);
-            if( Context.GenAnswerHeaderAndRemove(&Context, BackTraceMsgCtx, InnerMsgCtx) != 0 )
-            {
-                ERRORMSG("Fatal error 267.\n");
-                continue;
-            }
-
-            if( HostsUtils_CombineRecursedResponse((MsgContext *)InnerBuffer,
-                                                   SOCKET_CONTEXT_LENGTH,
-                                                   OuterEntity,
-                                                   State,
-                                                   OuterHeader->Domain
-                                                   )
-                != 0 )
-            {
-                ERRORMSG("Fatal error 279.\n");
-                continue;
-            }
-
-            if( MsgContext_SendBack((MsgContext *)InnerBuffer) != 0 )
-            {
-                ERRORMSG("Fatal error 285.\n");
-                continue;
-            }
-
-            ShowNormalMessage(InnerHeader, 'H');
-        }
-    }
-
-    ModuleContext_Free(&Context);
-
-EXIT_1:
-    Puller.Free(&Puller);
-
-    return ret;
-}
-
 int Hosts_Init(ConfigFileInfo *ConfigInfo)
 {
-    ThreadHandle t;
-
     StaticHosts_Init(ConfigInfo);
     DynamicHosts_Init(ConfigInfo);
 
@@ -314,14 +351,30 @@ int Hosts_Init(ConfigFileInfo *ConfigInfo)
                                                  "BlockIpv6WhenIpv4Exists"
                                                  );
 
-    InnerSocket = TryBindLocal(Ipv6_Enabled, 10200, &InnerAddress);
-    if( InnerSocket == INVALID_SOCKET )
+    if( Bst_InitBalanced(&Pending,
+                         sizeof(HostsPending),
+                         (CompareFunc)HostsPending_Compare
+                         )
+        != 0 )
     {
         return -25;
     }
 
-    CREATE_THREAD(Hosts_SocketLoop, NULL, t);
-    DETACH_THREAD(t);
+    EFFECTIVE_LOCK_INIT(PendingLock);
+
+    TimedTask_Add("hosts pending sweep",
+                  TRUE,
+                  FALSE,
+                  HOSTS_PENDING_TIMEOUT * 1000,
+                  Hosts_Sweep,
+                  NULL,
+                  NULL,
+                  FALSE
+                  );
+
+    srand(time(NULL));
+
+    MsgContext_SetChildHandler(Hosts_Resume);
 
     return 0;
 }
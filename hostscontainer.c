@@ -33,31 +33,24 @@ PRIFUNC HostsRecordType HostsContainer_DetermineType(const char *IPOrCName)
 
     if( isxdigit(*IPOrCName) )
     {
-        const char *Itr;
-        /* Check if it is IPv6 */
-        if( strchr(IPOrCName, ':') != NULL )
-        {
-            return HOSTS_TYPE_AAAA;
-        }
+        /* One scan: IPv6 if there is a colon, otherwise CNAME if there is a
+         * letter or a hyphen, otherwise IPv4 */
+        HostsRecordType Type = HOSTS_TYPE_A;
 
-        /* Check if it is CNAME */
-        for(Itr = IPOrCName; *Itr != '\0'; ++Itr)
+        for( ; *IPOrCName != '\0'; ++IPOrCName )
         {
-            if( isalpha(*Itr) || *Itr == '-' )
+            if( *IPOrCName == ':' )
             {
-                return HOSTS_TYPE_CNAME;
+                return HOSTS_TYPE_AAAA;
             }
-        }
 
-        for(Itr = IPOrCName; *Itr != '\0'; ++Itr)
-        {
-            if( isdigit(*Itr) || *Itr == '.' )
+            if( isalpha(*IPOrCName) || *IPOrCName == '-' )
             {
-                return HOSTS_TYPE_A;
+                Type = HOSTS_TYPE_CNAME;
             }
         }
 
-        return HOSTS_TYPE_UNKNOWN;
+        return Type;
 
     } else {
 
@@ -78,25 +71,91 @@ PRIFUNC HostsRecordType HostsContainer_DetermineType(const char *IPOrCName)
     }
 }
 
-/*
- If Func == NULL:
-    Return NULL : No match found;
-    Otherwise : A match found;
+/* 64-bit FNV-1a, names case-insensitively */
+#define HOSTS_KEY_INIT  0xCBF29CE484222325ULL
+#define HOSTS_KEY_PRIME 0x100000001B3ULL
 
- If Func != NULL:
-    Return NULL : Func returned non-zero at a call or no match found;
-    Otherwise : Func returned zero at every call and at least one match found;
-*/
-PUBFUNC const void *HostsContainer_Find(HostsContainer  *Container,
-                                        const char      *Name,
-                                        HostsRecordType Type,
-                                        HostsFindFunc   Func,
-                                        void            *Arg
-                                        )
+uint64_t HostsContainer_Key(HostsRecordType Type,
+                            const char *Domain,
+                            const void *Data
+                            )
+{
+    uint64_t h = HOSTS_KEY_INIT;
+    BOOL WildCard = FALSE;
+
+    for( ; *Domain != '\0'; ++Domain )
+    {
+        if( *Domain == '*' || *Domain == '?' )
+        {
+            WildCard = TRUE;
+        }
+
+        h ^= (unsigned char)tolower(*Domain);
+        h *= HOSTS_KEY_PRIME;
+    }
+
+    h ^= (unsigned int)Type;
+    h *= HOSTS_KEY_PRIME;
+
+    if( Data != NULL )
+    {
+        const unsigned char *Itr = Data;
+
+        if( Type == HOSTS_TYPE_A || Type == HOSTS_TYPE_AAAA )
+        {
+            /* `Addr' of an `IpAddr' */
+            int loop;
+
+            for( loop = 0; loop != 16; ++loop )
+            {
+                h ^= Itr[loop];
+                h *= HOSTS_KEY_PRIME;
+            }
+        } else {
+            for( ; *Itr != '\0'; ++Itr )
+            {
+                h ^= *Itr;
+                h *= HOSTS_KEY_PRIME;
+            }
+        }
+    }
+
+    return WildCard ? h | 1 : h & ~(uint64_t)1;
+}
+
+static int HostsContainer_KeyCompare(const uint64_t *One, const uint64_t *Two)
+{
+    return *One < *Two ? -1 : *One > *Two;
+}
+
+static BOOL HostsContainer_IsRemoved(const Array *Removed,
+                                     const char *Name,
+                                     const TableNode *Node
+                                     )
+{
+    uint64_t Key = HostsContainer_Key(Node->Type, Name, Node->Data);
+
+    return bsearch(&Key,
+                   Array_GetBySubscript(Removed, 0),
+                   Array_GetUsed(Removed),
+                   sizeof(uint64_t),
+                   (int (*)(const void *, const void *))HostsContainer_KeyCompare
+                   ) != NULL;
+}
+
+/* The first record of `Name' of `Type', skipping the ones in `Removed' if
+ * not NULL. For an AAAA one missing, `IP4to6' gets the first A one if it's
+ * still NULL.
+ */
+static const TableNode *HostsContainer_Lookup(HostsContainer  *Container,
+                                              const char      *Name,
+                                              HostsRecordType Type,
+                                              const Array     *Removed,
+                                              const TableNode **IP4to6
+                                              )
 {
     const TableNode **Matched = NULL;
     const TableNode *IP = NULL;
-    const TableNode *IP4to6 = NULL;
 
     if( !StringChunk_Match(&(Container->Mappings), Name, NULL, (void **)&Matched, NULL, NULL) )
     {
@@ -110,21 +169,61 @@ PUBFUNC const void *HostsContainer_Find(HostsContainer  *Container,
 
     while( IP != NULL )
     {
-        if( Type == HOSTS_TYPE_UNKNOWN || IP->Type == Type )
+        if( Removed == NULL || !HostsContainer_IsRemoved(Removed, Name, IP) )
         {
-            Type = IP->Type;
-            break;
-        }
-        if( Type == HOSTS_TYPE_AAAA && IP->Type == HOSTS_TYPE_A && IP4to6 == NULL )
-        {
-            IP4to6 = IP;
+            if( Type == HOSTS_TYPE_UNKNOWN || IP->Type == Type )
+            {
+                return IP;
+            }
+
+            if( Type == HOSTS_TYPE_AAAA && IP->Type == HOSTS_TYPE_A && *IP4to6 == NULL )
+            {
+                *IP4to6 = IP;
+            }
         }
 
         IP = IP->Next;
     }
 
-    if( IP == NULL )
+    return NULL;
+}
+
+/*
+ If Func == NULL:
+    Return NULL : No match found;
+    Otherwise : A match found;
+
+ If Func != NULL:
+    Return NULL : Func returned non-zero at a call or no match found;
+    Otherwise : Func returned zero at every call and at least one match found;
+*/
+PUBFUNC const void *HostsContainer_Find(HostsContainer  *Container,
+                                        const char      *Name,
+                                        HostsRecordType Type,
+                                        HostsFindFunc   Func,
+                                        void            *Arg
+                                        )
+{
+    const TableNode *IP = NULL;
+    const TableNode *IP4to6 = NULL;
+
+    IP = HostsContainer_Lookup(Container, Name, Type, NULL, &IP4to6);
+
+    if( IP == NULL && Container->Base != NULL )
+    {
+        IP = HostsContainer_Lookup(Container->Base,
+                                   Name,
+                                   Type,
+                                   Array_IsEmpty(&(Container->Removed)) ?
+                                        NULL : &(Container->Removed),
+                                   &IP4to6
+                                   );
+    }
+
+    if( IP != NULL )
     {
+        Type = IP->Type;
+    } else {
         IP = IP4to6;
     }
 
@@ -169,6 +268,28 @@ PRIFUNC const void *HostsContainer_FindExist(HostsContainer  *Container,
     }
 }
 
+/* `Ip' points to an `IpAddr', maybe unaligned */
+static uint32_t HostsContainer_HashIp(const char *Ip, uint32_t Length)
+{
+    const unsigned char *Itr = (const unsigned char *)Ip; /* `Addr' */
+    uint32_t h = 0;
+    int loop;
+
+    for( loop = 0; loop != 16; ++loop )
+    {
+        h = h * 31 + Itr[loop];
+    }
+
+    /* Mixed, most addresses differ only in their last bytes */
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+
+    return h;
+}
+
 PRIFUNC int HostsContainer_AddNode(HostsContainer   *Container,
                                    const char       *Name,
                                    HostsRecordType  Type,
@@ -182,28 +303,26 @@ PRIFUNC int HostsContainer_AddNode(HostsContainer   *Container,
     {
         if( Type == HOSTS_TYPE_A || Type == HOSTS_TYPE_AAAA )
         {
-            StableBufferIterator IPI;
-            IpAddr *ipAddr;
-
-            if(StableBufferIterator_Init(&IPI, &(Container->TableIPAddr)) != 0)
+            IpAddr * const *Indexed = NULL;
+            IpAddr *ipAddr = NULL;
+
+            /* Every distinct address is stored once */
+            while( (Indexed = (IpAddr * const *)SimpleHT_Find(
+                                                    &(Container->IpIndex),
+                                                    Data,
+                                                    DataLength,
+                                                    NULL,
+                                                    (const char *)Indexed
+                                                    )
+                    ) != NULL )
             {
-                return -170;
-            }
-            IPI.Reset(&IPI);
-            while( (ipAddr = IPI.NextBlock(&IPI)) != NULL )
-            {
-                int i, BytesOfMetaInfo;
-                BytesOfMetaInfo = IPI.CurrentBlockUsed(&IPI);
-                for( i = 0; i * sizeof(IpAddr) < BytesOfMetaInfo; ++i, ++ipAddr )
+                if( memcmp(*Indexed, Data, DataLength) == 0 )
                 {
-                    if( memcmp(ipAddr, Data, DataLength) == 0 )
-                    {
-                        goto OUT_SEARCH;
-                    }
+                    ipAddr = *Indexed;
+                    break;
                 }
             }
 
-OUT_SEARCH:
             if( ipAddr == NULL )
             {
                 ipAddr = Container->TableIPAddr.Add(&(Container->TableIPAddr),
@@ -211,6 +330,17 @@ OUT_SEARCH:
                                                       DataLength,
                                                       TRUE
                                                       );
+                if( ipAddr == NULL ||
+                    SimpleHT_Add(&(Container->IpIndex),
+                                 Data,
+                                 DataLength,
+                                 (const char *)&ipAddr,
+                                 NULL
+                                 ) == NULL
+                    )
+                {
+                    return -170;
+                }
             }
 
             n.Data = ipAddr;
@@ -273,138 +403,190 @@ OUT_SEARCH:
     return 0;
 }
 
-PRIFUNC int HostsContainer_AddIP(HostsContainer *Container,
-                                 HostsRecordType  Type,
-                                 const char *IP,
-                                 const char *Domain
-                                )
+/* Copy a token of `Line' to `Buffer', return where the token ends, or NULL
+ * if there is no token or it's too long */
+static const char *HostsContainer_Token(const char *Line, char *Buffer)
 {
-    IpAddr ipAddr;
-
-    IpAddr_Parse(IP, &ipAddr);
+    int Length = 0;
 
-    return HostsContainer_AddNode(Container,
-                                  Domain,
-                                  Type,
-                                  &ipAddr,
-                                  sizeof(IpAddr)
-                                  );
-}
+    while( isspace(*Line) )
+    {
+        ++Line;
+    }
 
-PRIFUNC int HostsContainer_AddCName(HostsContainer *Container,
-                                    const char *CName,
-                                    const char *Domain
-                                    )
-{
-    return HostsContainer_AddNode(Container,
-                                  Domain,
-                                  HOSTS_TYPE_CNAME,
-                                  CName,
-                                  strlen(CName) + 1
-                                  );
-}
+    while( *Line != '\0' && !isspace(*Line) )
+    {
+        if( Length == DOMAIN_NAME_LENGTH_MAX )
+        {
+            return NULL;
+        }
 
-PRIFUNC int HostsContainer_AddGoodIpList(HostsContainer *Container,
-                                         const char *ListName,
-                                         const char *Domain
-                                         )
-{
-    char            Trimed[128];
+        Buffer[Length++] = *Line++;
+    }
 
-    sscanf(ListName, "<%127[^>]", Trimed);
+    Buffer[Length] = '\0';
 
-    return HostsContainer_AddNode(Container,
-                                  Domain,
-                                  HOSTS_TYPE_GOOD_IP_LIST,
-                                  Trimed,
-                                  strlen(Trimed) + 1
-                                  );
+    return Length == 0 ? NULL : Line;
 }
 
-PRIFUNC int HostsContainer_AddExcluded(HostsContainer *Container,
-                                       const char *Domain
-                                       )
+HostsRecordType HostsContainer_Parse(const char *MetaLine, HostsRecord *Record)
 {
-    return HostsContainer_AddNode(Container,
-                                  Domain,
-                                  HOSTS_TYPE_EXCLUEDE,
-                                  NULL,
-                                  0
-                                  );
-}
+    char IPOrCName[DOMAIN_NAME_LENGTH_MAX + 1];
+    const char *Itr;
 
-PRIFUNC HostsRecordType HostsContainer_Add(HostsContainer *Container,
-                                           const char *IPOrCName,
-                                           const char *Domain
-                                           )
-{
-    HostsRecordType  Type = HostsContainer_DetermineType(IPOrCName);
+    Itr = HostsContainer_Token(MetaLine, IPOrCName);
+    if( Itr == NULL || HostsContainer_Token(Itr, Record->Domain) == NULL )
+    {
+        INFO("Unrecognisable host : %s, it may be too long.\n", MetaLine);
+        return HOSTS_TYPE_UNKNOWN;
+    }
 
-    switch( Type )
+    Record->Type = HostsContainer_DetermineType(IPOrCName);
+
+    switch( Record->Type )
     {
         case HOSTS_TYPE_AAAA:
         case HOSTS_TYPE_A:
-            if( HostsContainer_AddIP(Container, Type, IPOrCName, Domain) != 0 )
             {
-                return HOSTS_TYPE_UNKNOWN;
-            } else {
-                return Type;
+                IpAddr ipAddr;
+
+                IpAddr_Parse(IPOrCName, &ipAddr);
+                memcpy(Record->Data, &ipAddr, sizeof(IpAddr));
+                Record->DataLength = sizeof(IpAddr);
             }
             break;
 
         case HOSTS_TYPE_CNAME:
-            if( HostsContainer_AddCName(Container, IPOrCName, Domain) != 0 )
-            {
-                return HOSTS_TYPE_UNKNOWN;
-            } else {
-                return HOSTS_TYPE_CNAME;
-            }
+            strcpy(Record->Data, IPOrCName);
+            Record->DataLength = strlen(IPOrCName) + 1;
             break;
 
         case HOSTS_TYPE_EXCLUEDE:
-            if( HostsContainer_AddExcluded(Container, Domain) != 0 )
-            {
-                return HOSTS_TYPE_UNKNOWN;
-            } else {
-                return HOSTS_TYPE_EXCLUEDE;
-            }
+            Record->DataLength = 0;
             break;
 
         case HOSTS_TYPE_GOOD_IP_LIST:
-            if( HostsContainer_AddGoodIpList(Container, IPOrCName, Domain) != 0 )
-            {
-                return HOSTS_TYPE_UNKNOWN;
-            } else {
-                return HOSTS_TYPE_GOOD_IP_LIST;
-            }
+            sscanf(IPOrCName, "<%127[^>]", Record->Data);
+            Record->DataLength = strlen(Record->Data) + 1;
             break;
 
         default:
-            INFO("Unrecognisable host : %s %s\n", IPOrCName, Domain);
+            INFO("Unrecognisable host : %s %s\n", IPOrCName, Record->Domain);
             return HOSTS_TYPE_UNKNOWN;
             break;
     }
+
+    return Record->Type;
+}
+
+PUBFUNC int HostsContainer_AddParsed(HostsContainer *Container,
+                                     HostsRecordType Type,
+                                     const char *Domain,
+                                     const void *Data,
+                                     int DataLength
+                                     )
+{
+    if( Container->Base != NULL )
+    {
+        const TableNode *IP4to6 = NULL;
+
+        /* They would come after the added one, unlike in a single container */
+        if( HostsContainer_Lookup(Container->Base,
+                                  Domain,
+                                  Type,
+                                  Array_IsEmpty(&(Container->Removed)) ?
+                                        NULL : &(Container->Removed),
+                                  &IP4to6
+                                  )
+            != NULL )
+        {
+            return -230;
+        }
+    }
+
+    return HostsContainer_AddNode(Container,
+                                  Domain,
+                                  Type,
+                                  DataLength == 0 ? NULL : Data,
+                                  DataLength
+                                  );
 }
 
 PUBFUNC HostsRecordType HostsContainer_Load(HostsContainer *Container,
                                             const char *MetaLine
                                             )
 {
-    char IPOrCName[DOMAIN_NAME_LENGTH_MAX + 1];
-    char Domain[DOMAIN_NAME_LENGTH_MAX + 1];
+    HostsRecord r;
 
-    if( sscanf(MetaLine,
-               "%" STRINGIZINGINT(DOMAIN_NAME_LENGTH_MAX) "s%" STRINGIZINGINT(DOMAIN_NAME_LENGTH_MAX) "s",
-               IPOrCName,
-               Domain
-               )
-     != 2 )
+    if( HostsContainer_Parse(MetaLine, &r) == HOSTS_TYPE_UNKNOWN )
     {
-        INFO("Unrecognisable host : %s, it may be too long.\n", MetaLine);
         return HOSTS_TYPE_UNKNOWN;
     }
 
-    return HostsContainer_Add(Container, IPOrCName, Domain);
+    if( HostsContainer_AddParsed(Container,
+                                 r.Type,
+                                 r.Domain,
+                                 r.Data,
+                                 r.DataLength
+                                 )
+        != 0 )
+    {
+        return HOSTS_TYPE_UNKNOWN;
+    }
+
+    return r.Type;
+}
+
+PUBFUNC int HostsContainer_Remove(HostsContainer *Container, uint64_t Key)
+{
+    int Used = Array_GetUsed(&(Container->Removed));
+
+    if( Container->Base == NULL || (Key & 1) != 0 )
+    {
+        return -1;
+    }
+
+    if( Array_PushBack(&(Container->Removed), &Key, NULL) < 0 )
+    {
+        return -2;
+    }
+
+    /* Kept sorted for `AddParsed', cheap if added in order */
+    if( Used > 0 &&
+        *(uint64_t *)Array_GetBySubscript(&(Container->Removed), Used - 1) > Key
+        )
+    {
+        Array_Sort(&(Container->Removed),
+                   (int (*)(const void *, const void *))HostsContainer_KeyCompare
+                   );
+    }
+
+    return 0;
+}
+
+PUBFUNC int HostsContainer_Compile(HostsContainer *Container)
+{
+    Array_Sort(&(Container->Removed),
+               (int (*)(const void *, const void *))HostsContainer_KeyCompare
+               );
+
+    if( StringChunk_Compile_WildCard(&(Container->Mappings)) != 0 )
+    {
+        return -1;
+    }
+
+    return StringChunk_Compile_Prefilter(&(Container->Mappings)) == 0 ? 0 : -2;
+}
+
+PUBFUNC BOOL HostsContainer_MayContain(HostsContainer *Container,
+                                       const char *Name,
+                                       const uint32_t *HashValue
+                                       )
+{
+    return StringChunk_MayMatch(&(Container->Mappings), Name, HashValue) ||
+           (Container->Base != NULL &&
+            Container->Base->MayContain(Container->Base, Name, HashValue)
+            );
 }
 
 PUBFUNC void HostsContainer_Free(HostsContainer *Container)
@@ -412,6 +594,8 @@ PUBFUNC void HostsContainer_Free(HostsContainer *Container)
     StringChunk_Free(&(Container->Mappings), TRUE);
     Container->Table.Free(&(Container->Table));
     Container->TableIPAddr.Free(&(Container->TableIPAddr));
+    SimpleHT_Free(&(Container->IpIndex));
+    Array_Free(&(Container->Removed));
 }
 
 int HostsContainer_Init(HostsContainer *Container)
@@ -434,9 +618,51 @@ int HostsContainer_Init(HostsContainer *Container)
         return -7;
     }
 
+    if( SimpleHT_Init(&(Container->IpIndex),
+                      sizeof(IpAddr *),
+                      HostsContainer_HashIp
+                      )
+        != 0 )
+    {
+        StringChunk_Free(&(Container->Mappings), TRUE);
+        Container->Table.Free(&(Container->Table));
+        Container->TableIPAddr.Free(&(Container->TableIPAddr));
+        return -8;
+    }
+
+    if( Array_Init(&(Container->Removed), sizeof(uint64_t), 0, FALSE, NULL)
+        != 0 )
+    {
+        StringChunk_Free(&(Container->Mappings), TRUE);
+        Container->Table.Free(&(Container->Table));
+        Container->TableIPAddr.Free(&(Container->TableIPAddr));
+        SimpleHT_Free(&(Container->IpIndex));
+        return -9;
+    }
+
+    Container->Base = NULL;
+
     Container->Load = HostsContainer_Load;
+    Container->AddParsed = HostsContainer_AddParsed;
+    Container->Remove = HostsContainer_Remove;
     Container->Find = HostsContainer_Find;
+    Container->Compile = HostsContainer_Compile;
+    Container->MayContain = HostsContainer_MayContain;
     Container->Free = HostsContainer_Free;
 
     return 0;
 }
+
+int HostsContainer_InitDerived(HostsContainer *Container,
+                               HostsContainer *Base
+                               )
+{
+    int ret = HostsContainer_Init(Container);
+
+    if( ret == 0 )
+    {
+        Container->Base = Base;
+    }
+
+    return ret;
+}
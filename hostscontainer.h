@@ -4,6 +4,7 @@
 #define DOMAIN_NAME_LENGTH_MAX 128
 
 #include "stringchunk.h"
+#include "array.h"
 #include "oo.h"
 
 typedef enum _HostsRecordType{
@@ -26,15 +27,45 @@ typedef int (*HostsFindFunc)(int                Number, /* Start with 1 */
                              void               *Arg
                              );
 
+/* A hosts line parsed but not added yet, so lines can be parsed by several
+ * threads and added by one */
+typedef struct _HostsRecord{
+    HostsRecordType Type;
+    char            Domain[DOMAIN_NAME_LENGTH_MAX + 1];
+    char            Data[DOMAIN_NAME_LENGTH_MAX + 1]; /* An `IpAddr' or a name */
+    int             DataLength; /* 0 if no data */
+} HostsRecord;
+
 struct _HostsContainer{
     PRIMEMB StringChunk     Mappings;
     PRIMEMB StableBuffer    Table;
     PRIMEMB StableBuffer    TableIPAddr;
+    PRIMEMB SimpleHT        IpIndex; /* `IpAddr *'s in `TableIPAddr' */
+
+    /* A container initialized by `HostsContainer_InitDerived' holds changes
+     * made over `Base': records added to it come before the ones of `Base',
+     * records of `Base' whose keys are in `Removed' are skipped.
+     */
+    PRIMEMB HostsContainer  *Base;
+    PRIMEMB Array           Removed; /* `uint64_t' keys, sorted by `Compile' */
 
     PUBMEMB HostsRecordType (*Load)(HostsContainer *Container,
                                     const char *MetaLine
                                     );
 
+    /* What `HostsContainer_Parse' gave */
+    PUBMEMB int (*AddParsed)(HostsContainer *Container,
+                             HostsRecordType Type,
+                             const char *Domain,
+                             const void *Data,
+                             int DataLength
+                             );
+
+    /* Hide the records of the base having `Key', see `HostsContainer_Key'.
+     * Records of names with wildcards cannot be hidden.
+     */
+    PUBMEMB int (*Remove)(HostsContainer *Container, uint64_t Key);
+
     PUBMEMB const void *(*Find)(HostsContainer  *Container,
                                 const char      *Name,
                                 HostsRecordType Type,
@@ -42,10 +73,35 @@ struct _HostsContainer{
                                 void            *Arg
                                 );
 
+    /* Call it after all hosts are loaded */
+    PUBMEMB int (*Compile)(HostsContainer *Container);
+
+    /* FALSE if `Name' definitely matches nothing, TRUE if it may */
+    PUBMEMB BOOL (*MayContain)(HostsContainer *Container,
+                               const char *Name,
+                               const uint32_t *HashValue /* Could be NULL */
+                               );
+
     PUBMEMB void (*Free)(HostsContainer *Container);
 
 };
 
 int HostsContainer_Init(HostsContainer *Container);
 
+/* `Base' must be compiled, and live longer than `Container' */
+int HostsContainer_InitDerived(HostsContainer *Container,
+                               HostsContainer *Base
+                               );
+
+/* Thread safe, HOSTS_TYPE_UNKNOWN if `MetaLine' is not a valid one */
+HostsRecordType HostsContainer_Parse(const char *MetaLine, HostsRecord *Record);
+
+/* Identify a record by its content, thread safe. The lowest bit is set for
+ * names with wildcards. `Data' could be NULL.
+ */
+uint64_t HostsContainer_Key(HostsRecordType Type,
+                            const char *Domain,
+                            const void *Data
+                            );
+
 #endif /* HOSTSCONTAINER_H_INCLUDED */
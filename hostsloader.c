@@ -0,0 +1,727 @@
+#include <string.h>
+#include <ctype.h>
+#include "hostsloader.h"
+#include "utils.h"
+#include "logs.h"
+#include "ptimer.h"
+#include "region.h"
+
+/* As long as `ReadLine' takes */
+#define HOSTS_LINE_MAX  320
+
+#define HOSTS_LOADER_THREADS_MAX    8
+
+/* Files smaller than this are not worth a thread per chunk */
+#define HOSTS_LOADER_CHUNK_MIN  (1024 * 1024)
+
+/* Followed by `DomainLength' bytes of the domain, then `DataLength' bytes of
+ * the data, the whole rounded up to an int */
+typedef struct _HostsPacked{
+    int Type;
+    int DomainLength; /* With the terminating zero */
+    int DataLength;
+} HostsPacked;
+
+typedef struct _HostsChunk{
+    const char  *Start;
+    const char  *End;
+
+    /* Parsed lines, `HostsPacked's */
+    char        *Records;
+    size_t      Used;
+    size_t      Allocated;
+
+    int         Failed;
+    ThreadHandle    Thread;
+} HostsChunk;
+
+typedef struct _HostsMap{
+    const char  *Base;
+    size_t      Length;
+#ifdef _WIN32
+    HANDLE      Mapping;
+#endif /* _WIN32 */
+} HostsMap;
+
+static int HostsLoader_Map(HostsMap *m, const char *File)
+{
+    m->Base = NULL;
+    m->Length = 0;
+
+#ifdef _WIN32
+    {
+        HANDLE f;
+        LARGE_INTEGER Size;
+
+        m->Mapping = NULL;
+
+        f = CreateFile(File,
+                       GENERIC_READ,
+                       FILE_SHARE_READ,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL,
+                       NULL
+                       );
+        if( f == INVALID_HANDLE_VALUE )
+        {
+            return -1;
+        }
+
+        if( !GetFileSizeEx(f, &Size) )
+        {
+            CloseHandle(f);
+            return -2;
+        }
+
+        /* Nothing to map */
+        if( Size.QuadPart == 0 )
+        {
+            CloseHandle(f);
+            return 0;
+        }
+
+        m->Length = (size_t)Size.QuadPart;
+
+        m->Mapping = CreateFileMapping(f, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(f);
+        if( m->Mapping == NULL )
+        {
+            return -6;
+        }
+
+        m->Base = MapViewOfFile(m->Mapping, FILE_MAP_READ, 0, 0, 0);
+        if( m->Base == NULL )
+        {
+            CloseHandle(m->Mapping);
+            m->Mapping = NULL;
+            return -6;
+        }
+    }
+#else /* _WIN32 */
+    {
+        int fd;
+        struct stat st;
+        void *Base;
+
+        fd = open(File, O_RDONLY);
+        if( fd < 0 )
+        {
+            return -1;
+        }
+
+        if( fstat(fd, &st) != 0 )
+        {
+            close(fd);
+            return -2;
+        }
+
+        /* Nothing to map */
+        if( st.st_size == 0 )
+        {
+            close(fd);
+            return 0;
+        }
+
+        m->Length = st.st_size;
+
+        Base = mmap(NULL, m->Length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if( Base == MAP_FAILED )
+        {
+            return -6;
+        }
+
+        m->Base = Base;
+    }
+#endif /* _WIN32 */
+
+    return 0;
+}
+
+static void HostsLoader_Unmap(HostsMap *m)
+{
+    if( m->Base != NULL )
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m->Base);
+        CloseHandle(m->Mapping);
+        m->Mapping = NULL;
+#else /* _WIN32 */
+        munmap((void *)m->Base, m->Length);
+#endif /* _WIN32 */
+    }
+
+    m->Base = NULL;
+}
+
+static int HostsLoader_Processors(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+
+    return (int)si.dwNumberOfProcessors;
+#else /* _WIN32 */
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int)n : 1;
+#endif /* _WIN32 */
+}
+
+/* What `ReadLine' does to a line: cutting comments off and trimming spaces.
+ * Return FALSE if it's too long or empty.
+ */
+static BOOL HostsLoader_GetLine(const char *Itr, size_t Length, char *Line)
+{
+    size_t Copied = Length < HOSTS_LINE_MAX - 1 ? Length : HOSTS_LINE_MAX - 1;
+    char *Mark, *Home, *End;
+
+    memcpy(Line, Itr, Copied);
+    Line[Copied] = '\0';
+
+    Mark = strchr(Line, '#');
+    if( Mark == NULL )
+    {
+        Mark = strchr(Line, ';');
+    }
+
+    if( Mark != NULL )
+    {
+        *Mark = '\0';
+    } else if( Copied < Length )
+    {
+        ERRORMSG("Hosts is too long : %s\n", Line);
+        return FALSE;
+    }
+
+    for( Home = Line; isspace(*Home); ++Home );
+
+    for( End = Home + strlen(Home); End > Home && isspace(*(End - 1)); --End );
+    *End = '\0';
+
+    if( *Home == '\0' )
+    {
+        return FALSE;
+    }
+
+    if( Home != Line )
+    {
+        memmove(Line, Home, End - Home + 1);
+    }
+
+    return TRUE;
+}
+
+static int HostsLoader_Pack(HostsChunk *c, const HostsRecord *r)
+{
+    HostsPacked p;
+    size_t Size;
+
+    p.Type = r->Type;
+    p.DomainLength = strlen(r->Domain) + 1;
+    p.DataLength = r->DataLength;
+
+    Size = ROUND_UP(sizeof(HostsPacked) + p.DomainLength + p.DataLength,
+                    sizeof(int)
+                    );
+
+    if( c->Used + Size > c->Allocated )
+    {
+        size_t NewAllocated = c->Allocated * 2 + Size;
+
+        if( SafeRealloc((void **)&(c->Records), NewAllocated) != 0 )
+        {
+            return -1;
+        }
+
+        c->Allocated = NewAllocated;
+    }
+
+    memcpy(c->Records + c->Used, &p, sizeof(HostsPacked));
+    memcpy(c->Records + c->Used + sizeof(HostsPacked),
+           r->Domain,
+           p.DomainLength
+           );
+    memcpy(c->Records + c->Used + sizeof(HostsPacked) + p.DomainLength,
+           r->Data,
+           p.DataLength
+           );
+
+    c->Used += Size;
+
+    return 0;
+}
+
+static int
+#ifdef _WIN32
+WINAPI
+#endif
+HostsLoader_Parse(HostsChunk *c)
+{
+    char Line[HOSTS_LINE_MAX];
+    HostsRecord r;
+    const char *Itr = c->Start;
+
+    while( Itr < c->End )
+    {
+        const char *Next = memchr(Itr, '\n', c->End - Itr);
+
+        Next = Next == NULL ? c->End : Next + 1;
+
+        if( HostsLoader_GetLine(Itr, Next - Itr, Line) &&
+            HostsContainer_Parse(Line, &r) != HOSTS_TYPE_UNKNOWN &&
+            HostsLoader_Pack(c, &r) != 0
+            )
+        {
+            c->Failed = 1;
+            break;
+        }
+
+        Itr = Next;
+    }
+
+    return 0;
+}
+
+/* Pass what a chunk parsed to `Func', and free it */
+static int HostsLoader_Merge(HostsChunk *c, HostsLoaderFunc Func, void *Arg)
+{
+    size_t Itr = 0;
+    int Count = 0;
+
+    while( Itr < c->Used )
+    {
+        HostsPacked p;
+        const char *Domain;
+
+        memcpy(&p, c->Records + Itr, sizeof(HostsPacked));
+        Domain = c->Records + Itr + sizeof(HostsPacked);
+
+        if( Func((HostsRecordType)p.Type,
+                 Domain,
+                 p.DataLength == 0 ? NULL : Domain + p.DomainLength,
+                 p.DataLength,
+                 Arg
+                 )
+            == 0 )
+        {
+            ++Count;
+        }
+
+        Itr += ROUND_UP(sizeof(HostsPacked) + p.DomainLength + p.DataLength,
+                        sizeof(int)
+                        );
+    }
+
+    SafeFree(c->Records);
+    c->Records = NULL;
+    c->Used = 0;
+    c->Allocated = 0;
+
+    return Count;
+}
+
+int HostsLoader_Enum(const char *File,
+                     int Threads,
+                     HostsLoaderFunc Func,
+                     void *Arg,
+                     int *Lines
+                     )
+{
+    HostsMap m;
+    HostsChunk Chunks[HOSTS_LOADER_THREADS_MAX];
+    int ChunkCount, loop, Count = 0, ret = 0;
+    const char *Itr;
+
+    ret = HostsLoader_Map(&m, File);
+    if( ret != 0 )
+    {
+        return ret;
+    }
+
+    if( Threads > 0 )
+    {
+        ChunkCount = Threads;
+    } else {
+        ChunkCount = HostsLoader_Processors();
+
+        if( (size_t)ChunkCount > m.Length / HOSTS_LOADER_CHUNK_MIN )
+        {
+            ChunkCount = (int)(m.Length / HOSTS_LOADER_CHUNK_MIN);
+        }
+    }
+
+    if( ChunkCount > HOSTS_LOADER_THREADS_MAX )
+    {
+        ChunkCount = HOSTS_LOADER_THREADS_MAX;
+    }
+
+    if( ChunkCount < 1 )
+    {
+        ChunkCount = 1;
+    }
+
+    /* Cut on line boundaries */
+    Itr = m.Base;
+    for( loop = 0; loop != ChunkCount; ++loop )
+    {
+        HostsChunk *c = Chunks + loop;
+        const char *End;
+
+        c->Start = Itr;
+        c->Records = NULL;
+        c->Used = 0;
+        c->Allocated = 0;
+        c->Failed = 0;
+        c->Thread = NULL_THREAD;
+
+        if( loop == ChunkCount - 1 )
+        {
+            End = m.Base + m.Length;
+        } else {
+            End = m.Base + m.Length / ChunkCount * (loop + 1);
+            if( End < Itr )
+            {
+                End = Itr;
+            }
+
+            End = memchr(End, '\n', m.Base + m.Length - End);
+            End = End == NULL ? m.Base + m.Length : End + 1;
+        }
+
+        c->End = End;
+        Itr = End;
+    }
+
+    /* The first one is parsed by this thread, the others alongside */
+    for( loop = 1; loop < ChunkCount; ++loop )
+    {
+        CREATE_THREAD(HostsLoader_Parse, Chunks + loop, Chunks[loop].Thread);
+    }
+
+    HostsLoader_Parse(Chunks);
+
+    for( loop = 0; loop != ChunkCount; ++loop )
+    {
+        HostsChunk *c = Chunks + loop;
+
+        if( c->Thread != NULL_THREAD )
+        {
+            JOIN_THREAD(c->Thread);
+        } else if( loop != 0 )
+        {
+            /* No thread could be created */
+            HostsLoader_Parse(c);
+        }
+
+        if( c->Failed )
+        {
+            ret = -37;
+        }
+
+        Count += HostsLoader_Merge(c, Func, Arg);
+    }
+
+    HostsLoader_Unmap(&m);
+
+    if( Lines != NULL )
+    {
+        *Lines = Count;
+    }
+
+    return ret;
+}
+
+typedef struct _HostsLoaderTarget{
+    HostsContainer  *Container;
+    Array           *Keys; /* Could be NULL */
+} HostsLoaderTarget;
+
+static int HostsLoader_Add(HostsRecordType Type,
+                           const char *Domain,
+                           const void *Data,
+                           int DataLength,
+                           HostsLoaderTarget *t
+                           )
+{
+    if( t->Container->AddParsed(t->Container, Type, Domain, Data, DataLength)
+        != 0 )
+    {
+        return -1;
+    }
+
+    if( t->Keys != NULL )
+    {
+        uint64_t Key = HostsContainer_Key(Type, Domain, Data);
+
+        Array_PushBack(t->Keys, &Key, NULL);
+    }
+
+    return 0;
+}
+
+static int HostsLoader_KeyCompare(const uint64_t *One, const uint64_t *Two)
+{
+    return *One < *Two ? -1 : *One > *Two;
+}
+
+int HostsLoader_LoadKeyed(HostsContainer *Container,
+                          const char *File,
+                          int Threads,
+                          Array *Keys,
+                          int *Lines
+                          )
+{
+    HostsLoaderTarget t;
+    int Count = 0, ret;
+    PTimer Timer;
+    unsigned long Elapsed;
+
+    PTimer_Start(&Timer);
+
+    t.Container = Container;
+    t.Keys = Keys;
+
+    ret = HostsLoader_Enum(File,
+                           Threads,
+                           (HostsLoaderFunc)HostsLoader_Add,
+                           &t,
+                           &Count
+                           );
+
+    if( Keys != NULL )
+    {
+        Array_Sort(Keys,
+                   (int (*)(const void *, const void *))HostsLoader_KeyCompare
+                   );
+    }
+
+    Elapsed = PTimer_End(&Timer);
+    INFO("Hosts `%s' loaded: %d lines in %lu ms (%lu lines/s).\n",
+         File,
+         Count,
+         Elapsed,
+         (unsigned long)((double)Count * 1000 / (Elapsed == 0 ? 1 : Elapsed))
+         );
+
+    if( Lines != NULL )
+    {
+        *Lines = Count;
+    }
+
+    return ret;
+}
+
+int HostsLoader_Load(HostsContainer *Container,
+                     const char *File,
+                     int Threads,
+                     int *Lines
+                     )
+{
+    return HostsLoader_LoadKeyed(Container, File, Threads, NULL, Lines);
+}
+
+typedef struct _HostsLoaderPatch{
+    const Array *BaseKeys;  /* Sorted */
+    Array       Keys;       /* Of the file */
+    Array       Added;      /* `HostsRecord's not in the base */
+    int         MaxAdded;
+    BOOL        TooMany;
+} HostsLoaderPatch;
+
+static int HostsLoader_Collect(HostsRecordType Type,
+                               const char *Domain,
+                               const void *Data,
+                               int DataLength,
+                               HostsLoaderPatch *p
+                               )
+{
+    uint64_t Key = HostsContainer_Key(Type, Domain, Data);
+    HostsRecord r;
+
+    if( Array_PushBack(&(p->Keys), &Key, NULL) < 0 )
+    {
+        return -1;
+    }
+
+    if( p->TooMany ||
+        bsearch(&Key,
+                Array_GetBySubscript(p->BaseKeys, 0),
+                Array_GetUsed(p->BaseKeys),
+                sizeof(uint64_t),
+                (int (*)(const void *, const void *))HostsLoader_KeyCompare
+                ) != NULL )
+    {
+        return 0;
+    }
+
+    /* Only the keys are needed for a full load */
+    if( Array_GetUsed(&(p->Added)) >= p->MaxAdded )
+    {
+        p->TooMany = TRUE;
+        return 0;
+    }
+
+    r.Type = Type;
+    strcpy(r.Domain, Domain);
+    if( Data != NULL )
+    {
+        memcpy(r.Data, Data, DataLength);
+    }
+    r.DataLength = DataLength;
+
+    return Array_PushBack(&(p->Added), &r, NULL) < 0 ? -1 : 0;
+}
+
+int HostsLoader_Patch(HostsContainer *Container,
+                      const char *File,
+                      const Array *BaseKeys,
+                      int MaxChanges,
+                      int *Changes
+                      )
+{
+    HostsLoaderPatch p;
+    Array Removed;
+    Region *PreviousRegion;
+    BOOL BaseWildCards = FALSE, AddedWildCards = FALSE;
+    int b = 0, n = 0, ret = 0;
+    PTimer Timer;
+    unsigned long Elapsed;
+
+    PTimer_Start(&Timer);
+
+    /* Nothing but the changes are kept in the region of `Container' */
+    PreviousRegion = Region_Enter(NULL);
+
+    Array_Init(&(p.Keys), sizeof(uint64_t), 0, FALSE, NULL);
+    Array_Init(&(p.Added), sizeof(HostsRecord), 0, FALSE, NULL);
+    Array_Init(&Removed, sizeof(uint64_t), 0, FALSE, NULL);
+
+    Region_Leave(PreviousRegion);
+
+    p.BaseKeys = BaseKeys;
+    p.MaxAdded = MaxChanges;
+    p.TooMany = FALSE;
+
+    /* Parsed once, records not in the base are kept aside */
+    if( HostsLoader_Enum(File,
+                         0,
+                         (HostsLoaderFunc)HostsLoader_Collect,
+                         &p,
+                         NULL
+                         )
+        != 0 )
+    {
+        ret = -1;
+        goto EXIT_1;
+    }
+
+    Array_Sort(&(p.Keys),
+               (int (*)(const void *, const void *))HostsLoader_KeyCompare
+               );
+
+    /* Both sorted, ones only in the base are removed. Duplicates count
+     * once, they can't be told apart.
+     */
+    while( b < Array_GetUsed(BaseKeys) )
+    {
+        uint64_t Key = *(uint64_t *)Array_GetBySubscript(BaseKeys, b);
+
+        BaseWildCards = BaseWildCards || (Key & 1) != 0;
+
+        while( n < Array_GetUsed(&(p.Keys)) &&
+               *(uint64_t *)Array_GetBySubscript(&(p.Keys), n) < Key )
+        {
+            ++n;
+        }
+
+        if( n == Array_GetUsed(&(p.Keys)) ||
+            *(uint64_t *)Array_GetBySubscript(&(p.Keys), n) != Key )
+        {
+            Array_PushBack(&Removed, &Key, NULL);
+        }
+
+        while( b < Array_GetUsed(BaseKeys) &&
+               *(uint64_t *)Array_GetBySubscript(BaseKeys, b) == Key )
+        {
+            ++b;
+        }
+    }
+
+    for( n = 0; n < Array_GetUsed(&(p.Added)); ++n )
+    {
+        const HostsRecord *r = Array_GetBySubscript(&(p.Added), n);
+
+        if( HostsContainer_Key(r->Type, r->Domain, NULL) & 1 )
+        {
+            AddedWildCards = TRUE;
+        }
+    }
+
+    if( Changes != NULL )
+    {
+        *Changes = Array_GetUsed(&(p.Added)) + Array_GetUsed(&Removed);
+    }
+
+    if( p.TooMany ||
+        Array_GetUsed(&(p.Added)) + Array_GetUsed(&Removed) > MaxChanges )
+    {
+        ret = 1;
+        goto EXIT_1;
+    }
+
+    /* A name whose records are all removed may match a wildcard instead,
+     * and a wildcard added would come before names of the base */
+    if( (Array_GetUsed(&Removed) > 0 && BaseWildCards) || AddedWildCards )
+    {
+        ret = 2;
+        goto EXIT_1;
+    }
+
+    for( b = 0; b < Array_GetUsed(&Removed); ++b )
+    {
+        if( Container->Remove(Container,
+                              *(uint64_t *)Array_GetBySubscript(&Removed, b)
+                              )
+            != 0 )
+        {
+            ret = -2;
+            goto EXIT_1;
+        }
+    }
+
+    for( n = 0; n < Array_GetUsed(&(p.Added)); ++n )
+    {
+        const HostsRecord *r = Array_GetBySubscript(&(p.Added), n);
+
+        /* Records of the base left would come after it */
+        if( Container->AddParsed(Container,
+                                 r->Type,
+                                 r->Domain,
+                                 r->Data,
+                                 r->DataLength
+                                 )
+            != 0 )
+        {
+            ret = 3;
+            goto EXIT_1;
+        }
+    }
+
+    Elapsed = PTimer_End(&Timer);
+    INFO("Hosts `%s' patched: %d added, %d removed in %lu ms.\n",
+         File,
+         Array_GetUsed(&(p.Added)),
+         Array_GetUsed(&Removed),
+         Elapsed
+         );
+
+EXIT_1:
+    Array_Free(&Removed);
+    Array_Free(&(p.Added));
+    Array_Free(&(p.Keys));
+
+    return ret;
+}
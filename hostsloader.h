@@ -0,0 +1,66 @@
+#ifndef HOSTSLOADER_H_INCLUDED
+#define HOSTSLOADER_H_INCLUDED
+
+#include "hostscontainer.h"
+#include "array.h"
+
+/* Gets the records of a file in file order, 0 if one is taken */
+typedef int (*HostsLoaderFunc)(HostsRecordType Type,
+                               const char *Domain,
+                               const void *Data, /* Could be NULL */
+                               int DataLength,
+                               void *Arg
+                               );
+
+/* Load a hosts file into `Container', for big files like ad-block lists.
+ *
+ * The file is mapped and cut into chunks on line boundaries. Lines of each
+ * chunk are parsed by a thread of its own, then added to `Container' by the
+ * calling thread in file order, so the result is the same as adding them one
+ * by one with `Load'.
+ *
+ * `Threads' 0 for one per processor, as far as the file is big enough.
+ * `Lines' gets how many hosts were added, could be NULL.
+ */
+int HostsLoader_Load(HostsContainer *Container,
+                     const char *File,
+                     int Threads,
+                     int *Lines
+                     );
+
+/* Parse a hosts file the same way, passing its records to `Func' instead.
+ * `Lines' gets how many were taken.
+ */
+int HostsLoader_Enum(const char *File,
+                     int Threads,
+                     HostsLoaderFunc Func,
+                     void *Arg,
+                     int *Lines
+                     );
+
+/* `HostsLoader_Load', also giving the sorted keys of the records added, see
+ * `HostsContainer_Key'. `Keys' is an `Array' of `uint64_t's, could be NULL.
+ */
+int HostsLoader_LoadKeyed(HostsContainer *Container,
+                          const char *File,
+                          int Threads,
+                          Array *Keys,
+                          int *Lines
+                          );
+
+/* Bring a container derived from the one loaded with `BaseKeys' up to date
+ * with `File', by adding and removing only the records that changed.
+ *
+ * Return 0 if done, a positive number if the changes should be loaded in
+ * full instead: more than `MaxChanges' of them, or ones that can't be made
+ * over the base, like records of names with wildcards. `Changes' gets how
+ * many there were, could be NULL.
+ */
+int HostsLoader_Patch(HostsContainer *Container,
+                      const char *File,
+                      const Array *BaseKeys,
+                      int MaxChanges,
+                      int *Changes
+                      );
+
+#endif /* HOSTSLOADER_H_INCLUDED */
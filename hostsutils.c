@@ -129,6 +129,16 @@ HostsUtilsTryResult HostsUtils_Try(MsgContext *MsgCtx,
     const char  *MatchState;
     HostsRecordType Type;
 
+    /* Most names are in no hosts, the lookups below are skipped for them */
+    if( !Container->MayContain(Container,
+                               Header->Domain,
+                               DomainHash_Get(&(Header->SuffixHashes), 0)
+                               )
+        )
+    {
+        return HOSTSUTILS_TRY_NONE;
+    }
+
     if( Header->Type != DNS_TYPE_CNAME &&
         HostsUtils_TypeExisting(Container, Header->Domain, HOSTS_TYPE_CNAME)
         )
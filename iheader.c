@@ -4,9 +4,58 @@
 #include "dnsgenerator.h"
 #include "common.h"
 #include "logs.h"
+#include "ptimer.h"
 
 static BOOL ap = FALSE;
 
+static int (*ChildHandler)(MsgContext *MsgCtx) = NULL;
+
+IHeaderCheck IHeader_Check(const char *DnsEntity, int EntityLength)
+{
+    const unsigned char *d = (const unsigned char *)DnsEntity;
+    int Here;
+
+    /* The root name, type and class */
+    if( EntityLength < DNS_HEADER_LENGTH + 1 + 4 )
+    {
+        return IHEADER_CHECK_SHORT;
+    }
+
+    if( (d[2] & 0x80) != 0 )
+    {
+        return IHEADER_CHECK_RESPONSE;
+    }
+
+    if( (d[2] & 0x78) != 0 )
+    {
+        return IHEADER_CHECK_OPCODE;
+    }
+
+    if( DNSGetQuestionCount(DnsEntity) != 1 )
+    {
+        return IHEADER_CHECK_QDCOUNT;
+    }
+
+    for( Here = DNS_HEADER_LENGTH; d[Here] != 0; Here += d[Here] + 1 )
+    {
+        /* Compression or extended labels, and room for what follows */
+        if( (d[Here] & 0xC0) != 0 ||
+            Here + d[Here] + 1 + 1 + 4 > EntityLength ||
+            Here + d[Here] + 1 - DNS_HEADER_LENGTH + 1 > 255
+            )
+        {
+            return IHEADER_CHECK_NAME;
+        }
+    }
+
+    if( GET_16_BIT_U_INT(d + Here + 3) != DNS_CLASS_IN )
+    {
+        return IHEADER_CHECK_CLASS;
+    }
+
+    return IHEADER_CHECK_OK;
+}
+
 void IHeader_Reset(IHeader *h)
 {
     h->Parent = NULL;
@@ -15,7 +64,9 @@ void IHeader_Reset(IHeader *h)
     h->BackAddress.family = AF_UNSPEC;
     h->Domain[0] = '\0';
     h->HashValue = 0;
+    h->SuffixHashes.Count = 0;
     h->EDNSEnabled = FALSE;
+    h->Upstream = NULL;
 }
 
 int IHeader_Fill(IHeader *h,
@@ -34,6 +85,11 @@ int IHeader_Fill(IHeader *h,
     h->Parent = NULL;
     h->RequestTcp = FALSE;
     h->EDNSEnabled = FALSE;
+    h->ReceivedTime = PTimer_MonotonicMicro();
+    h->SentTime = 0;
+    h->Upstream = NULL;
+    STAMP_CLEAR(h);
+    STAMP(h, STAMP_RECEIVED);
 
     if( DnsSimpleParser_Init(&p, DnsEntity, EntityLength, FALSE) != 0 )
     {
@@ -55,13 +111,22 @@ int IHeader_Fill(IHeader *h,
                 return -48;
             }
 
-            if( i.GetName(&i, h->Domain, sizeof(h->Domain)) < 0 )
+            /* Unpacking, lowercasing and hashing in one pass */
+            if( DomainHash_Unpack(p.RawDns,
+                                  p.RawDnsLength,
+                                  i.CurrentPosition,
+                                  h->Domain,
+                                  sizeof(h->Domain),
+                                  &(h->SuffixHashes)
+                                  )
+                < 0 )
             {
                 return -46;
             }
 
-            StrToLower(h->Domain);
-            h->HashValue = HASH(h->Domain, 0);
+            h->HashValue = h->SuffixHashes.Count > 0 ?
+                           h->SuffixHashes.Suffix[0] :
+                           HASH(h->Domain, 0);
             h->Type = (DNSRecordType)DNSGetRecordType(DNSJumpHeader(DnsEntity));
             break;
 
@@ -103,6 +168,23 @@ int IHeader_Fill(IHeader *h,
 }
 
 
+const char *IHeader_GetAgent(IHeader *h)
+{
+    if( h->Agent[0] != '\0' )
+    {
+        return h->Agent;
+    }
+
+    if( h->BackAddress.family == AF_INET )
+    {
+        IPv4AddressToAsc(&(h->BackAddress.Addr.Addr4.sin_addr), h->Agent);
+    } else if( h->BackAddress.family == AF_INET6 ) {
+        IPv6AddressToAsc(&(h->BackAddress.Addr.Addr6.sin6_addr), h->Agent);
+    }
+
+    return h->Agent;
+}
+
 int MsgContext_Init(BOOL _ap)
 {
     ap = _ap;
@@ -156,12 +238,22 @@ BOOL MsgContext_IsFromTCP(const MsgContext *MsgCtx)
     return (h->BackAddress.family == AF_UNSPEC);
 }
 
+void MsgContext_SetChildHandler(int (*Handler)(MsgContext *MsgCtx))
+{
+    ChildHandler = Handler;
+}
+
 int MsgContext_SendBack(MsgContext *MsgCtx)
 {
     IHeader *h = (IHeader *)MsgCtx;
     char *Content = (char *)(IHEADER_TAIL(h));
     int Length = h->EntityLength;
 
+    if( h->Parent != NULL && ChildHandler != NULL )
+    {
+        return ChildHandler(MsgCtx);
+    }
+
     if( MsgContext_IsFromTCP(MsgCtx) )
     {
         /* TCP */
@@ -178,6 +270,7 @@ int MsgContext_SendBack(MsgContext *MsgCtx)
             != Length )
         {
             /** TODO: Show error */
+            PROBE_QUERY2(send_back, h, Length, -112);
             return -112;
         }
     } else {
@@ -198,10 +291,15 @@ int MsgContext_SendBack(MsgContext *MsgCtx)
            != Length )
         {
             /** TODO: Show error */
+            PROBE_QUERY2(send_back, h, Length, -138);
             return -138;
         }
     }
 
+    STAMP(h, STAMP_SENT_BACK);
+    PROBE_QUERY2(send_back, h, Length, 0);
+    PROBE_STAMPS(h);
+
     return 0;
 }
 
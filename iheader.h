@@ -5,6 +5,8 @@
 #include "dnsparser.h"
 #include "dnsgenerator.h"
 #include "utils.h"
+#include "domainhash.h"
+#include "probes.h"
 
 typedef struct _IHeader IHeader;
 
@@ -15,11 +17,25 @@ struct _IHeader{
     BOOL        RequestTcp; /* Parent is from TCP. */
     time_t      Timestamp;
 
+    /* `PTimer_MonotonicMicro' values for latencies, of the query received
+     * and of it passed to `UdpM_Send' or `TcpM_Send'
+     */
+    uint64_t    ReceivedTime;
+    uint64_t    SentTime;
+
+    /* The server answering, set while its answer is handled, NULL if none */
+    const struct sockaddr   *Upstream;
+
+#ifdef STAMP_QUERIES
+    uint64_t    Stamps[STAMP_NUMBER_OF_STAGES];
+#endif /* STAMP_QUERIES */
+
     Address_Type    BackAddress;    /* UDP requires it while TCP doesn't */
     SOCKET          SendBackSocket;
 
     char            Domain[256];
     uint32_t        HashValue;
+    DomainHash      SuffixHashes;   /* Suffix[0] is `HashValue' */
     DNSRecordType   Type;
 
     BOOL            ReturnHeader;
@@ -47,6 +63,27 @@ struct _MsgContext{
 
 #define IHEADER_TAIL(ptr)   (void *)((IHeader *)(ptr) + 1)
 
+/* Why a query is dropped before it is parsed, by `IHeader_Check', or after,
+ * by `IHeader_Fill' failing
+ */
+typedef enum _IHeaderCheck{
+    IHEADER_CHECK_OK = 0,
+    IHEADER_CHECK_SHORT,    /* Shorter than a header and a root question */
+    IHEADER_CHECK_RESPONSE, /* QR set */
+    IHEADER_CHECK_OPCODE,   /* Not a standard query */
+    IHEADER_CHECK_QDCOUNT,  /* Not one question */
+    IHEADER_CHECK_NAME,     /* Overrunning, over 255 bytes, or compressed */
+    IHEADER_CHECK_CLASS,    /* Not IN */
+    IHEADER_CHECK_PARSE,
+
+    IHEADER_CHECK_COUNT
+} IHeaderCheck;
+
+/* Cheap checks on the raw bytes of a query from a client, so junk is dropped
+ * before anything is parsed, rendered or looked up
+ */
+IHeaderCheck IHeader_Check(const char *DnsEntity, int EntityLength);
+
 void IHeader_Reset(IHeader *h);
 
 int IHeader_Fill(IHeader *h,
@@ -56,9 +93,14 @@ int IHeader_Fill(IHeader *h,
                  const struct sockaddr *BackAddress,
                  SOCKET SendBackSocket,
                  sa_family_t Family,
-                 const char *Agent
+                 const char *Agent /* NULL to render it from `BackAddress' */
                  );
 
+/* The text of the client, rendered at the first call if left NULL to
+ * `IHeader_Fill', as only logging and client statistics need it
+ */
+const char *IHeader_GetAgent(IHeader *h);
+
 
 int MsgContext_Init(BOOL _ap);
 
@@ -68,6 +110,10 @@ BOOL MsgContext_IsBlocked(const MsgContext *MsgCtx);
 
 BOOL MsgContext_IsFromTCP(const MsgContext *MsgCtx);
 
+/* Answers of queries having a `Parent' are passed to `Handler' instead of
+ * being sent */
+void MsgContext_SetChildHandler(int (*Handler)(MsgContext *MsgCtx));
+
 int MsgContext_SendBack(MsgContext *MsgCtx);
 
 int MsgContext_SendBackRefusedMessage(MsgContext *MsgCtx);
@@ -225,6 +225,8 @@ void IpChunk_Free(IpChunk *ic)
     ic->CidrChunk.Free(&(ic->CidrChunk));
     ic->Datas.Free(&(ic->Datas));
     ic->Extra.Free(&(ic->Extra));
+    Array_Free(&(ic->Elements));
+    Lpm_Free(&(ic->Compiled));
 }
 
 int IpChunk_Init(IpChunk *ic)
@@ -249,8 +251,22 @@ int IpChunk_Init(IpChunk *ic)
         goto EXIT_3;
     }
 
+    if( Array_Init(&(ic->Elements), sizeof(IpElement), 0, FALSE, NULL) != 0 )
+    {
+        goto EXIT_4;
+    }
+
+    if( Lpm_Init(&(ic->Compiled)) != 0 )
+    {
+        goto EXIT_5;
+    }
+
     return 0;
 
+EXIT_5:
+    Array_Free(&(ic->Elements));
+EXIT_4:
+    ic->Extra.Free(&(ic->Extra));
 EXIT_3:
     ic->Datas.Free(&(ic->Datas));
 EXIT_2:
@@ -308,9 +324,66 @@ int IpChunk_Add(IpChunk *ic,
         elm = ic->CidrChunk.Add(&(ic->CidrChunk), &New);
     }
 
+    if( elm != NULL )
+    {
+        if( Array_PushBack(&(ic->Elements), &New, NULL) < 0 )
+        {
+            return -1;
+        }
+
+        Lpm_Free(&(ic->Compiled));
+    }
+
     return elm == NULL;
 }
 
+int IpChunk_Compile(IpChunk *ic)
+{
+    Lpm_Prefix *Prefixes;
+    int Count = 0;
+    int loop;
+    int ret;
+
+    if( ic == NULL )
+    {
+        return 0;
+    }
+
+    Prefixes = SafeMalloc(sizeof(Lpm_Prefix) * (Array_GetUsed(&(ic->Elements)) + 1));
+    if( Prefixes == NULL )
+    {
+        return -1;
+    }
+
+    for( loop = 0; loop != Array_GetUsed(&(ic->Elements)); ++loop )
+    {
+        const IpElement *e = Array_GetBySubscript(&(ic->Elements), loop);
+        const IpAddr *ipAddr = &(e->IpSet.Ip);
+        Lpm_Prefix *p = Prefixes + Count;
+
+        /* Addresses being looked up have no zones, so zoned ones never
+         * match.
+         */
+        if( !IpAddr_IsValid(ipAddr) || IpAddr_HasZone(ipAddr) )
+        {
+            continue;
+        }
+
+        p->Is6 = IpAddr_Is6(ipAddr);
+        memcpy(p->Addr, p->Is6 ? ipAddr->Addr : ipAddr->Addr + 12, p->Is6 ? 16 : 4);
+        p->Bits = e->IpSet.PrefixBits;
+        p->Value = loop;
+
+        ++Count;
+    }
+
+    ret = Lpm_Build(&(ic->Compiled), Prefixes, Count);
+
+    SafeFree(Prefixes);
+
+    return ret == 0 ? 0 : -2;
+}
+
 BOOL IpChunk_Find(IpChunk *ic, unsigned char *Ip, int IpBytes, int *Type, const char **Data)
 {
     IpElement   Key;
@@ -338,10 +411,22 @@ BOOL IpChunk_Find(IpChunk *ic, unsigned char *Ip, int IpBytes, int *Type, const
     Key.Type = 0;
     Key.Data = NULL;
 
-    Result = ic->AddrChunk.Search(&(ic->AddrChunk), &Key, NULL);
-    if( Result == NULL )
+    if( Lpm_IsBuilt(&(ic->Compiled)) )
     {
-        Result = ic->CidrChunk.Search(&(ic->CidrChunk), &Key, NULL);
+        int32_t Value = IpBytes == 4 ?
+                        Lpm_Lookup4(&(ic->Compiled), Ip) :
+                        Lpm_Lookup6(&(ic->Compiled), Ip);
+
+        if( Value >= 0 )
+        {
+            Result = (const IpElement *)Array_GetBySubscript(&(ic->Elements), Value);
+        }
+    } else {
+        Result = ic->AddrChunk.Search(&(ic->AddrChunk), &Key, NULL);
+        if( Result == NULL )
+        {
+            Result = ic->CidrChunk.Search(&(ic->CidrChunk), &Key, NULL);
+        }
     }
 
     if( Result == NULL )
@@ -2,6 +2,7 @@
 #define IPCHUNK_H_INCLUDED
 
 #include "bst.h"
+#include "lpm.h"
 #include "stablebuffer.h"
 #include "common.h"
 
@@ -42,6 +43,12 @@ typedef struct _IpChunk{
     Bst             CidrChunk;
     StableBuffer    Datas;
     StableBuffer    Extra;
+
+    /* `IpElement' in adding order */
+    Array           Elements;
+
+    /* Compiled `Elements', empty if not compiled */
+    Lpm             Compiled;
 } IpChunk;
 
 void IpChunk_Free(IpChunk *ic);
@@ -55,6 +62,11 @@ int IpChunk_Add(IpChunk *ic,
                 uint32_t DataLength
                 );
 
+/* Compile for longest prefix matching, call it after all are added. A later
+ * adding drops the compiled result.
+ */
+int IpChunk_Compile(IpChunk *ic);
+
 BOOL IpChunk_Find(IpChunk *ic, unsigned char *Ip, int IpBytes, int *Type, const char **Data);
 
 #endif /* IPCHUNK_H_INCLUDED */
@@ -3,7 +3,9 @@
 #include "utils.h"
 #include "readline.h"
 #include "logs.h"
-#include "rwlock.h"
+#include "region.h"
+#include "epoch.h"
+#include "filestamp.h"
 
 #define SIZE_OF_PATH_BUFFER 384
 
@@ -134,6 +136,11 @@ static void IPMisc_SetBlockNegative(IPMisc *m, BOOL Value)
     m->BlockNegative = Value;
 }
 
+static int IPMisc_Compile(IPMisc *m)
+{
+    return IpChunk_Compile(&(m->c));
+}
+
 static void IPMisc_Free(IPMisc *m)
 {
     IpChunk_Free(&(m->c));
@@ -151,6 +158,7 @@ int IPMisc_Init(IPMisc *m)
     m->AddBlockFromString = IPMisc_AddBlockFromString;
     m->AddSubstituteFromString = IPMisc_AddSubstituteFromString;
     m->SetBlockNegative = IPMisc_SetBlockNegative;
+    m->Compile = IPMisc_Compile;
     m->Process = IPMisc_Process;
 
     return 0;
@@ -158,25 +166,32 @@ int IPMisc_Init(IPMisc *m)
 
 /** Mapping */
 
-static IPMisc   *CurrIpMiscMapping = NULL;
-static RWLock   IpMiscMappingLock = NULL_RWLOCK;
+/* A generation of the mapping, replaced as a whole */
+typedef struct _IpMiscSet{
+    IPMisc  Mapping;
+    Region  Memory; /* Where `Mapping' is built */
+} IpMiscSet;
+
+static IpMiscSet    *CurrIpMiscMapping = NULL;
 static ConfigFileInfo   *CurrConfigInfo = NULL;
 
-static void IpMiscMapping_Free(IPMisc *ipMiscMapping)
+/* `FileStamp's of `IPSubstitutingFile's, in order */
+static Array    IPSubstitutingFileStamps = Array_Init_Static(sizeof(FileStamp));
+
+static void IpMiscMapping_Free(IpMiscSet *Set)
 {
-    if( ipMiscMapping == NULL )
+    if( Set != NULL )
     {
-        return;
+        IPMisc_Free(&(Set->Mapping));
+        Region_Free(&(Set->Memory));
+        SafeFree(Set);
     }
-
-    IPMisc_Free(ipMiscMapping);
-    SafeFree(ipMiscMapping);
 }
 
 static void IpMiscMapping_Cleanup(void)
 {
-    IpMiscMapping_Free(CurrIpMiscMapping);
-    RWLock_Destroy(IpMiscMappingLock);
+    IpMiscMapping_Free(EPOCH_EXCHANGE(CurrIpMiscMapping, NULL));
+    Array_Free(&IPSubstitutingFileStamps);
 }
 
 static int LoadIPSubstitutingFromFile(IPMisc *ipMiscMapping, const char *FilePath)
@@ -238,9 +253,47 @@ static int LoadIPSubstitutingFromFile(IPMisc *ipMiscMapping, const char *FilePat
     return 0;
 }
 
+/* Stamps of all the files are taken again */
+static BOOL IPSubstitutingFile_Changed(void)
+{
+    StringList *Files = ConfigGetStringList(CurrConfigInfo, "IPSubstitutingFile");
+    const char *FilePath;
+    StringListIterator i;
+    BOOL Changed = FALSE;
+    int Subscript = 0;
+
+    if( Files == NULL )
+    {
+        return FALSE;
+    }
+
+    if( StringListIterator_Init(&i, Files) != 0 )
+    {
+        return TRUE;
+    }
+
+    while( (FilePath = i.Next(&i)) != NULL )
+    {
+        char NewPath[SIZE_OF_PATH_BUFFER];
+
+        if( ExpandPathTo(NewPath, SIZE_OF_PATH_BUFFER, FilePath) != 0 ||
+            FileStamp_ChangedAt(&IPSubstitutingFileStamps, Subscript, NewPath)
+            )
+        {
+            Changed = TRUE;
+        }
+
+        ++Subscript;
+    }
+
+    return Changed;
+}
+
 static int IpMiscMapping_Load(void)
 {
+    IpMiscSet *TempSet;
     IPMisc *IpMiscMapping;
+    Region *PreviousRegion;
     StringList *BlockIP = ConfigGetStringList(CurrConfigInfo, "BlockIP");
     StringList *IPSubstituting = ConfigGetStringList(CurrConfigInfo, "IPSubstituting");
     StringList *IPSubstitutingFile = ConfigGetStringList(CurrConfigInfo, "IPSubstitutingFile");
@@ -256,12 +309,18 @@ static int IpMiscMapping_Load(void)
         return 0;
     }
 
-    IpMiscMapping = SafeMalloc(sizeof(IPMisc));
-    if( IpMiscMapping == NULL )
+    TempSet = SafeMalloc(sizeof(IpMiscSet));
+    if( TempSet == NULL )
     {
         return -146;
     }
 
+    IpMiscMapping = &(TempSet->Mapping);
+
+    /* All of a generation is built in one region, freed at once */
+    Region_Init(&(TempSet->Memory), 0);
+    PreviousRegion = Region_Enter(&(TempSet->Memory));
+
     if( IPMisc_Init(IpMiscMapping) != 0 )
     {
         ret = -147;
@@ -338,21 +397,28 @@ static int IpMiscMapping_Load(void)
         }
     }
 
-    RWLock_WrLock(IpMiscMappingLock);
+    if( IpMiscMapping->Compile(IpMiscMapping) != 0 )
+    {
+        WARNING("Compiling IP rules failed, slower matching used.\n");
+    }
 
-    IpMiscMapping_Free(CurrIpMiscMapping);
-    CurrIpMiscMapping = IpMiscMapping;
+    Region_Leave(PreviousRegion);
 
-    RWLock_UnWLock(IpMiscMappingLock);
+    /* Responses go on with the old generation until they see the new one */
+    TempSet = EPOCH_EXCHANGE(CurrIpMiscMapping, TempSet);
+    Epoch_Synchronize();
+    IpMiscMapping_Free(TempSet);
 
     INFO("Loading IPSubstituting(File)s completed.\n");
 
     return 0;
 
 EXIT_2:
-    IPMisc_Free(CurrIpMiscMapping);
+    IPMisc_Free(IpMiscMapping);
 EXIT_1:
-    SafeFree(IpMiscMapping);
+    Region_Leave(PreviousRegion);
+    Region_Free(&(TempSet->Memory));
+    SafeFree(TempSet);
 
    return ret;
 }
@@ -360,44 +426,64 @@ EXIT_1:
 int IpMiscMapping_Init(ConfigFileInfo *ConfigInfo)
 {
     int ret;
-    RWLock_Init(IpMiscMappingLock);
     CurrConfigInfo = ConfigInfo;
 
+    IPSubstitutingFile_Changed();
+
     ret = IpMiscMapping_Load();
     if( ret == 0 )
     {
         atexit(IpMiscMapping_Cleanup);
+    } else {
+        /* Tried again next time */
+        FileStamp_InitAll(&IPSubstitutingFileStamps);
     }
 
     return ret;
 }
 
-void IpMiscMapping_Update(void)
+BOOL IpMiscMapping_Update(void)
 {
     if ( ConfigGetBoolean(CurrConfigInfo, "ReloadIPSubstituting") )
     {
-        IpMiscMapping_Load();
+        if( IPSubstitutingFile_Changed() )
+        {
+            if( IpMiscMapping_Load() != 0 )
+            {
+                /* Tried again next time */
+                FileStamp_InitAll(&IPSubstitutingFileStamps);
+            }
+
+            return TRUE;
+        } else {
+            INFO("IPSubstitutingFile unchanged, not reloaded.\n");
+        }
     }
+
+    return FALSE;
 }
 
 int IPMiscMapping_Process(MsgContext *MsgCtx)
 {
     IHeader *h = (IHeader *)MsgCtx;
+    IpMiscSet *Set;
     int ret;
 
-    if( CurrIpMiscMapping == NULL )
+    Epoch_Enter();
+
+    Set = EPOCH_LOAD(CurrIpMiscMapping);
+    if( Set == NULL )
     {
+        Epoch_Leave();
         return IP_MISC_NOTHING;
     }
 
-    RWLock_RdLock(IpMiscMappingLock);
-
-    ret = CurrIpMiscMapping->Process(CurrIpMiscMapping,
-                                   IHEADER_TAIL(h),
-                                   h->EntityLength
-                                   );
+    ret = Set->Mapping.Process(&(Set->Mapping),
+                               IHEADER_TAIL(h),
+                               h->EntityLength
+                               );
 
-    RWLock_UnRLock(IpMiscMappingLock);
+    Epoch_Leave();
 
     return ret;
 }
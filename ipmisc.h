@@ -30,6 +30,8 @@ struct _IPMisc{
                                    const char *Substituter
                                    );
     void (*SetBlockNegative)(IPMisc *m, BOOL Value);
+    /* Call it after all are added */
+    int (*Compile)(IPMisc *m);
     int (*Process)(IPMisc *m,
                    char *DNSPackage, /* Without TCPLength */
                    int PackageLength
@@ -38,7 +40,8 @@ struct _IPMisc{
 
 int IPMisc_Init(IPMisc *m);
 
-void IpMiscMapping_Update(void);
+/* TRUE if the IP substituting file was reloaded */
+BOOL IpMiscMapping_Update(void);
 
 /** Mapping */
 
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include "latency.h"
+#include "ptimer.h"
+#include "utils.h"
+
+#ifdef __GNUC__
+    #define LATENCY_LOAD(v)         __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+    #define LATENCY_STORE(v, n)     __atomic_store_n(&(v), (n), __ATOMIC_RELEASE)
+#else /* __GNUC__ */
+    /* Plain loads and stores are ordered on x86 */
+    #define LATENCY_LOAD(v)         (_ReadWriteBarrier(), (v))
+    #define LATENCY_STORE(v, n)     do {_ReadWriteBarrier(); (v) = (n);} while( 0 )
+#endif /* __GNUC__ */
+
+/* Upstream servers beyond it are not timed */
+#define LATENCY_UPSTREAM_MAX    16
+
+typedef struct _UpstreamLatency{
+    Address_Type    Address;
+    char            Name[LENGTH_OF_IPV6_ADDRESS_ASCII + 16];
+    Histogram       h;
+} UpstreamLatency;
+
+static const char *TypeNames[LATENCY_TYPE_COUNT] = {
+    "hosts",
+    "cache",
+    "udp",
+    "tcp",
+    "tcp queue"
+};
+
+static Histogram Latencies[LATENCY_TYPE_COUNT];
+
+/* Entries below `UpstreamCount' are never changed but their histograms, so
+ * they are looked up without a lock. `UpstreamLock' guards adding.
+ */
+static UpstreamLatency  Upstreams[LATENCY_UPSTREAM_MAX];
+static int              UpstreamCount = 0;
+static EFFECTIVE_LOCK   UpstreamLock;
+
+int Latency_Init(void)
+{
+    int loop;
+
+    for( loop = 0; loop != LATENCY_TYPE_COUNT; ++loop )
+    {
+        Histogram_Init(Latencies + loop);
+    }
+
+    EFFECTIVE_LOCK_INIT(UpstreamLock);
+
+    return 0;
+}
+
+static uint32_t Latency_Since(uint64_t Since)
+{
+    uint64_t Elapsed = PTimer_MonotonicMicro() - Since;
+
+    return Elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)Elapsed;
+}
+
+void Latency_Record(LatencyType Type, uint64_t Since)
+{
+    if( Since == 0 || Type < 0 || Type >= LATENCY_TYPE_COUNT )
+    {
+        return;
+    }
+
+    Histogram_Record(Latencies + Type, Latency_Since(Since));
+}
+
+static BOOL Latency_SameAddress(const Address_Type *a, const struct sockaddr *b)
+{
+    if( a->family != b->sa_family )
+    {
+        return FALSE;
+    }
+
+    if( a->family == AF_INET )
+    {
+        const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+
+        return a->Addr.Addr4.sin_port == b4->sin_port &&
+               memcmp(&(a->Addr.Addr4.sin_addr), &(b4->sin_addr), sizeof(b4->sin_addr)) == 0;
+    } else {
+        const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+
+        return a->Addr.Addr6.sin6_port == b6->sin6_port &&
+               memcmp(&(a->Addr.Addr6.sin6_addr), &(b6->sin6_addr), sizeof(b6->sin6_addr)) == 0;
+    }
+}
+
+static UpstreamLatency *Latency_FindUpstream(const struct sockaddr *Upstream)
+{
+    int Count = LATENCY_LOAD(UpstreamCount);
+    int loop;
+    UpstreamLatency *u;
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        if( Latency_SameAddress(&(Upstreams[loop].Address), Upstream) )
+        {
+            return Upstreams + loop;
+        }
+    }
+
+    EFFECTIVE_LOCK_GET(UpstreamLock);
+
+    /* Added meanwhile? */
+    for( ; loop != UpstreamCount; ++loop )
+    {
+        if( Latency_SameAddress(&(Upstreams[loop].Address), Upstream) )
+        {
+            EFFECTIVE_LOCK_RELEASE(UpstreamLock);
+            return Upstreams + loop;
+        }
+    }
+
+    if( UpstreamCount == LATENCY_UPSTREAM_MAX )
+    {
+        EFFECTIVE_LOCK_RELEASE(UpstreamLock);
+        return NULL;
+    }
+
+    u = Upstreams + UpstreamCount;
+
+    memset(&(u->Address), 0, sizeof(Address_Type));
+    u->Address.family = Upstream->sa_family;
+
+    if( Upstream->sa_family == AF_INET )
+    {
+        char Ip[LENGTH_OF_IPV4_ADDRESS_ASCII];
+
+        memcpy(&(u->Address.Addr.Addr4), Upstream, sizeof(struct sockaddr_in));
+        IPv4AddressToAsc(&(u->Address.Addr.Addr4.sin_addr), Ip);
+        sprintf(u->Name, "%s:%d", Ip, ntohs(u->Address.Addr.Addr4.sin_port));
+    } else {
+        char Ip[LENGTH_OF_IPV6_ADDRESS_ASCII];
+
+        memcpy(&(u->Address.Addr.Addr6), Upstream, sizeof(struct sockaddr_in6));
+        IPv6AddressToAsc(&(u->Address.Addr.Addr6.sin6_addr), Ip);
+        sprintf(u->Name, "[%s]:%d", Ip, ntohs(u->Address.Addr.Addr6.sin6_port));
+    }
+
+    Histogram_Init(&(u->h));
+
+    LATENCY_STORE(UpstreamCount, UpstreamCount + 1);
+
+    EFFECTIVE_LOCK_RELEASE(UpstreamLock);
+
+    return u;
+}
+
+void Latency_RecordUpstream(const struct sockaddr *Upstream, uint64_t Since)
+{
+    UpstreamLatency *u;
+
+    if( Since == 0 ||
+        (Upstream->sa_family != AF_INET && Upstream->sa_family != AF_INET6)
+        )
+    {
+        return;
+    }
+
+    u = Latency_FindUpstream(Upstream);
+    if( u != NULL )
+    {
+        Histogram_Record(&(u->h), Latency_Since(Since));
+    }
+}
+
+static void Latency_EnumOne(const char *Name,
+                            const char *Upstream,
+                            const Histogram *h,
+                            LatencyEnumFunc Func,
+                            void *Arg
+                            )
+{
+    static const double Percentiles[LATENCY_PERCENTILE_COUNT] = LATENCY_PERCENTILES;
+    uint32_t Values[LATENCY_PERCENTILE_COUNT];
+    uint32_t Max;
+    uint64_t Count;
+
+    Count = Histogram_Percentiles(h,
+                                  Percentiles,
+                                  Values,
+                                  LATENCY_PERCENTILE_COUNT,
+                                  &Max
+                                  );
+
+    Func(Name, Upstream, Count, Histogram_Sum(h), Values, Max, Arg);
+}
+
+void Latency_Enum(LatencyEnumFunc Func, void *Arg)
+{
+    int Count = LATENCY_LOAD(UpstreamCount);
+    int loop;
+
+    for( loop = 0; loop != LATENCY_TYPE_COUNT; ++loop )
+    {
+        Latency_EnumOne(TypeNames[loop], NULL, Latencies + loop, Func, Arg);
+    }
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        Latency_EnumOne("upstream",
+                        Upstreams[loop].Name,
+                        &(Upstreams[loop].h),
+                        Func,
+                        Arg
+                        );
+    }
+}
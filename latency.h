@@ -0,0 +1,47 @@
+#ifndef LATENCY_H_INCLUDED
+#define LATENCY_H_INCLUDED
+
+#include "common.h"
+#include "histogram.h"
+
+/* Where the time of a query is spent, in microseconds */
+typedef enum _LatencyType{
+    /* From a query received to its answer sent back, by where it came from */
+    LATENCY_TYPE_HOSTS = 0,
+    LATENCY_TYPE_CACHE,
+    LATENCY_TYPE_UDP,
+    LATENCY_TYPE_TCP,
+
+    /* From `TcpM_Send' to the query taken by the TCP module's thread */
+    LATENCY_TYPE_TCP_QUEUE,
+
+    LATENCY_TYPE_COUNT
+} LatencyType;
+
+/* Percentiles read back */
+#define LATENCY_PERCENTILES {50.0, 90.0, 99.0, 99.9}
+#define LATENCY_PERCENTILE_COUNT    4
+
+/* `Name' is "upstream" for upstream servers, `Upstream' their address, NULL
+ * for the others.
+ */
+typedef void (*LatencyEnumFunc)(const char *Name,
+                                const char *Upstream,
+                                uint64_t Count,
+                                uint64_t Sum,
+                                const uint32_t *Percentiles,
+                                uint32_t Max,
+                                void *Arg
+                                );
+
+int Latency_Init(void);
+
+/* `Since' is a `PTimer_MonotonicMicro' value, 0 if not taken */
+void Latency_Record(LatencyType Type, uint64_t Since);
+
+/* Round trips to an upstream server, by its address */
+void Latency_RecordUpstream(const struct sockaddr *Upstream, uint64_t Since);
+
+void Latency_Enum(LatencyEnumFunc Func, void *Arg);
+
+#endif /* LATENCY_H_INCLUDED */
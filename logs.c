@@ -1,12 +1,47 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 #include "logs.h"
 #include "utils.h"
 #include "dnsparser.h"
+#include "mpscqueue.h"
 
 #define MAX_PATH_BUFFER     256
 
+#ifdef __GNUC__
+    #define LOG_INCREASE(v)     __atomic_fetch_add(&(v), 1, __ATOMIC_RELAXED)
+    #define LOG_GET(v)          __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#else /* __GNUC__ */
+    #define LOG_INCREASE(v)     InterlockedIncrement((LONG volatile *)&(v))
+    #define LOG_GET(v)          (*(volatile uint32_t *)&(v))
+#endif /* __GNUC__ */
+
+/* Messages waiting to be written in asynchronous mode */
+#define LOG_QUEUE_LENGTH    512
+
+/* Longer messages are cut */
+#define LOG_TEXT_LENGTH     1000
+
+/* How long the writer sleeps when there is nothing to write, in ms */
+#define LOG_WRITER_INTERVAL 50
+
+typedef struct _LogRecord{
+    const char  *Type; /* Could be NULL */
+    time_t      Time;
+    char        Text[LOG_TEXT_LENGTH];
+} LogRecord;
+
+/* Messages waiting in asynchronous mode. Each costs the thread making it one
+ * compare-and-swap and a `vsnprintf', never waiting for the disk. Messages
+ * finding it full are dropped and counted.
+ */
+static MpscQueue            Queue;
+static BOOL                 Asynchronous = FALSE;
+
+static volatile uint32_t    Dropped = 0;
+static uint32_t             DroppedReported = 0;
+
 static BOOL PrintConsole = FALSE;
 static BOOL DebugOn = FALSE;
 
@@ -18,6 +53,8 @@ static char FilePath[MAX_PATH_BUFFER];
 
 static EFFECTIVE_LOCK   PrintLock;
 
+static int Log_StartWriter(void);
+
 static void Log_Cleanup(void)
 {
     if( LogFile != NULL )
@@ -36,6 +73,11 @@ int Log_Init(ConfigFileInfo *ConfigInfo, BOOL PrintScreen, BOOL Debug)
 
     if( ConfigGetBoolean(ConfigInfo, "LogOn") == FALSE )
     {
+        if( PrintConsole && ConfigGetBoolean(ConfigInfo, "LogAsynchronous") )
+        {
+            return Log_StartWriter();
+        }
+
         return 0;
     }
 
@@ -75,6 +117,11 @@ int Log_Init(ConfigFileInfo *ConfigInfo, BOOL PrintScreen, BOOL Debug)
         return -60;
     }
 
+    if( ConfigGetBoolean(ConfigInfo, "LogAsynchronous") )
+    {
+        return Log_StartWriter();
+    }
+
     return 0;
 }
 
@@ -136,6 +183,155 @@ static void CheckLength(void)
     }
 }
 
+/* Write one message, under `PrintLock' */
+static void Log_Write(const char *Type, time_t Time, const char *Text)
+{
+    char DateAndTime[32];
+
+    strftime(DateAndTime, sizeof(DateAndTime), "%Y/%m/%d %X", localtime(&Time));
+
+    if( LogFile != NULL )
+    {
+        CheckLength();
+
+        CurrentLength += fprintf(LogFile,
+                                 Type == NULL ? "%s " : "%s [%s] ",
+                                 DateAndTime,
+                                 Type == NULL ? "" : Type
+                                 );
+        CurrentLength += fprintf(LogFile, "%s", Text);
+    }
+
+    if( PrintConsole )
+    {
+        printf(Type == NULL ? "%s " : "%s [%s] ",
+               DateAndTime,
+               Type == NULL ? "" : Type
+               );
+        printf("%s", Text);
+    }
+}
+
+/* Write what is queued, under `PrintLock'. Return how many were written. */
+static int Log_Drain(void)
+{
+    uint32_t NewlyDropped;
+    int Count = 0;
+
+    while( TRUE )
+    {
+        /* NULL for empty, or the message is still being made */
+        LogRecord *r = MpscQueue_Peek(&Queue);
+
+        if( r == NULL )
+        {
+            break;
+        }
+
+        Log_Write(r->Type, r->Time, r->Text);
+
+        MpscQueue_Pop(&Queue);
+        ++Count;
+    }
+
+    NewlyDropped = LOG_GET(Dropped) - DroppedReported;
+    if( NewlyDropped != 0 )
+    {
+        char Text[64];
+
+        sprintf(Text, "%u messages dropped, the log queue was full.\n", NewlyDropped);
+        Log_Write("WARN", time(NULL), Text);
+
+        DroppedReported += NewlyDropped;
+        ++Count;
+    }
+
+    if( Count > 0 && LogFile != NULL )
+    {
+        fflush(LogFile);
+    }
+
+    return Count;
+}
+
+static void
+#ifdef _WIN32
+WINAPI
+#endif
+Log_Writer(void *Unused)
+{
+    while( TRUE )
+    {
+        int Count;
+
+        EFFECTIVE_LOCK_GET(PrintLock);
+        Count = Log_Drain();
+        EFFECTIVE_LOCK_RELEASE(PrintLock);
+
+        if( Count == 0 )
+        {
+            SLEEP(LOG_WRITER_INTERVAL);
+        }
+    }
+}
+
+/* Before the file is closed */
+static void Log_WriterCleanup(void)
+{
+    EFFECTIVE_LOCK_GET(PrintLock);
+    Log_Drain();
+    EFFECTIVE_LOCK_RELEASE(PrintLock);
+}
+
+static int Log_StartWriter(void)
+{
+    ThreadHandle t;
+
+    if( MpscQueue_Init(&Queue, LOG_QUEUE_LENGTH, sizeof(LogRecord)) != 0 )
+    {
+        return -65;
+    }
+
+    Asynchronous = TRUE;
+
+    atexit(Log_WriterCleanup);
+
+    CREATE_THREAD(Log_Writer, NULL, t);
+    DETACH_THREAD(t);
+
+    return 0;
+}
+
+static void Log_Enqueue(const char *Type, const char *format, va_list ap)
+{
+    LogRecord *r = MpscQueue_Reserve(&Queue);
+    int Length;
+
+    if( r == NULL )
+    {
+        LOG_INCREASE(Dropped);
+        return;
+    }
+
+    r->Type = Type;
+    r->Time = time(NULL);
+
+    Length = vsnprintf(r->Text, sizeof(r->Text), format, ap);
+    if( Length < 0 || Length >= sizeof(r->Text) )
+    {
+        /* Cut, still a line */
+        r->Text[sizeof(r->Text) - 2] = '\n';
+        r->Text[sizeof(r->Text) - 1] = '\0';
+    }
+
+    MpscQueue_Commit(&Queue, r);
+}
+
+uint32_t Log_Dropped(void)
+{
+    return LOG_GET(Dropped);
+}
+
 void Log_Print(const char *Type, const char *format, ...)
 {
     va_list ap;
@@ -146,6 +342,14 @@ void Log_Print(const char *Type, const char *format, ...)
         return;
     }
 
+    if( Asynchronous )
+    {
+        va_start(ap, format);
+        Log_Enqueue(Type, format, ap);
+        va_end(ap);
+        return;
+    }
+
     GetCurDateAndTime(DateAndTime, sizeof(DateAndTime));
 
     va_start(ap, format);
@@ -183,24 +387,30 @@ void Log_Print(const char *Type, const char *format, ...)
 
 void ShowRefusingMessage(IHeader *h, const char *Message)
 {
-    Log_Print(NULL,
-              "[R][%s][%s][%s] %s.\n",
-              h->Agent,
-              DNSGetTypeName(h->Type),
-              h->Domain,
-              Message
-              );
+    if( PRINTON )
+    {
+        Log_Print(NULL,
+                  "[R][%s][%s][%s] %s.\n",
+                  IHeader_GetAgent(h),
+                  DNSGetTypeName(h->Type),
+                  h->Domain,
+                  Message
+                  );
+    }
 }
 
-void ShowTimeOutMessage(const IHeader *h, char Protocol)
+void ShowTimeOutMessage(IHeader *h, char Protocol)
 {
-    Log_Print(NULL,
-              "[%c][%s][%s][%s] Timed out.\n",
-              Protocol,
-              h->Agent,
-              DNSGetTypeName(h->Type),
-              h->Domain
-              );
+    if( PRINTON )
+    {
+        Log_Print(NULL,
+                  "[%c][%s][%s][%s] Timed out.\n",
+                  Protocol,
+                  IHeader_GetAgent(h),
+                  DNSGetTypeName(h->Type),
+                  h->Domain
+                  );
+    }
 }
 
 void ShowErrorMessage(IHeader *h, char Protocol)
@@ -217,7 +427,7 @@ void ShowErrorMessage(IHeader *h, char Protocol)
         Log_Print(NULL,
                   "[%c][%s][%s][%s] An error occured : %d : %s .\n",
                   Protocol,
-                  h->Agent,
+                  IHeader_GetAgent(h),
                   DNSGetTypeName(h->Type),
                   h->Domain,
                   ErrorNum,
@@ -239,7 +449,7 @@ void ShowNormalMessage(IHeader *h, char Protocol)
         Log_Print(NULL,
                   "[%c][%s][%s][%s] : %d bytes\n%s",
                   Protocol,
-                  h->Agent,
+                  IHeader_GetAgent(h),
                   DNSGetTypeName(h->Type),
                   h->Domain,
                   h->EntityLength,
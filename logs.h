@@ -17,6 +17,9 @@ BOOL Log_DebugOn(void);
 
 void Log_Print(const char *Type, const char *format, ...);
 
+/* Messages dropped for a full queue in asynchronous mode */
+uint32_t Log_Dropped(void);
+
 #define ERRORMSG(...)   Log_Print("ERROR", __VA_ARGS__)
 #define WARNING(...)    Log_Print("WARN", __VA_ARGS__)
 #define INFO(...)       Log_Print("INFO", __VA_ARGS__)
@@ -25,7 +28,7 @@ void Log_Print(const char *Type, const char *format, ...);
 
 void ShowRefusingMessage(IHeader *h, const char *Message);
 
-void ShowTimeOutMessage(const IHeader *h, char Protocol);
+void ShowTimeOutMessage(IHeader *h, char Protocol);
 
 void ShowErrorMessage(IHeader *h, char Protocol);
 
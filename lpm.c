@@ -0,0 +1,459 @@
+#include <string.h>
+#include "lpm.h"
+#include "utils.h"
+#include "region.h"
+
+#define LPM4_FIRST_LEVEL    65536
+#define LPM4_CHUNK          256
+
+typedef struct _Lpm4_Item{
+    uint32_t    Addr; /* Host order, masked */
+    int32_t     Bits;
+    int32_t     Value;
+    int32_t     Order;
+} Lpm4_Item;
+
+/* Shorter prefixes first, so longer ones overwrite them when expanded, and
+ * no chunk of a level exists before all prefixes ending above it are in.
+ */
+static int Lpm4_ItemCompare(const Lpm4_Item *One, const Lpm4_Item *Two)
+{
+    if( One->Bits != Two->Bits )
+    {
+        return One->Bits - Two->Bits;
+    }
+
+    if( One->Addr != Two->Addr )
+    {
+        return One->Addr < Two->Addr ? -1 : 1;
+    }
+
+    return One->Order - Two->Order;
+}
+
+int Lpm_Init(Lpm *l)
+{
+    if( Array_Init(&(l->Table4), sizeof(int32_t), 0, FALSE, NULL) != 0 )
+    {
+        return -1;
+    }
+
+    if( Array_Init(&(l->Nodes6), sizeof(Lpm6_Node), 0, FALSE, NULL) != 0 )
+    {
+        Array_Free(&(l->Table4));
+        return -2;
+    }
+
+    return 0;
+}
+
+/* Append a chunk filled with `Entry', return its start, negative on error. */
+static int32_t Lpm4_NewChunk(Lpm *l, int32_t Entry)
+{
+    int32_t Start = Array_GetUsed(&(l->Table4));
+    int loop;
+
+    for( loop = 0; loop != LPM4_CHUNK; ++loop )
+    {
+        if( Array_PushBack(&(l->Table4), &Entry, NULL) < 0 )
+        {
+            return -1;
+        }
+    }
+
+    return Start;
+}
+
+/* The chunk below entry `Index', created if it's a leaf */
+static int32_t Lpm4_Descend(Lpm *l, int32_t Index)
+{
+    int32_t Entry = *(int32_t *)Array_GetBySubscript(&(l->Table4), Index);
+    int32_t Start;
+
+    if( Entry < 0 )
+    {
+        return -Entry;
+    }
+
+    Start = Lpm4_NewChunk(l, Entry);
+    if( Start < 0 )
+    {
+        return -1;
+    }
+
+    *(int32_t *)Array_GetBySubscript(&(l->Table4), Index) = -Start;
+
+    return Start;
+}
+
+static int Lpm4_Insert(Lpm *l, const Lpm4_Item *i)
+{
+    int32_t *Table;
+    int32_t Start;
+    int Shift;
+    int loop;
+
+    if( i->Bits <= 16 )
+    {
+        Start = i->Addr >> 16;
+        Shift = 16 - i->Bits;
+    } else {
+        Start = Lpm4_Descend(l, i->Addr >> 16);
+        if( Start < 0 )
+        {
+            return -1;
+        }
+
+        if( i->Bits <= 24 )
+        {
+            Start += (i->Addr >> 8) & 0xff;
+            Shift = 24 - i->Bits;
+        } else {
+            Start = Lpm4_Descend(l, Start + ((i->Addr >> 8) & 0xff));
+            if( Start < 0 )
+            {
+                return -1;
+            }
+
+            Start += i->Addr & 0xff;
+            Shift = 32 - i->Bits;
+        }
+    }
+
+    Table = (int32_t *)Array_GetRawArray(&(l->Table4));
+    for( loop = 0; loop != 1 << Shift; ++loop )
+    {
+        Table[Start + loop] = i->Value + 1;
+    }
+
+    return 0;
+}
+
+static int Lpm4_Build(Lpm *l, const Lpm_Prefix *Prefixes, int Count)
+{
+    Array Items;
+    Lpm4_Item *ItemArray;
+    Region *PreviousRegion;
+    int loop;
+    int ret = 0;
+
+    /* Only the result is kept in the region of the generation */
+    PreviousRegion = Region_Enter(NULL);
+    if( Array_Init(&Items, sizeof(Lpm4_Item), 0, FALSE, NULL) != 0 )
+    {
+        Region_Leave(PreviousRegion);
+        return -1;
+    }
+    Region_Leave(PreviousRegion);
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        const Lpm_Prefix *p = Prefixes + loop;
+        Lpm4_Item i;
+
+        if( p->Is6 )
+        {
+            continue;
+        }
+
+        i.Bits = p->Bits < 0 ? 0 : (p->Bits > 32 ? 32 : p->Bits);
+        i.Addr = ((uint32_t)p->Addr[0] << 24) | ((uint32_t)p->Addr[1] << 16) |
+                 ((uint32_t)p->Addr[2] << 8) | p->Addr[3];
+        i.Addr &= i.Bits == 0 ? 0 : ~0U << (32 - i.Bits);
+        i.Value = p->Value;
+        i.Order = loop;
+
+        if( Array_PushBack(&Items, &i, NULL) < 0 )
+        {
+            ret = -2;
+            goto EXIT;
+        }
+    }
+
+    if( Array_GetUsed(&Items) == 0 )
+    {
+        goto EXIT;
+    }
+
+    Array_Sort(&Items, (CompareFunc)Lpm4_ItemCompare);
+
+    /* The first level, as 256 chunks */
+    for( loop = 0; loop != LPM4_FIRST_LEVEL / LPM4_CHUNK; ++loop )
+    {
+        if( Lpm4_NewChunk(l, 0) < 0 )
+        {
+            ret = -3;
+            goto EXIT;
+        }
+    }
+
+    ItemArray = (Lpm4_Item *)Array_GetRawArray(&Items);
+    for( loop = 0; loop != Array_GetUsed(&Items); ++loop )
+    {
+        /* Identical ones are adjacent, the first one added is kept */
+        if( loop > 0 &&
+            ItemArray[loop].Bits == ItemArray[loop - 1].Bits &&
+            ItemArray[loop].Addr == ItemArray[loop - 1].Addr
+            )
+        {
+            continue;
+        }
+
+        if( Lpm4_Insert(l, ItemArray + loop) != 0 )
+        {
+            ret = -4;
+            goto EXIT;
+        }
+    }
+
+EXIT:
+    Array_Free(&Items);
+    return ret;
+}
+
+#define LPM6_BIT(Addr, Index)   (((Addr)[(Index) / 8] >> (7 - (Index) % 8)) & 1)
+
+/* Number of leading bits `One' and `Two' share, not more than `Limit' */
+static int Lpm6_Common(const unsigned char *One,
+                       const unsigned char *Two,
+                       int Limit
+                       )
+{
+    int Bits = 0;
+
+    while( Bits < Limit && One[Bits / 8] == Two[Bits / 8] )
+    {
+        Bits += 8;
+    }
+
+    while( Bits < Limit && LPM6_BIT(One, Bits) == LPM6_BIT(Two, Bits) )
+    {
+        ++Bits;
+    }
+
+    return Bits < Limit ? Bits : Limit;
+}
+
+static int32_t Lpm6_NewNode(Lpm *l,
+                            const unsigned char *Addr,
+                            int Bits,
+                            int32_t Value
+                            )
+{
+    Lpm6_Node n;
+    int loop;
+
+    memset(n.Addr, 0, sizeof(n.Addr));
+    for( loop = 0; loop < Bits; loop += 8 )
+    {
+        n.Addr[loop / 8] = Addr[loop / 8] &
+                           (Bits - loop >= 8 ? 0xff : 0xff << (8 - (Bits - loop)));
+    }
+
+    n.Bits = Bits;
+    n.Value = Value;
+    n.Child[0] = -1;
+    n.Child[1] = -1;
+
+    return Array_PushBack(&(l->Nodes6), &n, NULL);
+}
+
+#define LPM6_NODE(l, Index) \
+    ((Lpm6_Node *)Array_GetBySubscript(&((l)->Nodes6), (Index)))
+
+static int Lpm6_Insert(Lpm *l, const unsigned char *Addr, int Bits, int32_t Value)
+{
+    int32_t Current = 0;
+
+    while( TRUE )
+    {
+        Lpm6_Node *n = LPM6_NODE(l, Current);
+        const Lpm6_Node *c;
+        int32_t Child;
+        int32_t Split;
+        int Branch;
+        int Common;
+
+        if( n->Bits == Bits )
+        {
+            if( n->Value < 0 )
+            {
+                n->Value = Value;
+            }
+            return 0;
+        }
+
+        Branch = LPM6_BIT(Addr, n->Bits);
+        Child = n->Child[Branch];
+        if( Child < 0 )
+        {
+            Child = Lpm6_NewNode(l, Addr, Bits, Value);
+            if( Child < 0 )
+            {
+                return -1;
+            }
+
+            LPM6_NODE(l, Current)->Child[Branch] = Child;
+            return 0;
+        }
+
+        c = LPM6_NODE(l, Child);
+        Common = Lpm6_Common(Addr, c->Addr, Bits < c->Bits ? Bits : c->Bits);
+        if( Common == c->Bits )
+        {
+            Current = Child;
+            continue;
+        }
+
+        /* Diverging within the child's path, a node is put in between */
+        Split = Lpm6_NewNode(l, Addr, Common, Common == Bits ? Value : -1);
+        if( Split < 0 )
+        {
+            return -1;
+        }
+
+        c = LPM6_NODE(l, Child);
+        LPM6_NODE(l, Split)->Child[LPM6_BIT(c->Addr, Common)] = Child;
+
+        if( Common != Bits )
+        {
+            int32_t Leaf = Lpm6_NewNode(l, Addr, Bits, Value);
+            if( Leaf < 0 )
+            {
+                return -1;
+            }
+
+            LPM6_NODE(l, Split)->Child[LPM6_BIT(Addr, Common)] = Leaf;
+        }
+
+        LPM6_NODE(l, Current)->Child[Branch] = Split;
+        return 0;
+    }
+}
+
+static int Lpm6_Build(Lpm *l, const Lpm_Prefix *Prefixes, int Count)
+{
+    int loop;
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        const Lpm_Prefix *p = Prefixes + loop;
+        int Bits = p->Bits < 0 ? 0 : (p->Bits > 128 ? 128 : p->Bits);
+
+        if( !p->Is6 )
+        {
+            continue;
+        }
+
+        if( Array_GetUsed(&(l->Nodes6)) == 0 &&
+            Lpm6_NewNode(l, p->Addr, 0, -1) < 0
+            )
+        {
+            return -1;
+        }
+
+        if( Lpm6_Insert(l, p->Addr, Bits, p->Value) != 0 )
+        {
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+int Lpm_Build(Lpm *l, const Lpm_Prefix *Prefixes, int Count)
+{
+    Lpm_Free(l);
+    if( Lpm_Init(l) != 0 )
+    {
+        return -1;
+    }
+
+    if( Lpm4_Build(l, Prefixes, Count) != 0 )
+    {
+        Lpm_Free(l);
+        return -2;
+    }
+
+    if( Lpm6_Build(l, Prefixes, Count) != 0 )
+    {
+        Lpm_Free(l);
+        return -3;
+    }
+
+    return 0;
+}
+
+int32_t Lpm_Lookup4(const Lpm *l, const unsigned char Addr[4])
+{
+    const int32_t *Table = (const int32_t *)Array_GetRawArray(&(l->Table4));
+    uint32_t a;
+    int32_t Entry;
+
+    if( Array_GetUsed(&(l->Table4)) == 0 )
+    {
+        return -1;
+    }
+
+    a = ((uint32_t)Addr[0] << 24) | ((uint32_t)Addr[1] << 16) |
+        ((uint32_t)Addr[2] << 8) | Addr[3];
+
+    Entry = Table[a >> 16];
+    if( Entry < 0 )
+    {
+        Entry = Table[-Entry + ((a >> 8) & 0xff)];
+        if( Entry < 0 )
+        {
+            Entry = Table[-Entry + (a & 0xff)];
+        }
+    }
+
+    return Entry - 1;
+}
+
+int32_t Lpm_Lookup6(const Lpm *l, const unsigned char Addr[16])
+{
+    const Lpm6_Node *Nodes = (const Lpm6_Node *)Array_GetRawArray(&(l->Nodes6));
+    int32_t Current = 0;
+    int32_t Best = -1;
+
+    if( Array_GetUsed(&(l->Nodes6)) == 0 )
+    {
+        return -1;
+    }
+
+    while( Current >= 0 )
+    {
+        const Lpm6_Node *n = Nodes + Current;
+        int Full = n->Bits / 8;
+
+        /* Skipped bits of the path have to match */
+        if( memcmp(n->Addr, Addr, Full) != 0 ||
+            (n->Bits % 8 != 0 &&
+             ((n->Addr[Full] ^ Addr[Full]) & (0xff << (8 - n->Bits % 8)) & 0xff) != 0)
+            )
+        {
+            break;
+        }
+
+        if( n->Value >= 0 )
+        {
+            Best = n->Value;
+        }
+
+        if( n->Bits == 128 )
+        {
+            break;
+        }
+
+        Current = n->Child[LPM6_BIT(Addr, n->Bits)];
+    }
+
+    return Best;
+}
+
+void Lpm_Free(Lpm *l)
+{
+    Array_Free(&(l->Table4));
+    Array_Free(&(l->Nodes6));
+}
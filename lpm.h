@@ -0,0 +1,57 @@
+#ifndef LPM_H_INCLUDED
+#define LPM_H_INCLUDED
+
+#include "array.h"
+
+/* Longest prefix matching of IP addresses, built once from a fixed set of
+ * prefixes.
+ *
+ * IPv4 uses a multibit trie of strides 16, 8 and 8 (DIR-16-8-8), so a lookup
+ * reads at most three table entries. The full 2^24 first level of DIR-24-8
+ * is too big for a DNS forwarder. IPv6 uses a path-compressed binary trie,
+ * only nodes holding prefixes or branching are kept.
+ */
+
+typedef struct _Lpm_Prefix{
+    unsigned char   Addr[16]; /* 4 bytes used for IPv4, in network order */
+    int             Bits;
+    BOOL            Is6;
+    int32_t         Value; /* Non-negative */
+} Lpm_Prefix;
+
+typedef struct _Lpm6_Node{
+    unsigned char   Addr[16]; /* Masked to `Bits' */
+    int32_t         Bits;
+    int32_t         Value; /* -1 if no prefix ends here */
+    int32_t         Child[2]; /* -1 if none */
+} Lpm6_Node;
+
+typedef struct _Lpm{
+    /* `int32_t' entries, 65536 of the first level and then chunks of 256.
+     * An entry is 0 for none, Value + 1 for a prefix, or -(chunk start) for
+     * the next level.
+     */
+    Array   Table4;
+
+    /* `Lpm6_Node', the root is the first one */
+    Array   Nodes6;
+} Lpm;
+
+int Lpm_Init(Lpm *l);
+
+#define Lpm_IsBuilt(l_ptr)  (Array_GetUsed(&((l_ptr)->Table4)) > 0 || \
+                             Array_GetUsed(&((l_ptr)->Nodes6)) > 0)
+
+/* Any previous content is dropped. Of identical prefixes, the first one in
+ * `Prefixes' is kept.
+ */
+int Lpm_Build(Lpm *l, const Lpm_Prefix *Prefixes, int Count);
+
+/* Return `Value' of the longest prefix containing the address, or -1. */
+int32_t Lpm_Lookup4(const Lpm *l, const unsigned char Addr[4]);
+
+int32_t Lpm_Lookup6(const Lpm *l, const unsigned char Addr[16]);
+
+void Lpm_Free(Lpm *l);
+
+#endif /* LPM_H_INCLUDED */
@@ -22,6 +22,10 @@
 #include "tcpfrontend.h"
 #include "timedtask.h"
 #include "domainstatistic.h"
+#include "latency.h"
+#include "querylog.h"
+#include "metrics.h"
+#include "domainlist.h"
 
 #define VERSION__ "6.6.0"
 #define DESCRIPTIONS "DNSforwarder\nVersion: "VERSION__". License: GPL v3.\nTime of compilation: "__DATE__" "__TIME__".\n\n"
@@ -65,6 +69,9 @@ static int EnvironmentInit(void)
     TmpTypeDescriptor.INT32 = 102400;
     ConfigAddOption(&ConfigInfo, "LogFileThresholdLength", STRATEGY_DEFAULT, TYPE_INT32, TmpTypeDescriptor);
 
+    TmpTypeDescriptor.boolean = FALSE;
+    ConfigAddOption(&ConfigInfo, "LogAsynchronous", STRATEGY_DEFAULT, TYPE_BOOLEAN, TmpTypeDescriptor);
+
     GetFileDirectory(TmpStr);
     strcat(TmpStr, PATH_SLASH_STR);
     TmpTypeDescriptor.str = TmpStr;
@@ -80,6 +87,12 @@ static int EnvironmentInit(void)
     ConfigAddOption(&ConfigInfo, "TCPLocal", STRATEGY_APPEND_DISCARD_DEFAULT, TYPE_STRING, TmpTypeDescriptor);
     ConfigSetStringDelimiters(&ConfigInfo, "TCPLocal", ",");
 
+    TmpTypeDescriptor.INT32 = 0;
+    ConfigAddOption(&ConfigInfo, "RateLimit", STRATEGY_DEFAULT, TYPE_INT32, TmpTypeDescriptor);
+
+    TmpTypeDescriptor.INT32 = 2;
+    ConfigAddOption(&ConfigInfo, "RateLimitSlip", STRATEGY_DEFAULT, TYPE_INT32, TmpTypeDescriptor);
+
     TmpTypeDescriptor.str = NULL;
     ConfigAddOption(&ConfigInfo, "ServerGroup", STRATEGY_APPEND_DISCARD_DEFAULT, TYPE_STRING, TmpTypeDescriptor);
     ConfigSetStringDelimiters(&ConfigInfo, "ServerGroup", "\t ");
@@ -138,6 +151,18 @@ static int EnvironmentInit(void)
     TmpTypeDescriptor.INT32 = 60;
     ConfigAddOption(&ConfigInfo, "StatisticUpdateInterval", STRATEGY_DEFAULT, TYPE_INT32, TmpTypeDescriptor);
 
+    TmpTypeDescriptor.INT32 = 0;
+    ConfigAddOption(&ConfigInfo, "StatisticMaxEntries", STRATEGY_DEFAULT, TYPE_INT32, TmpTypeDescriptor);
+
+    TmpTypeDescriptor.str = NULL;
+    ConfigAddOption(&ConfigInfo, "MetricsListen", STRATEGY_DEFAULT, TYPE_STRING, TmpTypeDescriptor);
+
+    TmpTypeDescriptor.str = NULL;
+    ConfigAddOption(&ConfigInfo, "QueryLog", STRATEGY_DEFAULT, TYPE_STRING, TmpTypeDescriptor);
+
+    TmpTypeDescriptor.INT32 = 1;
+    ConfigAddOption(&ConfigInfo, "QueryLogSampleRate", STRATEGY_DEFAULT, TYPE_INT32, TmpTypeDescriptor);
+
     TmpTypeDescriptor.str = NULL;
     ConfigAddOption(&ConfigInfo, "Hosts", STRATEGY_APPEND, TYPE_PATH, TmpTypeDescriptor);
 
@@ -216,6 +241,9 @@ static int EnvironmentInit(void)
     TmpTypeDescriptor.str = NULL;
     ConfigAddOption(&ConfigInfo, "DisabledList", STRATEGY_APPEND, TYPE_PATH, TmpTypeDescriptor);
 
+    TmpTypeDescriptor.INT32 = 0;
+    ConfigAddOption(&ConfigInfo, "PrefilterFalsePositive", STRATEGY_DEFAULT, TYPE_INT32, TmpTypeDescriptor);
+
     TmpTypeDescriptor.str = NULL;
     ConfigAddOption(&ConfigInfo, "GoodIPList", STRATEGY_APPEND, TYPE_STRING, TmpTypeDescriptor);
 
@@ -380,6 +408,10 @@ static int ArgParse(int argc, char *argv_ori[])
                   "  -q         Quiet mode. Do not print any information.\n"
                   "  -D         Show debug messages.\n"
                   "  -d         Daemon mode. Running at background.\n"
+                  "\n"
+                  "  --compile-list <INPUT> <OUTPUT>\n"
+                  "             Compile domain list <INPUT> into <OUTPUT>, which could\n"
+                  "             be used as a `DisabledList' and is loaded much faster.\n"
 #ifndef _WIN32
                   "\n"
                   "  -p         Prepare needed environment.\n"
@@ -421,6 +453,27 @@ static int ArgParse(int argc, char *argv_ori[])
             continue;
         }
 
+        if( strcmp("--compile-list", *argv) == 0 )
+        {
+            int ret;
+
+            if( argv[1] == NULL || argv[2] == NULL )
+            {
+                printf("Usage : --compile-list <INPUT> <OUTPUT>\n");
+                exit(1);
+            }
+
+            ret = DomainList_Compile(argv[1], argv[2]);
+            if( ret < 0 )
+            {
+                printf("Compiling `%s' failed : %d.\n", argv[1], ret);
+                exit(1);
+            }
+
+            printf("%d entries compiled into `%s'.\n", ret, argv[2]);
+            exit(0);
+        }
+
 #ifndef _WIN32
         if( strcmp("-p", *argv) == 0 )
         {
@@ -549,6 +602,16 @@ int main(int argc, char *argv[])
         return -505;
     }
 
+    if( Latency_Init() != 0 )
+    {
+        return -507;
+    }
+
+    if( QueryLog_Init(&ConfigInfo) != 0 )
+    {
+        return -509;
+    }
+
     if( DomainStatistic_Init(&ConfigInfo) != 0 )
     {
         return -496;
@@ -569,6 +632,11 @@ int main(int argc, char *argv[])
         return -305;
     }
 
+    if( Metrics_Init(&ConfigInfo) != 0 )
+    {
+        return -508;
+    }
+
     if( UdpStatus == 0 )
     {
         UdpFrontend_StartWork();
@@ -50,6 +50,8 @@ static void ModuleContext_Sweep(ModuleContext *c, SweepCallback cb, void *Arg)
         }
 
         c->d.Delete(&(c->d), *Context);
+        --(c->InFlight);
+        ++(c->TimedOut);
     }
 
     Array_Free(&Pending);
@@ -58,6 +60,7 @@ static void ModuleContext_Sweep(ModuleContext *c, SweepCallback cb, void *Arg)
 static MsgContext *ModuleContext_Add(ModuleContext *c, MsgContext *MsgCtx)
 {
     IHeader *h;
+    MsgContext *Added;
 
     if( MsgCtx == NULL )
     {
@@ -67,7 +70,13 @@ static MsgContext *ModuleContext_Add(ModuleContext *c, MsgContext *MsgCtx)
     h = (IHeader *)MsgCtx;
     h->Timestamp = time(NULL);
 
-    return (MsgContext *)(c->d.Add(&(c->d), MsgCtx));
+    Added = (MsgContext *)(c->d.Add(&(c->d), MsgCtx));
+    if( Added != NULL )
+    {
+        ++(c->InFlight);
+    }
+
+    return Added;
 }
 
 static const MsgContext *ModuleContext_Find(ModuleContext *c, MsgContext *Input)
@@ -78,6 +87,7 @@ static const MsgContext *ModuleContext_Find(ModuleContext *c, MsgContext *Input)
 static void ModuleContext_Del(ModuleContext *c, MsgContext *Input)
 {
     c->d.Delete(&(c->d), Input);
+    --(c->InFlight);
 }
 
 static int ModuleContext_GenAnswerHeaderAndRemove(ModuleContext *c,
@@ -110,6 +120,7 @@ static int ModuleContext_GenAnswerHeaderAndRemove(ModuleContext *c,
 
     IHeader_Reset((IHeader *)ri);
     c->d.Delete(&(c->d), ri);
+    --(c->InFlight);
 
     return 0;
 }
@@ -141,11 +152,14 @@ int ModuleContext_Init(ModuleContext *c, int ItemLength)
         return -86;
     }
 
-    if( Bst_Init(&(c->d), ItemLength, ModuleContextCompare) != 0 )
+    if( Bst_InitBalanced(&(c->d), ItemLength, ModuleContextCompare) != 0 )
     {
         return -106;
     }
 
+    c->InFlight = 0;
+    c->TimedOut = 0;
+
     c->Add = ModuleContext_Add;
     c->Del = ModuleContext_Del;
     c->Find = ModuleContext_Find;
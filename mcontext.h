@@ -13,6 +13,10 @@ struct _ModuleContext{
     /* private */
     Bst d;
 
+    /* public, kept under the module's lock, read by metrics without it */
+    volatile int        InFlight;
+    volatile uint32_t   TimedOut; /* Removed by `Sweep' */
+
     /* public */
     MsgContext *(*Add)(ModuleContext *c, MsgContext *MsgCtx);
     void (*Del)(ModuleContext *c, MsgContext *MsgCtx);
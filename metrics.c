@@ -0,0 +1,801 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "metrics.h"
+#include "addresslist.h"
+#include "histogram.h"
+#include "latency.h"
+#include "dnscache.h"
+#include "timedtask.h"
+#include "mmgr.h"
+#include "ptimer.h"
+#include "utils.h"
+#include "logs.h"
+#include "querylog.h"
+
+#ifndef _WIN32
+    #include <sys/un.h>
+#endif /* _WIN32 */
+
+#ifdef __GNUC__
+    #define METRICS_INCREASE(v) __atomic_fetch_add(&(v), 1, __ATOMIC_RELAXED)
+    #define METRICS_GET(v)      __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#else /* __GNUC__ */
+    #define METRICS_INCREASE(v) InterlockedIncrement64((LONGLONG volatile *)&(v))
+    #define METRICS_GET(v)      InterlockedCompareExchange64((LONGLONG volatile *)&(v), 0, 0)
+#endif /* __GNUC__ */
+
+/* A page is served in one go, bigger ones are cut */
+#define METRICS_PAGE_MAX    (1024 * 1024)
+
+/* Waiting for a request */
+#define METRICS_REQUEST_TIMEOUT 1000
+
+/* Waiting for a scraper to take more of the answer */
+#define METRICS_SEND_TIMEOUT    5000
+
+/* Query types counted by themselves, the others together */
+static const DNSRecordType QueryTypes[] = {
+    DNS_TYPE_A,
+    DNS_TYPE_NS,
+    DNS_TYPE_CNAME,
+    DNS_TYPE_SOA,
+    DNS_TYPE_PTR,
+    DNS_TYPE_MX,
+    DNS_TYPE_TXT,
+    DNS_TYPE_AAAA,
+    DNS_TYPE_SRV,
+    DNS_TYPE_SVCB,
+    DNS_TYPE_HTTPS,
+    DNS_TYPE_ANY
+};
+
+#define QUERY_TYPE_COUNT    (sizeof(QueryTypes) / sizeof(QueryTypes[0]) + 1)
+
+static const char *QueryTypeNames[QUERY_TYPE_COUNT] = {
+    "A",
+    "NS",
+    "CNAME",
+    "SOA",
+    "PTR",
+    "MX",
+    "TXT",
+    "AAAA",
+    "SRV",
+    "SVCB",
+    "HTTPS",
+    "ANY",
+    "other"
+};
+
+#define QUERY_SOURCE_COUNT  (STATISTIC_TYPE_BLOCKEDMSG + 1)
+
+/* Responses blocked are counted apart */
+static const char *SourceNames[STATISTIC_TYPE_BLOCKEDMSG] = {
+    "refused",
+    "hosts",
+    "cache",
+    "udp",
+    "tcp"
+};
+
+static const char *ReloadNames[METRICS_RELOAD_COUNT] = {
+    "hosts",
+    "filter",
+    "ip_misc",
+    "groups"
+};
+
+static const char *InvalidNames[IHEADER_CHECK_COUNT] = {
+    "",
+    "short",
+    "response",
+    "opcode",
+    "qdcount",
+    "name",
+    "class",
+    "parse"
+};
+
+static uint64_t Counters[METRICS_COUNTER_COUNT];
+
+static uint64_t Invalid[IHEADER_CHECK_COUNT];
+
+static uint64_t Queries[QUERY_SOURCE_COUNT][QUERY_TYPE_COUNT];
+
+/* In microseconds */
+static Histogram Reloads[METRICS_RELOAD_COUNT];
+
+static SOCKET ListenSocket = INVALID_SOCKET;
+
+/* The page, only touched by the serving thread */
+static char *Page = NULL;
+static int PageUsed = 0;
+static int PageSize = 0;
+
+void Metrics_Increase(MetricsCounter Counter)
+{
+    METRICS_INCREASE(Counters[Counter]);
+}
+
+static int Metrics_TypeIndex(DNSRecordType Type)
+{
+    int loop;
+
+    for( loop = 0; loop != QUERY_TYPE_COUNT - 1; ++loop )
+    {
+        if( QueryTypes[loop] == Type )
+        {
+            return loop;
+        }
+    }
+
+    return QUERY_TYPE_COUNT - 1;
+}
+
+void Metrics_CountQuery(StatisticType Source, DNSRecordType Type)
+{
+    if( Source < 0 || Source >= QUERY_SOURCE_COUNT )
+    {
+        return;
+    }
+
+    METRICS_INCREASE(Queries[Source][Metrics_TypeIndex(Type)]);
+}
+
+void Metrics_CountInvalid(IHeaderCheck Reason)
+{
+    if( Reason <= IHEADER_CHECK_OK || Reason >= IHEADER_CHECK_COUNT )
+    {
+        return;
+    }
+
+    METRICS_INCREASE(Invalid[Reason]);
+}
+
+void Metrics_RecordReload(MetricsReload What, uint64_t Since)
+{
+    uint64_t Elapsed = PTimer_MonotonicMicro() - Since;
+
+    Histogram_Record(Reloads + What,
+                     Elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)Elapsed
+                     );
+}
+
+/* Append to the page, return 0 on success */
+static int Metrics_Print(const char *Format, ...)
+{
+    va_list ap;
+    int ret;
+
+    while( TRUE )
+    {
+        int Left = PageSize - PageUsed;
+
+        if( Left > 0 )
+        {
+            va_start(ap, Format);
+            ret = vsnprintf(Page + PageUsed, Left, Format, ap);
+            va_end(ap);
+
+            if( ret >= 0 && ret < Left )
+            {
+                PageUsed += ret;
+                return 0;
+            }
+        }
+
+        /* Truncated, `_vsnprintf' returns -1 then */
+        if( PageSize >= METRICS_PAGE_MAX ||
+            SafeRealloc((void **)&Page, PageSize * 2 + 4096) != 0
+            )
+        {
+            if( PageSize > 0 )
+            {
+                Page[PageUsed] = '\0';
+            }
+            return -1;
+        }
+
+        PageSize = PageSize * 2 + 4096;
+    }
+}
+
+/* Label values with `\', `"' and line breaks escaped */
+static const char *Metrics_Escape(const char *In, char *Out, int OutLength)
+{
+    char *Itr = Out;
+
+    if( In == NULL )
+    {
+        In = "";
+    }
+
+    for( ; *In != '\0' && Itr - Out < OutLength - 2; ++In )
+    {
+        switch( *In )
+        {
+            case '\\':
+            case '"':
+                *Itr++ = '\\';
+                *Itr++ = *In;
+                break;
+
+            case '\n':
+                *Itr++ = '\\';
+                *Itr++ = 'n';
+                break;
+
+            default:
+                *Itr++ = *In;
+                break;
+        }
+    }
+
+    *Itr = '\0';
+
+    return Out;
+}
+
+static void Metrics_PrintHead(const char *Name, const char *Type, const char *Help)
+{
+    Metrics_Print("# HELP %s %s\n# TYPE %s %s\n", Name, Help, Name, Type);
+}
+
+/* Values in microseconds, printed in seconds */
+static void Metrics_PrintSummary(const char *Name,
+                                 const char *LabelName,
+                                 const char *LabelValue,
+                                 uint64_t Count,
+                                 uint64_t Sum,
+                                 const uint32_t *Values
+                                 )
+{
+    static const char *Quantiles[LATENCY_PERCENTILE_COUNT] = {
+        "0.5", "0.9", "0.99", "0.999"
+    };
+    char Label[256];
+    int loop;
+
+    Metrics_Escape(LabelValue, Label, sizeof(Label));
+
+    for( loop = 0; loop != LATENCY_PERCENTILE_COUNT; ++loop )
+    {
+        Metrics_Print("%s{%s=\"%s\",quantile=\"%s\"} %.6f\n",
+                      Name,
+                      LabelName,
+                      Label,
+                      Quantiles[loop],
+                      Values[loop] / 1000000.0
+                      );
+    }
+
+    Metrics_Print("%s_sum{%s=\"%s\"} %.6f\n", Name, LabelName, Label, Sum / 1000000.0);
+    Metrics_Print("%s_count{%s=\"%s\"} %llu\n",
+                  Name,
+                  LabelName,
+                  Label,
+                  (unsigned long long)Count
+                  );
+}
+
+static void Metrics_PrintQueries(void)
+{
+    int Source, Type;
+
+    Metrics_PrintHead("dnsforwarder_queries_total",
+                      "counter",
+                      "Queries by where they were answered, or refused."
+                      );
+
+    for( Source = 0; Source != STATISTIC_TYPE_BLOCKEDMSG; ++Source )
+    {
+        for( Type = 0; Type != QUERY_TYPE_COUNT; ++Type )
+        {
+            Metrics_Print("dnsforwarder_queries_total{source=\"%s\",type=\"%s\"} %llu\n",
+                          SourceNames[Source],
+                          QueryTypeNames[Type],
+                          (unsigned long long)METRICS_GET(Queries[Source][Type])
+                          );
+        }
+    }
+
+    Metrics_PrintHead("dnsforwarder_blocked_responses_total",
+                      "counter",
+                      "Responses blocked."
+                      );
+
+    for( Type = 0; Type != QUERY_TYPE_COUNT; ++Type )
+    {
+        Metrics_Print("dnsforwarder_blocked_responses_total{type=\"%s\"} %llu\n",
+                      QueryTypeNames[Type],
+                      (unsigned long long)METRICS_GET(Queries[STATISTIC_TYPE_BLOCKEDMSG][Type])
+                      );
+    }
+}
+
+static void Metrics_PrintInvalid(void)
+{
+    int Reason;
+
+    Metrics_PrintHead("dnsforwarder_invalid_queries_total",
+                      "counter",
+                      "Queries from clients dropped as invalid, by why."
+                      );
+
+    for( Reason = IHEADER_CHECK_OK + 1; Reason != IHEADER_CHECK_COUNT; ++Reason )
+    {
+        Metrics_Print("dnsforwarder_invalid_queries_total{reason=\"%s\"} %llu\n",
+                      InvalidNames[Reason],
+                      (unsigned long long)METRICS_GET(Invalid[Reason])
+                      );
+    }
+}
+
+static void Metrics_PrintCounter(const char *Name, const char *Help, MetricsCounter Counter)
+{
+    Metrics_PrintHead(Name, "counter", Help);
+    Metrics_Print("%s %llu\n", Name, (unsigned long long)METRICS_GET(Counters[Counter]));
+}
+
+static void Metrics_PrintCache(void)
+{
+    int32_t Count, Used, Size;
+
+    Metrics_PrintCounter("dnsforwarder_cache_hits_total",
+                         "Queries answered from the cache.",
+                         METRICS_CACHE_HITS
+                         );
+    Metrics_PrintCounter("dnsforwarder_cache_misses_total",
+                         "Queries not found in the cache.",
+                         METRICS_CACHE_MISSES
+                         );
+    Metrics_PrintCounter("dnsforwarder_cache_evictions_total",
+                         "Expired records taken out of the cache.",
+                         METRICS_CACHE_EVICTIONS
+                         );
+    Metrics_PrintCounter("dnsforwarder_cache_insert_failures_total",
+                         "Records not cached for lack of room.",
+                         METRICS_CACHE_FULL
+                         );
+
+    if( DNSCache_GetUsage(&Count, &Used, &Size) != 0 )
+    {
+        return;
+    }
+
+    Metrics_PrintHead("dnsforwarder_cache_entries", "gauge", "Records cached.");
+    Metrics_Print("dnsforwarder_cache_entries %d\n", Count);
+    Metrics_PrintHead("dnsforwarder_cache_bytes_used", "gauge", "Bytes of the cache used.");
+    Metrics_Print("dnsforwarder_cache_bytes_used %d\n", Used);
+    Metrics_PrintHead("dnsforwarder_cache_bytes", "gauge", "Bytes of the cache.");
+    Metrics_Print("dnsforwarder_cache_bytes %d\n", Size);
+    Metrics_PrintHead("dnsforwarder_cache_fill_ratio", "gauge", "Share of the cache used.");
+    Metrics_Print("dnsforwarder_cache_fill_ratio %.6f\n",
+                  Size > 0 ? (double)Used / Size : 0.0
+                  );
+}
+
+static void Metrics_PrintModule(const char *Protocol,
+                                const char *Services,
+                                const ModuleContext *Context,
+                                void *Arg
+                                )
+{
+    char Label[256];
+
+    Metrics_Escape(Services, Label, sizeof(Label));
+
+    if( Arg == NULL )
+    {
+        Metrics_Print("dnsforwarder_module_in_flight{protocol=\"%s\",servers=\"%s\"} %d\n",
+                      Protocol,
+                      Label,
+                      Context->InFlight
+                      );
+    } else {
+        Metrics_Print("dnsforwarder_upstream_timeouts_total{protocol=\"%s\",servers=\"%s\"} %u\n",
+                      Protocol,
+                      Label,
+                      (unsigned int)Context->TimedOut
+                      );
+    }
+}
+
+static void Metrics_PrintModules(void)
+{
+    Metrics_PrintHead("dnsforwarder_module_in_flight",
+                      "gauge",
+                      "Queries sent by a module and not answered yet."
+                      );
+    MMgr_EnumModules(Metrics_PrintModule, NULL);
+
+    Metrics_PrintHead("dnsforwarder_upstream_timeouts_total",
+                      "counter",
+                      "Queries of a module given up for time."
+                      );
+    MMgr_EnumModules(Metrics_PrintModule, (void *)1);
+}
+
+static void Metrics_PrintReloads(void)
+{
+    static const double Percentiles[LATENCY_PERCENTILE_COUNT] = LATENCY_PERCENTILES;
+    int loop;
+
+    Metrics_PrintHead("dnsforwarder_reload_duration_seconds",
+                      "summary",
+                      "Time taken to reload."
+                      );
+
+    for( loop = 0; loop != METRICS_RELOAD_COUNT; ++loop )
+    {
+        uint32_t Values[LATENCY_PERCENTILE_COUNT];
+        uint64_t Count;
+
+        Count = Histogram_Percentiles(Reloads + loop,
+                                      Percentiles,
+                                      Values,
+                                      LATENCY_PERCENTILE_COUNT,
+                                      NULL
+                                      );
+
+        Metrics_PrintSummary("dnsforwarder_reload_duration_seconds",
+                             "what",
+                             ReloadNames[loop],
+                             Count,
+                             Histogram_Sum(Reloads + loop),
+                             Values
+                             );
+    }
+}
+
+static void Metrics_PrintLatency(const char *Name,
+                                 const char *Upstream,
+                                 uint64_t Count,
+                                 uint64_t Sum,
+                                 const uint32_t *Percentiles,
+                                 uint32_t Max,
+                                 void *Arg
+                                 )
+{
+    if( Arg == NULL && Upstream == NULL )
+    {
+        Metrics_PrintSummary("dnsforwarder_latency_seconds",
+                             "stage",
+                             Name,
+                             Count,
+                             Sum,
+                             Percentiles
+                             );
+    } else if( Arg != NULL && Upstream != NULL ) {
+        Metrics_PrintSummary("dnsforwarder_upstream_rtt_seconds",
+                             "upstream",
+                             Upstream,
+                             Count,
+                             Sum,
+                             Percentiles
+                             );
+    }
+}
+
+static void Metrics_PrintLatencies(void)
+{
+    Metrics_PrintHead("dnsforwarder_latency_seconds",
+                      "summary",
+                      "Time from a query received to its answer sent back."
+                      );
+    Latency_Enum(Metrics_PrintLatency, NULL);
+
+    Metrics_PrintHead("dnsforwarder_upstream_rtt_seconds",
+                      "summary",
+                      "Round trips to upstream servers."
+                      );
+    Latency_Enum(Metrics_PrintLatency, (void *)1);
+}
+
+typedef enum _TaskFigure{
+    TASK_FIGURE_RUNS = 0,
+    TASK_FIGURE_DEFERRED,
+    TASK_FIGURE_RUN_TIME,
+    TASK_FIGURE_DELAY
+} TaskFigure;
+
+static int Metrics_PrintTask(const TimedTaskMetrics *m, void *Arg)
+{
+    char Label[128];
+
+    Metrics_Escape(m->Name, Label, sizeof(Label));
+
+    switch( (TaskFigure)(size_t)Arg )
+    {
+        case TASK_FIGURE_RUNS:
+            Metrics_Print("dnsforwarder_timed_task_runs_total{task=\"%s\"} %u\n",
+                          Label,
+                          m->Runs
+                          );
+            break;
+
+        case TASK_FIGURE_DEFERRED:
+            Metrics_Print("dnsforwarder_timed_task_deferred_total{task=\"%s\"} %u\n",
+                          Label,
+                          m->Deferred
+                          );
+            break;
+
+        case TASK_FIGURE_RUN_TIME:
+            Metrics_Print("dnsforwarder_timed_task_run_seconds_total{task=\"%s\"} %.3f\n",
+                          Label,
+                          m->RunTime / 1000.0
+                          );
+            break;
+
+        case TASK_FIGURE_DELAY:
+            Metrics_Print("dnsforwarder_timed_task_delay_seconds_total{task=\"%s\"} %.3f\n",
+                          Label,
+                          m->Delay / 1000.0
+                          );
+            break;
+    }
+
+    return 0;
+}
+
+static void Metrics_PrintTasks(void)
+{
+    Metrics_PrintHead("dnsforwarder_timed_task_runs_total",
+                      "counter",
+                      "Runs of timed tasks."
+                      );
+    TimedTask_EnumMetrics(Metrics_PrintTask, (void *)TASK_FIGURE_RUNS);
+
+    Metrics_PrintHead("dnsforwarder_timed_task_deferred_total",
+                      "counter",
+                      "Runs of timed tasks put off while workers were all behind."
+                      );
+    TimedTask_EnumMetrics(Metrics_PrintTask, (void *)TASK_FIGURE_DEFERRED);
+
+    Metrics_PrintHead("dnsforwarder_timed_task_run_seconds_total",
+                      "counter",
+                      "Time taken by timed tasks."
+                      );
+    TimedTask_EnumMetrics(Metrics_PrintTask, (void *)TASK_FIGURE_RUN_TIME);
+
+    Metrics_PrintHead("dnsforwarder_timed_task_delay_seconds_total",
+                      "counter",
+                      "Time from timed tasks being due to being run."
+                      );
+    TimedTask_EnumMetrics(Metrics_PrintTask, (void *)TASK_FIGURE_DELAY);
+}
+
+static void Metrics_MakePage(void)
+{
+    PageUsed = 0;
+
+    Metrics_PrintQueries();
+    Metrics_PrintInvalid();
+    Metrics_PrintCache();
+    Metrics_PrintModules();
+    Metrics_PrintCounter("dnsforwarder_socket_errors_total",
+                         "Errors on sockets to clients and upstream servers.",
+                         METRICS_SOCKET_ERRORS
+                         );
+    Metrics_PrintCounter("dnsforwarder_rate_limit_drops_total",
+                         "UDP queries over the rate limit of their prefix, dropped.",
+                         METRICS_RATE_LIMIT_DROPS
+                         );
+    Metrics_PrintCounter("dnsforwarder_rate_limit_slips_total",
+                         "UDP queries over the rate limit of their prefix, answered truncated.",
+                         METRICS_RATE_LIMIT_SLIPS
+                         );
+    Metrics_PrintHead("dnsforwarder_log_dropped_total",
+                      "counter",
+                      "Log messages dropped for a full queue."
+                      );
+    Metrics_Print("dnsforwarder_log_dropped_total %u\n", (unsigned int)Log_Dropped());
+    Metrics_PrintHead("dnsforwarder_query_log_dropped_total",
+                      "counter",
+                      "Queries not written to the query log."
+                      );
+    Metrics_Print("dnsforwarder_query_log_dropped_total %u\n",
+                  (unsigned int)QueryLog_Dropped()
+                  );
+    Metrics_PrintReloads();
+    Metrics_PrintLatencies();
+    Metrics_PrintTasks();
+}
+
+static int Metrics_Send(SOCKET Sock, const char *Buffer, int Length)
+{
+    while( Length > 0 )
+    {
+        int ret = send(Sock, Buffer, Length, MSG_NOSIGNAL);
+
+        if( ret <= 0 )
+        {
+            return -1;
+        }
+
+        Buffer += ret;
+        Length -= ret;
+    }
+
+    return 0;
+}
+
+static void Metrics_Answer(SOCKET Sock)
+{
+    char Request[1024];
+    char Head[256];
+    int State;
+
+    if( !SocketIsStillReadable(Sock, METRICS_REQUEST_TIMEOUT) )
+    {
+        return;
+    }
+
+    State = recv(Sock, Request, sizeof(Request) - 1, 0);
+    if( State <= 0 )
+    {
+        return;
+    }
+    Request[State] = '\0';
+
+    if( strncmp(Request, "GET /metrics ", 13) != 0 &&
+        strncmp(Request, "GET / ", 6) != 0
+        )
+    {
+        static const char NotFound[] = "HTTP/1.0 404 Not Found\r\n"
+                                       "Content-Length: 0\r\n"
+                                       "Connection: close\r\n\r\n";
+
+        Metrics_Send(Sock, NotFound, sizeof(NotFound) - 1);
+        return;
+    }
+
+    Metrics_MakePage();
+
+    State = snprintf(Head,
+                     sizeof(Head),
+                     "HTTP/1.0 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %d\r\n"
+                     "Connection: close\r\n\r\n",
+                     PageUsed
+                     );
+
+    if( Metrics_Send(Sock, Head, State) != 0 )
+    {
+        return;
+    }
+
+    Metrics_Send(Sock, Page, PageUsed);
+}
+
+static void
+#ifdef WIN32
+WINAPI
+#endif
+Metrics_Work(void *Unused)
+{
+    while( TRUE )
+    {
+        SOCKET Sock = accept(ListenSocket, NULL, NULL);
+
+        if( Sock == INVALID_SOCKET )
+        {
+            ShowSocketError("Accepting metrics requests failed", GET_LAST_ERROR());
+            continue;
+        }
+
+        /* A scraper not reading its answer must not hold the thread up */
+        SetSocketTimeout(Sock, SO_SNDTIMEO, METRICS_SEND_TIMEOUT);
+
+        Metrics_Answer(Sock);
+
+        CLOSE_SOCKET(Sock);
+    }
+}
+
+/* A TCP address or, not on Windows, a path of a unix domain socket */
+static SOCKET Metrics_Listen(const char *Where)
+{
+    SOCKET Sock;
+
+#ifndef _WIN32
+    if( *Where == '/' )
+    {
+        struct sockaddr_un Addr;
+
+        if( strlen(Where) >= sizeof(Addr.sun_path) )
+        {
+            ERRORMSG("`MetricsListen' is too long: %s .\n", Where);
+            return INVALID_SOCKET;
+        }
+
+        memset(&Addr, 0, sizeof(Addr));
+        Addr.sun_family = AF_UNIX;
+        strcpy(Addr.sun_path, Where);
+
+        /* Left by a former run */
+        unlink(Where);
+
+        Sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if( Sock == INVALID_SOCKET )
+        {
+            return INVALID_SOCKET;
+        }
+
+        if( bind(Sock, (const struct sockaddr *)&Addr, sizeof(Addr)) != 0 )
+        {
+            goto EXIT_1;
+        }
+    } else
+#endif /* _WIN32 */
+    {
+        Address_Type a;
+        sa_family_t f;
+
+        f = AddressList_ConvertFromString(&a, Where, 9153);
+        if( f == AF_UNSPEC )
+        {
+            ERRORMSG("Invalid `MetricsListen' option: %s .\n", Where);
+            return INVALID_SOCKET;
+        }
+
+        Sock = socket(f, SOCK_STREAM, IPPROTO_TCP);
+        if( Sock == INVALID_SOCKET )
+        {
+            return INVALID_SOCKET;
+        }
+
+#ifndef _WIN32
+        /* Connections closed by the last run could still be waited out */
+        {
+            int On = 1;
+
+            setsockopt(Sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&On, sizeof(On));
+        }
+#endif /* _WIN32 */
+
+        if( bind(Sock, (const struct sockaddr *)&(a.Addr), GetAddressLength(f)) != 0 )
+        {
+            goto EXIT_1;
+        }
+    }
+
+    if( listen(Sock, 4) == SOCKET_ERROR )
+    {
+        goto EXIT_1;
+    }
+
+    return Sock;
+
+EXIT_1:
+    ShowSocketError("Opening the metrics interface failed", GET_LAST_ERROR());
+    CLOSE_SOCKET(Sock);
+    return INVALID_SOCKET;
+}
+
+int Metrics_Init(ConfigFileInfo *ConfigInfo)
+{
+    const char *Where = ConfigGetRawString(ConfigInfo, "MetricsListen");
+    ThreadHandle t;
+
+    if( Where == NULL || *Where == '\0' )
+    {
+        return 0;
+    }
+
+    ListenSocket = Metrics_Listen(Where);
+    if( ListenSocket == INVALID_SOCKET )
+    {
+        return -1;
+    }
+
+    CREATE_THREAD(Metrics_Work, NULL, t);
+    DETACH_THREAD(t);
+
+    INFO("Metrics served on %s .\n", Where);
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include "readconfig.h"
+#include "domainstatistic.h"
+
+/* Counters of the whole program, served with the module, cache, latency and
+ * timed task figures in the Prometheus text format on `MetricsListen'.
+ *
+ * Counting is an atomic increment. Serving reads everything without taking
+ * a lock the query paths take, so it can be scraped every second.
+ */
+
+typedef enum _MetricsCounter{
+    METRICS_CACHE_HITS = 0,
+    METRICS_CACHE_MISSES,
+    METRICS_CACHE_EVICTIONS,    /* Expired records taken out */
+    METRICS_CACHE_FULL,         /* Records not cached for lack of room */
+    METRICS_SOCKET_ERRORS,
+    METRICS_RATE_LIMIT_DROPS,   /* Queries over `RateLimit' dropped */
+    METRICS_RATE_LIMIT_SLIPS,   /* And answered with TC set */
+
+    METRICS_COUNTER_COUNT
+} MetricsCounter;
+
+typedef enum _MetricsReload{
+    METRICS_RELOAD_HOSTS = 0,
+    METRICS_RELOAD_FILTER,
+    METRICS_RELOAD_IP_MISC,
+    METRICS_RELOAD_GROUPS,
+
+    METRICS_RELOAD_COUNT
+} MetricsReload;
+
+int Metrics_Init(ConfigFileInfo *ConfigInfo);
+
+void Metrics_Increase(MetricsCounter Counter);
+
+/* Queries answered or refused, and responses blocked, by `Source' */
+void Metrics_CountQuery(StatisticType Source, DNSRecordType Type);
+
+/* Queries from clients dropped as invalid */
+void Metrics_CountInvalid(IHeaderCheck Reason);
+
+/* `Since' is a `PTimer_MonotonicMicro' value */
+void Metrics_RecordReload(MetricsReload What, uint64_t Since);
+
+#endif /* METRICS_H_INCLUDED */
@@ -8,7 +8,7 @@
 #include "logs.h"
 #include "ipmisc.h"
 #include "readline.h"
-#include "rwlock.h"
+#include "epoch.h"
 
 typedef int (*SendFunc)(void *Module,
                         IHeader *h, /* Entity followed */
@@ -34,7 +34,6 @@ typedef struct _ModuleMap {
 } ModuleMap;
 
 static ModuleMap    *CurModuleMap = NULL;
-static RWLock       ModulesLock = NULL_RWLOCK;
 static ConfigFileInfo *CurrConfigInfo = NULL;
 
 static BOOL EnableUDPtoTCP;
@@ -615,6 +614,10 @@ Modules_SafeCleanup(ModuleMap *ModuleMap)
         return -1;
     }
 
+    /* No query can be handed to the old modules after this, then they are
+     * stopped, their threads quit by their own timeouts */
+    Epoch_Synchronize();
+
     while( InUse )
     {
         InUse = FALSE;
@@ -654,7 +657,7 @@ Modules_SafeCleanup(ModuleMap *ModuleMap)
 
 static int Modules_Load(ConfigFileInfo *ConfigInfo)
 {
-    ModuleMap *NewModuleMap;
+    ModuleMap *NewModuleMap, *OldModuleMap;
     ThreadHandle th;
     int ret;
 
@@ -712,13 +715,15 @@ static int Modules_Load(ConfigFileInfo *ConfigInfo)
         goto ModulesFree;
     }
 
-    RWLock_WrLock(ModulesLock);
+    if( StringChunk_Compile(NewModuleMap->Distributor) != 0 )
+    {
+        WARNING("Compiling group domains failed, slower matching used.\n");
+    }
+
+    OldModuleMap = EPOCH_EXCHANGE(CurModuleMap, NewModuleMap);
 
-    CREATE_THREAD(Modules_SafeCleanup, CurModuleMap, th);
+    CREATE_THREAD(Modules_SafeCleanup, OldModuleMap, th);
     DETACH_THREAD(th);
-    CurModuleMap = NewModuleMap;
-
-    RWLock_UnWLock(ModulesLock);
 
     INFO("Loading GroupFile(s) completed.\n");
 
@@ -732,11 +737,7 @@ ModulesFree:
 
 static void Modules_Cleanup(void)
 {
-    if( CurModuleMap != NULL )
-    {
-        Modules_Free(CurModuleMap);
-    }
-    RWLock_Destroy(ModulesLock);
+    Modules_Free(EPOCH_EXCHANGE(CurModuleMap, NULL));
 }
 
 int MMgr_Init(ConfigFileInfo *ConfigInfo)
@@ -747,7 +748,8 @@ int MMgr_Init(ConfigFileInfo *ConfigInfo)
     EnableTCPtoUDP = ConfigGetBoolean(ConfigInfo, "EnableTCPtoUDP");
     TCPM_Keep_Alive = ConfigGetInt32(ConfigInfo, "TCPKeepAlive");
 
-    RWLock_Init(ModulesLock);
+    /* Before any list gets compiled */
+    StringChunk_SetPrefilterRate(ConfigGetInt32(ConfigInfo, "PrefilterFalsePositive"));
 
     ret = Modules_Load(ConfigInfo);
     if( ret != 0 )
@@ -782,13 +784,14 @@ int MMgr_Init(ConfigFileInfo *ConfigInfo)
     return 0;
 }
 
-int Modules_Update(void)
+BOOL Modules_Update(void)
 {
     if ( ConfigGetBoolean(CurrConfigInfo, "ReloadGroupFile") )
     {
         Modules_Load(CurrConfigInfo);
+        return TRUE;
     }
-    return 0;
+    return FALSE;
 }
 
 static BOOL ModuleFitRequest(const void **Data, const void *Expected)
@@ -819,6 +822,7 @@ int MMgr_Send(const char *Buffer, int BufferLength)
 {
     ModuleInterface **i;
     ModuleInterface *TheModule;
+    ModuleMap *Map;
     MsgContext *MsgCtx = (MsgContext *)Buffer;
     IHeader *h = (IHeader *)Buffer;
 
@@ -843,21 +847,25 @@ int MMgr_Send(const char *Buffer, int BufferLength)
 
     /* Ordinary models */
 
-    RWLock_RdLock(ModulesLock);
+    Epoch_Enter();
 
-    if( StringChunk_Domain_Match_WildCardRandom(CurModuleMap->Distributor,
+    Map = EPOCH_LOAD(CurModuleMap);
+    if( Map == NULL )
+    {
+        i = NULL;
+    } else if( StringChunk_Domain_Match_WildCardRandom(Map->Distributor,
                                                  h->Domain,
-                                                 &(h->HashValue),
+                                                 &(h->SuffixHashes),
                                                  (void **)&i,
                                                  ModuleFitRequest,
                                                  h
                                                  )
        )
     {
-    } else if( Array_GetUsed(CurModuleMap->ModuleArray) > 0 ){
-        i = Array_GetBySubscript(CurModuleMap->ModuleArray,
+    } else if( Array_GetUsed(Map->ModuleArray) > 0 ){
+        i = Array_GetBySubscript(Map->ModuleArray,
                                  (int)(DNSGetQueryIdentifier(IHEADER_TAIL(h))) %
-                                 Array_GetUsed(CurModuleMap->ModuleArray)
+                                 Array_GetUsed(Map->ModuleArray)
                                  );
     } else {
         i = NULL;
@@ -871,7 +879,42 @@ int MMgr_Send(const char *Buffer, int BufferLength)
         ret = TheModule->Send(&(TheModule->ModuleUnion), h, BufferLength);
     }
 
-    RWLock_UnRLock(ModulesLock);
+    Epoch_Leave();
 
     return ret;
 }
+
+void MMgr_EnumModules(MMgrEnumFunc Func, void *Arg)
+{
+    ModuleMap *Map;
+    int loop;
+
+    Epoch_Enter();
+
+    Map = EPOCH_LOAD(CurModuleMap);
+    if( Map != NULL )
+    {
+        for( loop = 0; loop != Array_GetUsed(Map->ModuleArray); ++loop )
+        {
+            const ModuleInterface *m =
+                *(ModuleInterface **)Array_GetBySubscript(Map->ModuleArray, loop);
+
+            if( strcmp(m->ModuleName, "UDP") == 0 )
+            {
+                Func(m->ModuleName,
+                     m->ModuleUnion.Udp.ServiceName,
+                     &(m->ModuleUnion.Udp.Context),
+                     Arg
+                     );
+            } else if( strcmp(m->ModuleName, "TCP") == 0 ) {
+                Func(m->ModuleName,
+                     m->ModuleUnion.Tcp.ServiceName,
+                     &(m->ModuleUnion.Tcp.Context),
+                     Arg
+                     );
+            }
+        }
+    }
+
+    Epoch_Leave();
+}
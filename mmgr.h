@@ -7,8 +7,19 @@
 
 int MMgr_Init(ConfigFileInfo *ConfigInfo);
 
-int Modules_Update(void);
+/* TRUE if the groups were reloaded */
+BOOL Modules_Update(void);
 
 int MMgr_Send(const char *Buffer, int BufferLength);
 
+/* `Protocol' is "UDP" or "TCP" */
+typedef void (*MMgrEnumFunc)(const char *Protocol,
+                             const char *Services,
+                             const ModuleContext *Context,
+                             void *Arg
+                             );
+
+/* The modules in use, from any thread */
+void MMgr_EnumModules(MMgrEnumFunc Func, void *Arg);
+
 #endif /* MMGR_H_INCLUDED */
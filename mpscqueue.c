@@ -0,0 +1,109 @@
+#include "mpscqueue.h"
+#include "utils.h"
+
+#ifdef __GNUC__
+    #define MPSC_LOAD(v)        __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+    #define MPSC_STORE(v, n)    __atomic_store_n(&(v), (n), __ATOMIC_RELEASE)
+    #define MPSC_CAS(v, o, n)   __atomic_compare_exchange_n(&(v), &(o), (n), FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else /* __GNUC__ */
+    /* Plain loads and stores are ordered on x86 */
+    #define MPSC_LOAD(v)        (_ReadWriteBarrier(), (v))
+    #define MPSC_STORE(v, n)    do {_ReadWriteBarrier(); (v) = (n);} while( 0 )
+    #define MPSC_CAS(v, o, n)   ((uint32_t)InterlockedCompareExchange((LONG volatile *)&(v), (n), (o)) == (o))
+#endif /* __GNUC__ */
+
+/* Cell `i' is free for the item numbered `n' when its `Sequence' equals `n',
+ * and holds that item when it equals `n + 1'.
+ */
+typedef struct _MpscCell{
+    volatile uint32_t   Sequence;
+    uint32_t            Number; /* Of the item held */
+} MpscCell;
+
+#define MPSC_CELL(q, n) ((MpscCell *)((q)->Cells + (size_t)((n) & (q)->Mask) * (q)->CellLength))
+
+int MpscQueue_Init(MpscQueue *q, int Length, int ItemLength)
+{
+    uint32_t Cells = 1;
+    uint32_t loop;
+
+    while( Cells < (uint32_t)Length )
+    {
+        Cells <<= 1;
+    }
+
+    q->CellLength = ROUND_UP(sizeof(MpscCell) + ItemLength, sizeof(uint64_t));
+    q->Cells = SafeMalloc((size_t)Cells * q->CellLength);
+    if( q->Cells == NULL )
+    {
+        return -1;
+    }
+
+    q->Mask = Cells - 1;
+    q->Reserved = 0;
+    q->Taken = 0;
+
+    for( loop = 0; loop != Cells; ++loop )
+    {
+        MPSC_CELL(q, loop)->Sequence = loop;
+    }
+
+    return 0;
+}
+
+void *MpscQueue_Reserve(MpscQueue *q)
+{
+    uint32_t Number = MPSC_LOAD(q->Reserved);
+
+    while( TRUE )
+    {
+        MpscCell *c = MPSC_CELL(q, Number);
+        int32_t Difference = (int32_t)(MPSC_LOAD(c->Sequence) - Number);
+
+        if( Difference == 0 )
+        {
+            if( MPSC_CAS(q->Reserved, Number, Number + 1) )
+            {
+                c->Number = Number;
+                return c + 1;
+            }
+        } else if( Difference < 0 ) {
+            /* Full */
+            return NULL;
+        }
+
+        Number = MPSC_LOAD(q->Reserved);
+    }
+}
+
+void MpscQueue_Commit(MpscQueue *q, void *Item)
+{
+    MpscCell *c = (MpscCell *)Item - 1;
+
+    MPSC_STORE(c->Sequence, c->Number + 1);
+}
+
+void *MpscQueue_Peek(MpscQueue *q)
+{
+    MpscCell *c = MPSC_CELL(q, q->Taken);
+
+    if( MPSC_LOAD(c->Sequence) != q->Taken + 1 )
+    {
+        return NULL;
+    }
+
+    return c + 1;
+}
+
+void MpscQueue_Pop(MpscQueue *q)
+{
+    MpscCell *c = MPSC_CELL(q, q->Taken);
+
+    MPSC_STORE(c->Sequence, q->Taken + q->Mask + 1);
+    ++(q->Taken);
+}
+
+void MpscQueue_Free(MpscQueue *q)
+{
+    SafeFree(q->Cells);
+}
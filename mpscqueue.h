@@ -0,0 +1,38 @@
+#ifndef MPSCQUEUE_H_INCLUDED
+#define MPSCQUEUE_H_INCLUDED
+
+#include "common.h"
+
+/* A bounded queue of fixed-size items, put by many threads and taken by one,
+ * without locks.
+ *
+ * An item is put in place: `MpscQueue_Reserve' hands out a cell with one
+ * compare-and-swap, or NULL when the queue is full, so a thread never waits
+ * for the taker. `MpscQueue_Commit' then makes it visible. The taker sees
+ * items in the order they were reserved, and stops at one not committed yet.
+ */
+
+typedef struct _MpscQueue{
+    char                *Cells;
+    int                 CellLength;
+    uint32_t            Mask;
+    volatile uint32_t   Reserved;   /* Items reserved so far */
+    uint32_t            Taken;      /* Only touched by the taker */
+} MpscQueue;
+
+/* `Length' is rounded up to a power of 2 */
+int MpscQueue_Init(MpscQueue *q, int Length, int ItemLength);
+
+void *MpscQueue_Reserve(MpscQueue *q);
+
+void MpscQueue_Commit(MpscQueue *q, void *Item);
+
+/* The oldest committed item, NULL if there is none */
+void *MpscQueue_Peek(MpscQueue *q);
+
+/* Give back the cell of the item peeked */
+void MpscQueue_Pop(MpscQueue *q);
+
+void MpscQueue_Free(MpscQueue *q);
+
+#endif /* MPSCQUEUE_H_INCLUDED */
@@ -0,0 +1,89 @@
+#ifndef PROBES_H_INCLUDED
+#define PROBES_H_INCLUDED
+
+#include "common.h"
+#include "ptimer.h"
+
+/* Static tracepoints on the path of a query, for bpftrace or perf, e.g.
+ *
+ *   bpftrace -e 'usdt:./dnsforwarder:dnsforwarder:cache_miss
+ *                { printf("%s\n", str(arg1)); }'
+ *
+ * They come from <sys/sdt.h> and cost a nop each until attached. Without it
+ * they are compiled out.
+ *
+ * Each probe has the IHeader as `arg0', its domain as `arg1' and its type as
+ * `arg2', followed by:
+ *
+ *   query_received     arg3: client struct sockaddr, arg4: 1 if by TCP
+ *   filter_out         arg3: 1 if refused
+ *   hosts_get          arg3: `HOSTSUTILS_TRY_*' result
+ *   cache_hit
+ *   cache_miss
+ *   module_send        arg3: "udp" or "tcp"
+ *   upstream_answer    arg3: "udp" or "tcp", arg4: `SentTime', in microseconds
+ *   send_back          arg3: length, arg4: 0 if sent
+ *   query_timeout      arg3: "udp" or "tcp"
+ *   query_stamps       arg3 - arg9: the stamps below, when built with them
+ */
+
+#ifdef HAVE_SYS_SDT_H
+    #include <sys/sdt.h>
+
+    #define PROBE_QUERY0(name, h) \
+        DTRACE_PROBE3(dnsforwarder, name, (h), (h)->Domain, (int)(h)->Type)
+    #define PROBE_QUERY1(name, h, a3) \
+        DTRACE_PROBE4(dnsforwarder, name, (h), (h)->Domain, (int)(h)->Type, a3)
+    #define PROBE_QUERY2(name, h, a3, a4) \
+        DTRACE_PROBE5(dnsforwarder, name, (h), (h)->Domain, (int)(h)->Type, a3, a4)
+#else /* HAVE_SYS_SDT_H */
+    #define PROBE_QUERY0(name, h)           ((void)0)
+    #define PROBE_QUERY1(name, h, a3)       ((void)0)
+    #define PROBE_QUERY2(name, h, a3, a4)   ((void)0)
+#endif /* HAVE_SYS_SDT_H */
+
+/* Built with `--enable-stamps', each IHeader carries `PTimer_MonotonicNano'
+ * values of the stages it passed, 0 for ones it skipped, and `query_stamps'
+ * fires with them when its answer is sent back. Otherwise they take neither
+ * space nor time.
+ */
+typedef enum _StampStage{
+    STAMP_RECEIVED = 0,
+    STAMP_FILTERED,
+    STAMP_HOSTS,
+    STAMP_CACHE,
+    STAMP_SENT,
+    STAMP_ANSWERED,
+    STAMP_SENT_BACK,
+
+    STAMP_NUMBER_OF_STAGES
+} StampStage;
+
+#ifdef STAMP_QUERIES
+    #define STAMP(h, Stage)     ((h)->Stamps[(Stage)] = PTimer_MonotonicNano())
+    #define STAMP_CLEAR(h)      memset((h)->Stamps, 0, sizeof((h)->Stamps))
+#else /* STAMP_QUERIES */
+    #define STAMP(h, Stage)     ((void)0)
+    #define STAMP_CLEAR(h)      ((void)0)
+#endif /* STAMP_QUERIES */
+
+#if defined(STAMP_QUERIES) && defined(HAVE_SYS_SDT_H)
+    #define PROBE_STAMPS(h) \
+        DTRACE_PROBE10(dnsforwarder, \
+                       query_stamps, \
+                       (h), \
+                       (h)->Domain, \
+                       (int)(h)->Type, \
+                       (h)->Stamps[STAMP_RECEIVED], \
+                       (h)->Stamps[STAMP_FILTERED], \
+                       (h)->Stamps[STAMP_HOSTS], \
+                       (h)->Stamps[STAMP_CACHE], \
+                       (h)->Stamps[STAMP_SENT], \
+                       (h)->Stamps[STAMP_ANSWERED], \
+                       (h)->Stamps[STAMP_SENT_BACK] \
+                       )
+#else /* STAMP_QUERIES && HAVE_SYS_SDT_H */
+    #define PROBE_STAMPS(h)     ((void)0)
+#endif /* STAMP_QUERIES && HAVE_SYS_SDT_H */
+
+#endif /* PROBES_H_INCLUDED */
@@ -52,3 +52,101 @@ unsigned long PTimer_End(const PTimer *t)
     return ms;
 #endif /* _WIN32 */
 }
+
+uint64_t PTimer_Monotonic(void)
+{
+#ifdef _WIN32
+    #if defined(_WIN64) || _WIN32_WINNT >= 0x0600
+    return GetTickCount64();
+    #else
+    return GetTickCount();
+    #endif
+#else
+    struct timespec c;
+
+    if( clock_gettime(CLOCK_MONOTONIC, &c) != 0 )
+    {
+        return 0;
+    }
+
+    return (uint64_t)c.tv_sec * 1000 + c.tv_nsec / 1000000;
+#endif /* _WIN32 */
+}
+
+uint64_t PTimer_MonotonicMicro(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER Frequency = {{0, 0}};
+    LARGE_INTEGER c;
+
+    if( Frequency.QuadPart == 0 && !QueryPerformanceFrequency(&Frequency) )
+    {
+        return PTimer_Monotonic() * 1000;
+    }
+
+    QueryPerformanceCounter(&c);
+
+    return (uint64_t)(c.QuadPart / Frequency.QuadPart) * 1000000 +
+           (uint64_t)(c.QuadPart % Frequency.QuadPart) * 1000000 / Frequency.QuadPart;
+#else
+    struct timespec c;
+
+    if( clock_gettime(CLOCK_MONOTONIC, &c) != 0 )
+    {
+        return 0;
+    }
+
+    return (uint64_t)c.tv_sec * 1000000 + c.tv_nsec / 1000;
+#endif /* _WIN32 */
+}
+
+uint64_t PTimer_MonotonicNano(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER Frequency = {{0, 0}};
+    LARGE_INTEGER c;
+
+    if( Frequency.QuadPart == 0 && !QueryPerformanceFrequency(&Frequency) )
+    {
+        return PTimer_Monotonic() * 1000000;
+    }
+
+    QueryPerformanceCounter(&c);
+
+    return (uint64_t)(c.QuadPart / Frequency.QuadPart) * 1000000000 +
+           (uint64_t)(c.QuadPart % Frequency.QuadPart) * 1000000000 / Frequency.QuadPart;
+#else
+    struct timespec c;
+
+    if( clock_gettime(CLOCK_MONOTONIC, &c) != 0 )
+    {
+        return 0;
+    }
+
+    return (uint64_t)c.tv_sec * 1000000000 + c.tv_nsec;
+#endif /* _WIN32 */
+}
+
+uint64_t PTimer_RealtimeMicro(void)
+{
+#ifdef _WIN32
+    FILETIME f;
+    ULARGE_INTEGER u;
+
+    GetSystemTimeAsFileTime(&f);
+    u.LowPart = f.dwLowDateTime;
+    u.HighPart = f.dwHighDateTime;
+
+    /* From 100 ns since 1601 */
+    return (u.QuadPart - 116444736000000000ULL) / 10;
+#else
+    struct timespec c;
+
+    if( clock_gettime(CLOCK_REALTIME, &c) != 0 )
+    {
+        return 0;
+    }
+
+    return (uint64_t)c.tv_sec * 1000000 + c.tv_nsec / 1000;
+#endif /* _WIN32 */
+}
@@ -13,6 +13,8 @@
     #include <time.h>
 #endif /* _WIN32 */
 
+#include <stdint.h>
+
 typedef struct _PTimer PTimer;
 
 struct _PTimer{
@@ -31,4 +33,16 @@ int PTimer_Start(PTimer *t);
 
 unsigned long PTimer_End(const PTimer *t);
 
+/* Milliseconds of a clock never set back, from an arbitrary start */
+uint64_t PTimer_Monotonic(void);
+
+/* The same in microseconds, for timing short work */
+uint64_t PTimer_MonotonicMicro(void);
+
+/* And in nanoseconds, on the clock of bpftrace's `nsecs' on Linux */
+uint64_t PTimer_MonotonicNano(void);
+
+/* Microseconds of the wall clock since 1970 */
+uint64_t PTimer_RealtimeMicro(void);
+
 #endif /* PTIMER_H_INCLUDED */
@@ -0,0 +1,691 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "querylog.h"
+#include "mpscqueue.h"
+#include "ptimer.h"
+#include "utils.h"
+#include "logs.h"
+
+#ifndef _WIN32
+    #include <sys/un.h>
+#endif /* _WIN32 */
+
+#ifdef _MSC_VER
+    #define QUERYLOG_THREAD_LOCAL   __declspec(thread)
+#else
+    #define QUERYLOG_THREAD_LOCAL   __thread
+#endif /* _MSC_VER */
+
+#ifdef __GNUC__
+    #define QUERYLOG_ADD(v, n)  __atomic_fetch_add(&(v), (n), __ATOMIC_RELAXED)
+    #define QUERYLOG_GET(v)     __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#else /* __GNUC__ */
+    #define QUERYLOG_ADD(v, n)  InterlockedExchangeAdd((LONG volatile *)&(v), (n))
+    #define QUERYLOG_GET(v)     (*(volatile uint32_t *)&(v))
+#endif /* __GNUC__ */
+
+#define QUERYLOG_QUEUE_LENGTH   1024
+
+/* Longer messages are logged without their bytes */
+#define QUERYLOG_MESSAGE_LENGTH 1232
+
+/* Enough for a record of the longest message */
+#define QUERYLOG_FRAME_MAX      (QUERYLOG_MESSAGE_LENGTH + 512)
+
+#define QUERYLOG_BATCH_LENGTH   (64 * 1024)
+
+/* How long the writer sleeps when there is nothing to write, in ms */
+#define QUERYLOG_WRITER_INTERVAL    50
+
+/* Seconds between tries to connect a lost socket */
+#define QUERYLOG_RETRY_INTERVAL 5
+
+/* Frame Streams */
+#define FSTRM_CONTENT_TYPE      "protobuf:dnstap.Dnstap"
+#define FSTRM_CONTROL_ACCEPT    1
+#define FSTRM_CONTROL_START     2
+#define FSTRM_CONTROL_STOP      3
+#define FSTRM_CONTROL_READY     4
+#define FSTRM_FIELD_CONTENT_TYPE    1
+
+/* dnstap.proto */
+#define DNSTAP_TYPE_MESSAGE             1
+#define DNSTAP_MESSAGE_CLIENT_QUERY     5
+#define DNSTAP_MESSAGE_CLIENT_RESPONSE  6
+#define DNSTAP_FAMILY_INET              1
+#define DNSTAP_FAMILY_INET6             2
+#define DNSTAP_PROTOCOL_UDP             1
+#define DNSTAP_PROTOCOL_TCP             2
+
+#define PB_VARINT   0
+#define PB_BYTES    2
+#define PB_FIXED32  5
+
+typedef struct _QueryLogRecord{
+    uint64_t        Time;       /* Of the answer, `PTimer_RealtimeMicro' */
+    uint32_t        Latency;    /* From the query received, in microseconds */
+
+    StatisticType   Source;
+    BOOL            Tcp;
+    BOOL            IsResponse;
+
+    sa_family_t     ClientFamily;   /* AF_UNSPEC if not known */
+    uint16_t        ClientPort;     /* 0 if not known */
+    char            Client[16];
+
+    sa_family_t     UpstreamFamily;
+    uint16_t        UpstreamPort;
+    char            Upstream[16];
+
+    int             MessageLength;  /* 0 if too long */
+    char            Message[QUERYLOG_MESSAGE_LENGTH];
+} QueryLogRecord;
+
+static const char *SourceNames[] = {
+    "refused",
+    "hosts",
+    "cache",
+    "udp",
+    "tcp"
+};
+
+static BOOL                 Inited = FALSE;
+static int                  SampleRate = 1;
+static QUERYLOG_THREAD_LOCAL int    Skipped = 0;
+
+static MpscQueue            Queue;
+static volatile uint32_t    Dropped = 0;
+
+/* Below are touched under `WriterLock' */
+static EFFECTIVE_LOCK       WriterLock;
+
+static FILE                 *File = NULL;
+
+#ifndef _WIN32
+static SOCKET               Sock = INVALID_SOCKET;
+static struct sockaddr_un   SocketAddress;
+static time_t               LastTry = 0;
+#endif /* _WIN32 */
+
+static char                 Batch[QUERYLOG_BATCH_LENGTH];
+static int                  BatchUsed = 0;
+static int                  BatchRecords = 0;
+
+static void QueryLog_CopyAddress(const struct sockaddr *a,
+                                 sa_family_t *Family,
+                                 uint16_t *Port,
+                                 char *Address
+                                 )
+{
+    if( a != NULL && a->sa_family == AF_INET )
+    {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+
+        *Family = AF_INET;
+        *Port = ntohs(a4->sin_port);
+        memcpy(Address, &(a4->sin_addr), 4);
+    } else if( a != NULL && a->sa_family == AF_INET6 ) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+
+        *Family = AF_INET6;
+        *Port = ntohs(a6->sin6_port);
+        memcpy(Address, &(a6->sin6_addr), 16);
+    } else {
+        *Family = AF_UNSPEC;
+        *Port = 0;
+    }
+}
+
+void QueryLog_Add(IHeader *h, StatisticType Source)
+{
+    QueryLogRecord *r;
+    const unsigned char *Message = IHEADER_TAIL(h);
+    uint64_t Now;
+
+    /* Answers discarded by `BlockIP' and the like never reach the client,
+     * whose query is logged with the answer it does get.
+     */
+    if( !Inited || Source == STATISTIC_TYPE_BLOCKEDMSG )
+    {
+        return;
+    }
+
+    /* Counted by each thread apart, no line shared */
+    if( SampleRate > 1 )
+    {
+        if( ++Skipped < SampleRate )
+        {
+            return;
+        }
+
+        Skipped = 0;
+    }
+
+    r = MpscQueue_Reserve(&Queue);
+    if( r == NULL )
+    {
+        QUERYLOG_ADD(Dropped, 1);
+        return;
+    }
+
+    Now = PTimer_MonotonicMicro();
+
+    r->Time = PTimer_RealtimeMicro();
+    r->Latency = h->ReceivedTime == 0 || Now < h->ReceivedTime ?
+                 0 :
+                 (Now - h->ReceivedTime > UINT32_MAX ?
+                  UINT32_MAX : (uint32_t)(Now - h->ReceivedTime));
+    r->Source = Source;
+    r->Tcp = MsgContext_IsFromTCP((MsgContext *)h);
+    r->IsResponse = h->EntityLength >= 12 && (Message[2] & 0x80) != 0;
+
+    if( !r->Tcp )
+    {
+        QueryLog_CopyAddress((const struct sockaddr *)&(h->BackAddress.Addr),
+                             &(r->ClientFamily),
+                             &(r->ClientPort),
+                             r->Client
+                             );
+    } else {
+        /* Only its text is kept */
+        r->ClientPort = 0;
+
+        if( strchr(h->Agent, ':') != NULL )
+        {
+            r->ClientFamily = IPv6AddressToNum(h->Agent, r->Client) == 16 ?
+                              AF_INET6 : AF_UNSPEC;
+        } else if( h->Agent[0] != '\0' ) {
+            r->ClientFamily = IPv4AddressToNum(h->Agent, r->Client) == 4 ?
+                              AF_INET : AF_UNSPEC;
+        } else {
+            r->ClientFamily = AF_UNSPEC;
+        }
+    }
+
+    QueryLog_CopyAddress(h->Upstream,
+                         &(r->UpstreamFamily),
+                         &(r->UpstreamPort),
+                         r->Upstream
+                         );
+
+    if( h->EntityLength > 0 && h->EntityLength <= QUERYLOG_MESSAGE_LENGTH )
+    {
+        r->MessageLength = h->EntityLength;
+        memcpy(r->Message, Message, h->EntityLength);
+    } else {
+        r->MessageLength = 0;
+    }
+
+    MpscQueue_Commit(&Queue, r);
+}
+
+uint32_t QueryLog_Dropped(void)
+{
+    return QUERYLOG_GET(Dropped);
+}
+
+/* Protobuf encoding, each returning where it stopped */
+static char *Pb_Varint(char *p, uint64_t v)
+{
+    while( v >= 0x80 )
+    {
+        *p++ = (char)(v | 0x80);
+        v >>= 7;
+    }
+
+    *p++ = (char)v;
+
+    return p;
+}
+
+static char *Pb_Uint(char *p, int Field, uint64_t v)
+{
+    p = Pb_Varint(p, (Field << 3) | PB_VARINT);
+
+    return Pb_Varint(p, v);
+}
+
+static char *Pb_Fixed32(char *p, int Field, uint32_t v)
+{
+    p = Pb_Varint(p, (Field << 3) | PB_FIXED32);
+
+    p[0] = (char)v;
+    p[1] = (char)(v >> 8);
+    p[2] = (char)(v >> 16);
+    p[3] = (char)(v >> 24);
+
+    return p + 4;
+}
+
+static char *Pb_Bytes(char *p, int Field, const void *Bytes, int Length)
+{
+    p = Pb_Varint(p, (Field << 3) | PB_BYTES);
+    p = Pb_Varint(p, Length);
+    memcpy(p, Bytes, Length);
+
+    return p + Length;
+}
+
+static void QueryLog_Put32(char *p, uint32_t v)
+{
+    p[0] = (char)(v >> 24);
+    p[1] = (char)(v >> 16);
+    p[2] = (char)(v >> 8);
+    p[3] = (char)v;
+}
+
+/* What dnstap has no field for */
+static int QueryLog_Extra(const QueryLogRecord *r, char *Out, int OutLength)
+{
+    char Upstream[LENGTH_OF_IPV6_ADDRESS_ASCII + 24];
+
+    if( r->UpstreamFamily == AF_INET )
+    {
+        char Ip[LENGTH_OF_IPV4_ADDRESS_ASCII];
+
+        IPv4AddressToAsc(r->Upstream, Ip);
+        sprintf(Upstream, " upstream=%s:%d", Ip, r->UpstreamPort);
+    } else if( r->UpstreamFamily == AF_INET6 ) {
+        char Ip[LENGTH_OF_IPV6_ADDRESS_ASCII];
+
+        IPv6AddressToAsc(r->Upstream, Ip);
+        sprintf(Upstream, " upstream=[%s]:%d", Ip, r->UpstreamPort);
+    } else {
+        Upstream[0] = '\0';
+    }
+
+    return snprintf(Out,
+                    OutLength,
+                    "source=%s latency_us=%u%s",
+                    SourceNames[r->Source],
+                    r->Latency,
+                    Upstream
+                    );
+}
+
+/* A data frame of a dnstap message, return its length */
+static int QueryLog_Encode(const QueryLogRecord *r, char *Out)
+{
+    char Message[QUERYLOG_MESSAGE_LENGTH + 128];
+    char Extra[128];
+    char *m = Message, *d;
+    uint64_t QueryTime = r->Time - r->Latency;
+    int ExtraLength;
+
+    m = Pb_Uint(m,
+                1,
+                r->IsResponse ?
+                    DNSTAP_MESSAGE_CLIENT_RESPONSE : DNSTAP_MESSAGE_CLIENT_QUERY
+                );
+
+    if( r->ClientFamily != AF_UNSPEC )
+    {
+        m = Pb_Uint(m,
+                    2,
+                    r->ClientFamily == AF_INET ?
+                        DNSTAP_FAMILY_INET : DNSTAP_FAMILY_INET6
+                    );
+    }
+
+    m = Pb_Uint(m, 3, r->Tcp ? DNSTAP_PROTOCOL_TCP : DNSTAP_PROTOCOL_UDP);
+
+    if( r->ClientFamily != AF_UNSPEC )
+    {
+        m = Pb_Bytes(m, 4, r->Client, r->ClientFamily == AF_INET ? 4 : 16);
+
+        if( r->ClientPort != 0 )
+        {
+            m = Pb_Uint(m, 6, r->ClientPort);
+        }
+    }
+
+    m = Pb_Uint(m, 8, QueryTime / 1000000);
+    m = Pb_Fixed32(m, 9, (uint32_t)(QueryTime % 1000000) * 1000);
+
+    if( r->IsResponse )
+    {
+        m = Pb_Uint(m, 12, r->Time / 1000000);
+        m = Pb_Fixed32(m, 13, (uint32_t)(r->Time % 1000000) * 1000);
+
+        if( r->MessageLength > 0 )
+        {
+            m = Pb_Bytes(m, 14, r->Message, r->MessageLength);
+        }
+    } else if( r->MessageLength > 0 ) {
+        m = Pb_Bytes(m, 10, r->Message, r->MessageLength);
+    }
+
+    ExtraLength = QueryLog_Extra(r, Extra, sizeof(Extra));
+    if( ExtraLength < 0 || ExtraLength >= sizeof(Extra) )
+    {
+        ExtraLength = strlen(Extra);
+    }
+
+    d = Out + 4;
+    d = Pb_Bytes(d, 1, "dnsforwarder", sizeof("dnsforwarder") - 1);
+    d = Pb_Bytes(d, 3, Extra, ExtraLength);
+    d = Pb_Bytes(d, 14, Message, m - Message);
+    d = Pb_Uint(d, 15, DNSTAP_TYPE_MESSAGE);
+
+    QueryLog_Put32(Out, d - Out - 4);
+
+    return d - Out;
+}
+
+/* A control frame, return its length */
+static int QueryLog_Control(char *Out, int Type, BOOL WithContentType)
+{
+    int Length = 4;
+
+    QueryLog_Put32(Out, 0); /* Escape */
+    QueryLog_Put32(Out + 8, Type);
+
+    if( WithContentType )
+    {
+        QueryLog_Put32(Out + 12, FSTRM_FIELD_CONTENT_TYPE);
+        QueryLog_Put32(Out + 16, sizeof(FSTRM_CONTENT_TYPE) - 1);
+        memcpy(Out + 20, FSTRM_CONTENT_TYPE, sizeof(FSTRM_CONTENT_TYPE) - 1);
+
+        Length += 8 + sizeof(FSTRM_CONTENT_TYPE) - 1;
+    }
+
+    QueryLog_Put32(Out + 4, Length);
+
+    return 8 + Length;
+}
+
+static int QueryLog_Write(const char *Buffer, int Length)
+{
+    if( File != NULL )
+    {
+        if( fwrite(Buffer, 1, Length, File) != Length )
+        {
+            return -1;
+        }
+
+        fflush(File);
+
+        return 0;
+    }
+
+#ifndef _WIN32
+    while( Sock != INVALID_SOCKET && Length > 0 )
+    {
+        int ret = send(Sock, Buffer, Length, MSG_NOSIGNAL);
+
+        if( ret <= 0 )
+        {
+            CLOSE_SOCKET(Sock);
+            Sock = INVALID_SOCKET;
+            break;
+        }
+
+        Buffer += ret;
+        Length -= ret;
+    }
+
+    return Sock == INVALID_SOCKET ? -1 : 0;
+#else
+    return -1;
+#endif /* _WIN32 */
+}
+
+#ifndef _WIN32
+/* Connect and shake hands the bidirectional Frame Streams way: READY,
+ * ACCEPT, START.
+ */
+static int QueryLog_Connect(void)
+{
+    char Frame[64];
+    uint32_t Length;
+    int ret;
+
+    LastTry = time(NULL);
+
+    Sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( Sock == INVALID_SOCKET )
+    {
+        return -1;
+    }
+
+    if( connect(Sock,
+                (const struct sockaddr *)&SocketAddress,
+                sizeof(SocketAddress)
+                )
+        != 0 )
+    {
+        goto EXIT_1;
+    }
+
+    SetSocketTimeout(Sock, SO_RCVTIMEO, 2000);
+
+    if( QueryLog_Write(Frame, QueryLog_Control(Frame, FSTRM_CONTROL_READY, TRUE)) != 0 )
+    {
+        return -1;
+    }
+
+    /* ACCEPT, the content types it lists are not checked */
+    ret = recv(Sock, Frame, 8, MSG_WAITALL);
+    if( ret != 8 || memcmp(Frame, "\0\0\0\0", 4) != 0 )
+    {
+        goto EXIT_1;
+    }
+
+    Length = ntohl(*(uint32_t *)(Frame + 4));
+    if( Length < 4 || Length > sizeof(Frame) )
+    {
+        goto EXIT_1;
+    }
+
+    ret = recv(Sock, Frame, Length, MSG_WAITALL);
+    if( ret != Length || ntohl(*(uint32_t *)Frame) != FSTRM_CONTROL_ACCEPT )
+    {
+        goto EXIT_1;
+    }
+
+    return QueryLog_Write(Frame, QueryLog_Control(Frame, FSTRM_CONTROL_START, TRUE));
+
+EXIT_1:
+    CLOSE_SOCKET(Sock);
+    Sock = INVALID_SOCKET;
+    return -1;
+}
+#endif /* _WIN32 */
+
+/* Write the batch, under `WriterLock' */
+static void QueryLog_Flush(void)
+{
+#ifndef _WIN32
+    if( File == NULL &&
+        Sock == INVALID_SOCKET &&
+        (time(NULL) - LastTry < QUERYLOG_RETRY_INTERVAL || QueryLog_Connect() != 0)
+        )
+    {
+        QUERYLOG_ADD(Dropped, BatchRecords);
+    } else
+#endif /* _WIN32 */
+    if( QueryLog_Write(Batch, BatchUsed) != 0 )
+    {
+        QUERYLOG_ADD(Dropped, BatchRecords);
+    }
+
+    BatchUsed = 0;
+    BatchRecords = 0;
+}
+
+/* Encode and write what is queued, under `WriterLock'. Return how many
+ * records were taken.
+ */
+static int QueryLog_Drain(void)
+{
+    QueryLogRecord *r;
+    int Count = 0;
+
+    while( (r = MpscQueue_Peek(&Queue)) != NULL )
+    {
+        if( BatchUsed > QUERYLOG_BATCH_LENGTH - QUERYLOG_FRAME_MAX )
+        {
+            QueryLog_Flush();
+        }
+
+        BatchUsed += QueryLog_Encode(r, Batch + BatchUsed);
+        ++BatchRecords;
+
+        MpscQueue_Pop(&Queue);
+        ++Count;
+    }
+
+    if( BatchUsed > 0 )
+    {
+        QueryLog_Flush();
+    }
+
+    return Count;
+}
+
+static void
+#ifdef _WIN32
+WINAPI
+#endif
+QueryLog_Works(void *Unused)
+{
+    while( TRUE )
+    {
+        int Count;
+
+        EFFECTIVE_LOCK_GET(WriterLock);
+        Count = QueryLog_Drain();
+        EFFECTIVE_LOCK_RELEASE(WriterLock);
+
+        if( Count == 0 )
+        {
+            SLEEP(QUERYLOG_WRITER_INTERVAL);
+        }
+    }
+}
+
+static void QueryLog_Cleanup(void)
+{
+    char Frame[16];
+
+    EFFECTIVE_LOCK_GET(WriterLock);
+
+    QueryLog_Drain();
+    QueryLog_Write(Frame, QueryLog_Control(Frame, FSTRM_CONTROL_STOP, FALSE));
+
+    if( File != NULL )
+    {
+        fclose(File);
+        File = NULL;
+    }
+
+#ifndef _WIN32
+    if( Sock != INVALID_SOCKET )
+    {
+        CLOSE_SOCKET(Sock);
+        Sock = INVALID_SOCKET;
+    }
+#endif /* _WIN32 */
+
+    EFFECTIVE_LOCK_RELEASE(WriterLock);
+}
+
+/* A stream has only one START, so a file is written anew. The previous one
+ * is kept as `<Where>.1', replacing any older one.
+ */
+static int QueryLog_Rotate(const char *Where)
+{
+    char *Previous;
+    int ret;
+
+    Previous = SafeMalloc(strlen(Where) + sizeof(".1"));
+    if( Previous == NULL )
+    {
+        return -1;
+    }
+
+    sprintf(Previous, "%s.1", Where);
+
+#ifdef _WIN32
+    ret = MoveFileEx(Where, Previous, MOVEFILE_REPLACE_EXISTING) ? 0 : -2;
+#else /* _WIN32 */
+    ret = rename(Where, Previous) == 0 ? 0 : -2;
+#endif /* _WIN32 */
+
+    SafeFree(Previous);
+
+    return ret;
+}
+
+int QueryLog_Init(ConfigFileInfo *ConfigInfo)
+{
+    const char *Where = ConfigGetRawString(ConfigInfo, "QueryLog");
+    ThreadHandle t;
+
+    if( Where == NULL || *Where == '\0' )
+    {
+        return 0;
+    }
+
+    SampleRate = ConfigGetInt32(ConfigInfo, "QueryLogSampleRate");
+    if( SampleRate < 1 )
+    {
+        ERRORMSG("`QueryLogSampleRate' is too small (< 1).\n");
+        return -1;
+    }
+
+    if( strncmp(Where, "unix:", 5) == 0 )
+    {
+#ifdef _WIN32
+        ERRORMSG("Unix domain sockets are not supported, `QueryLog' : %s .\n", Where);
+        return -2;
+#else
+        if( strlen(Where + 5) >= sizeof(SocketAddress.sun_path) )
+        {
+            ERRORMSG("`QueryLog' is too long : %s .\n", Where);
+            return -3;
+        }
+
+        memset(&SocketAddress, 0, sizeof(SocketAddress));
+        SocketAddress.sun_family = AF_UNIX;
+        strcpy(SocketAddress.sun_path, Where + 5);
+
+        if( QueryLog_Connect() != 0 )
+        {
+            WARNING("Query log reader %s is not ready, retrying later.\n", Where);
+        }
+#endif /* _WIN32 */
+    } else {
+        char Frame[64];
+
+        /* Nothing to keep at the first start */
+        QueryLog_Rotate(Where);
+
+        File = fopen(Where, "wb");
+        if( File == NULL )
+        {
+            ERRORMSG("Query log %s is unwritable.\n", Where);
+            return -4;
+        }
+
+        QueryLog_Write(Frame, QueryLog_Control(Frame, FSTRM_CONTROL_START, TRUE));
+    }
+
+    if( MpscQueue_Init(&Queue, QUERYLOG_QUEUE_LENGTH, sizeof(QueryLogRecord)) != 0 )
+    {
+        return -5;
+    }
+
+    EFFECTIVE_LOCK_INIT(WriterLock);
+    atexit(QueryLog_Cleanup);
+
+    CREATE_THREAD(QueryLog_Works, NULL, t);
+    DETACH_THREAD(t);
+
+    Inited = TRUE;
+
+    INFO("Logging one in %d queries to %s .\n", SampleRate, Where);
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef QUERYLOG_H_INCLUDED
+#define QUERYLOG_H_INCLUDED
+
+#include "readconfig.h"
+#include "iheader.h"
+#include "domainstatistic.h"
+
+/* A binary log of queries and their answers, in dnstap: protobuf messages
+ * framed by Frame Streams, written to `QueryLog', a file or `unix:<path>'.
+ *
+ * Query threads copy what is logged into a bounded queue, one in every
+ * `QueryLogSampleRate' queries. A thread of its own encodes and writes them
+ * in batches. Queries finding the queue full are dropped and counted.
+ */
+
+int QueryLog_Init(ConfigFileInfo *ConfigInfo);
+
+/* `h' is followed by the message sent back, or by the query if none was */
+void QueryLog_Add(IHeader *h, StatisticType Source);
+
+/* Queries not logged for a full queue or a lost socket */
+uint32_t QueryLog_Dropped(void);
+
+#endif /* QUERYLOG_H_INCLUDED */
@@ -0,0 +1,251 @@
+#include <string.h>
+#include "ratelimit.h"
+#include "dnsparser.h"
+#include "ptimer.h"
+#include "metrics.h"
+#include "logs.h"
+#include "utils.h"
+
+/* Buckets come in sets of `RATELIMIT_WAYS' */
+#define RATELIMIT_TABLE_BITS    12
+#define RATELIMIT_WAYS          2
+
+/* Tokens are in thousandths of a query, so a millisecond earns `Rate' */
+#define RATELIMIT_TOKEN         1000
+
+#define RATELIMIT_MAX_RATE      1000000
+
+typedef struct _RateLimitBucket{
+    uint64_t    Prefix;     /* Family and prefix, 0 if the slot is unused */
+    uint32_t    Refilled;   /* `PTimer_Monotonic', wrapping */
+    uint32_t    Limited;    /* Queries over the limit, for slipping */
+    int32_t     Tokens;
+} RateLimitBucket;
+
+static RateLimitBucket  *Table = NULL;
+static int32_t          Rate = 0;
+static int32_t          Slip = 2;
+
+static uint64_t RateLimit_Prefix(const struct sockaddr *Client, sa_family_t Family)
+{
+    const unsigned char *a;
+    uint64_t Prefix;
+    int Bytes, loop;
+
+    if( Family == AF_INET )
+    {
+        a = (const unsigned char *)&(((const struct sockaddr_in *)Client)->sin_addr);
+        Bytes = 3;
+        Prefix = 4;
+    } else {
+        const struct in6_addr *a6 = &(((const struct sockaddr_in6 *)Client)->sin6_addr);
+
+        /* IPv4 clients of a dual-stack socket, ::ffff:a.b.c.d */
+        if( IN6_IS_ADDR_V4MAPPED(a6) )
+        {
+            a = (const unsigned char *)a6 + 12;
+            Bytes = 3;
+            Prefix = 4;
+        } else {
+            a = (const unsigned char *)a6;
+            Bytes = 7;
+            Prefix = 6;
+        }
+    }
+
+    for( loop = 0; loop != Bytes; ++loop )
+    {
+        Prefix = (Prefix << 8) | a[loop];
+    }
+
+    return Prefix;
+}
+
+static RateLimitBucket *RateLimit_Bucket(uint64_t Prefix, uint32_t Now)
+{
+    RateLimitBucket *Set, *Oldest;
+    int loop;
+
+    Set = Table + ((Prefix * 0x9E3779B97F4A7C15ULL) >>
+                   (64 - RATELIMIT_TABLE_BITS)
+                   ) / RATELIMIT_WAYS * RATELIMIT_WAYS;
+
+    Oldest = Set;
+    for( loop = 0; loop != RATELIMIT_WAYS; ++loop )
+    {
+        if( Set[loop].Prefix == Prefix )
+        {
+            return Set + loop;
+        }
+
+        if( Now - Set[loop].Refilled > Now - Oldest->Refilled )
+        {
+            Oldest = Set + loop;
+        }
+    }
+
+    /* The tokens left are taken over too, or prefixes meeting in a set could
+     * refill each other by turns.
+     */
+    Oldest->Prefix = Prefix;
+    Oldest->Limited = 0;
+
+    return Oldest;
+}
+
+/* Answer with the question only and TC set. Responses are not answered. */
+static int RateLimit_Slip(SOCKET Sock,
+                          char *Query,
+                          int Length,
+                          const struct sockaddr *Client,
+                          sa_family_t Family
+                          )
+{
+    DNSHeader *h = DNSGetHeader(Query);
+    int End;
+
+    if( Length <= DNS_HEADER_LENGTH ||
+        h->Flags.Direction != 0 ||
+        DNSGetQuestionCount(Query) != 1
+        )
+    {
+        return -1;
+    }
+
+    for( End = DNS_HEADER_LENGTH;
+         End < Length && Query[End] != 0;
+         End += (unsigned char)Query[End] + 1
+         )
+    {
+        if( DNSIsLabelPointerStart((unsigned char)Query[End]) )
+        {
+            return -2;
+        }
+    }
+
+    /* The root label, type and class */
+    End += 1 + 4;
+    if( End > Length )
+    {
+        return -3;
+    }
+
+    h->Flags.Direction = 1;
+    h->Flags.TrunCation = 1;
+    h->Flags.RecursionAvailable = 1;
+    h->Flags.ResponseCode = 0;
+    h->AnswerCount = 0;
+    h->NameServerCount = 0;
+    h->AdditionalCount = 0;
+
+    if( sendto(Sock,
+               Query,
+               End,
+               MSG_NOSIGNAL,
+               Client,
+               GetAddressLength(Family)
+               )
+        != End )
+    {
+        return -4;
+    }
+
+    return 0;
+}
+
+BOOL RateLimit_Out(SOCKET Sock,
+                   char *Query,
+                   int Length,
+                   const struct sockaddr *Client,
+                   sa_family_t Family
+                   )
+{
+    uint64_t Prefix;
+    RateLimitBucket *b;
+    uint32_t Now, Elapsed;
+
+    if( Table == NULL )
+    {
+        return FALSE;
+    }
+
+    Prefix = RateLimit_Prefix(Client, Family);
+    Now = (uint32_t)PTimer_Monotonic();
+    b = RateLimit_Bucket(Prefix, Now);
+
+    Elapsed = Now - b->Refilled;
+    if( Elapsed > 1000 )
+    {
+        Elapsed = 1000;
+    }
+
+    b->Tokens += Elapsed * Rate;
+    if( b->Tokens > Rate * RATELIMIT_TOKEN )
+    {
+        b->Tokens = Rate * RATELIMIT_TOKEN;
+    }
+
+    b->Refilled = Now;
+
+    if( b->Tokens >= RATELIMIT_TOKEN )
+    {
+        b->Tokens -= RATELIMIT_TOKEN;
+        return FALSE;
+    }
+
+    ++(b->Limited);
+
+    if( Slip > 0 &&
+        b->Limited % Slip == 0 &&
+        RateLimit_Slip(Sock, Query, Length, Client, Family) == 0
+        )
+    {
+        Metrics_Increase(METRICS_RATE_LIMIT_SLIPS);
+    } else {
+        Metrics_Increase(METRICS_RATE_LIMIT_DROPS);
+    }
+
+    return TRUE;
+}
+
+int RateLimit_Init(ConfigFileInfo *ConfigInfo)
+{
+    int Slot;
+
+    Rate = ConfigGetInt32(ConfigInfo, "RateLimit");
+    Slip = ConfigGetInt32(ConfigInfo, "RateLimitSlip");
+
+    if( Rate <= 0 )
+    {
+        return 0;
+    }
+
+    if( Rate > RATELIMIT_MAX_RATE )
+    {
+        ERRORMSG("`RateLimit' is too large (> %d).\n", RATELIMIT_MAX_RATE);
+        return -1;
+    }
+
+    if( Slip < 0 )
+    {
+        ERRORMSG("`RateLimitSlip' is too small (< 0).\n");
+        return -2;
+    }
+
+    Table = SafeMalloc(sizeof(RateLimitBucket) << RATELIMIT_TABLE_BITS);
+    if( Table == NULL )
+    {
+        return -3;
+    }
+
+    memset(Table, 0, sizeof(RateLimitBucket) << RATELIMIT_TABLE_BITS);
+    for( Slot = 0; Slot != (1 << RATELIMIT_TABLE_BITS); ++Slot )
+    {
+        Table[Slot].Tokens = Rate * RATELIMIT_TOKEN;
+        Table[Slot].Refilled = (uint32_t)PTimer_Monotonic();
+    }
+
+    INFO("Rate limiting UDP clients to %d queries a second per prefix.\n", Rate);
+
+    return 0;
+}
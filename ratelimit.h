@@ -0,0 +1,31 @@
+#ifndef RATELIMIT_H_INCLUDED
+#define RATELIMIT_H_INCLUDED
+
+#include "common.h"
+#include "readconfig.h"
+
+/* Response rate limiting of the UDP frontend, by a token bucket for each
+ * client prefix, /24 for IPv4 (mapped ones included) and /56 for IPv6.
+ *
+ * A prefix earns `RateLimit' queries a second and saves up to a second of
+ * them. Queries over that are dropped, but every `RateLimitSlip'th of them
+ * is answered empty with TC set, so a real client behind a flood retries by
+ * TCP while a spoofed one gets nothing bigger than it sent.
+ *
+ * The buckets are in a table of a fixed size, in sets of two indexed by a
+ * hash of the prefix. A prefix finding its set full takes over the bucket
+ * least recently used, with the tokens left in it. The table is touched by
+ * the UDP frontend thread only.
+ */
+
+int RateLimit_Init(ConfigFileInfo *ConfigInfo);
+
+/* TRUE if the query has been dropped or slipped, and is done with */
+BOOL RateLimit_Out(SOCKET Sock,
+                   char *Query,
+                   int Length,
+                   const struct sockaddr *Client,
+                   sa_family_t Family
+                   );
+
+#endif /* RATELIMIT_H_INCLUDED */
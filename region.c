@@ -0,0 +1,186 @@
+#include <string.h>
+#include "region.h"
+#include "utils.h"
+
+#define REGION_DEFAULT_CHUNK    (256 * 1024)
+
+#define REGION_ALIGN(Size)  ROUND_UP((Size), sizeof(void *))
+
+#ifdef _MSC_VER
+    #define REGION_THREAD_LOCAL __declspec(thread)
+#else
+    #define REGION_THREAD_LOCAL __thread
+#endif /* _MSC_VER */
+
+static REGION_THREAD_LOCAL Region *CurrentRegion = NULL;
+
+int Region_Init(Region *r, size_t ChunkSize)
+{
+    r->Chunks = NULL;
+    r->Position = NULL;
+    r->End = NULL;
+    r->Large = NULL;
+    r->ChunkSize = ChunkSize == 0 ? REGION_DEFAULT_CHUNK : ChunkSize;
+    r->Allocated = 0;
+
+    return 0;
+}
+
+/* Bigger ones would waste too much of a chunk */
+#define REGION_IS_LARGE(r, Size)    ((Size) > (r)->ChunkSize / 4)
+
+static void *Region_AllocLarge(Region *r, size_t Size)
+{
+    Region_Block *b = SafeMalloc(sizeof(Region_Block) + Size);
+
+    if( b == NULL )
+    {
+        return NULL;
+    }
+
+    b->Prev = NULL;
+    b->Next = r->Large;
+    if( r->Large != NULL )
+    {
+        r->Large->Prev = b;
+    }
+    r->Large = b;
+
+    r->Allocated += Size;
+
+    return b + 1;
+}
+
+void *Region_Alloc(Region *r, size_t Size)
+{
+    void *ret;
+
+    Size = REGION_ALIGN(Size == 0 ? 1 : Size);
+
+    if( REGION_IS_LARGE(r, Size) )
+    {
+        return Region_AllocLarge(r, Size);
+    }
+
+    if( r->Position == NULL || (size_t)(r->End - r->Position) < Size )
+    {
+        Region_Block *b = SafeMalloc(sizeof(Region_Block) + r->ChunkSize);
+
+        if( b == NULL )
+        {
+            return NULL;
+        }
+
+        b->Prev = NULL;
+        b->Next = r->Chunks;
+        r->Chunks = b;
+        r->Position = (char *)(b + 1);
+        r->End = r->Position + r->ChunkSize;
+
+        r->Allocated += r->ChunkSize;
+    }
+
+    ret = r->Position;
+    r->Position += Size;
+
+    return ret;
+}
+
+void *Region_Realloc(Region *r, void *Old, size_t OldSize, size_t NewSize)
+{
+    void *New;
+
+    if( Old == NULL )
+    {
+        return Region_Alloc(r, NewSize);
+    }
+
+    OldSize = REGION_ALIGN(OldSize == 0 ? 1 : OldSize);
+    NewSize = REGION_ALIGN(NewSize == 0 ? 1 : NewSize);
+
+    if( REGION_IS_LARGE(r, OldSize) && REGION_IS_LARGE(r, NewSize) )
+    {
+        Region_Block *b = ((Region_Block *)Old) - 1;
+
+        if( SafeRealloc((void **)&b, sizeof(Region_Block) + NewSize) != 0 )
+        {
+            return NULL;
+        }
+
+        /* It may have moved */
+        if( b->Prev == NULL )
+        {
+            r->Large = b;
+        } else {
+            b->Prev->Next = b;
+        }
+
+        if( b->Next != NULL )
+        {
+            b->Next->Prev = b;
+        }
+
+        r->Allocated += NewSize - OldSize;
+
+        return b + 1;
+    }
+
+    /* The last small allocation grows in place if there's room */
+    if( !REGION_IS_LARGE(r, NewSize) &&
+        (char *)Old + OldSize == r->Position &&
+        (size_t)(r->End - (char *)Old) >= NewSize
+        )
+    {
+        r->Position = (char *)Old + NewSize;
+        return Old;
+    }
+
+    /* Otherwise the old one is left until the region is freed */
+    New = Region_Alloc(r, NewSize);
+    if( New == NULL )
+    {
+        return NULL;
+    }
+
+    memcpy(New, Old, OldSize < NewSize ? OldSize : NewSize);
+
+    return New;
+}
+
+Region *Region_Enter(Region *r)
+{
+    Region *Previous = CurrentRegion;
+
+    CurrentRegion = r;
+
+    return Previous;
+}
+
+void Region_Leave(Region *Previous)
+{
+    CurrentRegion = Previous;
+}
+
+Region *Region_Current(void)
+{
+    return CurrentRegion;
+}
+
+static void Region_FreeBlocks(Region_Block *b)
+{
+    while( b != NULL )
+    {
+        Region_Block *Next = b->Next;
+
+        SafeFree(b);
+        b = Next;
+    }
+}
+
+void Region_Free(Region *r)
+{
+    Region_FreeBlocks(r->Chunks);
+    Region_FreeBlocks(r->Large);
+
+    Region_Init(r, r->ChunkSize);
+}
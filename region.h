@@ -0,0 +1,57 @@
+#ifndef REGION_H_INCLUDED
+#define REGION_H_INCLUDED
+
+#include "common.h"
+
+/* A region (arena) for structures loaded together and dropped together, like
+ * a generation of hosts or filters.
+ *
+ * Small allocations are cut from big chunks, big ones get a block of their
+ * own, so they can still be resized in place. Nothing is freed one by one,
+ * `Region_Free' drops everything at once.
+ *
+ * `Array's and `StableBuffer's initialized by a thread between
+ * `Region_Enter' and `Region_Leave' allocate from the region entered, for
+ * their whole lives. Their `Free' functions then give nothing back, they
+ * must not be used after the region is freed. A region is not thread safe.
+ */
+
+typedef struct _Region_Block Region_Block;
+
+struct _Region_Block{
+    Region_Block    *Prev;
+    Region_Block    *Next;
+};
+
+typedef struct _Region{
+    /* Small allocations are cut from the first one */
+    Region_Block    *Chunks;
+    char            *Position;
+    char            *End;
+
+    /* Blocks of one allocation each */
+    Region_Block    *Large;
+
+    size_t          ChunkSize;
+    size_t          Allocated; /* In bytes, all blocks */
+} Region;
+
+/* `ChunkSize' 0 for the default */
+int Region_Init(Region *r, size_t ChunkSize);
+
+void *Region_Alloc(Region *r, size_t Size);
+
+/* `OldSize' must be the size `Old' was allocated or resized with. */
+void *Region_Realloc(Region *r, void *Old, size_t OldSize, size_t NewSize);
+
+/* Return the region entered before, to be passed to `Region_Leave' */
+Region *Region_Enter(Region *r);
+
+void Region_Leave(Region *Previous);
+
+/* The region entered by the calling thread, NULL if none */
+Region *Region_Current(void);
+
+void Region_Free(Region *r);
+
+#endif /* REGION_H_INCLUDED */
@@ -1,97 +1,279 @@
 #include <string.h>
 #include "simpleht.h"
+#include "utils.h"
 
-typedef struct _Sht_Slot{
-    int32_t Next;
-} Sht_Slot;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-static const Sht_Slot EmptySlot = {-1};
+#define SHT_GROUP       16
+#define SHT_EMPTY       0x80
+#define SHT_MOVED       0xFE
 
-int SimpleHT_Init(SimpleHT *ht, int DataLength, size_t MaxLoadFactor, uint32_t (*HashFunction)(const char *, uint32_t))
+/* `HASH' values are poorly distributed in their low bits, so they are mixed
+ * before picking groups and control bytes (the finalizer of MurmurHash3).
+ */
+static uint32_t SimpleHT_Mix(uint32_t h)
 {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/* Bit i is set if control byte i of the group is `Byte' */
+static uint32_t SimpleHT_Match(const uint8_t *Group, uint8_t Byte)
+{
+#ifdef __SSE2__
+    __m128i g = _mm_loadu_si128((const __m128i *)Group);
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)Byte)));
+#else
+    uint32_t Mask = 0;
     int loop;
 
-    if( Array_Init(&(ht->Slots), sizeof(Sht_Slot), 7, FALSE, NULL) != 0 )
+    for( loop = 0; loop != SHT_GROUP; ++loop )
+    {
+        if( Group[loop] == Byte )
+        {
+            Mask |= 1U << loop;
+        }
+    }
+
+    return Mask;
+#endif /* __SSE2__ */
+}
+
+static int Sht_Table_Init(Sht_Table *t, uint32_t Capacity)
+{
+    t->Controls = SafeMalloc(Capacity);
+    t->Slots = SafeMalloc(sizeof(Sht_Slot) * Capacity);
+    if( t->Controls == NULL || t->Slots == NULL )
     {
+        SafeFree(t->Controls);
+        SafeFree(t->Slots);
         return -1;
     }
 
-    for( loop = 0; loop != 7; ++loop )
+    memset(t->Controls, SHT_EMPTY, Capacity);
+    t->Capacity = Capacity;
+    t->Used = 0;
+    t->MaxStep = 0;
+
+    return 0;
+}
+
+static void Sht_Table_Free(Sht_Table *t)
+{
+    if( t->Capacity != 0 )
     {
-        Array_PushBack(&(ht->Slots), &EmptySlot, NULL);
+        SafeFree(t->Controls);
+        SafeFree(t->Slots);
     }
 
-    if( Array_Init(&(ht->Nodes), sizeof(Sht_NodeHead) + DataLength, 0, FALSE, NULL) != 0 )
+    t->Controls = NULL;
+    t->Slots = NULL;
+    t->Capacity = 0;
+    t->Used = 0;
+    t->MaxStep = 0;
+}
+
+/* Groups are probed triangularly, which covers all of them since the number
+ * of groups is a power of 2. No hash value lies further than the longest
+ * probe of insertions, which also ends probing the old table, where moved
+ * slots never count as empty.
+ */
+static Sht_Slot *Sht_Table_Find(const Sht_Table *t, uint32_t HashValue, uint32_t Mixed)
+{
+    uint32_t GroupMask = t->Capacity / SHT_GROUP - 1;
+    uint32_t Group = (Mixed >> 7) & GroupMask;
+    uint32_t Step;
+
+    if( t->Capacity == 0 )
     {
-        Array_Free(&(ht->Slots));
-        return -2;
+        return NULL;
     }
 
-    ht->MaxLoadFactor = MaxLoadFactor;
-    ht->LeftSpace = 7 * MaxLoadFactor;
-    ht->HashFunction = HashFunction;
+    for( Step = 0; Step <= t->MaxStep; ++Step )
+    {
+        const uint8_t *Controls = t->Controls + Group * SHT_GROUP;
+        Sht_Slot *Slots = t->Slots + Group * SHT_GROUP;
+        uint32_t Mask = SimpleHT_Match(Controls, Mixed & 0x7f);
+        int Index;
 
-    return 0;
+        for( Index = 0; Mask != 0; ++Index, Mask >>= 1 )
+        {
+            if( (Mask & 1) != 0 && Slots[Index].HashValue == HashValue )
+            {
+                return Slots + Index;
+            }
+        }
+
+        if( SimpleHT_Match(Controls, SHT_EMPTY) != 0 )
+        {
+            return NULL;
+        }
+
+        Group = (Group + Step + 1) & GroupMask;
+    }
+
+    return NULL;
 }
 
-static int SimpleHT_AddToSlot(SimpleHT *ht, Sht_NodeHead *Node, int NodeSubscript)
+/* `HashValue' must not be in the table, and there must be room. */
+static void Sht_Table_Insert(Sht_Table *t,
+                             uint32_t HashValue,
+                             uint32_t Mixed,
+                             int32_t Head
+                             )
 {
-    int NumberOfSlots = Array_GetUsed(&(ht->Slots));
-    Sht_Slot *TheSlot;
+    uint32_t GroupMask = t->Capacity / SHT_GROUP - 1;
+    uint32_t Group = (Mixed >> 7) & GroupMask;
+    uint32_t Step;
+
+    for( Step = 0; Step <= GroupMask; ++Step )
+    {
+        uint8_t *Controls = t->Controls + Group * SHT_GROUP;
+        uint32_t Mask = SimpleHT_Match(Controls, SHT_EMPTY);
 
-    TheSlot = Array_GetBySubscript(&(ht->Slots), Node->HashValue % NumberOfSlots);
-    if( TheSlot == NULL )
+        if( Mask != 0 )
+        {
+            int Index = 0;
+
+            while( (Mask & 1) == 0 )
+            {
+                ++Index;
+                Mask >>= 1;
+            }
+
+            Controls[Index] = Mixed & 0x7f;
+            t->Slots[Group * SHT_GROUP + Index].HashValue = HashValue;
+            t->Slots[Group * SHT_GROUP + Index].Head = Head;
+            ++(t->Used);
+            if( Step > t->MaxStep )
+            {
+                t->MaxStep = Step;
+            }
+            return;
+        }
+
+        Group = (Group + Step + 1) & GroupMask;
+    }
+}
+
+int SimpleHT_Init(SimpleHT *ht, int DataLength, uint32_t (*HashFunction)(const char *, uint32_t))
+{
+    if( Sht_Table_Init(&(ht->Current), SHT_GROUP) != 0 )
     {
         return -1;
     }
 
-    Node->Next = TheSlot->Next;
-    TheSlot->Next = NodeSubscript;
+    if( Array_Init(&(ht->Nodes), sizeof(Sht_NodeHead) + DataLength, 0, FALSE, NULL) != 0 )
+    {
+        Sht_Table_Free(&(ht->Current));
+        return -2;
+    }
+
+    ht->Old.Controls = NULL;
+    ht->Old.Slots = NULL;
+    ht->Old.Capacity = 0;
+    ht->Old.Used = 0;
+    ht->Old.MaxStep = 0;
+    ht->Moved = 0;
+
+    ht->HashFunction = HashFunction;
 
     return 0;
 }
 
-static int SimpleHT_Expand(SimpleHT *ht)
+/* Move at most `Count' slots of the old table */
+static void SimpleHT_Move(SimpleHT *ht, uint32_t Count)
 {
-    int NumberOfSlots_Old = Array_GetUsed(&(ht->Slots));
-    int NumberOfNodes = Array_GetUsed(&(ht->Nodes));
-    Sht_NodeHead *nh = NULL;
-    int loop;
+    Sht_Table *Old = &(ht->Old);
 
-    for( loop = 0; loop < NumberOfSlots_Old; ++loop )
+    if( Old->Capacity == 0 )
     {
-        if( Array_PushBack(&(ht->Slots), &EmptySlot, NULL) < 0 )
+        return;
+    }
+
+    for( ; Count != 0 && ht->Moved != Old->Capacity; --Count, ++(ht->Moved) )
+    {
+        if( Old->Controls[ht->Moved] < SHT_EMPTY )
         {
-            return -1;
+            const Sht_Slot *s = Old->Slots + ht->Moved;
+
+            Sht_Table_Insert(&(ht->Current),
+                             s->HashValue,
+                             SimpleHT_Mix(s->HashValue),
+                             s->Head
+                             );
+
+            Old->Controls[ht->Moved] = SHT_MOVED;
         }
     }
 
-    memset(ht->Slots.Data, -1, NumberOfSlots_Old * ht->Slots.DataLength);
+    if( ht->Moved == Old->Capacity )
+    {
+        Sht_Table_Free(Old);
+        ht->Moved = 0;
+    }
+}
+
+/* Keep the load under 7/8. The old table is moved a group an addition, so
+ * it's done long before the new one, twice as big, needs growing again.
+ */
+static int SimpleHT_Expand(SimpleHT *ht)
+{
+    Sht_Table New;
+
+    if( ht->Current.Used + 1 <= ht->Current.Capacity / 8 * 7 )
+    {
+        return 0;
+    }
 
-    for( loop = 0; loop < NumberOfNodes; ++loop )
+    if( Sht_Table_Init(&New, ht->Current.Capacity * 2) != 0 )
     {
-        nh = Array_GetBySubscript(&(ht->Nodes), loop);
-        SimpleHT_AddToSlot(ht, nh, loop);
+        return -1;
     }
 
+    /* Not expected, but nothing is left behind */
+    SimpleHT_Move(ht, ht->Old.Capacity);
+
+    ht->Old = ht->Current;
+    ht->Current = New;
+    ht->Moved = 0;
+
     return 0;
 }
 
 const char *SimpleHT_Add(SimpleHT *ht, const char *Key, int KeyLength, const char *Data, const uint32_t *HashValue)
 {
     Sht_NodeHead *New;
+    Sht_Slot *Slot;
     int NewSubscript;
+    uint32_t Hash, Mixed;
 
-    if( ht->LeftSpace == 0 )
+    if( HashValue == NULL )
     {
-        int NumberOfSlots_Old = Array_GetUsed(&(ht->Slots));
+        Hash = (ht->HashFunction)(Key, KeyLength);
+    } else {
+        Hash = *HashValue;
+    }
 
-        if( SimpleHT_Expand(ht) != 0 )
-        {
-            return NULL;
-        }
+    Mixed = SimpleHT_Mix(Hash);
 
-        ht->LeftSpace = NumberOfSlots_Old * ht->MaxLoadFactor;
+    Slot = Sht_Table_Find(&(ht->Current), Hash, Mixed);
+    if( Slot == NULL )
+    {
+        Slot = Sht_Table_Find(&(ht->Old), Hash, Mixed);
+    }
+
+    if( Slot == NULL && SimpleHT_Expand(ht) != 0 )
+    {
+        return NULL;
     }
 
     NewSubscript = Array_PushBack(&(ht->Nodes), NULL, NULL);
@@ -102,53 +284,55 @@ const char *SimpleHT_Add(SimpleHT *ht, const char *Key, int KeyLength, const cha
 
     New = Array_GetBySubscript(&(ht->Nodes), NewSubscript);
 
-    if( HashValue == NULL )
-    {
-        New->HashValue = (ht->HashFunction)(Key, KeyLength);
-    } else {
-        New->HashValue = *HashValue;
-    }
+    New->HashValue = Hash;
 
     memcpy(New + 1, Data, ht->Nodes.DataLength - sizeof(Sht_NodeHead));
 
-    SimpleHT_AddToSlot(ht, New, NewSubscript);
+    if( Slot == NULL )
+    {
+        New->Next = -1;
+        Sht_Table_Insert(&(ht->Current), Hash, Mixed, NewSubscript);
+    } else {
+        New->Next = Slot->Head;
+        Slot->Head = NewSubscript;
+    }
 
-    --(ht->LeftSpace);
+    SimpleHT_Move(ht, SHT_GROUP);
 
     return (const char *)(New + 1);
 }
 
 const char *SimpleHT_Find(SimpleHT *ht, const char *Key, int KeyLength, const uint32_t *HashValue, const char *Start)
 {
-    int NumberOfSlots = Array_GetUsed(&(ht->Slots));
     Sht_NodeHead *Node;
 
-    if( NumberOfSlots <= 0 )
-    {
-        return NULL;
-    }
-
     if( Start != NULL )
     {
         Node = Array_GetBySubscript(&(ht->Nodes), (((Sht_NodeHead *)Start) - 1)->Next);
     } else {
-        Sht_Slot *TheSlot;
-        int SlotNumber;
+        const Sht_Slot *Slot;
+        uint32_t Hash, Mixed;
 
         if( HashValue == NULL )
         {
-            SlotNumber = (ht->HashFunction)(Key, KeyLength) % NumberOfSlots;
+            Hash = (ht->HashFunction)(Key, KeyLength);
         } else {
-            SlotNumber = (*HashValue) % NumberOfSlots;
+            Hash = *HashValue;
         }
 
-        TheSlot = Array_GetBySubscript(&(ht->Slots), SlotNumber);
-        if( TheSlot == NULL )
+        Mixed = SimpleHT_Mix(Hash);
+
+        Slot = Sht_Table_Find(&(ht->Current), Hash, Mixed);
+        if( Slot == NULL )
         {
-            return NULL;
+            Slot = Sht_Table_Find(&(ht->Old), Hash, Mixed);
+            if( Slot == NULL )
+            {
+                return NULL;
+            }
         }
 
-        Node = Array_GetBySubscript(&(ht->Nodes), TheSlot->Next);
+        Node = Array_GetBySubscript(&(ht->Nodes), Slot->Head);
     }
 
     if( Node == NULL )
@@ -160,7 +344,7 @@ const char *SimpleHT_Find(SimpleHT *ht, const char *Key, int KeyLength, const ui
 
 }
 
-const char *SimpleHT_Enum(SimpleHT *ht, int32_t *Start)
+const char *SimpleHT_Enum_Hash(SimpleHT *ht, int32_t *Start, uint32_t *HashValue)
 {
     const Array *Nodes = &(ht->Nodes);
     const Sht_NodeHead *Node;
@@ -170,14 +354,24 @@ const char *SimpleHT_Enum(SimpleHT *ht, int32_t *Start)
     if( Node != NULL )
     {
         ++(*Start);
+        if( HashValue != NULL )
+        {
+            *HashValue = Node->HashValue;
+        }
         return (const char *)(Node + 1);
     } else {
         return NULL;
     }
 }
 
+const char *SimpleHT_Enum(SimpleHT *ht, int32_t *Start)
+{
+    return SimpleHT_Enum_Hash(ht, Start, NULL);
+}
+
 void SimpleHT_Free(SimpleHT *ht)
 {
-    Array_Free(&(ht->Slots));
+    Sht_Table_Free(&(ht->Current));
+    Sht_Table_Free(&(ht->Old));
     Array_Free(&(ht->Nodes));
 }
@@ -3,30 +3,64 @@
 
 #include "array.h"
 
+/* Open addressing over full hash values, in the style of Swiss tables.
+ *
+ * Every distinct hash value takes one slot, slots are grouped by 16, and a
+ * control byte a slot holds 7 bits of the hash, so a group is probed by one
+ * SIMD comparison. Nodes of the same hash value are chained through `Next',
+ * the last added first.
+ *
+ * Growing is incremental, the old table is moved into the new one a group
+ * an addition, and both are probed in the meantime.
+ */
+
 typedef struct _Sht_NodeHead{
-    int32_t     Next;
+    int32_t     Next; /* Node added before with the same hash value, or -1 */
     uint32_t    HashValue;
 } Sht_NodeHead;
 
+typedef struct _Sht_Slot{
+    uint32_t    HashValue;
+    int32_t     Head; /* The last node added */
+} Sht_Slot;
+
+typedef struct _Sht_Table{
+    uint8_t     *Controls;
+    Sht_Slot    *Slots;
+    uint32_t    Capacity; /* A power of 2, not less than 16 */
+    uint32_t    Used;
+    uint32_t    MaxStep; /* The longest probe of insertions, in groups */
+} Sht_Table;
+
 typedef struct _SimpleHT {
-    Array   Slots;
-    Array   Nodes;
+    Sht_Table   Current;
 
-    size_t  MaxLoadFactor;
-    size_t  LeftSpace;
+    /* Being moved into `Current', slots below `Moved' are done */
+    Sht_Table   Old;
+    uint32_t    Moved;
+
+    Array   Nodes;
 
     uint32_t    (*HashFunction)(const char *, uint32_t);
 
 } SimpleHT;
 
-int SimpleHT_Init(SimpleHT *ht, int DataLength, size_t MaxLoadFactor, uint32_t (*HashFunction)(const char *, uint32_t));
+int SimpleHT_Init(SimpleHT *ht, int DataLength, uint32_t (*HashFunction)(const char *, uint32_t));
 
 const char *SimpleHT_Add(SimpleHT *ht, const char *Key, int KeyLength, const char *Data, const uint32_t *HashValue);
 
+/* Nodes of the same hash value as `Key', one by one, `Start' is the last one
+ * returned. Different keys may still share a hash value.
+ */
 const char *SimpleHT_Find(SimpleHT *ht, const char *Key, int KeyLength, const uint32_t *HashValue, const char *Start);
 
 const char *SimpleHT_Enum(SimpleHT *ht, int32_t *Start);
 
+/* The same, also giving the hash value the node was added with */
+const char *SimpleHT_Enum_Hash(SimpleHT *ht, int32_t *Start, uint32_t *HashValue);
+
+#define SimpleHT_GetCount(ht_ptr)   Array_GetUsed(&((ht_ptr)->Nodes))
+
 void SimpleHT_Free(SimpleHT *ht);
 
 #endif /* SIMPLEHT_H_INCLUDED */
@@ -130,7 +130,7 @@ int SocketPool_Init(SocketPool *sp, int DataLength)
 {
     DataLength += sizeof(SOCKET);
 
-    if( Bst_Init(&(sp->t),
+    if( Bst_InitBalanced(&(sp->t),
                     DataLength,
                     (CompareFunc)Compare
                     )
@@ -25,7 +25,10 @@ static BOOL NeedRealloc(const Array *MetaInfo, int DataLength)
     }
 }
 
-static StableBuffer_MetaInfo *Realloc(Array *MetaInfo, int DataLength)
+static StableBuffer_MetaInfo *Realloc(Array *MetaInfo,
+                                      Region *Owner,
+                                      int DataLength
+                                      )
 {
     int s;
     StableBuffer_MetaInfo   m;
@@ -34,7 +37,13 @@ static StableBuffer_MetaInfo *Realloc(Array *MetaInfo, int DataLength)
 
     m.Amount = ROUND_UP(DataLength * BLOCK_ORDER, sizeof(void *));
     m.Used = 0;
-    m.Start = SafeMalloc(m.Amount);
+    if( Owner != NULL )
+    {
+        m.Start = Region_Alloc(Owner, m.Amount);
+    } else {
+        m.Start = SafeMalloc(m.Amount);
+    }
+
     if( m.Start == NULL )
     {
         return NULL;
@@ -43,7 +52,10 @@ static StableBuffer_MetaInfo *Realloc(Array *MetaInfo, int DataLength)
     s = Array_PushBack(MetaInfo, &m, NULL);
     if( s < 0 )
     {
-        SafeFree(m.Start);
+        if( Owner == NULL )
+        {
+            SafeFree(m.Start);
+        }
         return NULL;
     }
 
@@ -51,11 +63,11 @@ static StableBuffer_MetaInfo *Realloc(Array *MetaInfo, int DataLength)
 
 }
 
-static void *WriteHere(Array *MetaInfo, int DataLength)
+static void *WriteHere(Array *MetaInfo, Region *Owner, int DataLength)
 {
     if( NeedRealloc(MetaInfo, DataLength) )
     {
-        StableBuffer_MetaInfo   *lm = Realloc(MetaInfo, DataLength);
+        StableBuffer_MetaInfo   *lm = Realloc(MetaInfo, Owner, DataLength);
         if( lm != NULL)
         {
             lm->Used = DataLength;
@@ -83,6 +95,7 @@ static void *WriteHere(Array *MetaInfo, int DataLength)
 static void *Add(StableBuffer *s, const void *Data, int Length, BOOL Align)
 {
     void *wh = WriteHere(&(s->MetaInfo),
+                         s->Owner,
                          Align ? ROUND_UP(Length, sizeof(void *)) : Length
                          );
 
@@ -102,7 +115,7 @@ static void *Add(StableBuffer *s, const void *Data, int Length, BOOL Align)
 static void Clear(StableBuffer *s)
 {
     int i;
-    for( i = 0; i < Array_GetUsed(&(s->MetaInfo)); ++i )
+    for( i = 0; i < Array_GetUsed(&(s->MetaInfo)) && s->Owner == NULL; ++i )
     {
         StableBuffer_MetaInfo *m = Array_GetBySubscript(&(s->MetaInfo), i);
 
@@ -127,6 +140,8 @@ int StableBuffer_Init(StableBuffer *s)
     s->Clear = Clear;
     s->Free = Free;
 
+    s->Owner = Region_Current();
+
     return Array_Init(&(s->MetaInfo),
                       sizeof(StableBuffer_MetaInfo), 0, FALSE, NULL);
 }
@@ -14,6 +14,9 @@ typedef struct _StableBuffer StableBuffer;
 struct _StableBuffer{
     Array   MetaInfo;
 
+    /* Where blocks are allocated, NULL for the heap. See `region.h'. */
+    Region  *Owner;
+
     void    *(*Add)(StableBuffer *s, const void *Data, int Length, BOOL Align);
     void    (*Clear)(StableBuffer *s);
     void    (*Free)(StableBuffer *s);
@@ -41,6 +41,8 @@ int StaticHosts_Init(ConfigFileInfo *ConfigInfo)
         Itr = sli.Next(&sli);
     }
 
+    MainStaticContainer.Compile(&MainStaticContainer);
+
     Inited = TRUE;
 
     INFO("Loading Appendhosts completed.\n");
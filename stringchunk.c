@@ -1,5 +1,4 @@
 #include <string.h>
-#include <time.h>
 #include "stringchunk.h"
 #include "utils.h"
 
@@ -8,6 +7,14 @@ typedef struct _EntryForString{
     void  *Data;
 } EntryForString;
 
+/* Off unless set, see `PrefilterFalsePositive' */
+static int PrefilterOneIn = 0;
+
+void StringChunk_SetPrefilterRate(int OneIn)
+{
+    PrefilterOneIn = OneIn;
+}
+
 int StringChunk_Init(StringChunk *dl, StringList *List)
 {
     int ret;
@@ -17,7 +24,7 @@ int StringChunk_Init(StringChunk *dl, StringList *List)
         return 0;
     }
 
-    if( SimpleHT_Init(&(dl->List_Pos), sizeof(EntryForString), 5, HASH) != 0 )
+    if( SimpleHT_Init(&(dl->List_Pos), sizeof(EntryForString), HASH) != 0 )
     {
         return -1;
     }
@@ -34,6 +41,15 @@ int StringChunk_Init(StringChunk *dl, StringList *List)
         goto EXIT_2;
     }
 
+    if( WildcardSet_Init(&(dl->Compiled_W)) != 0 )
+    {
+        ret = -6;
+        goto EXIT_3;
+    }
+
+    /* Not built yet, allocates nothing */
+    BloomFilter_Init(&(dl->Prefilter), 0, 0);
+
     /* Whether to use external `StringList' to store strings. */
     if( List == NULL )
     {
@@ -41,13 +57,13 @@ int StringChunk_Init(StringChunk *dl, StringList *List)
         if( dl->List == NULL )
         {
             ret = -4;
-            goto EXIT_3;
+            goto EXIT_4;
         }
 
         if( StringList_Init(dl->List, NULL, NULL) != 0 )
         {
             ret = -5;
-            goto EXIT_4;
+            goto EXIT_5;
         }
     } else {
         dl->List = List;
@@ -55,9 +71,11 @@ int StringChunk_Init(StringChunk *dl, StringList *List)
 
     return 0;
 
-EXIT_4:
+EXIT_5:
     SafeFree(dl->List);
     dl->List = NULL;
+EXIT_4:
+    WildcardSet_Free(&(dl->Compiled_W));
 EXIT_3:
     dl->AdditionalDataChunk.Free(&(dl->AdditionalDataChunk));
 EXIT_2:
@@ -118,11 +136,15 @@ int StringChunk_Add(StringChunk *dl,
         {
             return -3;
         }
+
+        WildcardSet_Free(&(dl->Compiled_W));
     } else {
         if( SimpleHT_Add(nl, Str, 0, (const char *)&NewEntry, NULL) == NULL )
         {
             return -4;
         }
+
+        BloomFilter_Free(&(dl->Prefilter));
     }
 
     return 0;
@@ -142,6 +164,79 @@ int StringChunk_Add_Domain(StringChunk  *dl,
     return StringChunk_Add(dl, Domain, AdditionalData, LengthOfAdditionalData);
 }
 
+int StringChunk_Compile_WildCard(StringChunk *dl)
+{
+    Array *wl;
+    const char **Patterns;
+    int ret;
+    int loop;
+
+    if( dl == NULL )
+    {
+        return 0;
+    }
+
+    wl = &(dl->List_W_Pos);
+
+    Patterns = SafeMalloc(sizeof(const char *) * (Array_GetUsed(wl) + 1));
+    if( Patterns == NULL )
+    {
+        return -1;
+    }
+
+    for( loop = 0; loop != Array_GetUsed(wl); ++loop )
+    {
+        const EntryForString *Entry = Array_GetBySubscript(wl, loop);
+
+        Patterns[loop] = Entry->str;
+    }
+
+    ret = WildcardSet_Compile(&(dl->Compiled_W), Patterns, Array_GetUsed(wl));
+
+    SafeFree(Patterns);
+
+    return ret == 0 ? 0 : -2;
+}
+
+int StringChunk_Compile_Prefilter(StringChunk *dl)
+{
+    int32_t Start = 0;
+    uint32_t Hash;
+
+    if( dl == NULL )
+    {
+        return 0;
+    }
+
+    BloomFilter_Free(&(dl->Prefilter));
+    if( BloomFilter_Init(&(dl->Prefilter),
+                         SimpleHT_GetCount(&(dl->List_Pos)),
+                         PrefilterOneIn
+                         )
+        != 0 )
+    {
+        return -1;
+    }
+
+    /* Hashes were computed when adding */
+    while( SimpleHT_Enum_Hash(&(dl->List_Pos), &Start, &Hash) != NULL )
+    {
+        BloomFilter_Add(&(dl->Prefilter), Hash);
+    }
+
+    return 0;
+}
+
+int StringChunk_Compile(StringChunk *dl)
+{
+    if( StringChunk_Compile_WildCard(dl) != 0 )
+    {
+        return -1;
+    }
+
+    return StringChunk_Compile_Prefilter(dl) == 0 ? 0 : -2;
+}
+
 BOOL StringChunk_Match_NoWildCard(StringChunk       *dl,
                                   const char        *Str,
                                   const uint32_t    *HashValue,
@@ -153,6 +248,7 @@ BOOL StringChunk_Match_NoWildCard(StringChunk       *dl,
     SimpleHT        *nl;
 
     EntryForString *FoundEntry = NULL;
+    uint32_t        Hash;
 
     if( dl == NULL )
     {
@@ -161,6 +257,17 @@ BOOL StringChunk_Match_NoWildCard(StringChunk       *dl,
 
     nl = &(dl->List_Pos);
 
+    if( BloomFilter_IsBuilt(&(dl->Prefilter)) )
+    {
+        Hash = HashValue == NULL ? HASH(Str, 0) : *HashValue;
+        if( !BloomFilter_MayContain(&(dl->Prefilter), Hash) )
+        {
+            return FALSE;
+        }
+
+        HashValue = &Hash;
+    }
+
     while( FoundEntry = (EntryForString *)SimpleHT_Find(nl, Str, 0, HashValue, (const char *)FoundEntry),
             FoundEntry != NULL )
     {
@@ -185,118 +292,221 @@ BOOL StringChunk_Match_NoWildCard(StringChunk       *dl,
 
 }
 
-BOOL StringChunk_Match_OnlyWildCard(StringChunk *dl,
-                                    const char  *Str,
-                                    void        **Data,
-                                    DataCompare cb,
-                                    void        *Expected
-                                    )
+/* Finding the first matched wildcard entry */
+typedef struct _WildCardSearch{
+    StringChunk *dl;
+    const char  *Str;
+    BOOL        Exactly;    /* strcmp() instead of WILDCARD_MATCH() */
+    BOOL        StopAtFirst;    /* Visited in ascending order */
+
+    void        **Data;
+    DataCompare cb;
+    void        *Expected;
+
+    int32_t     Found;  /* -1 if not found */
+    void        *FoundData;
+} WildCardSearch;
+
+static int StringChunk_WildCard_Search(int32_t Subscript, WildCardSearch *s)
 {
-    Array           *wl;
+    const EntryForString *FoundEntry;
 
-    EntryForString *FoundEntry;
+    if( s->Found >= 0 && Subscript > s->Found )
+    {
+        return 0;
+    }
 
-    int loop;
+    FoundEntry = (const EntryForString *)Array_GetBySubscript(&(s->dl->List_W_Pos),
+                                                                Subscript
+                                                                );
+    if( FoundEntry == NULL )
+    {
+        return 0;
+    }
 
-    if( dl == NULL )
+    if( s->Exactly ?
+        strcmp(s->Str, FoundEntry->str) != 0 :
+        WILDCARD_MATCH(FoundEntry->str, s->Str) != WILDCARD_MATCHED
+        )
     {
-        return FALSE;
+        return 0;
     }
 
-    wl = &(dl->List_W_Pos);
+    if( s->Data != NULL && s->cb != NULL && !(s->cb(FoundEntry->Data, s->Expected)) )
+    {
+        return 0;
+    }
 
-    for( loop = 0; loop != Array_GetUsed(wl); ++loop )
+    s->Found = Subscript;
+    s->FoundData = FoundEntry->Data;
+
+    return s->StopAtFirst;
+}
+
+/* Picking a random one from all matched wildcard entries, a "*" one is
+ * picked only if nothing else matched.
+ */
+typedef struct _WildCardPick{
+    StringChunk *dl;
+    const char  *Str;
+
+    DataCompare cb;
+    void        *Expected;
+
+    int         Count;
+    void        *Picked;
+    int         CountAny;
+    void        *PickedAny;
+} WildCardPick;
+
+static int StringChunk_WildCard_Pick(int32_t Subscript, WildCardPick *p)
+{
+    const EntryForString *FoundEntry;
+
+    FoundEntry = (const EntryForString *)Array_GetBySubscript(&(p->dl->List_W_Pos),
+                                                                Subscript
+                                                                );
+    if( FoundEntry == NULL ||
+        WILDCARD_MATCH(FoundEntry->str, p->Str) != WILDCARD_MATCHED
+        )
     {
-        FoundEntry = (EntryForString *)Array_GetBySubscript(wl, loop);
-        if( FoundEntry != NULL )
-        {
-            const char *FoundString = FoundEntry->str;
-            if( WILDCARD_MATCH(FoundString, Str) == WILDCARD_MATCHED )
-            {
-                if( Data != NULL )
-                {
-                    if( cb != NULL && !cb(FoundEntry->Data, Expected) )
-                    {
-                        continue;
-                    }
-                    *Data = (void *)(FoundEntry->Data);
-                }
-                return TRUE;
-            }
+        return 0;
+    }
 
-        } else {
-            return FALSE;
+    if( p->cb != NULL && !(p->cb(FoundEntry->Data, p->Expected)) )
+    {
+        return 0;
+    }
+
+    /* Reservoir sampling, every one has the same chance without collecting
+     * them.
+     */
+    if( strcmp(FoundEntry->str, "*") == 0 )
+    {
+        ++(p->CountAny);
+        if( rand() % p->CountAny == 0 )
+        {
+            p->PickedAny = FoundEntry->Data;
+        }
+    } else {
+        ++(p->Count);
+        if( rand() % p->Count == 0 )
+        {
+            p->Picked = FoundEntry->Data;
         }
     }
 
-    return FALSE;
+    return 0;
 }
 
-BOOL StringChunk_Match_OnlyWildCard_GetOne(StringChunk  *dl,
-                                           const char   *Str,
-                                           void         **Data,
-                                           DataCompare  cb,
-                                           void         *Expected
-                                           )
+/* Visit the compiled candidates, or all wildcard entries in order. */
+static void StringChunk_WildCard_Visit(StringChunk          *dl,
+                                       const char           *Str,
+                                       WildcardSet_Visitor  Visitor,
+                                       void                 *Arg
+                                       )
 {
-    Array           Matches;
-    Array           MatchesAny;
-    Array           *pm;
-    Array           *wl;
+    int loop;
 
-    EntryForString *FoundEntry;
+    if( WildcardSet_IsCompiled(&(dl->Compiled_W)) )
+    {
+        WildcardSet_Candidates(&(dl->Compiled_W), Str, Visitor, Arg);
+        return;
+    }
 
-    int loop;
+    for( loop = 0; loop != Array_GetUsed(&(dl->List_W_Pos)); ++loop )
+    {
+        if( Visitor(loop, Arg) != 0 )
+        {
+            return;
+        }
+    }
+}
+
+static BOOL StringChunk_WildCard_First(StringChunk  *dl,
+                                       const char   *Str,
+                                       BOOL         Exactly,
+                                       void         **Data,
+                                       DataCompare  cb,
+                                       void         *Expected
+                                       )
+{
+    WildCardSearch s;
 
     if( dl == NULL )
     {
         return FALSE;
     }
 
-    if( Array_Init(&Matches, sizeof(void *), 4, FALSE, NULL) != 0 )
+    s.dl = dl;
+    s.Str = Str;
+    s.Exactly = Exactly;
+    s.StopAtFirst = !WildcardSet_IsCompiled(&(dl->Compiled_W));
+    s.Data = Data;
+    s.cb = cb;
+    s.Expected = Expected;
+    s.Found = -1;
+    s.FoundData = NULL;
+
+    StringChunk_WildCard_Visit(dl,
+                               Str,
+                               (WildcardSet_Visitor)StringChunk_WildCard_Search,
+                               &s
+                               );
+
+    if( s.Found < 0 )
     {
         return FALSE;
     }
 
-    if( Array_Init(&MatchesAny, sizeof(void *), 4, FALSE, NULL) != 0 )
+    if( Data != NULL )
     {
-        Array_Free(&Matches);
-        return FALSE;
+        *Data = s.FoundData;
     }
 
-    wl = &(dl->List_W_Pos);
+    return TRUE;
+}
 
-    for( loop = 0; loop != Array_GetUsed(wl); ++loop )
-    {
-        FoundEntry = (EntryForString *)Array_GetBySubscript(wl, loop);
-        if( FoundEntry != NULL )
-        {
-            const char *FoundString = FoundEntry->str;
-            if( WILDCARD_MATCH(FoundString, Str) == WILDCARD_MATCHED )
-            {
-                if( cb != NULL && !cb(FoundEntry->Data, Expected) )
-                {
-                    continue;
-                }
-                Array_PushBack(strcmp(FoundString, "*") == 0 ? &MatchesAny : &Matches,
-                               &(FoundEntry->Data),
-                               NULL
-                               );
-            }
-        }
-    }
+BOOL StringChunk_Match_OnlyWildCard(StringChunk *dl,
+                                    const char  *Str,
+                                    void        **Data,
+                                    DataCompare cb,
+                                    void        *Expected
+                                    )
+{
+    return StringChunk_WildCard_First(dl, Str, FALSE, Data, cb, Expected);
+}
 
-    pm = Array_GetUsed(&Matches) > 0 ? &Matches : &MatchesAny;
+BOOL StringChunk_Match_OnlyWildCard_GetOne(StringChunk  *dl,
+                                           const char   *Str,
+                                           void         **Data,
+                                           DataCompare  cb,
+                                           void         *Expected
+                                           )
+{
+    WildCardPick p;
 
-    if( Array_GetUsed(pm) > 0 )
+    if( dl == NULL )
     {
-        srand(time(NULL));
-        *Data = *((void **)Array_GetBySubscript(pm, rand() % Array_GetUsed(pm)));
-    } else {
-        *Data = NULL;
+        return FALSE;
     }
-    Array_Free(&MatchesAny);
-    Array_Free(&Matches);
+
+    p.dl = dl;
+    p.Str = Str;
+    p.cb = cb;
+    p.Expected = Expected;
+    p.Count = 0;
+    p.Picked = NULL;
+    p.CountAny = 0;
+    p.PickedAny = NULL;
+
+    StringChunk_WildCard_Visit(dl,
+                               Str,
+                               (WildcardSet_Visitor)StringChunk_WildCard_Pick,
+                               &p
+                               );
+
+    *Data = p.Count > 0 ? p.Picked : p.PickedAny;
 
     return *Data != NULL;
 }
@@ -313,51 +523,38 @@ BOOL StringChunk_Match(StringChunk      *dl,
             StringChunk_Match_OnlyWildCard(dl, Str, Data, cb, Expected));
 }
 
-static BOOL StringChunk_Match_WildCard_Exactly(StringChunk  *dl,
-                                               const char   *Str,
-                                               void         **Data,
-                                               DataCompare  cb,
-                                               void         *Expected
-                                               )
+BOOL StringChunk_MayMatch(StringChunk       *dl,
+                          const char        *Str,
+                          const uint32_t    *HashValue
+                          )
 {
-    Array           *wl;
-
-    EntryForString *FoundEntry;
-
-    int loop;
-
     if( dl == NULL )
     {
         return FALSE;
     }
 
-    wl = &(dl->List_W_Pos);
-
-    for( loop = 0; loop != Array_GetUsed(wl); ++loop )
+    if( !BloomFilter_IsBuilt(&(dl->Prefilter)) )
     {
-        FoundEntry = (EntryForString *)Array_GetBySubscript(wl, loop);
-        if( FoundEntry != NULL )
-        {
-            const char *FoundString = FoundEntry->str;
-            if( strcmp(Str, FoundString) == 0 )
-            {
-                if( Data != NULL )
-                {
-                    if( cb != NULL && !cb(FoundEntry->Data, Expected) )
-                    {
-                        continue;
-                    }
-                    *Data = (void *)(FoundEntry->Data);
-                }
-                return TRUE;
-            }
-
-        } else {
-            return FALSE;
-        }
+        return TRUE;
     }
 
-    return FALSE;
+    return BloomFilter_MayContain(&(dl->Prefilter),
+                                  HashValue == NULL ? HASH(Str, 0) : *HashValue
+                                  ) ||
+           StringChunk_Match_OnlyWildCard(dl, Str, NULL, NULL, NULL);
+}
+
+static BOOL StringChunk_Match_WildCard_Exactly(StringChunk  *dl,
+                                               const char   *Str,
+                                               void         **Data,
+                                               DataCompare  cb,
+                                               void         *Expected
+                                               )
+{
+    /* A pattern ends or starts with its own anchor, so it is a candidate of
+     * itself.
+     */
+    return StringChunk_WildCard_First(dl, Str, TRUE, Data, cb, Expected);
 }
 
 BOOL StringChunk_Match_Exactly(StringChunk      *dl,
@@ -374,32 +571,49 @@ BOOL StringChunk_Match_Exactly(StringChunk      *dl,
 
 BOOL StringChunk_Domain_Match_NoWildCard(StringChunk    *dl,
                                          const char     *Domain,
-                                         const uint32_t *HashValue,
+                                         const DomainHash *Hashes, /* Could be NULL */
                                          void           **Data,
                                          DataCompare    cb,
                                          void           *Expected
                                          )
 {
+    const char *Itr;
+
     if( dl == NULL )
     {
         return FALSE;
     }
 
-    if( StringChunk_Match_NoWildCard(dl, Domain, HashValue, Data, cb, Expected) == TRUE )
+    /* Suffix hashes are reused if they were computed along with `Domain' */
+    if( StringChunk_Match_NoWildCard(dl,
+                                     Domain,
+                                     DomainHash_Get(Hashes, 0),
+                                     Data,
+                                     cb,
+                                     Expected
+                                     )
+        == TRUE )
     {
         return TRUE;
     }
 
-    Domain = strchr(Domain + 1, '.');
+    Itr = strchr(Domain + 1, '.');
 
-    while( Domain != NULL )
+    while( Itr != NULL )
     {
-        if( StringChunk_Match_NoWildCard(dl, Domain + 1, NULL, Data, cb, Expected) == TRUE )
+        if( StringChunk_Match_NoWildCard(dl,
+                                         Itr + 1,
+                                         DomainHash_Get(Hashes, Itr + 1 - Domain),
+                                         Data,
+                                         cb,
+                                         Expected
+                                         )
+            == TRUE )
         {
             return TRUE;
         }
 
-        Domain = strchr(Domain + 1, '.');
+        Itr = strchr(Itr + 1, '.');
     }
 
     return FALSE;
@@ -407,25 +621,25 @@ BOOL StringChunk_Domain_Match_NoWildCard(StringChunk    *dl,
 
 BOOL StringChunk_Domain_Match(StringChunk       *dl,
                               const char        *Domain,
-                              const uint32_t    *HashValue,
+                              const DomainHash  *Hashes, /* Could be NULL */
                               void              **Data,
                               DataCompare       cb,
                               void              *Expected
                               )
 {
-    return (StringChunk_Domain_Match_NoWildCard(dl, Domain, HashValue, Data, cb, Expected) ||
+    return (StringChunk_Domain_Match_NoWildCard(dl, Domain, Hashes, Data, cb, Expected) ||
             StringChunk_Match_OnlyWildCard(dl, Domain, Data, cb, Expected));
 }
 
 BOOL StringChunk_Domain_Match_WildCardRandom(StringChunk    *dl,
                                              const char     *Domain,
-                                             const uint32_t *HashValue,
+                                             const DomainHash *Hashes, /* Could be NULL */
                                              void           **Data,
                                              DataCompare    cb,
                                              void           *Expected
                                              )
 {
-    return (StringChunk_Domain_Match_NoWildCard(dl, Domain, HashValue, Data, cb, Expected) ||
+    return (StringChunk_Domain_Match_NoWildCard(dl, Domain, Hashes, Data, cb, Expected) ||
             StringChunk_Match_OnlyWildCard_GetOne(dl, Domain, Data, cb, Expected));
 }
 
@@ -458,6 +672,8 @@ void StringChunk_Free(StringChunk *dl, BOOL FreeStringList)
     SimpleHT_Free(&(dl->List_Pos));
     Array_Free(&(dl->List_W_Pos));
     dl->AdditionalDataChunk.Free(&(dl->AdditionalDataChunk));
+    WildcardSet_Free(&(dl->Compiled_W));
+    BloomFilter_Free(&(dl->Prefilter));
 
     if( FreeStringList == TRUE )
     {
@@ -5,6 +5,9 @@
 #include "stringlist.h"
 #include "array.h"
 #include "stablebuffer.h"
+#include "domainhash.h"
+#include "wildcardset.h"
+#include "bloomfilter.h"
 
 typedef struct _StringChunk{
     StringList  *List;
@@ -18,6 +21,14 @@ typedef struct _StringChunk{
     /* Chunk of all additional datas */
     StableBuffer    AdditionalDataChunk;
 
+    /* Compiled `List_W_Pos', empty if not compiled */
+    WildcardSet Compiled_W;
+
+    /* Hashes of `List_Pos', telling most misses without probing it.
+     * Not built if not compiled or disabled.
+     */
+    BloomFilter Prefilter;
+
 } StringChunk;
 
 typedef BOOL (*DataCompare)(const void **Data, const void *Expected);
@@ -36,6 +47,29 @@ int StringChunk_Add_Domain(StringChunk  *dl,
                            int          LengthOfAdditionalData /* The length will not be stored. */
                            );
 
+/* Compile the wildcard ones and build the prefilter of the exact ones, call
+ * it after all strings are added. A later adding drops the compiled result of
+ * its kind.
+ */
+int StringChunk_Compile(StringChunk *dl);
+
+/* Compile the wildcard ones only */
+int StringChunk_Compile_WildCard(StringChunk *dl);
+
+/* Build the prefilter of the exact ones only */
+int StringChunk_Compile_Prefilter(StringChunk *dl);
+
+/* False positive rate of prefilters built later, 1 / `OneIn'. Prefilters
+ * are not built if `OneIn' <= 1, the default.
+ */
+void StringChunk_SetPrefilterRate(int OneIn);
+
+/* FALSE if `Str' definitely matches nothing in `StringChunk_Match' */
+BOOL StringChunk_MayMatch(StringChunk       *dl,
+                          const char        *Str,
+                          const uint32_t    *HashValue
+                          );
+
 /* NOTICE : Data address returned, not offset. */
 BOOL StringChunk_Match_NoWildCard(StringChunk       *dl,
                                   const char        *Str,
@@ -77,7 +111,7 @@ BOOL StringChunk_Match_Exactly(StringChunk      *dl,
 
 BOOL StringChunk_Domain_Match_NoWildCard(StringChunk    *dl,
                                          const char     *Domain,
-                                         const uint32_t *HashValue,
+                                         const DomainHash *Hashes, /* Could be NULL */
                                          void           **Data,
                                          DataCompare    cb,
                                          void           *Expected
@@ -86,7 +120,7 @@ BOOL StringChunk_Domain_Match_NoWildCard(StringChunk    *dl,
 /* Closest */
 BOOL StringChunk_Domain_Match(StringChunk       *dl,
                               const char        *Domain,
-                              const uint32_t    *HashValue,
+                              const DomainHash  *Hashes, /* Could be NULL */
                               void              **Data,
                               DataCompare       cb,
                               void              *Expected
@@ -94,7 +128,7 @@ BOOL StringChunk_Domain_Match(StringChunk       *dl,
 
 BOOL StringChunk_Domain_Match_WildCardRandom(StringChunk    *dl,
                                              const char     *Domain,
-                                             const uint32_t *HashValue,
+                                             const DomainHash *Hashes, /* Could be NULL */
                                              void           **Data,
                                              DataCompare    cb,
                                              void           *Expected
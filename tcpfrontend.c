@@ -4,6 +4,8 @@
 #include "utils.h"
 #include "mmgr.h"
 #include "logs.h"
+#include "probes.h"
+#include "metrics.h"
 
 extern BOOL Ipv6_Enabled;
 
@@ -88,9 +90,14 @@ TcpFrontend_Work(void *Unused)
             TCPLength = ntohs(TCPLength);
             if( TCPLength <= LEFT_LENGTH )
             {
+                IHeaderCheck Check;
+
                 RecvState = recv(sock_c, Entity, TCPLength, 0);
-                if( RecvState == TCPLength )
-                {
+                Check = RecvState == TCPLength ?
+                        IHeader_Check(Entity, RecvState) :
+                        IHEADER_CHECK_SHORT;
+
+                if( Check == IHEADER_CHECK_OK &&
                     IHeader_Fill(Header,
                                  FALSE,
                                  Entity,
@@ -99,7 +106,15 @@ TcpFrontend_Work(void *Unused)
                                  sock_c,
                                  ClientAddr->family,
                                  Agent
-                                 );
+                                 )
+                    != 0 )
+                {
+                    Check = IHEADER_CHECK_PARSE;
+                }
+
+                if( Check == IHEADER_CHECK_OK )
+                {
+                    PROBE_QUERY2(query_received, Header, ClientAddr, 1);
 
                     MMgr_Send(ReceiveBuffer, SOCKET_CONTEXT_LENGTH);
 
@@ -111,6 +126,7 @@ TcpFrontend_Work(void *Unused)
                     continue;
 
                 } else {
+                    Metrics_CountInvalid(Check);
                     INFO("Invalid data received from TCP client %s.\n", Agent);
                 }
             } else {
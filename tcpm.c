@@ -10,7 +10,10 @@
 #include "dnsgenerator.h"
 #include "ipmisc.h"
 #include "domainstatistic.h"
+#include "latency.h"
 #include "ptimer.h"
+#include "metrics.h"
+#include "probes.h"
 
 extern BOOL Ipv6_Enabled;
 
@@ -37,6 +40,7 @@ static void SweepWorks(MsgContext *MsgCtx, int Number, TcpM *Module)
 {
     IHeader *h = (IHeader *)MsgCtx;
 
+    PROBE_QUERY1(query_timeout, h, "tcp");
     ShowTimeOutMessage(h, 'T');
     DomainStatistic_Add(h, STATISTIC_TYPE_REFUSED);
 
@@ -257,6 +261,7 @@ static int TcpM_SendWrapper(SOCKET Sock, const char *Start, int Length)
                 )
         {
             ShowSocketError("Sending to TCP server or proxy failed.", LastError);
+            Metrics_Increase(METRICS_SOCKET_ERRORS);
             return (-1) * LastError;
         }
     }
@@ -278,6 +283,7 @@ static int TcpM_RecvWrapper(SOCKET Sock, char *Buffer, int BufferSize)
                 )
         {
             ShowSocketError("Receiving from TCP server or proxy failed", LastError);
+            Metrics_Increase(METRICS_SOCKET_ERRORS);
             return (-1) * LastError;
         }
     }
@@ -492,6 +498,10 @@ PUBFUNC int TcpM_Send(TcpM *m,
     int State;
     const IHeader *h = (IHeader *)Buffer;
 
+    ((IHeader *)Buffer)->SentTime = PTimer_MonotonicMicro();
+    STAMP((IHeader *)Buffer, STAMP_SENT);
+    PROBE_QUERY1(module_send, h, "tcp");
+
     State = sendto(m->Incoming,
                    Buffer,
                    sizeof(IHeader) + h->EntityLength,
@@ -599,6 +609,8 @@ TcpM_Works(TcpM *m)
 
                 ++NumberOfCumulated;
 
+                Latency_Record(LATENCY_TYPE_TCP_QUEUE, Header->SentTime);
+
                 MsgCtxStored = m->Context.Add(&(m->Context), MsgCtx);
                 if( MsgCtxStored == NULL )
                 {
@@ -618,6 +630,7 @@ TcpM_Works(TcpM *m)
             uint16_t TCPLength;
             SocketPuller *p2;
             char *PartialData;
+            const struct sockaddr *Upstream;
 
             p->Del(p, s);
 
@@ -670,6 +683,7 @@ TcpM_Works(TcpM *m)
             }
 
             p2 = m->Agents[TcpCtx->ServerIndex];
+            Upstream = m->Services[TcpCtx->ServerIndex];
             TcpCtx->LastActivity = time(NULL);
             TcpCtx->MsgCtx = NULL;
             p2->Add(p2, s, TcpCtx, sizeof(TcpContext));
@@ -723,17 +737,24 @@ TcpM_Works(TcpM *m)
                 continue;
             }
 
+            Header->Upstream = Upstream;
+            STAMP(Header, STAMP_ANSWERED);
+            PROBE_QUERY2(upstream_answer, Header, "tcp", Header->SentTime);
+
             if( MsgContext_SendBack(MsgCtx) != 0 )
             {
                 ShowErrorMessage(Header, 'T');
+                Metrics_Increase(METRICS_SOCKET_ERRORS);
                 continue;
             }
 
             ShowNormalMessage(Header, 'T');
             DomainStatistic_Add(Header, STATISTIC_TYPE_TCP);
+            Latency_Record(LATENCY_TYPE_TCP, Header->ReceivedTime);
         }
     }
 
+    DomainStatistic_Retire();
     TcpM_Cleanup(m);
 
     return 0;
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../bloomfilter.h"
+#include "../../stringchunk.h"
+#include "../../ptimer.h"
+#include "../../utils.h"
+#include "../testutils.h"
+
+#define RULE_COUNT      1000000
+#define QUERY_COUNT     1000000
+#define QUERY_LENGTH    64
+
+/* The measured false positive rate should be no worse than the configured
+ * one. Keys and queries are distinct hash values, string hashes would add
+ * collisions of their own (`RULE_COUNT' / 2^32).
+ */
+static int FalsePositive(int OneIn)
+{
+    BloomFilter b;
+    int Positive = 0;
+    uint32_t n;
+
+    BloomFilter_Init(&b, RULE_COUNT, OneIn);
+
+    /* An odd multiplier never maps two numbers to one hash */
+    for( n = 0; n != RULE_COUNT; ++n )
+    {
+        BloomFilter_Add(&b, n * 0x9E3779B1);
+    }
+
+    for( n = RULE_COUNT; n != RULE_COUNT + QUERY_COUNT; ++n )
+    {
+        Positive += BloomFilter_MayContain(&b, n * 0x9E3779B1);
+    }
+
+    printf("1 / %d configured : 1 / %.0f measured, %lu KB\n",
+           OneIn,
+           Positive == 0 ? 0.0 : (double)QUERY_COUNT / Positive,
+           (unsigned long)BloomFilter_GetSize(&b) / 1024
+           );
+
+    BloomFilter_Free(&b);
+
+    return Positive > QUERY_COUNT / OneIn;
+}
+
+/* Nine in ten of the queries match nothing */
+static int Lookup(StringChunk *c, const char *Queries, int *Matched)
+{
+    PTimer t;
+    int n;
+
+    *Matched = 0;
+
+    PTimer_Start(&t);
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        *Matched += StringChunk_Domain_Match(c, Queries + n * QUERY_LENGTH, NULL, NULL, NULL, NULL);
+    }
+
+    return PTimer_End(&t);
+}
+
+static int Bench(void)
+{
+    StringChunk c;
+    char Domain[64];
+    char *Queries = malloc(QUERY_COUNT * QUERY_LENGTH);
+    int Plain, Prefiltered;
+    unsigned long Time;
+    int n;
+
+    StringChunk_Init(&c, NULL);
+
+    for( n = 0; n != RULE_COUNT; ++n )
+    {
+        StringChunk_Add_Domain(&c, RandomDomain(Domain, 2 + n % 2), NULL, 0);
+    }
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        char *q = Queries + n * QUERY_LENGTH;
+
+        if( n % 10 == 0 )
+        {
+            int32_t Start = rand() % RULE_COUNT;
+
+            strcpy(q, "www.");
+            strcat(q, StringChunk_Enum_NoWildCard(&c, &Start, NULL));
+        } else {
+            RandomDomain(q, 4);
+        }
+    }
+
+    StringChunk_SetPrefilterRate(0);
+    StringChunk_Compile(&c);
+    Time = Lookup(&c, Queries, &Plain);
+    printf("without prefilter : %lu ms for %d queries, %d matched\n", Time, QUERY_COUNT, Plain);
+
+    StringChunk_SetPrefilterRate(1000);
+    StringChunk_Compile(&c);
+    Time = Lookup(&c, Queries, &Prefiltered);
+    printf("with prefilter : %lu ms for %d queries, %d matched\n", Time, QUERY_COUNT, Prefiltered);
+
+    free(Queries);
+    StringChunk_Free(&c, TRUE);
+
+    return Plain != Prefiltered;
+}
+
+int main(void)
+{
+    int Failed = 0;
+
+    srand(0);
+
+    Failed |= FalsePositive(100);
+    Failed |= FalsePositive(1000);
+    Failed |= FalsePositive(10000);
+    Failed |= Bench();
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -1,4 +1,5 @@
 #include "../../bst.h"
+#include "../../ptimer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -65,16 +66,43 @@ void del(Bst *t, int n)
     }
 }
 
-int main(void)
+/* Black height of a red-black subtree, -1 if broken */
+int black_height(Bst_NodeHead *n)
+{
+    int l, r;
+
+    if( n == NULL ) return 1;
+
+    if( n->Color == 0 &&
+        ((n->Left != NULL && n->Left->Color == 0) ||
+         (n->Right != NULL && n->Right->Color == 0)) )
+    {
+        return -1;
+    }
+
+    l = black_height(n->Left);
+    r = black_height(n->Right);
+
+    if( l < 0 || l != r ) return -1;
+
+    return l + n->Color;
+}
+
+void cases(BOOL Balanced)
 {
     Bst t;
     int loop;
 
     int max = -1,min = INT_MAX;
 
-    srand(time(NULL));
+    printf("==>>> %s tree\n", Balanced ? "Balanced" : "Unbalanced");
 
-    Bst_Init(&t, sizeof(int), (CompareFunc)f);
+    if( Balanced )
+    {
+        Bst_InitBalanced(&t, sizeof(int), (CompareFunc)f);
+    } else {
+        Bst_Init(&t, sizeof(int), (CompareFunc)f);
+    }
 
     printf("==>>> Delete a node with no child\n");
 
@@ -171,6 +199,109 @@ int main(void)
     t.Reset(&t);
     max = -1;min = INT_MAX;
 
+    t.Free(&t);
+}
+
+/* Random adds and deletes against a plain array, checking the balance */
+void stress(void)
+{
+    static int Keys[4096];
+    Bst t;
+    int Count = 0;
+    int loop;
+
+    printf("==>>> Balanced stress\n");
+
+    Bst_InitBalanced(&t, sizeof(int), (CompareFunc)f);
+
+    for( loop = 0; loop != 200000; ++loop )
+    {
+        if( Count < 4096 && (Count == 0 || rand() % 3 != 0) )
+        {
+            Keys[Count] = rand() % 1000;
+            t.Add(&t, Keys + Count);
+            ++Count;
+        } else {
+            int i = rand() % Count;
+            const void *Node = t.Search(&t, Keys + i, NULL);
+
+            if( Node == NULL )
+            {
+                printf("Test failed, %d not found.\n", Keys[i]);
+                break;
+            }
+
+            t.Delete(&t, Node);
+            Keys[i] = Keys[--Count];
+        }
+
+        if( loop % 1000 == 0 && black_height(t.Root) < 0 )
+        {
+            printf("Test failed, unbalanced.\n");
+            break;
+        }
+    }
+
+    t.Enum(&t, testify, NULL);
+    t.Free(&t);
+}
+
+void bench(BOOL Balanced, BOOL Sorted, int Count)
+{
+    Bst t;
+    PTimer p;
+    int *Keys = malloc(sizeof(int) * Count);
+    int loop;
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        Keys[loop] = Sorted ? loop : rand();
+    }
+
+    if( Balanced )
+    {
+        Bst_InitBalanced(&t, sizeof(int), (CompareFunc)f);
+    } else {
+        Bst_Init(&t, sizeof(int), (CompareFunc)f);
+    }
+
+    PTimer_Start(&p);
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        t.Add(&t, Keys + loop);
+    }
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        t.Delete(&t, t.Search(&t, Keys + loop, NULL));
+    }
+
+    printf("%-10s %-6s : %d adds and deletes, %lu ms\n",
+           Balanced ? "Balanced" : "Unbalanced",
+           Sorted ? "sorted" : "random",
+           Count,
+           PTimer_End(&p)
+           );
+
+    t.Free(&t);
+    free(Keys);
+}
+
+int main(void)
+{
+    srand(time(NULL));
+
+    cases(FALSE);
+    cases(TRUE);
+    stress();
+
+    printf("==>>> Benchmark\n");
+    bench(FALSE, FALSE, 1000000);
+    bench(TRUE, FALSE, 1000000);
+    bench(FALSE, TRUE, 30000);
+    bench(TRUE, TRUE, 30000);
+    bench(TRUE, TRUE, 1000000);
 
     return 0;
 }
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include "../../domainhash.h"
+#include "../../utils.h"
+
+static int Check(const char *Packet, int PacketLength, const char *NameStart)
+{
+    char Name[256];
+    char Expected[256];
+    DomainHash h;
+    const char *Itr;
+    int Length;
+    int Failed = 0;
+
+    Length = DomainHash_Unpack(Packet, PacketLength, NameStart, Name, sizeof(Name), &h);
+    if( Length < 0 )
+    {
+        printf("UNPACK FAILED\n\n");
+        return 1;
+    }
+
+    printf("NAME : %s (%d bytes, %d suffixes)\n", Name, Length, h.Count);
+
+    /* Compare with the plain way */
+    for( Itr = Name; Itr != NULL; Itr = strchr(Itr, '.') )
+    {
+        const uint32_t *v;
+
+        if( *Itr == '.' )
+        {
+            ++Itr;
+        }
+
+        strcpy(Expected, Itr);
+        StrToLower(Expected);
+
+        v = DomainHash_Get(&h, Itr - Name);
+        if( v == NULL || *v != HASH(Expected, 0) || strcmp(Expected, Itr) != 0 )
+        {
+            printf("    %s : MISMATCHED\n", Itr);
+            Failed = 1;
+        } else {
+            printf("    %s : %u\n", Itr, *v);
+        }
+    }
+
+    printf("\n");
+
+    return Failed;
+}
+
+int main(void)
+{
+    /* "WWW.Example.COM" followed by "mail" pointing to "Example.COM" */
+    static const char Packet[] =
+        "\x03" "WWW" "\x07" "Example" "\x03" "COM" "\x00"
+        "\x04" "mail" "\xC0\x04";
+
+    /* A label longer than 16 bytes */
+    static const char Long[] =
+        "\x25" "ThisIsALabelLongerThanSixteenBytes-00"
+        "\x02" "Cn" "\x00";
+
+    /* Pointing to itself */
+    static const char Loop[] = "\x01" "a" "\xC0\x02";
+
+    char Name[256];
+    int Failed = 0;
+
+    Failed |= Check(Packet, sizeof(Packet) - 1, Packet);
+    Failed |= Check(Packet, sizeof(Packet) - 1, Packet + 17);
+    Failed |= Check(Long, sizeof(Long) - 1, Long);
+
+    if( DomainHash_Unpack(Loop, sizeof(Loop) - 1, Loop, Name, sizeof(Name), NULL) >= 0 )
+    {
+        printf("POINTER LOOP NOT DETECTED\n");
+        Failed = 1;
+    }
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../domainlist.h"
+#include "../../stringchunk.h"
+#include "../../readline.h"
+#include "../../ptimer.h"
+#include "../testutils.h"
+
+#define RULE_COUNT      1000000
+#define QUERY_COUNT     1000000
+#define QUERY_LENGTH    64
+
+#define TEXT_FILE       "domainlist.txt"
+#define COMPILED_FILE   "domainlist.bin"
+
+/* Some with leading dots, some duplicated, and a few wildcard ones */
+static void MakeList(void)
+{
+    FILE *fp = fopen(TEXT_FILE, "w");
+    char Domain[64];
+    int n;
+
+    for( n = 0; n != RULE_COUNT; ++n )
+    {
+        RandomDomain(Domain, 2 + n % 2);
+
+        fprintf(fp, "%s%s\n", n % 10 == 0 ? "." : "", Domain);
+
+        if( n % 1000 == 0 )
+        {
+            fprintf(fp, "%s\n*.%s\n", Domain, Domain);
+        }
+    }
+
+    fclose(fp);
+}
+
+/* The same as `LoadDomainsFromFile' in filter.c does */
+static void LoadText(StringChunk *c)
+{
+    FILE *fp = fopen(TEXT_FILE, "r");
+    char Domain[512];
+
+    while( TRUE )
+    {
+        ReadLineStatus Status = ReadLine(fp, Domain, sizeof(Domain));
+
+        if( Status == READ_FAILED_OR_END )
+        {
+            break;
+        }
+
+        if( Status == READ_DONE )
+        {
+            StringChunk_Add_Domain(c, Domain, NULL, 0);
+        } else {
+            ReadLine_GoToNextLine(fp);
+        }
+    }
+
+    fclose(fp);
+}
+
+/* A bad offset must be refused, and compiling again must not touch a list
+ * already mapped.
+ */
+static int Corrupt(const DomainList *l)
+{
+    DomainList Copy;
+    FILE *fp;
+    char *Bytes;
+    uint32_t Bad = 0xFFFFFFF0;
+
+    Bytes = malloc(l->Length);
+    memcpy(Bytes, l->Base, l->Length);
+    memcpy(Bytes + ((const char *)(l->Offsets + 7) - (const char *)l->Base),
+           &Bad,
+           sizeof(Bad)
+           );
+
+    fp = fopen("corrupt.bin", "wb");
+    fwrite(Bytes, l->Length, 1, fp);
+    fclose(fp);
+    free(Bytes);
+
+    if( DomainList_Map(&Copy, "corrupt.bin") != -5 )
+    {
+        printf("A bad offset is taken.\n");
+        return -1;
+    }
+
+    remove("corrupt.bin");
+
+    if( DomainList_Compile(TEXT_FILE, COMPILED_FILE) < 0 ||
+        DomainList_GetCount(l) == 0 ||
+        !DomainList_Match(l, DomainList_GetWildCard(l, 0) + 2, NULL)
+        )
+    {
+        printf("Compiling again broke the mapped list.\n");
+        return -2;
+    }
+
+    return 0;
+}
+
+/* Half of the queries are subdomains of rules, the others match nothing */
+static char *MakeQueries(StringChunk *c)
+{
+    char *Queries = malloc(QUERY_COUNT * QUERY_LENGTH);
+    int n;
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        char *q = Queries + n * QUERY_LENGTH;
+
+        if( n % 2 == 0 )
+        {
+            int32_t Start = rand() % RULE_COUNT;
+            const char *Rule = StringChunk_Enum_NoWildCard(c, &Start, NULL);
+
+            strcpy(q, n % 4 == 0 ? "www." : "");
+            strcat(q, Rule);
+        } else {
+            RandomDomain(q, 4);
+        }
+    }
+
+    return Queries;
+}
+
+int main(void)
+{
+    StringChunk c;
+    DomainList l;
+    PTimer t;
+    char *Queries;
+    int Compiled;
+    int FromText = 0, FromMap = 0;
+    int n;
+
+    srand(0);
+
+    MakeList();
+
+    StringChunk_Init(&c, NULL);
+
+    PTimer_Start(&t);
+    LoadText(&c);
+    printf("Loading text : %lu ms\n", PTimer_End(&t));
+
+    PTimer_Start(&t);
+    Compiled = DomainList_Compile(TEXT_FILE, COMPILED_FILE);
+    printf("Compiling : %lu ms, %d entries\n", PTimer_End(&t), Compiled);
+
+    PTimer_Start(&t);
+    if( DomainList_Map(&l, COMPILED_FILE) != 0 )
+    {
+        printf("Mapping failed.\nFAILED\n");
+        return 1;
+    }
+    printf("Mapping : %lu ms, %u domains, %u wildcards\n",
+           PTimer_End(&t),
+           DomainList_GetCount(&l),
+           DomainList_GetWildCardCount(&l)
+           );
+
+    if( DomainList_Map(&l, TEXT_FILE) != -2 )
+    {
+        printf("A text file is taken as compiled.\nFAILED\n");
+        return 1;
+    }
+
+    DomainList_Map(&l, COMPILED_FILE);
+
+    if( Corrupt(&l) != 0 )
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    Queries = MakeQueries(&c);
+
+    PTimer_Start(&t);
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        FromText += StringChunk_Domain_Match_NoWildCard(&c, Queries + n * QUERY_LENGTH, NULL, NULL, NULL, NULL);
+    }
+    printf("StringChunk : %lu ms for %d queries, %d matched\n", PTimer_End(&t), QUERY_COUNT, FromText);
+
+    PTimer_Start(&t);
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        FromMap += DomainList_Match(&l, Queries + n * QUERY_LENGTH, NULL);
+    }
+    printf("DomainList : %lu ms for %d queries, %d matched\n", PTimer_End(&t), QUERY_COUNT, FromMap);
+
+    free(Queries);
+    DomainList_Unmap(&l);
+    StringChunk_Free(&c, TRUE);
+    remove(TEXT_FILE);
+    remove(COMPILED_FILE);
+
+    printf(FromText == FromMap ? "PASSED\n" : "FAILED\n");
+
+    return FromText != FromMap;
+}
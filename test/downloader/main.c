@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../downloader.h"
+
+/* Messages of the downloader are not checked here */
+void Log_Print(const char *Type, const char *format, ...)
+{
+}
+
+#if defined(_WIN32) || defined(DOWNLOAD_LIBCURL) || defined(DOWNLOAD_WGET)
+
+/* A local HTTP server, answering conditional requests the way hosts mirrors
+ * do: `/a' by `ETag', `/b' by `Last-Modified'.
+ */
+
+static int  Versions[2] = {1, 1};
+static int  Sent = 0;
+static int  NotModified = 0;
+
+static void Serve(SOCKET s)
+{
+    char Request[2048], Response[512], Value[64];
+    int Length = 0, n, Which;
+    const char *Header;
+
+    while( Length < (int)sizeof(Request) - 1 )
+    {
+        n = recv(s, Request + Length, sizeof(Request) - 1 - Length, 0);
+        if( n <= 0 )
+        {
+            break;
+        }
+
+        Length += n;
+        Request[Length] = '\0';
+
+        if( strstr(Request, "\r\n\r\n") != NULL )
+        {
+            break;
+        }
+    }
+    Request[Length] = '\0';
+
+    if( strncmp(Request, "GET /a ", 7) == 0 )
+    {
+        Which = 0;
+        sprintf(Value, "\"a%d\"", Versions[0]);
+        Header = "ETag";
+    } else if( strncmp(Request, "GET /b ", 7) == 0 )
+    {
+        Which = 1;
+        sprintf(Value, "Mon, 0%d Oct 2026 10:00:00 GMT", Versions[1]);
+        Header = "Last-Modified";
+    } else {
+        strcpy(Response, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        send(s, Response, strlen(Response), 0);
+        return;
+    }
+
+    if( (Which == 0 && strstr(Request, "If-None-Match: ") != NULL &&
+         strstr(Request, Value) != NULL) ||
+        (Which == 1 && strstr(Request, "If-Modified-Since: ") != NULL &&
+         strstr(Request, Value) != NULL)
+        )
+    {
+        ++NotModified;
+        sprintf(Response, "HTTP/1.0 304 Not Modified\r\n%s: %s\r\n\r\n", Header, Value);
+        send(s, Response, strlen(Response), 0);
+    } else {
+        char Body[32];
+
+        ++Sent;
+        sprintf(Body, "%c%d", 'A' + Which, Versions[Which]);
+        sprintf(Response,
+                "HTTP/1.0 200 OK\r\n%s: %s\r\nContent-Length: %d\r\n\r\n%s",
+                Header, Value, (int)strlen(Body), Body
+                );
+        send(s, Response, strlen(Response), 0);
+    }
+}
+
+static int
+#ifdef _WIN32
+WINAPI
+#endif
+Server(SOCKET *Listener)
+{
+    while( TRUE )
+    {
+        SOCKET s = accept(*Listener, NULL, NULL);
+
+        if( s == INVALID_SOCKET )
+        {
+            break;
+        }
+
+        Serve(s);
+        CLOSE_SOCKET(s);
+    }
+
+    return 0;
+}
+
+static int Check(const char *File, const char *Expected)
+{
+    char Content[64];
+    FILE *fp = fopen(File, "rb");
+    size_t Length;
+
+    if( fp == NULL )
+    {
+        return -1;
+    }
+
+    Length = fread(Content, 1, sizeof(Content) - 1, fp);
+    Content[Length] = '\0';
+    fclose(fp);
+
+    return strcmp(Content, Expected);
+}
+
+static int Download(const char **URLs,
+                    const char *File,
+                    int ExpectedState,
+                    int ExpectedSent,
+                    int ExpectedNotModified,
+                    const char *Expected,
+                    const char *Step
+                    )
+{
+    int State;
+
+    Sent = NotModified = 0;
+    State = GetFromInternet_MultiFiles(URLs, File, 0, 1, NULL, NULL);
+
+    printf("%-24s: state %d, %d sent, %d not modified\n",
+           Step, State, Sent, NotModified);
+
+    if( State != ExpectedState ||
+        Sent != ExpectedSent ||
+        NotModified != ExpectedNotModified ||
+        Check(File, Expected) != 0
+        )
+    {
+        printf("%s failed.\n", Step);
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif /* defined(_WIN32) || defined(DOWNLOAD_LIBCURL) || defined(DOWNLOAD_WGET) */
+
+int main(void)
+{
+#if defined(_WIN32) || defined(DOWNLOAD_LIBCURL) || defined(DOWNLOAD_WGET)
+    const char *File = GET_TEMP_DIR() PATH_SLASH_STR "downloader_test.txt";
+    char Validators[320];
+    char URLa[64], URLb[64];
+    const char *URLs[3] = {URLa, URLb, NULL};
+    SOCKET Listener;
+    struct sockaddr_in Address;
+    socklen_t AddressLength = sizeof(Address);
+    ThreadHandle t;
+    int Failed = 0;
+
+#ifdef _WIN32
+    WSADATA wd;
+    WSAStartup(MAKEWORD(2, 2), &wd);
+#endif
+
+    memset(&Address, 0, sizeof(Address));
+    FILL_ADDR4(Address, AF_INET, "127.0.0.1", 0);
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if( bind(Listener, (struct sockaddr *)&Address, sizeof(Address)) != 0 ||
+        listen(Listener, 8) != 0 ||
+        getsockname(Listener, (struct sockaddr *)&Address, &AddressLength) != 0
+        )
+    {
+        printf("Cannot start the server.\n");
+        return 1;
+    }
+
+    sprintf(URLa, "http://127.0.0.1:%d/a", ntohs(Address.sin_port));
+    sprintf(URLb, "http://127.0.0.1:%d/b", ntohs(Address.sin_port));
+
+    strcpy(Validators, File);
+    strcat(Validators, ".validators");
+    remove(File);
+    remove(Validators);
+
+    CREATE_THREAD(Server, &Listener, t);
+    DETACH_THREAD(t);
+
+    Failed |= Download(URLs, File, 0, 2, 0, "A1\nB1\n", "first");
+    Failed |= Download(URLs, File, GET_FROM_INTERNET_NOT_MODIFIED, 0, 2, "A1\nB1\n", "unchanged");
+
+    /* The one before has to be downloaded again to be kept in order */
+    Versions[1] = 2;
+    Failed |= Download(URLs, File, 0, 2, 1, "A1\nB2\n", "second changed");
+
+    /* The ones after are downloaded in full */
+    Versions[0] = 2;
+    Failed |= Download(URLs, File, 0, 2, 0, "A2\nB2\n", "first changed");
+    Failed |= Download(URLs, File, GET_FROM_INTERNET_NOT_MODIFIED, 0, 2, "A2\nB2\n", "unchanged again");
+
+    /* Not complete without the validators */
+    remove(Validators);
+    Failed |= Download(URLs, File, 0, 2, 0, "A2\nB2\n", "validators lost");
+
+    remove(File);
+    remove(Validators);
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+#else
+    printf("No downloader built in, skipped.\n");
+
+    return 0;
+#endif
+}
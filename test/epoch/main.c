@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../epoch.h"
+#include "../../rwlock.h"
+#include "../../ptimer.h"
+
+#define READERS         4
+#define SWAPS           2000
+#define BENCH_LOOPS     2000000
+#define VALUE_COUNT     64
+
+typedef struct _Generation{
+    int Serial;
+    int Values[VALUE_COUNT];
+} Generation;
+
+static Generation   *Current = NULL;
+static volatile int Stopped = 0;
+static volatile int Broken = 0;
+
+static RWLock   Lock = NULL_RWLOCK;
+
+static Generation *NewGeneration(int Serial)
+{
+    Generation *g = malloc(sizeof(Generation));
+    int loop;
+
+    g->Serial = Serial;
+    for( loop = 0; loop != VALUE_COUNT; ++loop )
+    {
+        g->Values[loop] = Serial;
+    }
+
+    return g;
+}
+
+/* Readers must never see one poisoned by the writer */
+static int
+#ifdef _WIN32
+WINAPI
+#endif
+Reader(void *Unused)
+{
+    while( !Stopped )
+    {
+        Generation *g;
+        int loop;
+
+        Epoch_Enter();
+
+        g = EPOCH_LOAD(Current);
+
+        /* Nested sections, like filters inside `MMgr_Send' */
+        Epoch_Enter();
+        Epoch_Leave();
+
+        for( loop = 0; loop != VALUE_COUNT; ++loop )
+        {
+            if( g->Values[loop] != g->Serial || g->Serial < 0 )
+            {
+                Broken = 1;
+            }
+        }
+
+        Epoch_Leave();
+    }
+
+    return 0;
+}
+
+static int
+#ifdef _WIN32
+WINAPI
+#endif
+BenchEpoch(int *Result)
+{
+    int loop, Sum = 0;
+
+    for( loop = 0; loop != BENCH_LOOPS; ++loop )
+    {
+        Epoch_Enter();
+        Sum += EPOCH_LOAD(Current)->Values[loop % VALUE_COUNT];
+        Epoch_Leave();
+    }
+
+    *Result = Sum;
+
+    return 0;
+}
+
+static int
+#ifdef _WIN32
+WINAPI
+#endif
+BenchLock(int *Result)
+{
+    int loop, Sum = 0;
+
+    for( loop = 0; loop != BENCH_LOOPS; ++loop )
+    {
+        RWLock_RdLock(Lock);
+        Sum += Current->Values[loop % VALUE_COUNT];
+        RWLock_UnRLock(Lock);
+    }
+
+    *Result = Sum;
+
+    return 0;
+}
+
+static unsigned long Bench(void *Func)
+{
+    ThreadHandle t[READERS];
+    int Sums[READERS];
+    PTimer Timer;
+    int loop;
+
+    PTimer_Start(&Timer);
+
+    for( loop = 0; loop != READERS; ++loop )
+    {
+        Sums[loop] = 0;
+        CREATE_THREAD(Func, Sums + loop, t[loop]);
+    }
+
+    for( loop = 0; loop != READERS; ++loop )
+    {
+#ifdef _WIN32
+        WaitForSingleObject(t[loop], INFINITE);
+        CloseHandle(t[loop]);
+#else
+        pthread_join(t[loop], NULL);
+#endif
+    }
+
+    return PTimer_End(&Timer);
+}
+
+int main(void)
+{
+    ThreadHandle t[READERS];
+    Generation **Retired;
+    int loop;
+
+    Retired = malloc(sizeof(Generation *) * SWAPS);
+    Current = NewGeneration(0);
+
+    for( loop = 0; loop != READERS; ++loop )
+    {
+        CREATE_THREAD(Reader, NULL, t[loop]);
+    }
+
+    for( loop = 0; loop != SWAPS; ++loop )
+    {
+        Generation *Old = EPOCH_EXCHANGE(Current, NewGeneration(loop + 1));
+
+        Epoch_Synchronize();
+
+        /* Freed as far as readers are concerned, kept to be checked */
+        memset(Old, 0xFF, sizeof(Generation));
+        Retired[loop] = Old;
+    }
+
+    Stopped = 1;
+
+    for( loop = 0; loop != READERS; ++loop )
+    {
+#ifdef _WIN32
+        WaitForSingleObject(t[loop], INFINITE);
+        CloseHandle(t[loop]);
+#else
+        pthread_join(t[loop], NULL);
+#endif
+    }
+
+    for( loop = 0; loop != SWAPS; ++loop )
+    {
+        free(Retired[loop]);
+    }
+    free(Retired);
+
+    printf("%d generations swapped under %d readers.\n", SWAPS, READERS);
+
+    /* For reference only. A section takes two locked instructions and a
+     * read lock one, so with one CPU the rwlock is as fast or faster (195 vs
+     * 215 ms measured). Epochs pay off with readers on several cores, which
+     * then don't share a lock cache line.
+     */
+    RWLock_Init(Lock);
+    printf("rwlock : %lu ms\n", Bench(BenchLock));
+    printf("epoch  : %lu ms\n", Bench(BenchEpoch));
+    RWLock_Destroy(Lock);
+
+    free(Current);
+
+    printf(Broken ? "FAILED\n" : "PASSED\n");
+
+    return Broken;
+}
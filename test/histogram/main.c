@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../histogram.h"
+#include "../../ptimer.h"
+
+#define VALUE_COUNT     1000000
+#define THREADS         4
+#define THREAD_LOOPS    1000000
+
+static Histogram Shared;
+
+static int CompareValues(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Latency-like: mostly around 1 ms, with a long tail up to seconds */
+static uint32_t NextValue(void)
+{
+    uint32_t v = 500 + rand() % 1000;
+
+    if( rand() % 100 == 0 )
+    {
+        v *= 1 + rand() % 1000;
+    }
+
+    return v;
+}
+
+/* Percentiles read back must be the true ones or at most 1/32 over */
+static int Accuracy(void)
+{
+    static const double Percentiles[] = {0.0, 50.0, 90.0, 99.0, 99.9, 100.0};
+    uint32_t *Values = malloc(sizeof(uint32_t) * VALUE_COUNT);
+    uint32_t Read[sizeof(Percentiles) / sizeof(Percentiles[0])];
+    Histogram h;
+    uint32_t Max;
+    int n, Failed = 0;
+
+    Histogram_Init(&h);
+
+    for( n = 0; n != VALUE_COUNT; ++n )
+    {
+        Values[n] = NextValue();
+        Histogram_Record(&h, Values[n]);
+    }
+
+    if( Histogram_Percentiles(&h,
+                              Percentiles,
+                              Read,
+                              sizeof(Percentiles) / sizeof(Percentiles[0]),
+                              &Max
+                              )
+        != VALUE_COUNT )
+    {
+        printf("Counts lost.\n");
+        Failed = 1;
+    }
+
+    qsort(Values, VALUE_COUNT, sizeof(uint32_t), CompareValues);
+
+    for( n = 0; n != sizeof(Percentiles) / sizeof(Percentiles[0]); ++n )
+    {
+        int Rank = (int)(VALUE_COUNT * Percentiles[n] / 100.0 + 0.999999);
+        uint32_t Truth = Values[Rank > 0 ? Rank - 1 : 0];
+
+        printf("p%g : %u, %u really\n", Percentiles[n], Read[n], Truth);
+
+        if( Read[n] < Truth || Read[n] > Truth + Truth / 32 + 1 )
+        {
+            Failed = 1;
+        }
+    }
+
+    if( Max != Values[VALUE_COUNT - 1] )
+    {
+        printf("Max %u, %u really.\n", Max, Values[VALUE_COUNT - 1]);
+        Failed = 1;
+    }
+
+    free(Values);
+
+    return Failed;
+}
+
+static int
+#ifdef _WIN32
+WINAPI
+#endif
+Recorder(void *Unused)
+{
+    int loop;
+
+    for( loop = 0; loop != THREAD_LOOPS; ++loop )
+    {
+        Histogram_Record(&Shared, loop);
+    }
+
+    return 0;
+}
+
+/* No count, nor any of the sum, is lost between threads */
+static int Concurrency(void)
+{
+    static const double Median = 50.0;
+    ThreadHandle t[THREADS];
+    PTimer Timer;
+    uint32_t Value, Max;
+    uint64_t Count;
+    int loop;
+
+    Histogram_Init(&Shared);
+
+    PTimer_Start(&Timer);
+
+    for( loop = 0; loop != THREADS; ++loop )
+    {
+        CREATE_THREAD(Recorder, NULL, t[loop]);
+    }
+
+    for( loop = 0; loop != THREADS; ++loop )
+    {
+#ifdef _WIN32
+        WaitForSingleObject(t[loop], INFINITE);
+        CloseHandle(t[loop]);
+#else
+        pthread_join(t[loop], NULL);
+#endif
+    }
+
+    printf("%d threads : %d recorded in %lu ms\n",
+           THREADS,
+           THREADS * THREAD_LOOPS,
+           PTimer_End(&Timer)
+           );
+
+    Count = Histogram_Percentiles(&Shared, &Median, &Value, 1, &Max);
+
+    return Count != (uint64_t)THREADS * THREAD_LOOPS ||
+           Max != THREAD_LOOPS - 1 ||
+           Histogram_Sum(&Shared) !=
+               (uint64_t)THREADS * THREAD_LOOPS * (THREAD_LOOPS - 1) / 2;
+}
+
+int main(void)
+{
+    int Failed = 0;
+
+    srand(0);
+
+    Failed |= Accuracy();
+    Failed |= Concurrency();
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../hostsloader.h"
+#include "../../readline.h"
+#include "../../ipchunk.h"
+#include "../../ptimer.h"
+
+#define LINE_COUNT  400000
+
+/* What `Generate' changes */
+#define VARIANT_ORIGINAL    0
+#define VARIANT_CHANGED     1 /* Some addresses changed, removed and added */
+#define VARIANT_WILDCARD    2 /* Plus a name with wildcards */
+
+#define ADDED_COUNT 100
+
+/* Messages of the loader are not checked here */
+void Log_Print(const char *Type, const char *format, ...)
+{
+}
+
+static void Generate(const char *File, int Variant)
+{
+    FILE *fp = fopen(File, "wb");
+    int loop;
+
+    for( loop = 0; loop != LINE_COUNT; ++loop )
+    {
+        const char *Eol = loop % 3 == 0 ? "\r\n" : "\n";
+
+        switch( loop % 10 )
+        {
+        case 0:
+            fprintf(fp, "# comment %d%s", loop, Eol);
+            break;
+
+        case 1:
+            fprintf(fp, "   \t%s", Eol);
+            break;
+
+        case 2:
+            fprintf(fp, "::%x host%d.example.net%s", loop, loop, Eol);
+            break;
+
+        case 3:
+            fprintf(fp, "alias%d.example.org host%d.example.com ; alias%s",
+                    loop, loop - 1, Eol);
+            break;
+
+        case 4:
+            fprintf(fp, "@@ ex%d.example.com%s", loop, Eol);
+            break;
+
+        case 5:
+            fprintf(fp, "<list%d> good%d.example.com%s", loop % 7, loop, Eol);
+            break;
+
+        case 6:
+            /* The same domain twice, the order must be kept */
+            fprintf(fp, "10.%d.%d.%d dup%d.example.com%s",
+                    loop >> 16 & 255, loop >> 8 & 255, loop & 255, loop / 10, Eol);
+            break;
+
+        case 7:
+            fprintf(fp, "  10.1.%d.%d   dup%d.example.com  # again%s",
+                    loop >> 8 & 255, loop & 255, loop / 10, Eol);
+            break;
+
+        case 8:
+            if( loop % 5000 == 8 )
+            {
+                int n;
+
+                /* Too long to be read */
+                fprintf(fp, "10.0.0.1 ");
+                for( n = 0; n != 40; ++n )
+                {
+                    fprintf(fp, "long%d.", n);
+                }
+                fprintf(fp, "example.com%s", Eol);
+                break;
+            }
+            /* Fall through */
+
+        default:
+            if( Variant != VARIANT_ORIGINAL && loop % 1000 == 9 )
+            {
+                fprintf(fp, "0.0.0.1 ad%d.example.com%s", loop, Eol);
+            } else if( Variant != VARIANT_ORIGINAL && loop % 1000 == 19 )
+            {
+                /* Removed */
+            } else {
+                fprintf(fp, "0.0.0.0 ad%d.example.com%s", loop, Eol);
+            }
+            break;
+        }
+    }
+
+    if( Variant != VARIANT_ORIGINAL )
+    {
+        for( loop = 0; loop != ADDED_COUNT; ++loop )
+        {
+            fprintf(fp, "10.2.0.%d new%d.example.com\n", loop, loop);
+        }
+    }
+
+    if( Variant == VARIANT_WILDCARD )
+    {
+        fprintf(fp, "10.3.0.1 *.example.net\n");
+    }
+
+    /* No line end at the end */
+    fprintf(fp, "0.0.0.0 last.example.com");
+
+    fclose(fp);
+}
+
+static int LoadByLines(HostsContainer *c, const char *File)
+{
+    FILE *fp = fopen(File, "r");
+    char Buffer[320];
+    ReadLineStatus Status;
+    int Count = 0;
+
+    while( (Status = ReadLine(fp, Buffer, sizeof(Buffer))) != READ_FAILED_OR_END )
+    {
+        if( Status == READ_TRUNCATED )
+        {
+            ReadLine_GoToNextLine(fp);
+            continue;
+        }
+
+        if( c->Load(c, Buffer) != HOSTS_TYPE_UNKNOWN )
+        {
+            ++Count;
+        }
+    }
+
+    fclose(fp);
+
+    return Count;
+}
+
+typedef struct _Found{
+    HostsRecordType Type;
+    char            Data[128];
+} Found;
+
+static int Collect(int Number, HostsRecordType Type, const void *Data, void *Arg)
+{
+    Found *f = Arg;
+
+    f->Type = Type;
+    memset(f->Data, 0, sizeof(f->Data));
+
+    if( Type == HOSTS_TYPE_A || Type == HOSTS_TYPE_AAAA )
+    {
+        memcpy(f->Data, ((const IpAddr *)Data)->Addr, 16);
+    } else if( Data != NULL )
+    {
+        strncpy(f->Data, Data, sizeof(f->Data) - 1);
+    }
+
+    return 0;
+}
+
+static int Compare(HostsContainer *a, HostsContainer *b, const char *Name)
+{
+    static const HostsRecordType Types[] = {HOSTS_TYPE_UNKNOWN,
+                                            HOSTS_TYPE_A,
+                                            HOSTS_TYPE_AAAA,
+                                            HOSTS_TYPE_CNAME
+                                            };
+    int loop;
+
+    for( loop = 0; loop != sizeof(Types) / sizeof(Types[0]); ++loop )
+    {
+        Found fa, fb;
+        const void *ra, *rb;
+
+        fa.Type = fb.Type = HOSTS_TYPE_UNKNOWN;
+
+        ra = a->Find(a, Name, Types[loop], Collect, &fa);
+        rb = b->Find(b, Name, Types[loop], Collect, &fb);
+
+        if( (ra == NULL) != (rb == NULL) ||
+            fa.Type != fb.Type ||
+            (ra != NULL && memcmp(fa.Data, fb.Data, sizeof(fa.Data)) != 0)
+            )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static const char *Patterns[] = {"host%d.example.net",
+                                  "host%d.example.com",
+                                  "ex%d.example.com",
+                                  "good%d.example.com",
+                                  "dup%d.example.com",
+                                  "ad%d.example.com",
+                                  "new%d.example.com"
+                                  };
+
+static int CompareAll(HostsContainer *a, HostsContainer *b)
+{
+    char Name[64];
+    int n;
+
+    for( n = 0; n < LINE_COUNT; ++n )
+    {
+        int p;
+
+        for( p = 0; p != sizeof(Patterns) / sizeof(Patterns[0]); ++p )
+        {
+            sprintf(Name, Patterns[p], p == 4 ? n / 10 : n);
+            if( Compare(a, b, Name) != 0 )
+            {
+                printf("%s differs.\n", Name);
+                return -1;
+            }
+        }
+    }
+
+    if( Compare(a, b, "last.example.com") != 0 ||
+        b->Find(b, "last.example.com", HOSTS_TYPE_A, NULL, NULL) == NULL
+        )
+    {
+        printf("The last line differs.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Changes made over a base must look the same as the changed file loaded */
+static int TestPatch(const char *File)
+{
+    HostsContainer Base, Patched, Full;
+    Array Keys;
+    PTimer t;
+    unsigned long Elapsed;
+    int Changes = 0, ret, Failed = 0;
+
+    Generate(File, VARIANT_ORIGINAL);
+
+    HostsContainer_Init(&Base);
+    Array_Init(&Keys, sizeof(uint64_t), 0, FALSE, NULL);
+    HostsLoader_LoadKeyed(&Base, File, 0, &Keys, NULL);
+    Base.Compile(&Base);
+
+    Generate(File, VARIANT_CHANGED);
+
+    HostsContainer_InitDerived(&Patched, &Base);
+    PTimer_Start(&t);
+    ret = HostsLoader_Patch(&Patched, File, &Keys, LINE_COUNT / 16, &Changes);
+    Elapsed = PTimer_End(&t);
+    Patched.Compile(&Patched);
+    printf("patched   : %d changes in %lu ms\n", Changes, Elapsed);
+
+    /* 400 changed, each removed and added, 400 removed and 100 added */
+    if( ret != 0 || Changes != LINE_COUNT / 1000 * 3 + ADDED_COUNT )
+    {
+        printf("Patching failed : %d.\n", ret);
+        Failed = 1;
+    }
+
+    HostsContainer_Init(&Full);
+    HostsLoader_Load(&Full, File, 0, NULL);
+    Full.Compile(&Full);
+
+    if( CompareAll(&Full, &Patched) != 0 )
+    {
+        Failed = 1;
+    }
+
+    Patched.Free(&Patched);
+    Full.Free(&Full);
+
+    /* Too many changes */
+    HostsContainer_InitDerived(&Patched, &Base);
+    if( HostsLoader_Patch(&Patched, File, &Keys, ADDED_COUNT, NULL) <= 0 )
+    {
+        printf("Too many changes patched.\n");
+        Failed = 1;
+    }
+    Patched.Free(&Patched);
+
+    /* Wildcards added could hide names of the base */
+    Generate(File, VARIANT_WILDCARD);
+    HostsContainer_InitDerived(&Patched, &Base);
+    if( HostsLoader_Patch(&Patched, File, &Keys, LINE_COUNT, NULL) <= 0 )
+    {
+        printf("A wildcard patched.\n");
+        Failed = 1;
+    }
+    Patched.Free(&Patched);
+
+    Array_Free(&Keys);
+    Base.Free(&Base);
+
+    return Failed;
+}
+
+int main(void)
+{
+    static const int Threads[] = {1, 3, 8};
+    const char *File = GET_TEMP_DIR() PATH_SLASH_STR "hostsloader_test.txt";
+    HostsContainer ByLines;
+    PTimer t;
+    unsigned long Elapsed;
+    int Count, loop, Failed = 0;
+
+    Generate(File, VARIANT_ORIGINAL);
+
+    HostsContainer_Init(&ByLines);
+    PTimer_Start(&t);
+    Count = LoadByLines(&ByLines, File);
+    Elapsed = PTimer_End(&t);
+    printf("by lines  : %d lines in %lu ms\n", Count, Elapsed);
+
+    for( loop = 0; loop != sizeof(Threads) / sizeof(Threads[0]); ++loop )
+    {
+        HostsContainer Loaded;
+        int Lines;
+
+        HostsContainer_Init(&Loaded);
+        PTimer_Start(&t);
+        if( HostsLoader_Load(&Loaded, File, Threads[loop], &Lines) != 0 )
+        {
+            printf("Loading failed.\n");
+            Failed = 1;
+        }
+        Elapsed = PTimer_End(&t);
+        printf("%d thread(s): %d lines in %lu ms\n", Threads[loop], Lines, Elapsed);
+
+        if( Lines != Count )
+        {
+            printf("Line counts differ.\n");
+            Failed = 1;
+        }
+
+        if( CompareAll(&ByLines, &Loaded) != 0 )
+        {
+            Failed = 1;
+        }
+
+        Loaded.Free(&Loaded);
+    }
+
+    ByLines.Free(&ByLines);
+
+    if( TestPatch(File) != 0 )
+    {
+        Failed = 1;
+    }
+
+    remove(File);
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
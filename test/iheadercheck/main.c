@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include "../../iheader.h"
+
+#define QUERY_LENGTH    512
+
+/* Builds a query of `Name' (dotted, "" for the root) of type A */
+static int MakeQuery(char *Query,
+                     unsigned char Flags,
+                     uint16_t QuestionCount,
+                     const char *Name,
+                     uint16_t Klass
+                     )
+{
+    int Here = 12;
+
+    memset(Query, 0, 12);
+    Query[0] = 0x12;
+    Query[1] = 0x34;
+    Query[2] = Flags;
+    Query[4] = QuestionCount >> 8;
+    Query[5] = QuestionCount & 0xFF;
+
+    while( *Name != '\0' )
+    {
+        const char *Dot = strchr(Name, '.');
+        int Length = Dot == NULL ? (int)strlen(Name) : Dot - Name;
+
+        Query[Here] = Length;
+        memcpy(Query + Here + 1, Name, Length);
+        Here += Length + 1;
+
+        Name += Length + (Dot != NULL);
+    }
+
+    Query[Here++] = 0;
+
+    Query[Here++] = 0;
+    Query[Here++] = 1;
+    Query[Here++] = Klass >> 8;
+    Query[Here++] = Klass & 0xFF;
+
+    return Here;
+}
+
+/* A name of `Labels' labels of `Length' bytes and one of `Last' bytes */
+static char *MakeName(char *Name, int Labels, int Length, int Last)
+{
+    char *Itr = Name;
+    int loop;
+
+    for( loop = 0; loop != Labels; ++loop )
+    {
+        memset(Itr, 'a', Length);
+        Itr[Length] = '.';
+        Itr += Length + 1;
+    }
+
+    memset(Itr, 'b', Last);
+    Itr[Last] = '\0';
+
+    return Name;
+}
+
+static int Check(const char *Case,
+                 const char *Query,
+                 int Length,
+                 IHeaderCheck Expected
+                 )
+{
+    IHeaderCheck Got = IHeader_Check(Query, Length);
+
+    if( Got != Expected )
+    {
+        printf("%s : %d, %d expected.\n", Case, Got, Expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    char Query[QUERY_LENGTH];
+    char Name[QUERY_LENGTH];
+    int Length;
+    int Failed = 0;
+
+    /* The shortest query, of the root */
+    Length = MakeQuery(Query, 0x01, 1, "", DNS_CLASS_IN);
+    Failed |= Check("Root", Query, Length, IHEADER_CHECK_OK);
+    Failed |= Check("Short", Query, Length - 1, IHEADER_CHECK_SHORT);
+    Failed |= Check("Header only", Query, 12, IHEADER_CHECK_SHORT);
+
+    Length = MakeQuery(Query, 0x81, 1, "example.com", DNS_CLASS_IN);
+    Failed |= Check("QR", Query, Length, IHEADER_CHECK_RESPONSE);
+
+    /* Opcode 2, status */
+    Length = MakeQuery(Query, 0x11, 1, "example.com", DNS_CLASS_IN);
+    Failed |= Check("Opcode", Query, Length, IHEADER_CHECK_OPCODE);
+
+    Length = MakeQuery(Query, 0x01, 0, "example.com", DNS_CLASS_IN);
+    Failed |= Check("No question", Query, Length, IHEADER_CHECK_QDCOUNT);
+
+    Length = MakeQuery(Query, 0x01, 2, "example.com", DNS_CLASS_IN);
+    Failed |= Check("Two questions", Query, Length, IHEADER_CHECK_QDCOUNT);
+
+    Length = MakeQuery(Query, 0x01, 1, "example.com", DNS_CLASS_IN);
+    Failed |= Check("Plain", Query, Length, IHEADER_CHECK_OK);
+
+    /* Type and class cut off, then a label running out of the query */
+    Failed |= Check("No class", Query, Length - 2, IHEADER_CHECK_NAME);
+    Query[12] = 60;
+    Failed |= Check("Overrunning label", Query, Length, IHEADER_CHECK_NAME);
+
+    /* 0xC0 for a pointer, 0x40 for an extended label */
+    Length = MakeQuery(Query, 0x01, 1, "www.example.com", DNS_CLASS_IN);
+    Query[16] = (char)0xC0;
+    Query[17] = 12;
+    Failed |= Check("Compression pointer", Query, Length, IHEADER_CHECK_NAME);
+    Query[16] = 0x47;
+    Failed |= Check("Extended label", Query, Length, IHEADER_CHECK_NAME);
+
+    /* 3 * 64 + 62 + 1 = 255 bytes, the longest valid name */
+    Length = MakeQuery(Query, 0x01, 1, MakeName(Name, 3, 63, 61), DNS_CLASS_IN);
+    Failed |= Check("255-byte name", Query, Length, IHEADER_CHECK_OK);
+
+    Length = MakeQuery(Query, 0x01, 1, MakeName(Name, 3, 63, 62), DNS_CLASS_IN);
+    Failed |= Check("256-byte name", Query, Length, IHEADER_CHECK_NAME);
+
+    /* CH */
+    Length = MakeQuery(Query, 0x01, 1, "version.bind", 3);
+    Failed |= Check("Class", Query, Length, IHEADER_CHECK_CLASS);
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
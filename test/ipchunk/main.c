@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../ipchunk.h"
+#include "../../ptimer.h"
+
+#define PREFIX_COUNT    100000
+#define QUERY_COUNT     1000000
+#define CHECK_COUNT     2000
+
+typedef struct _Rule{
+    unsigned char   Addr[16];
+    int             Bits;
+    BOOL            Is6;
+} Rule;
+
+static Rule Rules[PREFIX_COUNT];
+
+/* Longest one first, the first added among identical ones */
+static int Reference(const unsigned char *Ip, BOOL Is6)
+{
+    int Best = -1;
+    int n;
+
+    for( n = 0; n != PREFIX_COUNT; ++n )
+    {
+        const Rule *r = Rules + n;
+        int Bits = r->Bits;
+        int Full = Bits / 8;
+
+        if( r->Is6 != Is6 || (Best >= 0 && Bits <= Rules[Best].Bits) )
+        {
+            continue;
+        }
+
+        if( memcmp(r->Addr, Ip, Full) != 0 )
+        {
+            continue;
+        }
+
+        if( Bits % 8 != 0 && ((r->Addr[Full] ^ Ip[Full]) & (0xff << (8 - Bits % 8)) & 0xff) != 0 )
+        {
+            continue;
+        }
+
+        Best = n;
+    }
+
+    return Best;
+}
+
+static void MakeRules(IpChunk *c)
+{
+    char Str[64];
+    int n;
+
+    for( n = 0; n != PREFIX_COUNT; ++n )
+    {
+        Rule *r = Rules + n;
+        int loop;
+
+        r->Is6 = n % 5 == 0;
+
+        for( loop = 0; loop != 16; ++loop )
+        {
+            r->Addr[loop] = rand();
+        }
+
+        /* A few short prefixes, so that they overlap */
+        if( r->Is6 )
+        {
+            r->Bits = n % 100 == 0 ? 16 + rand() % 16 : 32 + rand() % 97;
+            sprintf(Str, "%x:%x:%x:%x:%x:%x:%x:%x/%d",
+                    (r->Addr[0] << 8) | r->Addr[1], (r->Addr[2] << 8) | r->Addr[3],
+                    (r->Addr[4] << 8) | r->Addr[5], (r->Addr[6] << 8) | r->Addr[7],
+                    (r->Addr[8] << 8) | r->Addr[9], (r->Addr[10] << 8) | r->Addr[11],
+                    (r->Addr[12] << 8) | r->Addr[13], (r->Addr[14] << 8) | r->Addr[15],
+                    r->Bits
+                    );
+        } else {
+            r->Bits = n % 100 == 1 ? 4 + rand() % 8 : 12 + rand() % 21;
+            sprintf(Str, "%d.%d.%d.%d/%d", r->Addr[0], r->Addr[1], r->Addr[2], r->Addr[3], r->Bits);
+        }
+
+        IpChunk_Add(c, Str, n, NULL, 0);
+    }
+}
+
+static unsigned char *MakeQueries(void)
+{
+    unsigned char *Queries = malloc(QUERY_COUNT * 16);
+    int n;
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        unsigned char *q = Queries + n * 16;
+        const Rule *r = Rules + rand() % PREFIX_COUNT;
+        int loop;
+
+        /* Mostly inside a rule, with the rest bits random */
+        for( loop = 0; loop != 16; ++loop )
+        {
+            q[loop] = rand();
+        }
+
+        if( n % 4 != 0 )
+        {
+            memcpy(q, r->Addr, r->Bits / 8);
+        }
+    }
+
+    return Queries;
+}
+
+static int Lookup(IpChunk *c, const unsigned char *Queries, unsigned long *Time)
+{
+    PTimer t;
+    int Matched = 0;
+    int n;
+
+    PTimer_Start(&t);
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        Matched += IpChunk_Find(c, (unsigned char *)Queries + n * 16, n % 5 == 0 ? 16 : 4, NULL, NULL);
+    }
+
+    *Time = PTimer_End(&t);
+
+    return Matched;
+}
+
+int main(void)
+{
+    IpChunk c;
+    PTimer t;
+    unsigned char *Queries;
+    unsigned long Time;
+    int Matched;
+    int Failed = 0;
+    int n;
+
+    srand(0);
+
+    IpChunk_Init(&c);
+    MakeRules(&c);
+    Queries = MakeQueries();
+
+    Matched = Lookup(&c, Queries, &Time);
+    printf("%d prefixes, bst : %lu ms for %d queries (%.1f M/s), %d matched\n",
+           PREFIX_COUNT, Time, QUERY_COUNT, QUERY_COUNT / 1000.0 / (Time + 1), Matched
+           );
+
+    PTimer_Start(&t);
+    IpChunk_Compile(&c);
+    printf("%d prefixes, compiling : %lu ms\n", PREFIX_COUNT, PTimer_End(&t));
+
+    Matched = Lookup(&c, Queries, &Time);
+    printf("%d prefixes, lpm : %lu ms for %d queries (%.1f M/s), %d matched\n",
+           PREFIX_COUNT, Time, QUERY_COUNT, QUERY_COUNT / 1000.0 / (Time + 1), Matched
+           );
+
+    for( n = 0; n != CHECK_COUNT; ++n )
+    {
+        const unsigned char *q = Queries + n * 16;
+        BOOL Is6 = n % 5 == 0;
+        int Expected = Reference(q, Is6);
+        int Type = -1;
+
+        if( !IpChunk_Find(&c, (unsigned char *)q, Is6 ? 16 : 4, &Type, NULL) )
+        {
+            Type = -1;
+        }
+
+        if( Type != Expected )
+        {
+            printf("Query %d : %d expected, %d got\n", n, Expected, Type);
+            Failed = 1;
+        }
+    }
+
+    free(Queries);
+    IpChunk_Free(&c);
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../mpscqueue.h"
+#include "../../ptimer.h"
+
+#ifdef _WIN32
+    #define YIELD() SwitchToThread()
+#else
+    #include <sched.h>
+    #define YIELD() sched_yield()
+#endif
+
+#define QUEUE_LENGTH    64
+#define THREADS         4
+#define THREAD_LOOPS    200000
+
+typedef struct _Item{
+    int Producer;
+    int Number;
+    int Check;
+} Item;
+
+static MpscQueue Shared;
+
+/* Full at its length, and items come back in order */
+static int Bounds(void)
+{
+    MpscQueue q;
+    Item *i;
+    int n, Failed = 0;
+
+    if( MpscQueue_Init(&q, QUEUE_LENGTH - 3, sizeof(Item)) != 0 )
+    {
+        return 1;
+    }
+
+    for( n = 0; n != QUEUE_LENGTH; ++n )
+    {
+        i = MpscQueue_Reserve(&q);
+        if( i == NULL )
+        {
+            printf("Full at %d.\n", n);
+            Failed = 1;
+            break;
+        }
+
+        i->Number = n;
+        MpscQueue_Commit(&q, i);
+    }
+
+    if( MpscQueue_Reserve(&q) != NULL )
+    {
+        printf("Not full at %d.\n", QUEUE_LENGTH);
+        Failed = 1;
+    }
+
+    for( n = 0; (i = MpscQueue_Peek(&q)) != NULL; ++n )
+    {
+        if( i->Number != n )
+        {
+            Failed = 1;
+        }
+
+        MpscQueue_Pop(&q);
+    }
+
+    if( n != QUEUE_LENGTH )
+    {
+        printf("%d taken back.\n", n);
+        Failed = 1;
+    }
+
+    /* Reserved but not committed holds back the ones after it */
+    i = MpscQueue_Reserve(&q);
+    MpscQueue_Commit(&q, MpscQueue_Reserve(&q));
+    if( MpscQueue_Peek(&q) != NULL )
+    {
+        Failed = 1;
+    }
+    MpscQueue_Commit(&q, i);
+    if( MpscQueue_Peek(&q) != i )
+    {
+        Failed = 1;
+    }
+
+    MpscQueue_Free(&q);
+
+    return Failed;
+}
+
+static int
+#ifdef _WIN32
+WINAPI
+#endif
+Producer(void *Arg)
+{
+    int Id = (int)(size_t)Arg;
+    int loop;
+
+    for( loop = 0; loop != THREAD_LOOPS; ++loop )
+    {
+        Item *i;
+
+        while( (i = MpscQueue_Reserve(&Shared)) == NULL )
+        {
+            YIELD();
+        }
+
+        i->Producer = Id;
+        i->Number = loop;
+        i->Check = Id ^ loop;
+        MpscQueue_Commit(&Shared, i);
+    }
+
+    return 0;
+}
+
+/* Nothing is lost, torn or reordered between threads */
+static int Concurrency(void)
+{
+    ThreadHandle t[THREADS];
+    int Next[THREADS];
+    PTimer Timer;
+    int loop, Taken = 0, Failed = 0;
+
+    if( MpscQueue_Init(&Shared, QUEUE_LENGTH, sizeof(Item)) != 0 )
+    {
+        return 1;
+    }
+
+    memset(Next, 0, sizeof(Next));
+
+    PTimer_Start(&Timer);
+
+    for( loop = 0; loop != THREADS; ++loop )
+    {
+        CREATE_THREAD(Producer, (void *)(size_t)loop, t[loop]);
+    }
+
+    while( Taken != THREADS * THREAD_LOOPS )
+    {
+        Item *i = MpscQueue_Peek(&Shared);
+
+        if( i == NULL )
+        {
+            YIELD();
+            continue;
+        }
+
+        if( i->Producer < 0 || i->Producer >= THREADS ||
+            i->Number != Next[i->Producer] ||
+            i->Check != (i->Producer ^ i->Number)
+            )
+        {
+            printf("Bad item %d from %d.\n", i->Number, i->Producer);
+            Failed = 1;
+            break;
+        }
+
+        ++(Next[i->Producer]);
+        ++Taken;
+
+        MpscQueue_Pop(&Shared);
+    }
+
+    for( loop = 0; loop != THREADS; ++loop )
+    {
+#ifdef _WIN32
+        WaitForSingleObject(t[loop], INFINITE);
+        CloseHandle(t[loop]);
+#else
+        pthread_join(t[loop], NULL);
+#endif
+    }
+
+    printf("%d threads : %d passed in %lu ms\n",
+           THREADS,
+           Taken,
+           PTimer_End(&Timer)
+           );
+
+    MpscQueue_Free(&Shared);
+
+    return Failed;
+}
+
+int main(void)
+{
+    int Failed = 0;
+
+    Failed |= Bounds();
+    Failed |= Concurrency();
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "../../ratelimit.h"
+#include "../../metrics.h"
+#include "../../ptimer.h"
+
+#define RATE    10
+#define SLIP    3
+
+/* Not linked in, the limiter only counts into them */
+static int Drops = 0;
+static int Slips = 0;
+
+void Metrics_Increase(MetricsCounter Counter)
+{
+    if( Counter == METRICS_RATE_LIMIT_DROPS )
+    {
+        ++Drops;
+    } else if( Counter == METRICS_RATE_LIMIT_SLIPS ) {
+        ++Slips;
+    }
+}
+
+void Log_Print(const char *Type, const char *format, ...)
+{
+}
+
+static SOCKET Sender;
+
+/* `Client' is where slipped answers go */
+static SOCKET Client;
+static struct sockaddr_in ClientAddress;
+
+/* A query of example.com A */
+static int MakeQuery(char *Query)
+{
+    static const char Packet[] = "\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+                                 "\x07" "example" "\x03" "com" "\x00"
+                                 "\x00\x01\x00\x01";
+
+    memcpy(Query, Packet, sizeof(Packet) - 1);
+
+    return sizeof(Packet) - 1;
+}
+
+static BOOL Out(const struct sockaddr *From, sa_family_t Family)
+{
+    char Query[64];
+    int Length = MakeQuery(Query);
+
+    return RateLimit_Out(Sender, Query, Length, From, Family);
+}
+
+static int Passed(int Times)
+{
+    int n, Count = 0;
+
+    for( n = 0; n != Times; ++n )
+    {
+        Count += !Out((struct sockaddr *)&ClientAddress, AF_INET);
+    }
+
+    return Count;
+}
+
+/* Slipped answers received, all of them must have TC set */
+static int Received(void)
+{
+    char Answer[64];
+    int Count = 0;
+
+    while( recv(Client, Answer, sizeof(Answer), 0) > 0 )
+    {
+        if( (Answer[2] & 0x82) != 0x82 )
+        {
+            printf("A slipped answer without QR and TC.\n");
+            return -1;
+        }
+
+        ++Count;
+    }
+
+    return Count;
+}
+
+/* A prefix gets `RATE' queries at once, every `SLIP'th one over is slipped */
+static int Burst(void)
+{
+    int Count = Passed(RATE + 3 * SLIP);
+
+    if( Count != RATE || Drops != 2 * SLIP || Slips != 3 )
+    {
+        printf("Burst : %d passed, %d dropped, %d slipped.\n", Count, Drops, Slips);
+        return 1;
+    }
+
+    /* Over the loopback, they are there at once */
+    if( Received() != 3 )
+    {
+        printf("Slipped answers lost.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* `RATE' a second come back, but no more than a second of them */
+static int Refill(void)
+{
+    uint64_t Since = PTimer_Monotonic();
+    int Expected, Count;
+
+    /* The bucket was emptied at `Since' or a bit before */
+    SLEEP(300);
+    Expected = (PTimer_Monotonic() - Since) * RATE / 1000;
+
+    Count = Passed(RATE);
+    if( Count < Expected || Count > Expected + 1 )
+    {
+        printf("Refill : %d passed, %d expected.\n", Count, Expected);
+        return 1;
+    }
+
+    SLEEP(2000);
+    Count = Passed(3 * RATE);
+    if( Count != RATE )
+    {
+        printf("Burst cap : %d passed after 2 seconds.\n", Count);
+        return 1;
+    }
+
+    Received();
+
+    return 0;
+}
+
+/* IPv4 clients of a dual-stack socket share the bucket of their /24 */
+static int Mapped(void)
+{
+    struct sockaddr_in6 a6;
+
+    memset(&a6, 0, sizeof(a6));
+    a6.sin6_family = AF_INET6;
+    a6.sin6_port = ClientAddress.sin_port;
+    memset((char *)&(a6.sin6_addr) + 10, 0xFF, 2);
+    memcpy((char *)&(a6.sin6_addr) + 12, &(ClientAddress.sin_addr), 4);
+
+    if( !Out((struct sockaddr *)&a6, AF_INET6) )
+    {
+        printf("A mapped IPv4 client has a bucket of its own.\n");
+        return 1;
+    }
+
+    /* ::1 */
+    memset(&(a6.sin6_addr), 0, sizeof(a6.sin6_addr));
+    ((unsigned char *)&(a6.sin6_addr))[15] = 1;
+
+    if( Out((struct sockaddr *)&a6, AF_INET6) )
+    {
+        printf("An IPv6 client is limited with an IPv4 one.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Prefixes meeting in the table take tokens over, they don't get new ones.
+ * Otherwise all of the queries would pass.
+ */
+static int TakeOver(void)
+{
+    struct sockaddr_in a;
+    PTimer t;
+    unsigned long Elapsed;
+    uint32_t n;
+    int Count = 0;
+
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = ClientAddress.sin_port;
+
+    PTimer_Start(&t);
+
+    /* Twice round 60000 /24s in 127/8, with a table of 4096 buckets */
+    for( n = 0; n != 2 * 60000; ++n )
+    {
+        uint32_t Ip = htonl(0x7F000000 + ((n % 60000 + 1) << 8));
+
+        memcpy(&(a.sin_addr), &Ip, 4);
+        Count += !Out((struct sockaddr *)&a, AF_INET);
+    }
+
+    Elapsed = PTimer_End(&t);
+
+    if( Count > 4096 * RATE + 4096 * RATE * (Elapsed + 100) / 1000 )
+    {
+        printf("Take over : %d of 120000 passed in %lu ms.\n", Count, Elapsed);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    ConfigFileInfo ConfigInfo;
+    VType v;
+    socklen_t Length = sizeof(ClientAddress);
+    int Failed = 0;
+
+#ifdef _WIN32
+    WSADATA wd;
+    WSAStartup(MAKEWORD(2, 2), &wd);
+#endif
+
+    ConfigInitInfo(&ConfigInfo);
+
+    v.INT32 = RATE;
+    ConfigAddOption(&ConfigInfo, "RateLimit", STRATEGY_DEFAULT, TYPE_INT32, v);
+
+    v.INT32 = SLIP;
+    ConfigAddOption(&ConfigInfo, "RateLimitSlip", STRATEGY_DEFAULT, TYPE_INT32, v);
+
+    if( RateLimit_Init(&ConfigInfo) != 0 )
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    memset(&ClientAddress, 0, sizeof(ClientAddress));
+    ClientAddress.sin_family = AF_INET;
+    ClientAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    Sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    Client = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if( Sender == INVALID_SOCKET ||
+        Client == INVALID_SOCKET ||
+        bind(Client, (struct sockaddr *)&ClientAddress, sizeof(ClientAddress)) != 0 ||
+        getsockname(Client, (struct sockaddr *)&ClientAddress, &Length) != 0
+        )
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    SetSocketNonBlock(Client, TRUE);
+
+    Failed |= Burst();
+    Failed |= Refill();
+    Failed |= Mapped();
+    Failed |= TakeOver();
+
+    CLOSE_SOCKET(Sender);
+    CLOSE_SOCKET(Client);
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../region.h"
+#include "../../stringchunk.h"
+#include "../../ptimer.h"
+
+#define DOMAIN_COUNT    200000
+#define ARRAY_COUNT     200000
+
+typedef struct _Generation{
+    StringChunk c;
+    Array       Small[ARRAY_COUNT];
+} Generation;
+
+static void Build(Generation *g)
+{
+    char Domain[64];
+    int loop;
+
+    StringChunk_Init(&(g->c), NULL);
+
+    for( loop = 0; loop != DOMAIN_COUNT; ++loop )
+    {
+        sprintf(Domain, "host%d.example%d.com", loop, loop % 97);
+        StringChunk_Add(&(g->c), Domain, (const char *)&loop, sizeof(loop));
+    }
+
+    StringChunk_Compile(&(g->c));
+
+    for( loop = 0; loop != ARRAY_COUNT; ++loop )
+    {
+        int n;
+
+        Array_Init(g->Small + loop, sizeof(int), 0, FALSE, NULL);
+        for( n = 0; n != 8; ++n )
+        {
+            Array_PushBack(g->Small + loop, &n, NULL);
+        }
+    }
+}
+
+static void Drop(Generation *g)
+{
+    int loop;
+
+    StringChunk_Free(&(g->c), TRUE);
+
+    for( loop = 0; loop != ARRAY_COUNT; ++loop )
+    {
+        Array_Free(g->Small + loop);
+    }
+}
+
+static int Check(Generation *g)
+{
+    char Domain[64];
+    int *Data;
+    int loop;
+
+    for( loop = 0; loop < DOMAIN_COUNT; loop += 7 )
+    {
+        sprintf(Domain, "host%d.example%d.com", loop, loop % 97);
+        if( !StringChunk_Match_NoWildCard(&(g->c), Domain, NULL, (void **)&Data, NULL, NULL) ||
+            *Data != loop
+            )
+        {
+            return -1;
+        }
+    }
+
+    for( loop = 0; loop != ARRAY_COUNT; ++loop )
+    {
+        if( *(int *)Array_GetBySubscript(g->Small + loop, 7) != 7 )
+        {
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static Generation g;
+    Region r, *Previous;
+    PTimer t;
+    char *p, *q;
+    int Failed = 0;
+
+    /* Small allocations grow in place while they are the last */
+    Region_Init(&r, 4096);
+    p = Region_Alloc(&r, 100);
+    memset(p, 'a', 100);
+    q = Region_Realloc(&r, p, 100, 200);
+    if( q != p || q[99] != 'a' )
+    {
+        printf("Growing in place failed.\n");
+        Failed = 1;
+    }
+
+    /* Large ones keep their contents when moved */
+    p = Region_Realloc(&r, q, 200, 100000);
+    memset(p + 200, 'b', 100000 - 200);
+    q = Region_Realloc(&r, p, 100000, 1000000);
+    if( q[99] != 'a' || q[99999] != 'b' )
+    {
+        printf("Growing large blocks failed.\n");
+        Failed = 1;
+    }
+    Region_Free(&r);
+
+    /* On the heap */
+    PTimer_Start(&t);
+    Build(&g);
+    printf("heap   : built in %lu ms\n", PTimer_End(&t));
+    if( Check(&g) != 0 )
+    {
+        printf("Heap generation broken.\n");
+        Failed = 1;
+    }
+
+    PTimer_Start(&t);
+    Drop(&g);
+    printf("heap   : freed in %lu ms\n", PTimer_End(&t));
+
+    /* In a region */
+    Region_Init(&r, 0);
+    PTimer_Start(&t);
+    Previous = Region_Enter(&r);
+    Build(&g);
+    Region_Leave(Previous);
+    printf("region : built in %lu ms, %lu KB\n",
+           PTimer_End(&t),
+           (unsigned long)(r.Allocated / 1024)
+           );
+    if( Check(&g) != 0 )
+    {
+        printf("Region generation broken.\n");
+        Failed = 1;
+    }
+
+    PTimer_Start(&t);
+    Drop(&g);
+    Region_Free(&r);
+    printf("region : freed in %lu ms\n", PTimer_End(&t));
+
+    if( Region_Current() != NULL )
+    {
+        printf("Region not left.\n");
+        Failed = 1;
+    }
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../simpleht.h"
+#include "../../ptimer.h"
+#include "../../utils.h"
+
+#define KEY_COUNT   1000000
+#define QUERY_COUNT 4000000
+
+/* The chained design used before, for comparison: slots of node chains,
+ * rehashed all at once when there are 5 nodes a slot.
+ */
+typedef struct _Chained{
+    Array   Slots; /* int32_t */
+    Array   Nodes; /* Sht_NodeHead + the key */
+    int     LeftSpace;
+} Chained;
+
+static void Chained_Init(Chained *c)
+{
+    int32_t Empty = -1;
+    int loop;
+
+    Array_Init(&(c->Slots), sizeof(int32_t), 7, FALSE, NULL);
+    for( loop = 0; loop != 7; ++loop )
+    {
+        Array_PushBack(&(c->Slots), &Empty, NULL);
+    }
+
+    Array_Init(&(c->Nodes), sizeof(Sht_NodeHead) + sizeof(const char *), 0, FALSE, NULL);
+    c->LeftSpace = 7 * 5;
+}
+
+static void Chained_Link(Chained *c, Sht_NodeHead *Node, int32_t Subscript)
+{
+    int32_t *Slot = Array_GetBySubscript(&(c->Slots),
+                                         Node->HashValue % Array_GetUsed(&(c->Slots))
+                                         );
+
+    Node->Next = *Slot;
+    *Slot = Subscript;
+}
+
+static void Chained_Add(Chained *c, const char *Key)
+{
+    Sht_NodeHead *New;
+    int32_t Subscript;
+
+    if( c->LeftSpace == 0 )
+    {
+        int32_t Empty = -1;
+        int Old = Array_GetUsed(&(c->Slots));
+        int loop;
+
+        for( loop = 0; loop != Old; ++loop )
+        {
+            Array_PushBack(&(c->Slots), &Empty, NULL);
+        }
+
+        memset(Array_GetRawArray(&(c->Slots)), -1, sizeof(int32_t) * Old);
+
+        for( loop = 0; loop != Array_GetUsed(&(c->Nodes)); ++loop )
+        {
+            Chained_Link(c, Array_GetBySubscript(&(c->Nodes), loop), loop);
+        }
+
+        c->LeftSpace = Old * 5;
+    }
+
+    Subscript = Array_PushBack(&(c->Nodes), NULL, NULL);
+    New = Array_GetBySubscript(&(c->Nodes), Subscript);
+    New->HashValue = HASH(Key, 0);
+    *(const char **)(New + 1) = Key;
+    Chained_Link(c, New, Subscript);
+
+    --(c->LeftSpace);
+}
+
+static BOOL Chained_Has(Chained *c, const char *Key)
+{
+    uint32_t Hash = HASH(Key, 0);
+    int32_t *Slot = Array_GetBySubscript(&(c->Slots), Hash % Array_GetUsed(&(c->Slots)));
+    const Sht_NodeHead *Node = Array_GetBySubscript(&(c->Nodes), *Slot);
+
+    while( Node != NULL )
+    {
+        if( strcmp(*(const char **)(Node + 1), Key) == 0 )
+        {
+            return TRUE;
+        }
+
+        Node = Array_GetBySubscript(&(c->Nodes), Node->Next);
+    }
+
+    return FALSE;
+}
+
+static BOOL SimpleHT_Has(SimpleHT *ht, const char *Key)
+{
+    const char *Found = NULL;
+
+    while( (Found = SimpleHT_Find(ht, Key, 0, NULL, Found)) != NULL )
+    {
+        if( strcmp(*(const char **)Found, Key) == 0 )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+int main(void)
+{
+    static char Names[KEY_COUNT * 2][32];
+    SimpleHT ht;
+    Chained c;
+    PTimer t;
+    const char *Chain = NULL;
+    int Found;
+    int Failed = 0;
+    int loop;
+
+    /* The second half is never added */
+    for( loop = 0; loop != KEY_COUNT * 2; ++loop )
+    {
+        sprintf(Names[loop], "host%d.example%d.com", loop, loop % 97);
+    }
+
+    /* Added in a random order */
+    srand(0);
+    for( loop = KEY_COUNT - 1; loop > 0; --loop )
+    {
+        int Other = ((unsigned)rand() * 32768U + rand()) % (loop + 1);
+        char Temp[32];
+
+        strcpy(Temp, Names[loop]);
+        strcpy(Names[loop], Names[Other]);
+        strcpy(Names[Other], Temp);
+    }
+
+    /* Same hash values, different keys, the last added found first */
+    SimpleHT_Init(&ht, sizeof(const char *), HASH);
+    for( loop = 0; loop != 3; ++loop )
+    {
+        const char *Key = Names[loop];
+        uint32_t Hash = 42;
+        SimpleHT_Add(&ht, Key, 0, (const char *)&Key, &Hash);
+    }
+    for( loop = 2; loop >= 0; --loop )
+    {
+        uint32_t Hash = 42;
+        Chain = SimpleHT_Find(&ht, NULL, 0, &Hash, Chain);
+        if( Chain == NULL || *(const char **)Chain != Names[loop] )
+        {
+            printf("Chain of the same hash value broken.\n");
+            Failed = 1;
+            break;
+        }
+    }
+    SimpleHT_Free(&ht);
+
+    PTimer_Start(&t);
+    Chained_Init(&c);
+    for( loop = 0; loop != KEY_COUNT; ++loop )
+    {
+        Chained_Add(&c, Names[loop]);
+    }
+    printf("chained    : %d adds, %lu ms\n", KEY_COUNT, PTimer_End(&t));
+
+    PTimer_Start(&t);
+    SimpleHT_Init(&ht, sizeof(const char *), HASH);
+    for( loop = 0; loop != KEY_COUNT; ++loop )
+    {
+        const char *Key = Names[loop];
+        SimpleHT_Add(&ht, Key, 0, (const char *)&Key, NULL);
+    }
+    printf("open       : %d adds, %lu ms\n", KEY_COUNT, PTimer_End(&t));
+
+    PTimer_Start(&t);
+    for( loop = 0, Found = 0; loop != QUERY_COUNT; ++loop )
+    {
+        Found += Chained_Has(&c, Names[(loop * 7919U) % (KEY_COUNT * 2)]);
+    }
+    printf("chained    : %d finds, half missing, %lu ms, %d found\n", QUERY_COUNT, PTimer_End(&t), Found);
+
+    PTimer_Start(&t);
+    for( loop = 0, Found = 0; loop != QUERY_COUNT; ++loop )
+    {
+        Found += SimpleHT_Has(&ht, Names[(loop * 7919U) % (KEY_COUNT * 2)]);
+    }
+    printf("open       : %d finds, half missing, %lu ms, %d found\n", QUERY_COUNT, PTimer_End(&t), Found);
+
+    for( loop = 0; loop != KEY_COUNT * 2; ++loop )
+    {
+        if( SimpleHT_Has(&ht, Names[loop]) != (loop < KEY_COUNT) )
+        {
+            printf("%s : wrong result\n", Names[loop]);
+            Failed = 1;
+            break;
+        }
+    }
+
+    SimpleHT_Free(&ht);
+    Array_Free(&(c.Slots));
+    Array_Free(&(c.Nodes));
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
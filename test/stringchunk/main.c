@@ -1,9 +1,104 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "../../stringlist.h"
 #include "../testutils.h"
 #include "../../stringchunk.h"
+#include "../../ptimer.h"
+
+#define QUERY_COUNT     1000000
+#define QUERY_LENGTH    64
+
+/* Half of the queries are subdomains of rules, the others match nothing */
+static char *MakeQueries(StringChunk *c, int RuleCount)
+{
+    char *Queries = malloc(QUERY_COUNT * QUERY_LENGTH);
+    int n;
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        char *q = Queries + n * QUERY_LENGTH;
+
+        if( n % 2 == 0 )
+        {
+            int32_t Start = rand() % RuleCount;
+
+            strcpy(q, "www.");
+            strcat(q, StringChunk_Enum_NoWildCard(c, &Start, NULL));
+        } else {
+            RandomDomain(q, 4);
+        }
+    }
+
+    return Queries;
+}
+
+/* Suffix hashes computed on the fly, or once per name as unpacking does */
+static int Lookup(StringChunk *c,
+                  const char *Queries,
+                  BOOL WithHashes,
+                  unsigned long *Time
+                  )
+{
+    PTimer t;
+    DomainHash h;
+    int Matched = 0;
+    int n;
+
+    PTimer_Start(&t);
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        const char *q = Queries + n * QUERY_LENGTH;
+
+        if( WithHashes )
+        {
+            DomainHash_FromString(&h, q);
+        }
+
+        if( StringChunk_Domain_Match(c, q, WithHashes ? &h : NULL, NULL, NULL, NULL) )
+        {
+            ++Matched;
+        }
+    }
+
+    *Time = PTimer_End(&t);
+
+    return Matched;
+}
+
+static int Bench(int RuleCount)
+{
+    StringChunk c;
+    char Domain[64];
+    char *Queries;
+    unsigned long Time;
+    int OnTheFly, Hashed;
+    int n;
+
+    StringChunk_Init(&c, NULL);
+
+    for( n = 0; n != RuleCount; ++n )
+    {
+        StringChunk_Add_Domain(&c, RandomDomain(Domain, 2 + n % 2), NULL, 0);
+    }
+
+    Queries = MakeQueries(&c, RuleCount);
+
+    OnTheFly = Lookup(&c, Queries, FALSE, &Time);
+    printf("%d rules, hashing on the fly : %lu ms for %d queries, %d matched\n",
+           RuleCount, Time, QUERY_COUNT, OnTheFly);
+
+    Hashed = Lookup(&c, Queries, TRUE, &Time);
+    printf("%d rules, with DomainHash : %lu ms for %d queries, %d matched\n",
+           RuleCount, Time, QUERY_COUNT, Hashed);
+
+    free(Queries);
+    StringChunk_Free(&c, TRUE);
+
+    return OnTheFly == Hashed ? 0 : 1;
+}
 
 int main(void)
 {
@@ -55,5 +150,9 @@ int main(void)
 
     StringChunk_Free(&c, TRUE);
 
-    return 0;
+    n = Bench(100000) | Bench(1000000);
+
+    printf(n ? "FAILED\n" : "PASSED\n");
+
+    return n;
 }
@@ -1,5 +1,6 @@
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 
 char *RandomString(char *out, int len)
 {
@@ -24,3 +25,27 @@ char *RandomAlpha(char *out, int len)
     out[len - 1] = '\0';
     return out;
 }
+
+/* Lowercased labels of 3 to 10 characters, ending with a common TLD */
+char *RandomDomain(char *out, int Labels)
+{
+    static const char *Tlds[] = {"com", "net", "org", "cn", "io", "de", "uk", "jp"};
+
+    char *Itr = out;
+    int i;
+
+    for( i = 0; i < Labels - 1; ++i )
+    {
+        int Length = rand() % 8 + 3;
+
+        while( Length-- > 0 )
+        {
+            *Itr++ = rand() % ('z' - 'a' + 1) + 'a';
+        }
+        *Itr++ = '.';
+    }
+
+    strcpy(Itr, Tlds[rand() % (sizeof(Tlds) / sizeof(Tlds[0]))]);
+
+    return out;
+}
@@ -5,4 +5,7 @@ char *RandomString(char *out, int len);
 
 char *RandomAlpha(char *out, int len);
 
+/* `out' should hold at least `Labels' * 11 bytes */
+char *RandomDomain(char *out, int Labels);
+
 #endif /* TESTUTILS_H_INCLUDED */
@@ -1,6 +1,29 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include "../../timedtask.h"
+#include "../../timingwheel.h"
+#include "../../linkedqueue.h"
+#include "../../ptimer.h"
+
+#define BURST   40
+
+#define BENCH_TIMERS    1000000
+#define BENCH_SPAN      600000 /* Milliseconds */
+#define BENCH_QUEUED    20000 /* Timers in a sorted queue, for comparison */
+
+static volatile int Done = 0;
+static EFFECTIVE_LOCK DoneLock;
+
+/* Messages of the tasks are not checked here */
+void Log_Print(const char *Type, const char *format, ...)
+{
+}
+
+BOOL Log_DebugOn(void)
+{
+    return FALSE;
+}
 
 void p(const char *t, void *u)
 {
@@ -14,21 +37,156 @@ void j2(void *a, void *b)
     printf("%ld : %s\n", time(NULL), "Job 2 end .");
 }
 
+void Burst(void *a, void *b)
+{
+    SLEEP(100);
+
+    EFFECTIVE_LOCK_GET(DoneLock);
+    ++Done;
+    EFFECTIVE_LOCK_RELEASE(DoneLock);
+}
+
+static int ShowMetrics(const TimedTaskMetrics *m, void *Unused)
+{
+    printf("%-8s: %u runs, %u put off, run %u ms at most, due %u ms at most\n",
+           m->Name,
+           m->Runs,
+           m->Deferred,
+           m->MaxRunTime,
+           m->MaxDelay
+           );
+
+    return 0;
+}
+
+static unsigned int Random(void)
+{
+    return ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+}
+
+static int CompareExpires(const void *One, const void *Two)
+{
+    uint64_t o = *(const uint64_t *)One, t = *(const uint64_t *)Two;
+
+    return o < t ? -1 : o > t;
+}
+
+/* Set a million timers, cancel a quarter, and wake up only when `Next' says
+ * so: every one left must expire on its very tick, in order.
+ */
+static int BenchWheel(void)
+{
+    TimingWheel w;
+    TimingWheelNode *Nodes, *n;
+    LinkedQueue q;
+    uint64_t Start = 1000, Now, Last = 0;
+    int loop, Expired = 0, Wakes = 0, Failed = 0;
+    PTimer t;
+
+    Nodes = calloc(BENCH_TIMERS, sizeof(TimingWheelNode));
+    if( Nodes == NULL )
+    {
+        return 1;
+    }
+
+    srand(1);
+    TimingWheel_Init(&w, Start);
+
+    PTimer_Start(&t);
+    for( loop = 0; loop != BENCH_TIMERS; ++loop )
+    {
+        w.Add(&w, Nodes + loop, Start + Random() % BENCH_SPAN);
+    }
+    printf("wheel : %d timers set in %lu ms\n", BENCH_TIMERS, PTimer_End(&t));
+
+    PTimer_Start(&t);
+    for( loop = 0; loop < BENCH_TIMERS; loop += 4 )
+    {
+        w.Cancel(&w, Nodes + loop);
+    }
+    printf("wheel : %d cancelled in %lu ms\n", BENCH_TIMERS / 4, PTimer_End(&t));
+
+    PTimer_Start(&t);
+    while( (Now = w.Next(&w)) != TIMINGWHEEL_NEVER )
+    {
+        ++Wakes;
+
+        while( (n = w.Expire(&w, Now)) != NULL )
+        {
+            if( n->Expires != Now || n->Expires < Last )
+            {
+                Failed = 1;
+            }
+
+            Last = n->Expires;
+            ++Expired;
+        }
+    }
+    printf("wheel : %d expired in %lu ms, %d wakes\n",
+           Expired,
+           PTimer_End(&t),
+           Wakes
+           );
+
+    if( Expired != BENCH_TIMERS - BENCH_TIMERS / 4 || w.Size(&w) != 0 )
+    {
+        Failed = 1;
+    }
+
+    free(Nodes);
+
+    /* What the scheduler used to keep them in */
+    LinkedQueue_Init(&q, sizeof(uint64_t), CompareExpires);
+
+    PTimer_Start(&t);
+    for( loop = 0; loop != BENCH_QUEUED; ++loop )
+    {
+        uint64_t e = Start + Random() % BENCH_SPAN;
+
+        q.Add(&q, &e);
+    }
+    printf("queue : %d timers set in %lu ms\n", BENCH_QUEUED, PTimer_End(&t));
+
+    q.Free(&q);
+
+    return Failed;
+}
+
 int main(void)
 {
+    int loop;
+    int Failed;
+
+    Failed = BenchWheel();
+
+    EFFECTIVE_LOCK_INIT(DoneLock);
     TimedTask_Init();
 
     printf("-->Job 1, Executing every 2 seconds.\n");
-    TimedTask_Add(TRUE, FALSE, 2000, (TaskFunc)p, "Job 1 .", NULL, FALSE);
+    TimedTask_Add("job 1", TRUE, FALSE, 2000, (TaskFunc)p, "Job 1 .", NULL, FALSE);
 
     printf("-->Job 2, Executing every 3 seconds.\n");
-    TimedTask_Add(TRUE, TRUE, 3000, (TaskFunc)j2, NULL, NULL, FALSE);
+    TimedTask_Add("job 2", TRUE, TRUE, 3000, (TaskFunc)j2, NULL, NULL, FALSE);
 
     SLEEP(10000);
 
     printf("-->Job 3, Executing after 5 seconds.\n");
-    TimedTask_Add(TRUE, FALSE, 5000, (TaskFunc)p, "Job 3 .", NULL, TRUE);
+    TimedTask_Add("job 3", TRUE, FALSE, 5000, (TaskFunc)p, "Job 3 .", NULL, TRUE);
+
+    /* More than the workers can take at once, all run sooner or later */
+    printf("-->%d asynchronous jobs at once.\n", BURST);
+    for( loop = 0; loop != BURST; ++loop )
+    {
+        TimedTask_Add("burst", FALSE, TRUE, 0, (TaskFunc)Burst, NULL, NULL, TRUE);
+    }
 
     SLEEP(9999);
-    return 0;
+
+    TimedTask_EnumMetrics(ShowMetrics, NULL);
+
+    Failed |= (Done != BURST);
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
 }
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../topk.h"
+#include "../../ptimer.h"
+#include "../../utils.h"
+
+#define KEY_COUNT       100000
+#define STREAM_LENGTH   4000000
+#define CAPACITY        1000
+#define SHARDS          4
+
+/* Skewed like queries: a few names take most of them, the rest is noise */
+static int NextKey(void)
+{
+    int r = rand() % 100;
+
+    if( r < 50 )
+    {
+        return rand() % 100;
+    } else if( r < 80 )
+    {
+        return 100 + rand() % 1000;
+    } else {
+        return rand() % KEY_COUNT;
+    }
+}
+
+static int Check(TopK *t, const int *Truth, int Total)
+{
+    char Key[16];
+    const char *Str;
+    int Start = 0;
+    uint32_t Count, Error;
+    int *Held = malloc(sizeof(int) * KEY_COUNT);
+    int n, MaxError = 0, Failed = 0;
+    int *Data;
+
+    memset(Held, 0, sizeof(int) * KEY_COUNT);
+
+    Str = TopK_Enum(t, &Start, NULL, &Count, &Error, (void **)&Data);
+    while( Str != NULL )
+    {
+        n = atoi(Str + 1);
+        Held[n] = 1;
+
+        /* Never under, at most `Error' over, data only since taken in */
+        if( Count < (uint32_t)Truth[n] ||
+            Count - Error > (uint32_t)Truth[n] ||
+            *Data > Truth[n]
+            )
+        {
+            printf("%s : %u (error %u), %d really.\n", Str, Count, Error, Truth[n]);
+            Failed = 1;
+        }
+
+        if( (int)Error > MaxError )
+        {
+            MaxError = Error;
+        }
+
+        Str = TopK_Enum(t, &Start, NULL, &Count, &Error, (void **)&Data);
+    }
+
+    for( n = 0; n != KEY_COUNT; ++n )
+    {
+        if( Truth[n] > Total / CAPACITY && !Held[n] )
+        {
+            sprintf(Key, "k%d", n);
+            printf("%s missed, %d times.\n", Key, Truth[n]);
+            Failed = 1;
+        }
+    }
+
+    printf("%d keys held, max error %d of bound %d\n",
+           TopK_Size(t),
+           MaxError,
+           Total / CAPACITY
+           );
+
+    free(Held);
+
+    return Failed;
+}
+
+int main(void)
+{
+    TopK Single, Shards[SHARDS], Merged;
+    int *Truth = malloc(sizeof(int) * KEY_COUNT);
+    int *Stream = malloc(sizeof(int) * STREAM_LENGTH);
+    char Key[16];
+    PTimer Timer;
+    int n, Failed = 0;
+
+    srand(0);
+
+    memset(Truth, 0, sizeof(int) * KEY_COUNT);
+    for( n = 0; n != STREAM_LENGTH; ++n )
+    {
+        Stream[n] = NextKey();
+        ++(Truth[Stream[n]]);
+    }
+
+    TopK_Init(&Single, CAPACITY, 16, sizeof(int));
+
+    PTimer_Start(&Timer);
+    for( n = 0; n != STREAM_LENGTH; ++n )
+    {
+        int *Data;
+
+        sprintf(Key, "k%d", Stream[n]);
+        Data = TopK_Add(&Single, Key, HASH(Key, 0), 1, 0);
+        ++(*Data);
+    }
+    printf("single : %d counted in %lu ms\n", STREAM_LENGTH, PTimer_End(&Timer));
+
+    Failed |= Check(&Single, Truth, STREAM_LENGTH);
+
+    /* Counted apart, then merged, like threads of `DomainStatistic' */
+    for( n = 0; n != SHARDS; ++n )
+    {
+        TopK_Init(Shards + n, CAPACITY, 16, sizeof(int));
+    }
+    TopK_Init(&Merged, CAPACITY, 16, sizeof(int));
+
+    for( n = 0; n != STREAM_LENGTH; ++n )
+    {
+        int *Data;
+
+        sprintf(Key, "k%d", Stream[n]);
+        Data = TopK_Add(Shards + n % SHARDS, Key, HASH(Key, 0), 1, 0);
+        ++(*Data);
+    }
+
+    PTimer_Start(&Timer);
+    for( n = 0; n != SHARDS; ++n )
+    {
+        const char *Str;
+        int Start = 0;
+        uint32_t Hash, Count, Error;
+        int *From, *To;
+
+        Str = TopK_Enum(Shards + n, &Start, &Hash, &Count, &Error, (void **)&From);
+        while( Str != NULL )
+        {
+            To = TopK_Add(&Merged, Str, Hash, Count, Error);
+            *To += *From;
+
+            Str = TopK_Enum(Shards + n, &Start, &Hash, &Count, &Error, (void **)&From);
+        }
+
+        TopK_Clear(Shards + n);
+    }
+    printf("merged : %d summaries in %lu ms\n", SHARDS, PTimer_End(&Timer));
+
+    Failed |= Check(&Merged, Truth, STREAM_LENGTH);
+
+    /* Cleared ones are empty and still usable */
+    if( TopK_Size(Shards) != 0 ||
+        TopK_Add(Shards, "k1", HASH("k1", 0), 0, 0) != NULL ||
+        TopK_Add(Shards, "k1", HASH("k1", 0), 1, 0) == NULL ||
+        TopK_Size(Shards) != 1
+        )
+    {
+        printf("Clearing failed.\n");
+        Failed = 1;
+    }
+
+    for( n = 0; n != SHARDS; ++n )
+    {
+        TopK_Free(Shards + n);
+    }
+    TopK_Free(&Merged);
+    TopK_Free(&Single);
+    free(Stream);
+    free(Truth);
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
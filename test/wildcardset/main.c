@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../stringchunk.h"
+#include "../../ptimer.h"
+#include "../testutils.h"
+
+#define PATTERN_COUNT   5000
+#define QUERY_COUNT     100000
+#define QUERY_LENGTH    64
+
+static char Domains[PATTERN_COUNT][32];
+
+static void MakePattern(char *Pattern, int n)
+{
+    const char *Domain = Domains[n];
+
+    switch( n % 5 )
+    {
+    case 0:
+        sprintf(Pattern, "*.%s", Domain);
+        break;
+
+    case 1:
+        sprintf(Pattern, "%s.*", Domain);
+        break;
+
+    case 2:
+        sprintf(Pattern, "ad?.%s", Domain);
+        break;
+
+    case 3:
+        sprintf(Pattern, "*%.4s*", Domain);
+        break;
+
+    default:
+        sprintf(Pattern, "[a-c]%s", Domain);
+        break;
+    }
+}
+
+static int Lookup(StringChunk *c, const char *Queries, int *Results, unsigned long *Time)
+{
+    PTimer t;
+    int Matched = 0;
+    int n;
+
+    PTimer_Start(&t);
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        int *Data = NULL;
+
+        if( StringChunk_Match_OnlyWildCard(c, Queries + n * QUERY_LENGTH, (void **)&Data, NULL, NULL) )
+        {
+            ++Matched;
+        }
+
+        Results[n] = Data == NULL ? -1 : *Data;
+    }
+
+    *Time = PTimer_End(&t);
+
+    return Matched;
+}
+
+/* Anchors of patterns with backslashes must agree with `WILDCARD_MATCH' */
+static int Escapes(void)
+{
+    static const char *Patterns[] = {
+        "ads\\.*",
+        "*\\?x.com",
+        "a\\*b.com",
+        "*.example\\",
+        "*x\\yz*"
+    };
+    static const char *Strings[] = {
+        "ads\\.example.com",
+        "ads.example.com",
+        "y\\?x.com",
+        "y\\ax.com",
+        "yx.com",
+        "a\\zzb.com",
+        "a*b.com",
+        "www.example\\",
+        "www.example",
+        "wx\\yz.com",
+        "wxyz.com"
+    };
+    StringChunk c;
+    int Linear[sizeof(Strings) / sizeof(Strings[0])];
+    int Failed = 0;
+    int n;
+
+    StringChunk_Init(&c, NULL);
+
+    for( n = 0; n != sizeof(Patterns) / sizeof(Patterns[0]); ++n )
+    {
+        StringChunk_Add(&c, Patterns[n], &n, sizeof(n));
+    }
+
+    for( n = 0; n != sizeof(Strings) / sizeof(Strings[0]); ++n )
+    {
+        int *Data = NULL;
+
+        StringChunk_Match_OnlyWildCard(&c, Strings[n], (void **)&Data, NULL, NULL);
+        Linear[n] = Data == NULL ? -1 : *Data;
+    }
+
+    StringChunk_Compile_WildCard(&c);
+
+    for( n = 0; n != sizeof(Strings) / sizeof(Strings[0]); ++n )
+    {
+        int *Data = NULL;
+
+        StringChunk_Match_OnlyWildCard(&c, Strings[n], (void **)&Data, NULL, NULL);
+        if( (Data == NULL ? -1 : *Data) != Linear[n] )
+        {
+            printf("MISMATCHED : %s, %d, %d\n", Strings[n], Linear[n], Data == NULL ? -1 : *Data);
+            Failed = 1;
+        }
+    }
+
+    StringChunk_Free(&c, TRUE);
+
+    return Failed;
+}
+
+int main(void)
+{
+    StringChunk c;
+    char Pattern[128];
+    char *Queries;
+    int *Linear, *Compiled;
+    unsigned long Time;
+    int Failed = 0;
+    int n;
+
+    srand(0);
+
+    StringChunk_Init(&c, NULL);
+
+    for( n = 0; n != PATTERN_COUNT; ++n )
+    {
+        RandomDomain(Domains[n], 2);
+        MakePattern(Pattern, n);
+        StringChunk_Add(&c, Pattern, &n, sizeof(n));
+    }
+    StringChunk_Add(&c, "*", &n, sizeof(n));
+
+    Queries = malloc(QUERY_COUNT * QUERY_LENGTH);
+    Linear = malloc(QUERY_COUNT * sizeof(int));
+    Compiled = malloc(QUERY_COUNT * sizeof(int));
+
+    /* Some match patterns of every kind, the others only match "*" */
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        char *q = Queries + n * QUERY_LENGTH;
+
+        switch( n % 4 )
+        {
+        case 0:
+            sprintf(q, "www.%s", Domains[rand() % PATTERN_COUNT]);
+            break;
+
+        case 1:
+            sprintf(q, "ads.%s", Domains[rand() % PATTERN_COUNT]);
+            break;
+
+        default:
+            RandomDomain(q, 3);
+            break;
+        }
+    }
+
+    n = Lookup(&c, Queries, Linear, &Time);
+    printf("%d patterns, linear : %lu ms for %d queries, %d matched\n", PATTERN_COUNT + 1, Time, QUERY_COUNT, n);
+
+    StringChunk_Compile_WildCard(&c);
+
+    n = Lookup(&c, Queries, Compiled, &Time);
+    printf("%d patterns, compiled : %lu ms for %d queries, %d matched\n", PATTERN_COUNT + 1, Time, QUERY_COUNT, n);
+
+    for( n = 0; n != QUERY_COUNT; ++n )
+    {
+        if( Linear[n] != Compiled[n] )
+        {
+            printf("MISMATCHED : %s, %d, %d\n", Queries + n * QUERY_LENGTH, Linear[n], Compiled[n]);
+            Failed = 1;
+        }
+    }
+
+    free(Queries);
+    free(Linear);
+    free(Compiled);
+    StringChunk_Free(&c, TRUE);
+
+    Failed |= Escapes();
+
+    printf(Failed ? "FAILED\n" : "PASSED\n");
+
+    return Failed;
+}
@@ -1,122 +1,150 @@
+#include <string.h>
 #include "timedtask.h"
-#include "linkedqueue.h"
+#include "timingwheel.h"
 #include "pipes.h"
+#include "ptimer.h"
+#include "utils.h"
 #include "logs.h"
 
 #ifdef _WIN32
 #include "winmsgque.h"
 #endif /* _WIN32 */
 
+/* Asynchronous tasks are run by a fixed number of workers, fed by a queue
+ * of a bounded length. Tasks due while it is full are put off a while.
+ */
+#define TIMEDTASK_WORKERS       3
+#define TIMEDTASK_QUEUE_SIZE    16
+#define TIMEDTASK_DEFERRING     1000 /* Milliseconds */
+
+/* Tasks of more names than these are not measured */
+#define TIMEDTASK_METRICS_MAX   32
+
 typedef struct _TaskInfo{
+    /* Set in `Wheel' by the scheduling thread, on the monotonic clock */
+    TimingWheelNode Node;
+
+    const char  *Name;
     TaskFunc    Task;
 
     void    *Arg1;
     void    *Arg2;
 
-#ifdef _WIN32
-    DWORD   TimeOut;
-    DWORD   LeftTime;
-#else /* _WIN32 */
-    struct timeval  TimeOut;
-    struct timeval  LeftTime;
-#endif /* _WIN32 */
+    int     TimeOut; /* Milliseconds */
+    int     LeftTime; /* Milliseconds, before being set */
 
     BOOL    Persistent;
     BOOL    Asynchronous;
+
+    /* When it has been due */
+    uint64_t    Due;
 } TaskInfo;
 
-static LinkedQueue  TimeQueue;
+static TimingWheel  Wheel;
 
 #ifdef _WIN32
 static WinMsgQue    MsgQue;
+static WinMsgQue    Pool; /* Of `TaskInfo *'s */
 #else /* _WIN32 */
 static PIPE_HANDLE  WriteTo, ReadFrom;
+static PIPE_HANDLE  PoolWriteTo, PoolReadFrom; /* Of `TaskInfo *'s */
 #endif /* _WIN32 */
 
-#ifndef _WIN32
-static int Tv_Comapre(const struct timeval *one, const struct timeval *two)
+/* Guards both of them */
+static EFFECTIVE_LOCK   MetricsLock;
+
+static int  Queued = 0;
+
+static TimedTaskMetrics Metrics[TIMEDTASK_METRICS_MAX];
+static int              MetricsCount = 0;
+
+/* Only called by the thread of `TimeTask_Work' */
+static void TimeTask_Set(TaskInfo *i, uint64_t Expires)
 {
-    if( one->tv_sec == two->tv_sec )
-    {
-        return one->tv_usec - two->tv_usec;
-    } else {
-        return one->tv_sec - two->tv_sec;
-    }
+    i->Due = Expires;
+    Wheel.Add(&Wheel, &(i->Node), Expires);
 }
 
-static int Tv_Subtract(struct timeval *Minuend,
-                       const struct timeval *Subtrahend
-                       )
+/* Take a copy of a task passed to the thread of `TimeTask_Work' */
+static int TimeTask_ReallyAdd(const TaskInfo *New)
 {
-    if( Tv_Comapre(Minuend, Subtrahend) <= 0 )
+    TaskInfo *i = SafeMalloc(sizeof(TaskInfo));
+
+    if( i == NULL )
     {
-        Minuend->tv_sec = 0;
-        Minuend->tv_usec = 0;
-        return 0;
-    } else {
-        if( Minuend->tv_usec >= Subtrahend->tv_usec )
-        {
-            Minuend->tv_usec -= Subtrahend->tv_usec;
-            Minuend->tv_sec -= Subtrahend->tv_sec;
-        } else {
-            Minuend->tv_sec -= (1 + Subtrahend->tv_sec);
-            Minuend->tv_usec = 1000000 - Subtrahend->tv_usec + Minuend->tv_usec;
-        }
-        return 1;
+        return -16;
     }
+
+    memcpy(i, New, sizeof(TaskInfo));
+    memset(&(i->Node), 0, sizeof(i->Node));
+
+    TimeTask_Set(i, PTimer_Monotonic() + New->LeftTime);
+
+    return 0;
 }
-#endif /* _WIN32 */
 
-#ifdef _WIN32
-static void TimeTask_ReduceTime(const DWORD tv)
+static void TimeTask_Account(const char *Name,
+                             unsigned long Delay,
+                             unsigned long RunTime,
+                             BOOL Deferred
+                             )
 {
-    LinkedQueueIterator i;
-    TaskInfo *ti;
+    TimedTaskMetrics *m = NULL;
+    int loop;
 
-    if( LinkedQueueIterator_Init(&i, &TimeQueue) != 0 )
-    {
-        /** TODO: Show fatal error */
-        return;
-    }
+    EFFECTIVE_LOCK_GET(MetricsLock);
 
-    while( (ti = i.Next(&i)) != NULL )
+    for( loop = 0; loop != MetricsCount; ++loop )
     {
-        if( tv > ti->LeftTime )
+        if( strcmp(Metrics[loop].Name, Name) == 0 )
         {
-            ti->LeftTime = 0;
-        } else {
-            ti->LeftTime -= tv;
+            m = Metrics + loop;
+            break;
         }
     }
-}
-#else /* _WIN32 */
-static void TimeTask_ReduceTime(const struct timeval *tv)
-{
-    LinkedQueueIterator i;
-    TaskInfo *ti;
 
-    if( tv == NULL )
+    if( m == NULL && MetricsCount != TIMEDTASK_METRICS_MAX )
     {
-        /** TODO: Show fatal error */
-        return;
-    }
+        m = Metrics + MetricsCount;
+        ++MetricsCount;
 
-    if( LinkedQueueIterator_Init(&i, &TimeQueue) != 0 )
-    {
-        /** TODO: Show fatal error */
-        return;
+        memset(m, 0, sizeof(TimedTaskMetrics));
+        m->Name = Name;
     }
 
-    while( (ti = i.Next(&i)) != NULL )
+    if( m != NULL )
     {
-        Tv_Subtract(&(ti->LeftTime), tv);
+        if( Deferred )
+        {
+            ++(m->Deferred);
+        } else {
+            ++(m->Runs);
+
+            m->RunTime += RunTime;
+            if( RunTime > m->MaxRunTime )
+            {
+                m->MaxRunTime = RunTime;
+            }
+
+            m->Delay += Delay;
+            if( Delay > m->MaxDelay )
+            {
+                m->MaxDelay = Delay;
+            }
+        }
     }
+
+    EFFECTIVE_LOCK_RELEASE(MetricsLock);
 }
-#endif /* _WIN32 */
 
-static int TimeTask_ReallyAdd(TaskInfo *i)
+/* Pass a persistent asynchronous task back to be set again */
+static int TimeTask_PostBack(TaskInfo *i)
 {
-    return TimeQueue.Add(&TimeQueue, i);
+#ifdef _WIN32
+    return MsgQue.Post(&MsgQue, i);
+#else /* _WIN32 */
+    return WRITE_PIPE(WriteTo, i, sizeof(TaskInfo)) < 0 ? -1 : 0;
+#endif /* _WIN32 */
 }
 
 static void
@@ -126,245 +154,269 @@ WINAPI
 TimeTask_RunTack(void *i)
 {
     TaskInfo *Info = (TaskInfo *)i;
+    unsigned long Delay, RunTime;
+    PTimer t;
+
+    Delay = (unsigned long)(PTimer_Monotonic() - Info->Due);
 
+    PTimer_Start(&t);
     Info->Task(Info->Arg1, Info->Arg2);
+    RunTime = PTimer_End(&t);
+
+    TimeTask_Account(Info->Name, Delay, RunTime, FALSE);
+    DEBUG("Task %s ran for %lu ms, %lu ms after due.\n",
+          Info->Name,
+          RunTime,
+          Delay
+          );
 
     if( Info->Persistent )
     {
-        Info->LeftTime = Info->TimeOut;
         if( Info->Asynchronous )
         {
-#ifdef _WIN32
-            if( MsgQue.Post(&MsgQue, Info) != 0 )
+            Info->LeftTime = Info->TimeOut;
+            if( TimeTask_PostBack(Info) != 0 )
             {
-                /** TODO: Show fatal error */
+                ERRORMSG("Task %s could not be set again, it will not run any more.\n",
+                         Info->Name
+                         );
             }
-#else /* _WIN32 */
-            if( WRITE_PIPE(WriteTo, Info, sizeof(TaskInfo)) < 0 )
-            {
-                /** TODO: Show fatal error */
-            }
-#endif /* _WIN32 */
         } else {
-            if( TimeTask_ReallyAdd(Info) != 0 )
-            {
-                /** TODO: Show fatal error */
-            }
+            /* Still in the thread of `TimeTask_Work' */
+            TimeTask_Set(Info, PTimer_Monotonic() + Info->TimeOut);
+            return;
         }
     }
 
-    LinkedQueue_FreeNode(i);
+    SafeFree(Info);
 }
 
-/* Only the particular one thread execute the function */
+/* Run asynchronous tasks handed by `TimeTask_Dispatch' */
 static void
 #ifdef WIN32
 WINAPI
 #endif
-TimeTask_Work(void *Unused)
+TimeTask_Worker(void *Unused)
 {
-#ifdef _WIN32
-    static TaskInfo *i = NULL;
-    static DWORD *tv = NULL;
-    DWORD BeforeWaiting = 0;
-    DWORD ElapsedTime = 0;
-
     while( TRUE )
     {
-        static TaskInfo *New;
+        TaskInfo *i;
 
-        i = TimeQueue.Get(&TimeQueue);
-        if( i == NULL )
-        {
-            tv = NULL;
-        } else {
-            tv = &(i->LeftTime);
-            BeforeWaiting = *tv;
-        }
+#ifdef _WIN32
+        TaskInfo **Msg = Pool.Wait(&Pool, NULL);
 
-        New = MsgQue.Wait(&MsgQue, tv);
-        if( tv != NULL )
+        if( Msg == NULL )
         {
-            ElapsedTime = BeforeWaiting - *tv;
+            continue;
         }
 
-        if( New == NULL )
-        {
-            /* Run the task */
-            TimeTask_ReduceTime(ElapsedTime);
+        i = *Msg;
+        WinMsgQue_FreeMsg(Msg);
+#else /* _WIN32 */
+        int Read;
 
-            /* Make analyzer happy. Shouldn't be both NULL. */
-            if( i == NULL )
+        Read = READ_PIPE(PoolReadFrom, &i, sizeof(TaskInfo *));
+        if( Read != sizeof(TaskInfo *) )
+        {
+            if( Read < 0 && GET_LAST_ERROR() == EINTR )
             {
                 continue;
             }
 
-            if( i->Asynchronous )
-            {
-                ThreadHandle t;
-                CREATE_THREAD(TimeTask_RunTack, i, t);
-                DETACH_THREAD(t);
-            } else {
-                TimeTask_RunTack(i);
-            }
+            /* A broken pipe would be read at once again, forever */
+            ERRORMSG("A timed task worker lost its pipe and has quit.\n");
+            return;
+        }
+#endif /* _WIN32 */
 
-        } else {
-            int r;
+        EFFECTIVE_LOCK_GET(MetricsLock);
+        --Queued;
+        EFFECTIVE_LOCK_RELEASE(MetricsLock);
 
-            if( i != NULL )
-            {
-                r = TimeTask_ReallyAdd(i);
-                LinkedQueue_FreeNode(i);
-                if( r != 0 )
-                {
-                    /** TODO: Show fatal error */
-                    break;
-                }
-            }
+        TimeTask_RunTack(i);
+    }
+}
 
-            /* Receive a new task from other thread */
-            if( tv != NULL )
-            {
-                TimeTask_ReduceTime(ElapsedTime);
-            }
+/* Hand an asynchronous task due to a worker, or put it off if they are all
+ * behind. Only called by the thread of `TimeTask_Work', `i' is taken.
+ */
+static void TimeTask_Dispatch(TaskInfo *i)
+{
+    BOOL Full;
 
-            r = TimeTask_ReallyAdd(New);
-            WinMsgQue_FreeMsg(New);
-            if( r != 0 )
-            {
-                /** TODO: Show fatal error */
-                break;
-            }
-        }
+    EFFECTIVE_LOCK_GET(MetricsLock);
+    Full = (Queued >= TIMEDTASK_QUEUE_SIZE);
+    if( !Full )
+    {
+        ++Queued;
     }
+    EFFECTIVE_LOCK_RELEASE(MetricsLock);
+
+    if( !Full )
+    {
+#ifdef _WIN32
+        if( Pool.Post(&Pool, &i) == 0 )
+        {
+            return;
+        }
 #else /* _WIN32 */
-    static fd_set   ReadSet, ReadySet;
+        if( WRITE_PIPE(PoolWriteTo, &i, sizeof(TaskInfo *)) == sizeof(TaskInfo *) )
+        {
+            return;
+        }
+#endif /* _WIN32 */
 
-    static TaskInfo *i = NULL;
-    static struct timeval   *tv = NULL;
-    static struct timeval   Elapsed = {0, 0};
+        EFFECTIVE_LOCK_GET(MetricsLock);
+        --Queued;
+        EFFECTIVE_LOCK_RELEASE(MetricsLock);
+    }
+
+    TimeTask_Account(i->Name, 0, 0, TRUE);
+    WARNING("Task %s put off, workers are all behind.\n", i->Name);
+
+    /* Still measured from when it was first due */
+    Wheel.Add(&Wheel, &(i->Node), PTimer_Monotonic() + TIMEDTASK_DEFERRING);
+}
+
+/* Only the particular one thread execute the function */
+static void
+#ifdef WIN32
+WINAPI
+#endif
+TimeTask_Work(void *Unused)
+{
+#ifndef _WIN32
+    fd_set  ReadSet, ReadySet;
 
     FD_ZERO(&ReadSet);
     FD_SET(ReadFrom, &ReadSet);
+#endif /* _WIN32 */
 
     while( TRUE )
     {
-        i = TimeQueue.Get(&TimeQueue);
+        TaskInfo *i;
+        uint64_t Now, Next;
 
-        if( i == NULL )
+        /* Run the tasks due */
+        Now = PTimer_Monotonic();
+        while( (i = (TaskInfo *)Wheel.Expire(&Wheel, Now)) != NULL )
         {
-            tv = NULL;
-        } else {
-            tv = &(i->LeftTime);
-            Elapsed = *tv;
-        }
-
-        ReadySet = ReadSet;
-        switch( select(ReadFrom + 1, &ReadySet, NULL, NULL, tv) )
-        {
-        case SOCKET_ERROR:
-            /** TODO: Show fatal error */
-            while( TRUE )
-            {
-                SLEEP(32767);
-            }
-            break;
-
-        case 0:
-            /* Run the task */
-            Tv_Subtract(&Elapsed, tv);
-            TimeTask_ReduceTime(&Elapsed);
-
             if( i->Asynchronous )
             {
-                ThreadHandle t;
-                CREATE_THREAD(TimeTask_RunTack, i, t);
-                DETACH_THREAD(t);
+                TimeTask_Dispatch(i);
             } else {
                 TimeTask_RunTack(i);
             }
+        }
 
-            break;
+        /* Wait for the next one, or a new one from other threads */
+        Next = Wheel.Next(&Wheel);
+        Now = PTimer_Monotonic();
 
-        default:
-            /* Receive a new task from other thread */
-            if( tv != NULL )
+#ifdef _WIN32
+        {
+            DWORD   TimeOut;
+            DWORD   *tv = NULL;
+            TaskInfo *New;
+
+            if( Next != TIMINGWHEEL_NEVER )
             {
-                Tv_Subtract(&Elapsed, tv);
-                TimeTask_ReduceTime(&Elapsed);
+                TimeOut = Next > Now ? (DWORD)(Next - Now) : 0;
+                tv = &TimeOut;
             }
 
+            New = MsgQue.Wait(&MsgQue, tv);
+            if( New != NULL )
             {
-                static TaskInfo ni;
+                int r = TimeTask_ReallyAdd(New);
 
-                if( READ_PIPE(ReadFrom, &ni, sizeof(TaskInfo)) < 0 )
+                WinMsgQue_FreeMsg(New);
+                if( r != 0 )
                 {
-                    /** TODO: Show fatal error */
+                    ERRORMSG("A timed task could not be added, timed tasks stopped.\n");
                     break;
                 }
+            }
+        }
+#else /* _WIN32 */
+        {
+            struct timeval  TimeOut;
+            struct timeval  *tv = NULL;
 
-                if( TimeTask_ReallyAdd(&ni) != 0 )
-                {
-                    /** TODO: Show fatal error */
-                    break;
-                }
+            if( Next != TIMINGWHEEL_NEVER )
+            {
+                uint64_t Left = Next > Now ? Next - Now : 0;
+
+                TimeOut.tv_sec = Left / 1000;
+                TimeOut.tv_usec = (Left % 1000) * 1000;
+                tv = &TimeOut;
             }
 
-            if( i != NULL )
+            ReadySet = ReadSet;
+            switch( select(ReadFrom + 1, &ReadySet, NULL, NULL, tv) )
             {
-                int r = TimeTask_ReallyAdd(i);
-                LinkedQueue_FreeNode(i);
-                if( r != 0 )
+            case SOCKET_ERROR:
+                ERRORMSG("Waiting for timed tasks failed, timed tasks stopped.\n");
+                while( TRUE )
                 {
-                    /** TODO: Show fatal error */
-                    break;
+                    SLEEP(32767);
                 }
-            }
+                break;
 
-            break;
+            case 0:
+                break;
+
+            default:
+                /* Receive a new task from other thread */
+                {
+                    TaskInfo ni;
+
+                    if( READ_PIPE(ReadFrom, &ni, sizeof(TaskInfo)) < 0 )
+                    {
+                        ERRORMSG("Reading a new timed task failed.\n");
+                        break;
+                    }
+
+                    if( TimeTask_ReallyAdd(&ni) != 0 )
+                    {
+                        ERRORMSG("Timed task %s could not be added.\n", ni.Name);
+                        break;
+                    }
+                }
+                break;
+            }
         }
-    }
 #endif /* _WIN32 */
+    }
 }
 
-int TimedTask_Add(BOOL Persistent,
-                 BOOL Asynchronous,
-                 int Milliseconds,
-                 TaskFunc Func,
-                 void *Arg1,
-                 void *Arg2,
-                 BOOL Immediate
-                 )
+int TimedTask_Add(const char *Name,
+                  BOOL Persistent,
+                  BOOL Asynchronous,
+                  int Milliseconds,
+                  TaskFunc Func,
+                  void *Arg1,
+                  void *Arg2,
+                  BOOL Immediate
+                  )
 {
     TaskInfo i;
 
-    if( Func == NULL )
+    if( Func == NULL || Name == NULL )
     {
         return -33;
     }
 
+    memset(&i, 0, sizeof(TaskInfo));
+
+    i.Name = Name;
     i.Task = Func;
     i.Arg1 = Arg1;
     i.Arg2 = Arg2;
     i.Persistent = Persistent;
     i.Asynchronous = Asynchronous;
-#ifdef _WIN32
     i.TimeOut = Milliseconds;
-#else /* _WIN32 */
-    i.TimeOut.tv_usec = (Milliseconds % 1000) * 1000;
-    i.TimeOut.tv_sec = Milliseconds / 1000;
-#endif /* _WIN32 */
-    if( Immediate )
-    {
-#ifdef _WIN32
-        i.LeftTime = 0;
-#else /* _WIN32 */
-        i.LeftTime.tv_sec = 0;
-        i.LeftTime.tv_usec = 0;
-#endif /* _WIN32 */
-    } else {
-        i.LeftTime = i.TimeOut;
-    }
+    i.LeftTime = Immediate ? 0 : Milliseconds;
 
 #ifdef _WIN32
     if( MsgQue.Post(&MsgQue, &i) != 0 )
@@ -381,21 +433,30 @@ int TimedTask_Add(BOOL Persistent,
     return 0;
 }
 
-static int Compare(const void *One, const void *Two)
+void TimedTask_EnumMetrics(TimedTaskMetricsFunc Func, void *Arg)
 {
-    const TaskInfo *o = One, *t = Two;
-#ifdef _WIN32
-    return o->LeftTime - t->LeftTime;
-#else /* _WIN32 */
-    return Tv_Comapre(&(o->LeftTime), &(t->LeftTime));
-#endif /* _WIN32 */
+    TimedTaskMetrics Copy[TIMEDTASK_METRICS_MAX];
+    int Count, loop;
+
+    EFFECTIVE_LOCK_GET(MetricsLock);
+    Count = MetricsCount;
+    memcpy(Copy, Metrics, sizeof(TimedTaskMetrics) * Count);
+    EFFECTIVE_LOCK_RELEASE(MetricsLock);
+
+    for( loop = 0; loop != Count; ++loop )
+    {
+        if( Func(Copy + loop, Arg) != 0 )
+        {
+            break;
+        }
+    }
 }
 
 static void TimedTask_Cleanup(void)
 {
-    TimeQueue.Free(&TimeQueue);
 #ifdef _WIN32
     WinMsgQue_Destroy(&MsgQue);
+    WinMsgQue_Destroy(&Pool);
 #else /* _WIN32 */
 #endif /* _WIN32 */
 }
@@ -403,32 +464,47 @@ static void TimedTask_Cleanup(void)
 int TimedTask_Init(void)
 {
     ThreadHandle t;
+    int loop;
 
-    if( LinkedQueue_Init(&TimeQueue,
-                         sizeof(TaskInfo),
-                         Compare
-                         ) != 0
-       )
+    if( TimingWheel_Init(&Wheel, PTimer_Monotonic()) != 0 )
     {
         return -20;
     }
 
     atexit(TimedTask_Cleanup);
 
+    EFFECTIVE_LOCK_INIT(MetricsLock);
+
 #ifdef _WIN32
     if( WinMsgQue_Init(&MsgQue, sizeof(TaskInfo)) != 0 )
     {
         return -247;
     }
+
+    if( WinMsgQue_Init(&Pool, sizeof(TaskInfo *)) != 0 )
+    {
+        return -248;
+    }
 #else /* _WIN32 */
     if( !CREATE_PIPE_SUCCEEDED(CREATE_PIPE(&ReadFrom, &WriteTo)) )
     {
         return -25;
     }
+
+    if( !CREATE_PIPE_SUCCEEDED(CREATE_PIPE(&PoolReadFrom, &PoolWriteTo)) )
+    {
+        return -26;
+    }
 #endif /* _WIN32 */
 
     CREATE_THREAD(TimeTask_Work, NULL, t);
     DETACH_THREAD(t);
 
+    for( loop = 0; loop != TIMEDTASK_WORKERS; ++loop )
+    {
+        CREATE_THREAD(TimeTask_Worker, NULL, t);
+        DETACH_THREAD(t);
+    }
+
     return 0;
 }
@@ -5,9 +5,32 @@
 
 typedef int (*TaskFunc)(void *Arg1, void *Arg2);
 
+/* What tasks of a name have taken so far, times in milliseconds */
+typedef struct _TimedTaskMetrics{
+    const char  *Name;
+
+    uint32_t    Runs;
+    uint32_t    Deferred; /* Times put off while workers were all behind */
+
+    uint64_t    RunTime; /* In total */
+    uint32_t    MaxRunTime;
+
+    uint64_t    Delay; /* From being due to being run, in total */
+    uint32_t    MaxDelay;
+} TimedTaskMetrics;
+
+/* Return 0 to go on */
+typedef int (*TimedTaskMetricsFunc)(const TimedTaskMetrics *Metrics,
+                                    void *Arg
+                                    );
+
 int TimedTask_Init(void);
 
-int TimedTask_Add(BOOL Persistent,
+/* `Name' must be kept for good, tasks are measured by it.
+ * Asynchronous ones are run by a few workers, shared by all of them.
+ */
+int TimedTask_Add(const char *Name,
+                  BOOL Persistent,
                   BOOL Asynchronous,
                   int Milliseconds,
                   TaskFunc Func,
@@ -16,4 +39,6 @@ int TimedTask_Add(BOOL Persistent,
                   BOOL Immediate
                   );
 
+void TimedTask_EnumMetrics(TimedTaskMetricsFunc Func, void *Arg);
+
 #endif /* TIMEDTASK_H_INCLUDED */
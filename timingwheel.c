@@ -0,0 +1,309 @@
+#include "timingwheel.h"
+
+#define TIMINGWHEEL_MASK    (TIMINGWHEEL_SLOTS - 1)
+
+/* How far timers could be placed */
+#define TIMINGWHEEL_SPAN    ((uint64_t)1 << (TIMINGWHEEL_BITS * TIMINGWHEEL_LEVELS))
+
+#define TIMINGWHEEL_INDEX(t, Level) \
+            ((int)(((t) >> (TIMINGWHEEL_BITS * (Level))) & TIMINGWHEEL_MASK))
+
+static void TimingWheel_ListInit(TimingWheelNode *Head)
+{
+    Head->Prev = Head;
+    Head->Next = Head;
+}
+
+static BOOL TimingWheel_ListEmpty(const TimingWheelNode *Head)
+{
+    return Head->Next == Head;
+}
+
+static void TimingWheel_ListAppend(TimingWheelNode *Head, TimingWheelNode *n)
+{
+    n->Prev = Head->Prev;
+    n->Next = Head;
+    Head->Prev->Next = n;
+    Head->Prev = n;
+}
+
+static void TimingWheel_ListUnlink(TimingWheelNode *n)
+{
+    n->Prev->Next = n->Next;
+    n->Next->Prev = n->Prev;
+    n->Next = NULL;
+    n->Prev = NULL;
+}
+
+/* Move all of `From' to the end of `To' */
+static void TimingWheel_ListSplice(TimingWheelNode *To, TimingWheelNode *From)
+{
+    if( TimingWheel_ListEmpty(From) )
+    {
+        return;
+    }
+
+    From->Next->Prev = To->Prev;
+    To->Prev->Next = From->Next;
+    From->Prev->Next = To;
+    To->Prev = From->Prev;
+
+    TimingWheel_ListInit(From);
+}
+
+/* Put `n' in the slot of its level, as seen from `w->Now' */
+static void TimingWheel_Place(TimingWheel *w, TimingWheelNode *n)
+{
+    uint64_t Expires = n->Expires;
+    uint64_t Delta;
+    int Level = 0;
+
+    if( Expires < w->Now )
+    {
+        Expires = w->Now;
+    }
+
+    Delta = Expires - w->Now;
+    if( Delta >= TIMINGWHEEL_SPAN )
+    {
+        /* Placed again when they get nearer */
+        Delta = TIMINGWHEEL_SPAN - 1;
+        Expires = w->Now + Delta;
+    }
+
+    while( Delta >= ((uint64_t)1 << (TIMINGWHEEL_BITS * (Level + 1))) )
+    {
+        ++Level;
+    }
+
+    TimingWheel_ListAppend(&(w->Slots[Level][TIMINGWHEEL_INDEX(Expires, Level)]), n);
+    n->Level = Level;
+    ++(w->LevelCounts[Level]);
+}
+
+static void TimingWheel_Unlink(TimingWheel *w, TimingWheelNode *n)
+{
+    if( n->Level != TIMINGWHEEL_LEVELS )
+    {
+        --(w->LevelCounts[n->Level]);
+    }
+
+    TimingWheel_ListUnlink(n);
+    --(w->Count);
+}
+
+PUBFUNC void TimingWheel_Add(TimingWheel *w,
+                             TimingWheelNode *n,
+                             uint64_t Expires
+                             )
+{
+    if( n->Next != NULL )
+    {
+        TimingWheel_Unlink(w, n);
+    }
+
+    n->Expires = Expires;
+    TimingWheel_Place(w, n);
+    ++(w->Count);
+}
+
+PUBFUNC void TimingWheel_Cancel(TimingWheel *w, TimingWheelNode *n)
+{
+    if( n->Next != NULL )
+    {
+        TimingWheel_Unlink(w, n);
+    }
+}
+
+/* Move the timers of a slot of a higher level down */
+static void TimingWheel_Cascade(TimingWheel *w, int Level, int Index)
+{
+    TimingWheelNode List;
+    TimingWheelNode *n;
+
+    TimingWheel_ListInit(&List);
+    TimingWheel_ListSplice(&List, &(w->Slots[Level][Index]));
+
+    while( !TimingWheel_ListEmpty(&List) )
+    {
+        n = List.Next;
+        TimingWheel_ListUnlink(n);
+        --(w->LevelCounts[Level]);
+        TimingWheel_Place(w, n);
+    }
+}
+
+static void TimingWheel_Tick(TimingWheel *w)
+{
+    int Index = TIMINGWHEEL_INDEX(w->Now, 0);
+    TimingWheelNode *n;
+
+    if( Index == 0 )
+    {
+        int Level;
+
+        for( Level = 1; Level != TIMINGWHEEL_LEVELS; ++Level )
+        {
+            int i = TIMINGWHEEL_INDEX(w->Now, Level);
+
+            TimingWheel_Cascade(w, Level, i);
+            if( i != 0 )
+            {
+                break;
+            }
+        }
+    }
+
+    for( n = w->Slots[0][Index].Next; n != &(w->Slots[0][Index]); n = n->Next )
+    {
+        n->Level = TIMINGWHEEL_LEVELS;
+        --(w->LevelCounts[0]);
+    }
+
+    TimingWheel_ListSplice(&(w->Expired), &(w->Slots[0][Index]));
+
+    ++(w->Now);
+}
+
+PUBFUNC TimingWheelNode *TimingWheel_Expire(TimingWheel *w, uint64_t Now)
+{
+    TimingWheelNode *n;
+
+    while( TimingWheel_ListEmpty(&(w->Expired)) && w->Now <= Now )
+    {
+        int Level;
+
+        if( w->Count == 0 )
+        {
+            w->Now = Now + 1;
+            break;
+        }
+
+        /* With the levels below empty, nothing happens until the next tick
+         * moving the first one not empty down
+         */
+        for( Level = 0;
+             Level != TIMINGWHEEL_LEVELS - 1 && w->LevelCounts[Level] == 0;
+             ++Level
+             );
+
+        if( Level > 0 )
+        {
+            uint64_t Step = (uint64_t)1 << (TIMINGWHEEL_BITS * Level);
+            uint64_t Boundary = (w->Now + Step - 1) & ~(Step - 1);
+
+            if( Boundary > Now )
+            {
+                w->Now = Now + 1;
+                break;
+            }
+
+            w->Now = Boundary;
+        }
+
+        TimingWheel_Tick(w);
+    }
+
+    if( TimingWheel_ListEmpty(&(w->Expired)) )
+    {
+        return NULL;
+    }
+
+    n = w->Expired.Next;
+    TimingWheel_ListUnlink(n);
+    --(w->Count);
+
+    return n;
+}
+
+PUBFUNC uint64_t TimingWheel_Next(TimingWheel *w)
+{
+    uint64_t Next = TIMINGWHEEL_NEVER;
+    uint64_t Boundary, t;
+    int d;
+
+    if( !TimingWheel_ListEmpty(&(w->Expired)) )
+    {
+        return w->Now - 1;
+    }
+
+    if( w->Count == 0 )
+    {
+        return TIMINGWHEEL_NEVER;
+    }
+
+    /* The lowest level holds the timers of the next `TIMINGWHEEL_SLOTS'
+     * ticks exactly
+     */
+    for( d = 0; d != TIMINGWHEEL_SLOTS; ++d )
+    {
+        t = w->Now + d;
+        if( !TimingWheel_ListEmpty(&(w->Slots[0][TIMINGWHEEL_INDEX(t, 0)])) )
+        {
+            Next = t;
+            break;
+        }
+    }
+
+    /* Then the first slot of the second level to move down. Higher ones
+     * are only looked at when it wraps around.
+     */
+    Boundary = (w->Now + TIMINGWHEEL_MASK) & ~(uint64_t)TIMINGWHEEL_MASK;
+    for( d = 0; d != TIMINGWHEEL_SLOTS; ++d )
+    {
+        int Index;
+
+        t = Boundary + ((uint64_t)d << TIMINGWHEEL_BITS);
+        if( t >= Next )
+        {
+            break;
+        }
+
+        Index = TIMINGWHEEL_INDEX(t, 1);
+        if( Index == 0 ||
+            !TimingWheel_ListEmpty(&(w->Slots[1][Index]))
+            )
+        {
+            Next = t;
+            break;
+        }
+    }
+
+    return Next;
+}
+
+PUBFUNC int TimingWheel_Size(TimingWheel *w)
+{
+    return w->Count;
+}
+
+int TimingWheel_Init(TimingWheel *w, uint64_t Now)
+{
+    int Level, Index;
+
+    w->Now = Now;
+    w->Count = 0;
+
+    for( Level = 0; Level != TIMINGWHEEL_LEVELS; ++Level )
+    {
+        w->LevelCounts[Level] = 0;
+    }
+
+    TimingWheel_ListInit(&(w->Expired));
+
+    for( Level = 0; Level != TIMINGWHEEL_LEVELS; ++Level )
+    {
+        for( Index = 0; Index != TIMINGWHEEL_SLOTS; ++Index )
+        {
+            TimingWheel_ListInit(&(w->Slots[Level][Index]));
+        }
+    }
+
+    w->Add = TimingWheel_Add;
+    w->Cancel = TimingWheel_Cancel;
+    w->Expire = TimingWheel_Expire;
+    w->Next = TimingWheel_Next;
+    w->Size = TimingWheel_Size;
+
+    return 0;
+}
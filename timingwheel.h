@@ -0,0 +1,66 @@
+#ifndef TIMINGWHEEL_H_INCLUDED
+#define TIMINGWHEEL_H_INCLUDED
+
+#include "common.h"
+#include "oo.h"
+
+/* A hierarchical timing wheel of millisecond ticks, on absolute times.
+ *
+ * Timers are nodes embedded in the structures they time, nothing is
+ * allocated. Adding, cancelling and taking an expired one are O(1); each
+ * tick passed costs O(1) too, plus moving the timers of a higher level
+ * down once in a while. Ticks of empty levels are skipped over.
+ *
+ * Timers due within 256 ms sit in the slots of the lowest level, the next
+ * 256 * 256 ms in the second, and so on; those beyond the last level are
+ * kept in it until they get nearer. Not thread safe.
+ */
+
+#define TIMINGWHEEL_LEVELS  4
+#define TIMINGWHEEL_BITS    8
+#define TIMINGWHEEL_SLOTS   (1 << TIMINGWHEEL_BITS)
+
+/* Returned by `Next' if no timer is set */
+#define TIMINGWHEEL_NEVER   UINT64_MAX
+
+typedef struct _TimingWheelNode TimingWheelNode;
+
+struct _TimingWheelNode{
+    TimingWheelNode *Prev;
+    TimingWheelNode *Next; /* NULL if not set */
+    uint64_t        Expires;
+    int             Level; /* `TIMINGWHEEL_LEVELS' once expired */
+};
+
+typedef struct _TimingWheel TimingWheel;
+
+struct _TimingWheel{
+    PRIMEMB uint64_t        Now; /* The next tick to pass */
+    PRIMEMB int             Count;
+    PRIMEMB int             LevelCounts[TIMINGWHEEL_LEVELS];
+    PRIMEMB TimingWheelNode Expired; /* Passed, not taken yet */
+    PRIMEMB TimingWheelNode Slots[TIMINGWHEEL_LEVELS][TIMINGWHEEL_SLOTS];
+
+    /* Set `n' to expire at `Expires', which could have passed already */
+    PUBMEMB void (*Add)(TimingWheel *w, TimingWheelNode *n, uint64_t Expires);
+
+    /* Nothing happens if `n' is not set */
+    PUBMEMB void (*Cancel)(TimingWheel *w, TimingWheelNode *n);
+
+    /* Pass ticks up to `Now', and take one timer expired, in the order of
+     * their ticks, NULL if none
+     */
+    PUBMEMB TimingWheelNode *(*Expire)(TimingWheel *w, uint64_t Now);
+
+    /* When `Expire' should be called next at the latest, a time passed if
+     * it could give one now
+     */
+    PUBMEMB uint64_t (*Next)(TimingWheel *w);
+
+    PUBMEMB int (*Size)(TimingWheel *w);
+};
+
+/* Nodes must be zeroed before their first `Add' or `Cancel' */
+int TimingWheel_Init(TimingWheel *w, uint64_t Now);
+
+#endif /* TIMINGWHEEL_H_INCLUDED */
@@ -0,0 +1,284 @@
+#include <string.h>
+#include "topk.h"
+#include "utils.h"
+
+typedef struct _TopKEntry{
+    uint32_t    Count;
+    uint32_t    Error;
+    uint32_t    Hash;
+    int         HeapIndex;
+    /* Followed by the key, then the data */
+} TopKEntry;
+
+#define TOPK_ENTRY(t_ptr, i)    ((TopKEntry *)((t_ptr)->Entries + (size_t)(i) * (t_ptr)->EntryLength))
+#define TOPK_KEY(e_ptr)         ((char *)((e_ptr) + 1))
+#define TOPK_DATA(t_ptr, e_ptr) (TOPK_KEY(e_ptr) + (t_ptr)->KeyLength)
+
+int TopK_Init(TopK *t, int Capacity, int KeyLength, int DataLength)
+{
+    uint32_t TableSize = 4;
+
+    if( Capacity <= 0 || KeyLength <= 0 || DataLength < 0 )
+    {
+        return -1;
+    }
+
+    /* At most half full */
+    while( TableSize < (uint32_t)Capacity * 2 )
+    {
+        TableSize *= 2;
+    }
+
+    t->KeyLength = ROUND_UP(KeyLength, 8);
+    t->EntryLength = ROUND_UP(sizeof(TopKEntry) + t->KeyLength + DataLength, 8);
+    t->Capacity = Capacity;
+    t->Used = 0;
+    t->TableMask = TableSize - 1;
+
+    t->Entries = SafeMalloc((size_t)Capacity * t->EntryLength);
+    t->Heap = SafeMalloc(sizeof(int) * Capacity);
+    t->Table = SafeMalloc(sizeof(int) * TableSize);
+
+    if( t->Entries == NULL || t->Heap == NULL || t->Table == NULL )
+    {
+        TopK_Free(t);
+        return -2;
+    }
+
+    memset(t->Table, 0, sizeof(int) * TableSize);
+
+    return 0;
+}
+
+static void TopK_Swap(TopK *t, int a, int b)
+{
+    int Tmp = t->Heap[a];
+
+    t->Heap[a] = t->Heap[b];
+    t->Heap[b] = Tmp;
+
+    TOPK_ENTRY(t, t->Heap[a])->HeapIndex = a;
+    TOPK_ENTRY(t, t->Heap[b])->HeapIndex = b;
+}
+
+static void TopK_SiftUp(TopK *t, int i)
+{
+    while( i > 0 )
+    {
+        int Parent = (i - 1) / 2;
+
+        if( TOPK_ENTRY(t, t->Heap[Parent])->Count <=
+            TOPK_ENTRY(t, t->Heap[i])->Count )
+        {
+            break;
+        }
+
+        TopK_Swap(t, i, Parent);
+        i = Parent;
+    }
+}
+
+static void TopK_SiftDown(TopK *t, int i)
+{
+    while( TRUE )
+    {
+        int Lowest = i;
+        int Child = i * 2 + 1;
+
+        if( Child < t->Used &&
+            TOPK_ENTRY(t, t->Heap[Child])->Count <
+                TOPK_ENTRY(t, t->Heap[Lowest])->Count )
+        {
+            Lowest = Child;
+        }
+
+        ++Child;
+        if( Child < t->Used &&
+            TOPK_ENTRY(t, t->Heap[Child])->Count <
+                TOPK_ENTRY(t, t->Heap[Lowest])->Count )
+        {
+            Lowest = Child;
+        }
+
+        if( Lowest == i )
+        {
+            break;
+        }
+
+        TopK_Swap(t, i, Lowest);
+        i = Lowest;
+    }
+}
+
+/* The slot of `Key', or of where it would go */
+static uint32_t TopK_Slot(TopK *t, const char *Key, uint32_t Hash)
+{
+    uint32_t Slot = Hash & t->TableMask;
+
+    while( t->Table[Slot] != 0 )
+    {
+        TopKEntry *e = TOPK_ENTRY(t, t->Table[Slot] - 1);
+
+        if( e->Hash == Hash &&
+            strncmp(TOPK_KEY(e), Key, t->KeyLength - 1) == 0 )
+        {
+            break;
+        }
+
+        Slot = (Slot + 1) & t->TableMask;
+    }
+
+    return Slot;
+}
+
+/* Empty `Slot', moving back the ones probed past it */
+static void TopK_Unlink(TopK *t, uint32_t Slot)
+{
+    uint32_t Next = Slot;
+
+    while( TRUE )
+    {
+        uint32_t Home;
+
+        Next = (Next + 1) & t->TableMask;
+        if( t->Table[Next] == 0 )
+        {
+            break;
+        }
+
+        Home = TOPK_ENTRY(t, t->Table[Next] - 1)->Hash & t->TableMask;
+
+        /* Could it be found from `Slot' on? */
+        if( ((Next - Home) & t->TableMask) >= ((Next - Slot) & t->TableMask) )
+        {
+            t->Table[Slot] = t->Table[Next];
+            Slot = Next;
+        }
+    }
+
+    t->Table[Slot] = 0;
+}
+
+void *TopK_Add(TopK *t,
+               const char *Key,
+               uint32_t Hash,
+               uint32_t Weight,
+               uint32_t Error
+               )
+{
+    uint32_t Slot = TopK_Slot(t, Key, Hash);
+    TopKEntry *e;
+
+    if( t->Table[Slot] != 0 )
+    {
+        e = TOPK_ENTRY(t, t->Table[Slot] - 1);
+
+        e->Count += Weight;
+        e->Error += Error;
+        TopK_SiftDown(t, e->HeapIndex);
+
+        return TOPK_DATA(t, e);
+    }
+
+    if( Weight == 0 )
+    {
+        return NULL;
+    }
+
+    if( t->Used < t->Capacity )
+    {
+        int Index = t->Used;
+
+        e = TOPK_ENTRY(t, Index);
+
+        e->Count = Weight;
+        e->Error = Error;
+        e->HeapIndex = Index;
+        t->Heap[Index] = Index;
+        ++(t->Used);
+    } else {
+        /* Take the place of the lowest */
+        e = TOPK_ENTRY(t, t->Heap[0]);
+
+        TopK_Unlink(t, TopK_Slot(t, TOPK_KEY(e), e->Hash));
+        Slot = TopK_Slot(t, Key, Hash);
+
+        e->Error = e->Count + Error;
+        e->Count += Weight;
+    }
+
+    e->Hash = Hash;
+    strncpy(TOPK_KEY(e), Key, t->KeyLength - 1);
+    TOPK_KEY(e)[t->KeyLength - 1] = '\0';
+    memset(TOPK_DATA(t, e),
+           0,
+           t->EntryLength - sizeof(TopKEntry) - t->KeyLength
+           );
+
+    t->Table[Slot] = ((char *)e - t->Entries) / t->EntryLength + 1;
+
+    TopK_SiftUp(t, e->HeapIndex);
+    TopK_SiftDown(t, e->HeapIndex);
+
+    return TOPK_DATA(t, e);
+}
+
+const char *TopK_Enum(TopK *t,
+                      int *Start,
+                      uint32_t *Hash,
+                      uint32_t *Count,
+                      uint32_t *Error,
+                      void **Data
+                      )
+{
+    TopKEntry *e;
+
+    if( *Start < 0 || *Start >= t->Used )
+    {
+        return NULL;
+    }
+
+    e = TOPK_ENTRY(t, *Start);
+    ++(*Start);
+
+    if( Hash != NULL )
+    {
+        *Hash = e->Hash;
+    }
+
+    if( Count != NULL )
+    {
+        *Count = e->Count;
+    }
+
+    if( Error != NULL )
+    {
+        *Error = e->Error;
+    }
+
+    if( Data != NULL )
+    {
+        *Data = TOPK_DATA(t, e);
+    }
+
+    return TOPK_KEY(e);
+}
+
+int TopK_Size(const TopK *t)
+{
+    return t->Used;
+}
+
+void TopK_Clear(TopK *t)
+{
+    t->Used = 0;
+    memset(t->Table, 0, sizeof(int) * (t->TableMask + 1));
+}
+
+void TopK_Free(TopK *t)
+{
+    SafeFree(t->Entries);
+    SafeFree(t->Heap);
+    SafeFree(t->Table);
+    t->Used = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef TOPK_H_INCLUDED
+#define TOPK_H_INCLUDED
+
+#include "common.h"
+
+/* A space-saving summary of the most counted keys, in fixed memory.
+ *
+ * It holds at most `Capacity' keys. A key not held takes the place of the one
+ * with the lowest count and starts from that count, which is kept as its
+ * `Error'. So a count is never below the true one and at most `Error' above
+ * it, and every key counted more than 1 / `Capacity' of the total is held.
+ *
+ * Each key carries `DataLength' bytes of the caller's, zeroed when it comes
+ * in, so they only count from then on.
+ */
+
+typedef struct _TopK{
+    char        *Entries;   /* `EntryLength' bytes each */
+    int         *Heap;      /* Entries by count, the lowest first */
+    int         *Table;     /* Entries by hash, 1-based, 0 for empty slots */
+    uint32_t    TableMask;
+    int         EntryLength;
+    int         KeyLength;
+    int         Capacity;
+    int         Used;
+} TopK;
+
+/* Keys longer than `KeyLength' - 1 are cut */
+int TopK_Init(TopK *t, int Capacity, int KeyLength, int DataLength);
+
+/* Count `Key' up by `Weight', and its error by `Error', both could be 0, the
+ * latter non-zero when merging another summary. `Hash' is the `HASH' value of
+ * it.
+ *
+ * Return the data of the key, or NULL if a `Weight' 0 key is not held, which
+ * is never taken in.
+ */
+void *TopK_Add(TopK *t,
+               const char *Key,
+               uint32_t Hash,
+               uint32_t Weight,
+               uint32_t Error
+               );
+
+/* `Start' 0 for the first, in no order */
+const char *TopK_Enum(TopK *t,
+                      int *Start,
+                      uint32_t *Hash,
+                      uint32_t *Count,
+                      uint32_t *Error,
+                      void **Data
+                      );
+
+int TopK_Size(const TopK *t);
+
+/* Drop all keys, keeping the memory */
+void TopK_Clear(TopK *t);
+
+void TopK_Free(TopK *t);
+
+#endif /* TOPK_H_INCLUDED */
@@ -4,6 +4,9 @@
 #include "utils.h"
 #include "mmgr.h"
 #include "logs.h"
+#include "probes.h"
+#include "ratelimit.h"
+#include "metrics.h"
 
 /* UDP is main; TCP is fallback. */
 BOOL Ipv6_Enabled = FALSE;
@@ -46,7 +49,7 @@ UdpFrontend_Work(void *Unused)
 
         socklen_t AddrLen;
 
-        char Agent[sizeof(Header->Agent)];
+        IHeaderCheck Check;
 
         sock = Frontend.Select(&Frontend,
                                NULL,
@@ -71,34 +74,56 @@ UdpFrontend_Work(void *Unused)
                              &AddrLen
                              );
 
-        if( *f == AF_INET )
-        {
-            IPv4AddressToAsc(&(((struct sockaddr_in *)IncomingAddress)->sin_addr),
-                             Agent
-                             );
-        } else {
-            IPv6AddressToAsc(&(((struct sockaddr_in6 *)IncomingAddress)->sin6_addr),
-                             Agent
-                             );
-        }
-
         if( RecvState < 0 )
         {
+            char Agent[sizeof(Header->Agent)];
+
+            if( *f == AF_INET )
+            {
+                IPv4AddressToAsc(&(((struct sockaddr_in *)IncomingAddress)->sin_addr),
+                                 Agent
+                                 );
+            } else {
+                IPv6AddressToAsc(&(((struct sockaddr_in6 *)IncomingAddress)->sin6_addr),
+                                 Agent
+                                 );
+            }
+
             INFO("An error occured while receiving from UDP client %s, not a big deal.\n",
                  Agent
                  );
             continue;
         }
 
-        IHeader_Fill(Header,
-                     FALSE,
-                     Entity,
-                     RecvState,
-                     IncomingAddress,
-                     sock,
-                     *f,
-                     Agent
-                     );
+        if( RateLimit_Out(sock, Entity, RecvState, IncomingAddress, *f) )
+        {
+            continue;
+        }
+
+        Check = IHeader_Check(Entity, RecvState);
+        if( Check != IHEADER_CHECK_OK )
+        {
+            Metrics_CountInvalid(Check);
+            continue;
+        }
+
+        /* `Agent' is rendered when asked for */
+        if( IHeader_Fill(Header,
+                         FALSE,
+                         Entity,
+                         RecvState,
+                         IncomingAddress,
+                         sock,
+                         *f,
+                         NULL
+                         )
+            != 0 )
+        {
+            Metrics_CountInvalid(IHEADER_CHECK_PARSE);
+            continue;
+        }
+
+        PROBE_QUERY2(query_received, Header, IncomingAddress, 0);
 
         MMgr_Send(ReceiveBuffer, SOCKET_CONTEXT_LENGTH);
     }
@@ -133,6 +158,11 @@ int UdpFrontend_Init(ConfigFileInfo *ConfigInfo, BOOL StartWork)
         return -11;
     }
 
+    if( RateLimit_Init(ConfigInfo) != 0 )
+    {
+        return -21;
+    }
+
     if( StringListIterator_Init(&i, UDPLocal) != 0 )
     {
         return -20;
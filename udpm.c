@@ -7,11 +7,16 @@
 #include "ipmisc.h"
 #include "domainstatistic.h"
 #include "timedtask.h"
+#include "latency.h"
+#include "ptimer.h"
+#include "metrics.h"
+#include "probes.h"
 
 static void SweepWorks(MsgContext *MsgCtx, int Number, UdpM *Module)
 {
     IHeader *h = (IHeader *)MsgCtx;
 
+    PROBE_QUERY1(query_timeout, h, "udp");
     ShowTimeOutMessage(h, 'U');
     DomainStatistic_Add(h, STATISTIC_TYPE_REFUSED);
     ++(Module->CountOfTimeout);
@@ -43,6 +48,7 @@ UdpM_Sweep_Thread(UdpM *m)
         SLEEP(10000);
     }
 
+    DomainStatistic_Retire();
     ModuleContext_Free(&(m->Context));
     EFFECTIVE_LOCK_DESTROY(m->Lock);
 
@@ -77,6 +83,10 @@ UdpM_Works(UdpM *m)
 
     struct sockaddr *addr;
 
+    /* Where answers come from, for latencies */
+    Address_Type From;
+    socklen_t FromLength;
+
     char ReceiveBuffer[SOCKET_CONTEXT_LENGTH];
     MsgContext *MsgCtx;
     IHeader *Header;
@@ -147,6 +157,7 @@ UdpM_Works(UdpM *m)
         {
             case SOCKET_ERROR:
                 WARNING("SOCKET_ERROR reached, 98.\n");
+                Metrics_Increase(METRICS_SOCKET_ERRORS);
                 FD_CLR(m->Departure, &ReadSet);
                 CLOSE_SOCKET(m->Departure);
                 m->Departure = INVALID_SOCKET;
@@ -172,17 +183,19 @@ UdpM_Works(UdpM *m)
         }
 
         /* recv */
+        FromLength = sizeof(From.Addr);
         RecvState = recvfrom(m->Departure,
                              Entity,
                              LEFT_LENGTH,
                              0,
-                             NULL,
-                             NULL
+                             (struct sockaddr *)&(From.Addr),
+                             &FromLength
                              );
 
         if( RecvState <= 0 )
         {
             ERRORMSG("recvfrom %s error: %d\n", m->ServiceName, RecvState);
+            Metrics_Increase(METRICS_SOCKET_ERRORS);
             continue;
         }
 
@@ -234,6 +247,14 @@ UdpM_Works(UdpM *m)
         ContextState = m->Context.GenAnswerHeaderAndRemove(&(m->Context), MsgCtx, MsgCtx);
         EFFECTIVE_LOCK_RELEASE(m->Lock);
 
+        if( ContextState == 0 )
+        {
+            Header->Upstream = (struct sockaddr *)&(From.Addr);
+            STAMP(Header, STAMP_ANSWERED);
+            PROBE_QUERY2(upstream_answer, Header, "udp", Header->SentTime);
+            Latency_RecordUpstream(Header->Upstream, Header->SentTime);
+        }
+
         DNSCache_AddItemsToCache(MsgCtx, ContextState == 0);
 
         if( ContextState != 0 )
@@ -244,13 +265,16 @@ UdpM_Works(UdpM *m)
         if( MsgContext_SendBack(MsgCtx) != 0 )
         {
             ShowErrorMessage(Header, 'U');
+            Metrics_Increase(METRICS_SOCKET_ERRORS);
             continue;
         }
 
         ShowNormalMessage(Header, 'U');
         DomainStatistic_Add(Header, STATISTIC_TYPE_UDP);
+        Latency_Record(LATENCY_TYPE_UDP, Header->ReceivedTime);
     }
 
+    DomainStatistic_Retire();
     UdpM_Cleanup(m);
 }
 
@@ -263,6 +287,9 @@ static int UdpM_Send(UdpM *m,
     const IHeader *h = (IHeader *)Buffer;
 
     MsgContext_AddFakeEdns((MsgContext *)Buffer, BufferLength);
+    ((IHeader *)Buffer)->SentTime = PTimer_MonotonicMicro();
+    STAMP((IHeader *)Buffer, STAMP_SENT);
+    PROBE_QUERY1(module_send, h, "udp");
 
     EFFECTIVE_LOCK_GET(m->Lock);
     if( m->Context.Add(&(m->Context), (MsgContext *)Buffer) == NULL )
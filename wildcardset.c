@@ -0,0 +1,563 @@
+#include <string.h>
+#include <ctype.h>
+#include "wildcardset.h"
+#include "utils.h"
+#include "region.h"
+
+/* Characters which can't be part of an anchor. Brackets are included since
+ * the content of a bracket expression is not literal. A backslash is literal
+ * to `fnmatch' with `FNM_NOESCAPE', but escapes the next character to other
+ * matchers. An anchor never spans one, so it's found in every matched string
+ * either way.
+ */
+#define WILDCARD_SET_SPECIALS   "*?[]\\"
+
+#define WILDCARD_SET_ROOT_TAIL      0
+#define WILDCARD_SET_ROOT_HEAD      1
+#define WILDCARD_SET_ROOT_SEGMENT   2
+
+/* Matched segment nodes remembered in one query, to visit each just once */
+#define WILDCARD_SET_MAX_SEEN   64
+
+#define WILDCARD_SET_LOWER(c)   ((unsigned char)tolower((unsigned char)(c)))
+
+typedef struct _WildcardSet_Item{
+    int32_t     Subscript;
+
+    const char  *Anchor;
+    int32_t     Length;
+    int32_t     Root;   /* WILDCARD_SET_ROOT_* */
+
+    int32_t     Consumed;
+
+    /* Next character of the anchor, -1 if all consumed */
+    int32_t     Key;
+} WildcardSet_Item;
+
+static int WildcardSet_ItemCompare(const WildcardSet_Item *One,
+                                   const WildcardSet_Item *Two
+                                   )
+{
+    if( One->Key != Two->Key )
+    {
+        return One->Key - Two->Key;
+    }
+
+    return One->Subscript - Two->Subscript;
+}
+
+/* The longest literal run strictly inside `Pattern' */
+static int WildcardSet_Segment(const char *Pattern, const char **Segment)
+{
+    const char *Itr = Pattern;
+    int Longest = 0;
+
+    /* The content of a bracket expression could be taken as literal */
+    if( strpbrk(Pattern, "[]") != NULL )
+    {
+        return 0;
+    }
+
+    while( *Itr != '\0' )
+    {
+        int Length = strcspn(Itr, WILDCARD_SET_SPECIALS);
+
+        if( Length > Longest && Itr != Pattern && Itr[Length] != '\0' )
+        {
+            Longest = Length;
+            *Segment = Itr;
+        }
+
+        Itr += Length;
+        if( *Itr != '\0' )
+        {
+            ++Itr;
+        }
+    }
+
+    return Longest;
+}
+
+/* Pick the anchor of a pattern, return FALSE if it has none. */
+static BOOL WildcardSet_Anchor(const char *Pattern, WildcardSet_Item *i)
+{
+    int Length = strlen(Pattern);
+    int HeadLength = strcspn(Pattern, WILDCARD_SET_SPECIALS);
+    int TailStart = Length;
+    const char *Segment = NULL;
+    int SegmentLength;
+
+#ifdef _WIN32
+    /* `PathMatchSpec' takes ';' separated lists, and a trailing dot means
+     * "no extension", so such patterns are not anchored.
+     */
+    if( strchr(Pattern, ';') != NULL ||
+        (Length > 0 && Pattern[Length - 1] == '.')
+        )
+    {
+        return FALSE;
+    }
+#endif /* _WIN32 */
+
+    while( TailStart > 0 &&
+           strchr(WILDCARD_SET_SPECIALS, Pattern[TailStart - 1]) == NULL
+           )
+    {
+        --TailStart;
+    }
+
+    SegmentLength = WildcardSet_Segment(Pattern, &Segment);
+
+    if( Length - TailStart >= HeadLength &&
+        Length - TailStart >= SegmentLength
+        )
+    {
+        i->Anchor = Pattern + TailStart;
+        i->Length = Length - TailStart;
+        i->Root = WILDCARD_SET_ROOT_TAIL;
+    } else if( HeadLength >= SegmentLength )
+    {
+        i->Anchor = Pattern;
+        i->Length = HeadLength;
+        i->Root = WILDCARD_SET_ROOT_HEAD;
+    } else {
+        i->Anchor = Segment;
+        i->Length = SegmentLength;
+        i->Root = WILDCARD_SET_ROOT_SEGMENT;
+    }
+
+    i->Consumed = 0;
+
+    return i->Length > 0;
+}
+
+int WildcardSet_Init(WildcardSet *w)
+{
+    if( Array_Init(&(w->Nodes), sizeof(WildcardSet_Node), 0, FALSE, NULL) != 0 )
+    {
+        return -1;
+    }
+
+    if( Array_Init(&(w->Entries), sizeof(int32_t), 0, FALSE, NULL) != 0 )
+    {
+        Array_Free(&(w->Nodes));
+        return -2;
+    }
+
+    if( Array_Init(&(w->Others), sizeof(int32_t), 0, FALSE, NULL) != 0 )
+    {
+        Array_Free(&(w->Nodes));
+        Array_Free(&(w->Entries));
+        return -3;
+    }
+
+    w->PatternCount = 0;
+
+    return 0;
+}
+
+static const WildcardSet_Node *WildcardSet_FindChild(const WildcardSet_Node *Nodes,
+                                                     const WildcardSet_Node *Parent,
+                                                     unsigned char Character
+                                                     )
+{
+    int Lo = Parent->FirstChild;
+    int Hi = Lo + Parent->ChildCount;
+
+    while( Lo < Hi )
+    {
+        int Mid = Lo + (Hi - Lo) / 2;
+
+        if( Nodes[Mid].Character == Character )
+        {
+            return Nodes + Mid;
+        } else if( Nodes[Mid].Character < Character )
+        {
+            Lo = Mid + 1;
+        } else {
+            Hi = Mid;
+        }
+    }
+
+    return NULL;
+}
+
+/* Aho-Corasick links of the children of `Parent'. Nodes are breadth-first,
+ * so all nodes the links may point to are linked already.
+ */
+static void WildcardSet_Link(WildcardSet_Node *Nodes, int Parent)
+{
+    const WildcardSet_Node *p = Nodes + Parent;
+    int loop;
+
+    for( loop = p->FirstChild; loop != p->FirstChild + p->ChildCount; ++loop )
+    {
+        WildcardSet_Node *Child = Nodes + loop;
+        const WildcardSet_Node *f;
+
+        if( Parent == WILDCARD_SET_ROOT_SEGMENT )
+        {
+            f = Nodes + WILDCARD_SET_ROOT_SEGMENT;
+        } else {
+            const WildcardSet_Node *Next = NULL;
+
+            f = Nodes + p->Fail;
+
+            while( (Next = WildcardSet_FindChild(Nodes, f, Child->Character)) == NULL &&
+                   f != Nodes + WILDCARD_SET_ROOT_SEGMENT
+                   )
+            {
+                f = Nodes + f->Fail;
+            }
+
+            if( Next != NULL )
+            {
+                f = Next;
+            }
+        }
+
+        Child->Fail = f - Nodes;
+        Child->Output = f->EntryCount > 0 ? Child->Fail : f->Output;
+    }
+}
+
+int WildcardSet_Compile(WildcardSet *w, const char **Patterns, int Count)
+{
+    Array Items;
+    WildcardSet_Item *ItemArray;
+    Region *PreviousRegion;
+    WildcardSet_Node Root = {0, 0, 0, 0,
+                             WILDCARD_SET_ROOT_SEGMENT, -1,
+                             '\0'
+                             };
+    int RootEnd[3] = {0, 0, 0};
+    int n;
+
+    WildcardSet_Free(w);
+    if( WildcardSet_Init(w) != 0 )
+    {
+        return -1;
+    }
+
+    /* Freed once compiled, so not taken from the current region */
+    PreviousRegion = Region_Enter(NULL);
+    if( Array_Init(&Items, sizeof(WildcardSet_Item), Count, FALSE, NULL) != 0 )
+    {
+        Region_Leave(PreviousRegion);
+        return -2;
+    }
+    Region_Leave(PreviousRegion);
+
+    for( n = 0; n != Count; ++n )
+    {
+        WildcardSet_Item i;
+
+        i.Subscript = n;
+
+        if( !WildcardSet_Anchor(Patterns[n], &i) )
+        {
+            if( Array_PushBack(&(w->Others), &n, NULL) < 0 )
+            {
+                goto EXIT_1;
+            }
+            continue;
+        }
+
+        Array_PushBack(&Items, &i, NULL);
+        ++(RootEnd[i.Root]);
+    }
+
+    ItemArray = (WildcardSet_Item *)Array_GetRawArray(&Items);
+
+    /* Grouped by roots, ascending subscripts are kept within each group */
+    for( n = 0; n != Array_GetUsed(&Items); ++n )
+    {
+        ItemArray[n].Key = ItemArray[n].Root;
+    }
+    qsort(ItemArray,
+          Array_GetUsed(&Items),
+          sizeof(WildcardSet_Item),
+          (CompareFunc)WildcardSet_ItemCompare
+          );
+
+    /* Breadth-first, the range of items of an unprocessed node is kept in
+     * `FirstEntry' and `EntryCount'.
+     */
+    for( n = WILDCARD_SET_ROOT_TAIL; n <= WILDCARD_SET_ROOT_SEGMENT; ++n )
+    {
+        Root.FirstEntry = n == 0 ? 0 : RootEnd[n - 1];
+        Root.EntryCount = RootEnd[n];
+        RootEnd[n] += Root.FirstEntry;
+
+        if( Array_PushBack(&(w->Nodes), &Root, NULL) < 0 )
+        {
+            goto EXIT_1;
+        }
+    }
+
+    for( n = 0; n < Array_GetUsed(&(w->Nodes)); ++n )
+    {
+        WildcardSet_Node *Node = Array_GetBySubscript(&(w->Nodes), n);
+        int Lo = Node->FirstEntry;
+        int Hi = Lo + Node->EntryCount;
+        int FirstChild = Array_GetUsed(&(w->Nodes));
+        int ChildCount = 0;
+        int Itr;
+
+        for( Itr = Lo; Itr < Hi; ++Itr )
+        {
+            WildcardSet_Item *i = ItemArray + Itr;
+
+            if( i->Consumed == i->Length )
+            {
+                i->Key = -1;
+            } else {
+                i->Key = WILDCARD_SET_LOWER(i->Root == WILDCARD_SET_ROOT_TAIL ?
+                                            i->Anchor[i->Length - 1 - i->Consumed] :
+                                            i->Anchor[i->Consumed]
+                                            );
+            }
+        }
+
+        qsort(ItemArray + Lo,
+              Hi - Lo,
+              sizeof(WildcardSet_Item),
+              (CompareFunc)WildcardSet_ItemCompare
+              );
+
+        for( Itr = Lo; Itr < Hi && ItemArray[Itr].Key < 0; ++Itr );
+
+        Node->EntryCount = Itr - Lo;
+
+        while( Itr < Hi )
+        {
+            WildcardSet_Node Child;
+
+            Child.FirstChild = 0;
+            Child.ChildCount = 0;
+            Child.FirstEntry = Itr;
+            Child.Fail = WILDCARD_SET_ROOT_SEGMENT;
+            Child.Output = -1;
+            Child.Character = ItemArray[Itr].Key;
+
+            for( ; Itr < Hi && ItemArray[Itr].Key == Child.Character; ++Itr )
+            {
+                ++(ItemArray[Itr].Consumed);
+            }
+
+            Child.EntryCount = Itr - Child.FirstEntry;
+
+            if( Array_PushBack(&(w->Nodes), &Child, NULL) < 0 )
+            {
+                goto EXIT_1;
+            }
+
+            ++ChildCount;
+        }
+
+        /* `Node' may have been moved by pushing */
+        Node = Array_GetBySubscript(&(w->Nodes), n);
+        Node->FirstChild = FirstChild;
+        Node->ChildCount = ChildCount;
+    }
+
+    /* Linked after all nodes are final, still breadth-first. Segment nodes
+     * hold the last part of items.
+     */
+    for( n = 0; n < Array_GetUsed(&(w->Nodes)); ++n )
+    {
+        WildcardSet_Node *NodeArray = (WildcardSet_Node *)Array_GetRawArray(&(w->Nodes));
+
+        if( NodeArray[n].FirstEntry >= RootEnd[WILDCARD_SET_ROOT_HEAD] )
+        {
+            WildcardSet_Link(NodeArray, n);
+        }
+    }
+
+    for( n = 0; n != Array_GetUsed(&Items); ++n )
+    {
+        if( Array_PushBack(&(w->Entries), &(ItemArray[n].Subscript), NULL) < 0 )
+        {
+            goto EXIT_1;
+        }
+    }
+
+    w->PatternCount = Count;
+
+    Array_Free(&Items);
+    return 0;
+
+EXIT_1:
+    Array_Free(&Items);
+    WildcardSet_Free(w);
+    return -3;
+}
+
+/* Return non-zero if stopped */
+static int WildcardSet_VisitNode(const WildcardSet         *w,
+                                 const WildcardSet_Node    *Node,
+                                 WildcardSet_Visitor       Visitor,
+                                 void                      *Arg
+                                 )
+{
+    const int32_t *Entries = (const int32_t *)Array_GetRawArray(&(w->Entries));
+    int loop;
+
+    for( loop = 0; loop != Node->EntryCount; ++loop )
+    {
+        if( Visitor(Entries[Node->FirstEntry + loop], Arg) != 0 )
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Collect segment nodes found in `Str', return -1 if there are too many. */
+static int WildcardSet_Segments(const WildcardSet_Node *NodeArray,
+                                const char *Str,
+                                int32_t *Seen
+                                )
+{
+    const WildcardSet_Node *Root = NodeArray + WILDCARD_SET_ROOT_SEGMENT;
+    const WildcardSet_Node *State = Root;
+    int Count = 0;
+
+    if( Root->ChildCount == 0 )
+    {
+        return 0;
+    }
+
+    for( ; *Str != '\0'; ++Str )
+    {
+        unsigned char c = WILDCARD_SET_LOWER(*Str);
+        const WildcardSet_Node *Next;
+        int32_t Out;
+
+        while( (Next = WildcardSet_FindChild(NodeArray, State, c)) == NULL &&
+               State != Root
+               )
+        {
+            State = NodeArray + State->Fail;
+        }
+
+        State = Next == NULL ? Root : Next;
+
+        for( Out = State->EntryCount > 0 ? State - NodeArray : State->Output;
+             Out >= 0;
+             Out = NodeArray[Out].Output
+             )
+        {
+            int loop;
+
+            for( loop = 0; loop != Count && Seen[loop] != Out; ++loop );
+
+            if( loop == Count )
+            {
+                if( Count == WILDCARD_SET_MAX_SEEN )
+                {
+                    return -1;
+                }
+
+                Seen[Count++] = Out;
+            }
+        }
+    }
+
+    return Count;
+}
+
+void WildcardSet_Candidates(const WildcardSet   *w,
+                            const char          *Str,
+                            WildcardSet_Visitor Visitor,
+                            void                *Arg
+                            )
+{
+    const WildcardSet_Node *NodeArray;
+    const WildcardSet_Node *Node;
+    const int32_t *Others;
+    int32_t Seen[WILDCARD_SET_MAX_SEEN];
+    int SeenCount;
+    int Length = strlen(Str);
+    int loop;
+
+    if( !WildcardSet_IsCompiled(w) )
+    {
+        return;
+    }
+
+    NodeArray = (const WildcardSet_Node *)Array_GetRawArray(&(w->Nodes));
+
+    SeenCount = WildcardSet_Segments(NodeArray, Str, Seen);
+    if( SeenCount < 0 )
+    {
+        /* Too many segments found, every pattern is a candidate then */
+        for( loop = 0; loop != w->PatternCount; ++loop )
+        {
+            if( Visitor(loop, Arg) != 0 )
+            {
+                return;
+            }
+        }
+
+        return;
+    }
+
+    for( loop = 0; loop != SeenCount; ++loop )
+    {
+        if( WildcardSet_VisitNode(w, NodeArray + Seen[loop], Visitor, Arg) != 0 )
+        {
+            return;
+        }
+    }
+
+    /* Tails, from the end of `Str' */
+    Node = NodeArray + WILDCARD_SET_ROOT_TAIL;
+    for( loop = Length - 1; loop >= 0; --loop )
+    {
+        Node = WildcardSet_FindChild(NodeArray, Node, WILDCARD_SET_LOWER(Str[loop]));
+        if( Node == NULL )
+        {
+            break;
+        }
+
+        if( WildcardSet_VisitNode(w, Node, Visitor, Arg) != 0 )
+        {
+            return;
+        }
+    }
+
+    /* Heads */
+    Node = NodeArray + WILDCARD_SET_ROOT_HEAD;
+    for( loop = 0; loop < Length; ++loop )
+    {
+        Node = WildcardSet_FindChild(NodeArray, Node, WILDCARD_SET_LOWER(Str[loop]));
+        if( Node == NULL )
+        {
+            break;
+        }
+
+        if( WildcardSet_VisitNode(w, Node, Visitor, Arg) != 0 )
+        {
+            return;
+        }
+    }
+
+    Others = (const int32_t *)Array_GetRawArray(&(w->Others));
+    for( loop = 0; loop != Array_GetUsed(&(w->Others)); ++loop )
+    {
+        if( Visitor(Others[loop], Arg) != 0 )
+        {
+            return;
+        }
+    }
+}
+
+void WildcardSet_Free(WildcardSet *w)
+{
+    Array_Free(&(w->Nodes));
+    Array_Free(&(w->Entries));
+    Array_Free(&(w->Others));
+    w->PatternCount = 0;
+}
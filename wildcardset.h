@@ -0,0 +1,74 @@
+#ifndef WILDCARDSET_H_INCLUDED
+#define WILDCARDSET_H_INCLUDED
+
+#include "array.h"
+
+/* A read-only index of wildcard patterns, telling which patterns a string
+ * may match.
+ *
+ * A pattern is anchored by the longest one of its literal tail (the part
+ * after the last wildcard character), its literal head and its literal
+ * segments in between. A string can only match patterns whose anchor it
+ * ends with, starts with or contains. Tails and heads are kept in two
+ * character tries, segments in an Aho-Corasick automaton, so only a few
+ * patterns are left to be verified by `WILDCARD_MATCH', however many
+ * patterns there are. Patterns without an anchor, like "*", are always
+ * candidates. Anchors stop at backslashes, whether they escape or not.
+ */
+
+typedef struct _WildcardSet_Node{
+    /* Children are contiguous and sorted by `Character' */
+    int32_t     FirstChild;
+    int32_t     ChildCount;
+
+    /* Patterns anchored here, in `Entries' */
+    int32_t     FirstEntry;
+    int32_t     EntryCount;
+
+    /* Segment automaton only. The node of the longest proper suffix, and the
+     * nearest node having patterns along `Fail' links (-1 if none).
+     */
+    int32_t     Fail;
+    int32_t     Output;
+
+    unsigned char   Character; /* Lowercased */
+} WildcardSet_Node;
+
+typedef struct _WildcardSet{
+    /* `WildcardSet_Node', the first three are the roots of reversed tails,
+     * heads and segments.
+     */
+    Array   Nodes;
+
+    /* Subscripts of patterns given at compiling time, ascending in a node */
+    Array   Entries;
+
+    /* Subscripts of patterns without anchors, ascending */
+    Array   Others;
+
+    int32_t PatternCount;
+} WildcardSet;
+
+/* Return non-zero to stop visiting */
+typedef int (*WildcardSet_Visitor)(int32_t Subscript, void *Arg);
+
+int WildcardSet_Init(WildcardSet *w);
+
+#define WildcardSet_IsCompiled(w_ptr)   (Array_GetUsed(&((w_ptr)->Nodes)) > 0)
+
+/* Any previous content is dropped. */
+int WildcardSet_Compile(WildcardSet *w, const char **Patterns, int Count);
+
+/* Visit subscripts of all patterns which may match `Str'. A subscript is
+ * visited once, but not in a global order. If `Str' contains too many
+ * segments, every pattern is visited.
+ */
+void WildcardSet_Candidates(const WildcardSet   *w,
+                            const char          *Str,
+                            WildcardSet_Visitor Visitor,
+                            void                *Arg
+                            );
+
+void WildcardSet_Free(WildcardSet *w);
+
+#endif /* WILDCARDSET_H_INCLUDED */